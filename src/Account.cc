@@ -9,6 +9,7 @@
 #include <phosg/Time.hh>
 
 #include "Account.hh"
+#include "SaveStore.hh"
 
 std::shared_ptr<DCNTELicense> DCNTELicense::from_json(const phosg::JSON& json) {
   auto ret = std::make_shared<DCNTELicense>();
@@ -399,12 +400,12 @@ void Account::save() const {
     std::string json_data = json.serialize(
         phosg::JSON::SerializeOption::FORMAT | phosg::JSON::SerializeOption::HEX_INTEGERS);
     std::string filename = std::format("system/licenses/{:010}.json", this->account_id);
-    phosg::save_file(filename, json_data);
+    save_store->put(filename, std::move(json_data));
   }
 }
 
 void Account::delete_file() const {
-  std::filesystem::remove(std::format("system/licenses/{:010}.json", this->account_id));
+  save_store->remove(std::format("system/licenses/{:010}.json", this->account_id));
 }
 
 std::string Login::str() const {
@@ -1019,19 +1020,14 @@ std::shared_ptr<Account> AccountIndex::create_temporary_account_for_shared_accou
 
 AccountIndex::AccountIndex(bool force_all_temporary) : force_all_temporary(force_all_temporary) {
   if (!this->force_all_temporary) {
-    if (!std::filesystem::is_directory("system/licenses")) {
-      std::filesystem::create_directories("system/licenses");
-    } else {
-      for (const auto& item : std::filesystem::directory_iterator("system/licenses")) {
-        std::string filename = item.path().filename().string();
-        if (filename.ends_with(".json")) {
-          try {
-            phosg::JSON json = phosg::JSON::parse(phosg::load_file("system/licenses/" + filename));
-            this->add(std::make_shared<Account>(json));
-          } catch (const std::exception& e) {
-            phosg::log_error_f("Failed to index account {}", filename);
-            throw;
-          }
+    for (const auto& filename : save_store->list("system/licenses")) {
+      if (filename.ends_with(".json")) {
+        try {
+          phosg::JSON json = phosg::JSON::parse(save_store->get("system/licenses/" + filename));
+          this->add(std::make_shared<Account>(json));
+        } catch (const std::exception& e) {
+          phosg::log_error_f("Failed to index account {}", filename);
+          throw;
         }
       }
     }
@@ -8,6 +8,7 @@
 #include <phosg/Time.hh>
 
 #include "CommandCensorData.hh"
+#include "CommandMetrics.hh"
 #include "Loggers.hh"
 #include "StaticGameData.hh"
 #include "Version.hh"
@@ -36,18 +37,73 @@ void Channel::send(uint16_t cmd, uint32_t flag, bool silent) {
 }
 
 void Channel::send(
-    uint16_t cmd, uint32_t flag, const std::vector<std::pair<const void*, size_t>> blocks, bool silent) {
+    uint16_t cmd, uint32_t flag, const std::vector<std::pair<const void*, size_t>>& blocks, bool silent) {
+  this->send_blocks(cmd, flag, blocks.data(), blocks.size(), silent);
+}
+
+uint8_t Channel::framing_type() const {
+  bool encrypted = (this->crypt_out.get() != nullptr);
+  switch (this->version) {
+    case Version::DC_NTE:
+    case Version::DC_11_2000:
+    case Version::DC_V1:
+    case Version::DC_V2:
+    case Version::GC_NTE:
+    case Version::GC_V3:
+    case Version::GC_EP3_NTE:
+    case Version::GC_EP3:
+    case Version::XB_V3:
+      return (encrypted && !is_v1(this->version)) ? 1 : 0;
+    case Version::PC_PATCH:
+    case Version::BB_PATCH:
+    case Version::PC_NTE:
+    case Version::PC_V2:
+      return encrypted ? 3 : 2;
+    case Version::BB_V4:
+      return encrypted ? 5 : 4;
+    default:
+      throw std::logic_error("unimplemented game version in framing_type");
+  }
+}
+
+void Channel::send_blocks(
+    uint16_t cmd, uint32_t flag, const std::pair<const void*, size_t>* blocks, size_t num_blocks, bool silent) {
+  if (!this->connected()) {
+    channel_exceptions_log.warning_f("Attempted to send command on closed channel; dropping data");
+    return;
+  }
+
+  std::string send_data = this->get_send_buffer();
+  this->frame_command(send_data, cmd, flag, blocks, num_blocks);
+  this->send_framed_buffer(std::move(send_data), cmd, flag, silent);
+}
+
+void Channel::send_framed(const std::string& framed, bool silent) {
   if (!this->connected()) {
     channel_exceptions_log.warning_f("Attempted to send command on closed channel; dropping data");
     return;
   }
 
+  const auto* header = reinterpret_cast<const PSOCommandHeader*>(framed.data());
+  uint16_t cmd = header->command(this->version);
+  uint32_t flag = header->flag(this->version);
+  std::string send_data = this->get_send_buffer();
+  send_data.assign(framed);
+  this->send_framed_buffer(std::move(send_data), cmd, flag, silent);
+}
+
+void Channel::frame_command(
+    std::string& send_data,
+    uint16_t cmd,
+    uint32_t flag,
+    const std::pair<const void*, size_t>* blocks,
+    size_t num_blocks) const {
+  size_t start_offset = send_data.size();
   size_t size = 0;
-  for (const auto& b : blocks) {
-    size += b.second;
+  for (size_t z = 0; z < num_blocks; z++) {
+    size += blocks[z].second;
   }
 
-  std::string send_data;
   size_t logical_size;
   size_t send_data_size = 0;
   switch (this->version) {
@@ -119,12 +175,14 @@ void Channel::send(
     throw std::runtime_error("outbound command too large");
   }
 
-  send_data.reserve(send_data_size);
-  for (const auto& b : blocks) {
-    send_data.append(reinterpret_cast<const char*>(b.first), b.second);
+  send_data.reserve(start_offset + send_data_size);
+  for (size_t z = 0; z < num_blocks; z++) {
+    send_data.append(reinterpret_cast<const char*>(blocks[z].first), blocks[z].second);
   }
-  send_data.resize(send_data_size, '\0');
+  send_data.resize(start_offset + send_data_size, '\0');
+}
 
+void Channel::send_framed_buffer(std::string&& send_data, uint16_t cmd, uint32_t flag, bool silent) {
   if (!silent && (command_data_log.should_log(phosg::LogLevel::L_INFO)) && (this->terminal_send_color != phosg::TerminalFormat::END)) {
     if (use_terminal_colors && this->terminal_send_color != phosg::TerminalFormat::NORMAL) {
       print_color_escape(stderr, phosg::TerminalFormat::FG_YELLOW, phosg::TerminalFormat::BOLD, phosg::TerminalFormat::END);
@@ -154,6 +212,22 @@ void Channel::send(
     }
   }
 
+  if (this->capture) {
+    size_t header_size = is_v4(this->version) ? 8 : 4;
+    if (this->censor_sent_credentials) {
+      auto [censor_data, censor_size] = censor_data_for_client_command(this->version, cmd);
+      this->capture->add_command(this->capture_client_id, ReplayCaptureEvent::Type::RECEIVE, send_data.data(),
+          header_size, send_data.data() + header_size, send_data.size() - header_size, censor_data, censor_size);
+    } else {
+      this->capture->add_command(this->capture_client_id, ReplayCaptureEvent::Type::RECEIVE, send_data.data(),
+          header_size, send_data.data() + header_size, send_data.size() - header_size);
+    }
+  }
+
+  if (this->record_metrics) {
+    command_metrics.record_sent(CommandMetrics::Kind::COMMAND, this->version, cmd & 0xFF, send_data.size());
+  }
+
   if (this->crypt_out.get()) {
     this->crypt_out->encrypt(send_data.data(), send_data.size());
   }
@@ -161,8 +235,25 @@ void Channel::send(
   this->send_raw(std::move(send_data));
 }
 
+std::string Channel::get_send_buffer() {
+  if (this->send_buffer_pool.empty()) {
+    return std::string();
+  }
+  std::string ret = std::move(this->send_buffer_pool.back());
+  this->send_buffer_pool.pop_back();
+  ret.clear();
+  return ret;
+}
+
+void Channel::return_send_buffer(std::string&& buf) {
+  if (this->send_buffer_pool.size() < MAX_POOLED_SEND_BUFFERS) {
+    this->send_buffer_pool.emplace_back(std::move(buf));
+  }
+}
+
 void Channel::send(uint16_t cmd, uint32_t flag, const void* data, size_t size, bool silent) {
-  this->send(cmd, flag, {std::make_pair(data, size)}, silent);
+  auto block = std::make_pair(data, size);
+  this->send_blocks(cmd, flag, &block, 1, silent);
 }
 
 void Channel::send(uint16_t cmd, uint32_t flag, const std::string& data, bool silent) {
@@ -185,6 +276,31 @@ void Channel::send(const std::string& data, bool silent) {
 }
 
 asio::awaitable<Channel::Message> Channel::recv() {
+  Message msg{};
+  co_await this->recv_into(msg);
+  co_return msg;
+}
+
+asio::awaitable<std::unique_ptr<Channel::Message>> Channel::recv_pooled() {
+  std::unique_ptr<Message> msg;
+  if (this->message_pool.empty()) {
+    msg = std::make_unique<Message>();
+  } else {
+    msg = std::move(this->message_pool.back());
+    this->message_pool.pop_back();
+  }
+  co_await this->recv_into(*msg);
+  co_return msg;
+}
+
+void Channel::return_message(std::unique_ptr<Message>&& msg) {
+  if (msg && (this->message_pool.size() < MAX_POOLED_MESSAGES) &&
+      (msg->data.capacity() <= MAX_POOLED_MESSAGE_CAPACITY)) {
+    this->message_pool.emplace_back(std::move(msg));
+  }
+}
+
+asio::awaitable<void> Channel::recv_into(Message& msg) {
   size_t header_size = (this->version == Version::BB_V4) ? 8 : 4;
   PSOCommandHeader header;
   co_await this->recv_raw(&header, header_size);
@@ -203,7 +319,10 @@ asio::awaitable<Channel::Message> Channel::recv() {
       ? ((command_logical_size + 7) & ~7)
       : command_logical_size;
 
-  std::string command_data(command_physical_size - header_size, '\0');
+  // The whole buffer is overwritten by recv_raw, so any data left in it from a previous (pooled) message doesn't
+  // matter here
+  std::string& command_data = msg.data;
+  command_data.resize(command_physical_size - header_size);
   co_await this->recv_raw(command_data.data(), command_data.size());
 
   if (this->crypt_in.get()) {
@@ -258,11 +377,27 @@ asio::awaitable<Channel::Message> Channel::recv() {
     }
   }
 
-  co_return Message{
-      .command = command,
-      .flag = header.flag(this->version),
-      .data = std::move(command_data),
-  };
+  if (this->capture) {
+    if (this->censor_received_credentials) {
+      auto [censor_data, censor_size] = censor_data_for_client_command(this->version, command);
+      this->capture->add_command(this->capture_client_id, ReplayCaptureEvent::Type::SEND, &header, header_size,
+          command_data.data(), command_data.size(), censor_data, censor_size);
+    } else {
+      this->capture->add_command(this->capture_client_id, ReplayCaptureEvent::Type::SEND, &header, header_size,
+          command_data.data(), command_data.size());
+    }
+  }
+
+  msg.command = command;
+  msg.flag = header.flag(this->version);
+}
+
+size_t Channel::send_buffer_bytes() const {
+  return 0;
+}
+
+asio::awaitable<void> Channel::wait_for_send_buffer(size_t) {
+  co_return;
 }
 
 std::shared_ptr<SocketChannel> SocketChannel::create(
@@ -303,7 +438,9 @@ SocketChannel::SocketChannel(
       sock(std::move(sock)),
       local_addr(this->sock->local_endpoint()),
       remote_addr(this->sock->remote_endpoint()),
-      send_buffer_nonempty_signal(io_context->get_executor()) {}
+      recv_buffer(RECV_BUFFER_SIZE, '\0'),
+      send_buffer_nonempty_signal(io_context->get_executor()),
+      send_buffer_written_signal(io_context->get_executor()) {}
 
 std::string SocketChannel::default_name() const {
   return "ip:" + str_for_endpoint(this->remote_addr);
@@ -316,20 +453,55 @@ bool SocketChannel::connected() const {
 void SocketChannel::disconnect() {
   this->should_disconnect = true;
   this->send_buffer_nonempty_signal.set();
+  this->send_buffer_written_signal.set();
 }
 
 void SocketChannel::send_raw(std::string&& data) {
   if (this->sock && !this->should_disconnect) {
+    this->unwritten_bytes += data.size();
     this->outbound_data.emplace_back(std::move(data));
     this->send_buffer_nonempty_signal.set();
   }
 }
 
+size_t SocketChannel::send_buffer_bytes() const {
+  return this->unwritten_bytes;
+}
+
+asio::awaitable<void> SocketChannel::wait_for_send_buffer(size_t max_bytes) {
+  // Ensure *this doesn't get deleted while waiting
+  auto this_sh = this->shared_from_this();
+  while (this->connected() && (this->unwritten_bytes > max_bytes)) {
+    this->send_buffer_written_signal.clear();
+    co_await this->send_buffer_written_signal.wait();
+  }
+}
+
 asio::awaitable<void> SocketChannel::recv_raw(void* data, size_t size) {
   if (!this->sock || this->should_disconnect) {
     throw std::runtime_error("Cannot receive on closed channel");
   }
-  co_await asio::async_read(*this->sock, asio::buffer(data, size), asio::use_awaitable);
+
+  uint8_t* out = reinterpret_cast<uint8_t*>(data);
+  while (size > 0) {
+    if (this->recv_buffer_offset >= this->recv_buffer_bytes) {
+      // If the request is at least as large as the buffer, there's no benefit to copying through the buffer
+      if (size >= RECV_BUFFER_SIZE) {
+        co_await asio::async_read(*this->sock, asio::buffer(out, size), asio::use_awaitable);
+        co_return;
+      }
+      this->recv_buffer_offset = 0;
+      this->recv_buffer_bytes = 0;
+      this->recv_buffer_bytes = co_await this->sock->async_read_some(
+          asio::buffer(this->recv_buffer.data(), this->recv_buffer.size()), asio::use_awaitable);
+    }
+
+    size_t bytes_to_copy = std::min<size_t>(size, this->recv_buffer_bytes - this->recv_buffer_offset);
+    memcpy(out, this->recv_buffer.data() + this->recv_buffer_offset, bytes_to_copy);
+    this->recv_buffer_offset += bytes_to_copy;
+    out += bytes_to_copy;
+    size -= bytes_to_copy;
+  }
 }
 
 asio::awaitable<void> SocketChannel::send_task() {
@@ -337,16 +509,20 @@ asio::awaitable<void> SocketChannel::send_task() {
   auto this_sh = this->shared_from_this();
 
   while (this->sock->is_open()) {
-    std::deque<std::string> to_send;
-    to_send.swap(this->outbound_data);
-
-    if (!to_send.empty()) {
-      std::vector<asio::const_buffer> bufs;
-      bufs.reserve(to_send.size());
-      for (const auto& it : to_send) {
-        bufs.emplace_back(asio::buffer(it.data(), it.size()));
+    if (!this->outbound_data.empty()) {
+      // Write everything queued so far in a single gathered write, then put the buffers back in the pool
+      this->sending_data.swap(this->outbound_data);
+      this->sending_bufs.clear();
+      for (const auto& it : this->sending_data) {
+        this->sending_bufs.emplace_back(asio::buffer(it.data(), it.size()));
+      }
+      co_await asio::async_write(*this->sock, this->sending_bufs, asio::use_awaitable);
+      for (auto& it : this->sending_data) {
+        this->unwritten_bytes -= it.size();
+        this->return_send_buffer(std::move(it));
       }
-      co_await asio::async_write(*this->sock, bufs, asio::use_awaitable);
+      this->sending_data.clear();
+      this->send_buffer_written_signal.set();
     }
 
     if (this->outbound_data.empty()) {
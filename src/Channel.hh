@@ -7,6 +7,7 @@
 #include "AsyncUtils.hh"
 #include "PSOEncryption.hh"
 #include "PSOProtocol.hh"
+#include "ReplayCapture.hh"
 #include "Version.hh"
 
 class Channel {
@@ -22,6 +23,12 @@ public:
   bool censor_received_credentials;
   bool censor_sent_credentials;
 
+  // If set, all commands sent and received on this channel are recorded (unencrypted) in this capture
+  std::shared_ptr<ReplayCaptureWriter> capture;
+  uint64_t capture_client_id = 0;
+  // If true, all commands sent on this channel are counted in command_metrics (see CommandMetrics.hh)
+  bool record_metrics = false;
+
   struct Message {
     uint16_t command;
     uint32_t flag;
@@ -69,7 +76,7 @@ public:
   // Sends a message with an automatically-constructed header.
   void send(uint16_t cmd, uint32_t flag = 0, bool silent = false);
   void send(uint16_t cmd, uint32_t flag, const void* data, size_t size, bool silent = false);
-  void send(uint16_t cmd, uint32_t flag, const std::vector<std::pair<const void*, size_t>> blocks, bool silent = false);
+  void send(uint16_t cmd, uint32_t flag, const std::vector<std::pair<const void*, size_t>>& blocks, bool silent = false);
   void send(uint16_t cmd, uint32_t flag, const std::string& data, bool silent = false);
   template <typename CmdT>
     requires(!std::is_pointer_v<CmdT>)
@@ -81,8 +88,35 @@ public:
   void send(const void* data, size_t size, bool silent = false);
   void send(const std::string& data, bool silent = false);
 
+  // Returns an identifier for the way this channel lays out outgoing commands (header format and padding). Channels
+  // with the same framing type produce identical plaintext for the same command, so a command framed for one of them
+  // can be sent via send_framed on any of the others.
+  uint8_t framing_type() const;
+  static constexpr size_t NUM_FRAMING_TYPES = 6;
+  // Appends the complete unencrypted command (header, data, and padding) to send_data.
+  void frame_command(
+      std::string& send_data,
+      uint16_t cmd,
+      uint32_t flag,
+      const std::pair<const void*, size_t>* blocks,
+      size_t num_blocks) const;
+  // Sends a command that was already framed by frame_command on a channel with the same framing type. Only the
+  // encryption is done per channel.
+  void send_framed(const std::string& framed, bool silent = false);
+
   // Receives a message. Throws std::out_of_range if no messages are available.
   asio::awaitable<Message> recv();
+  // Like recv, but reuses a message previously passed to return_message (if there is one), so in the steady state,
+  // receiving a command doesn't allocate any memory (the pooled messages keep their data buffers' capacity). Messages
+  // that aren't returned are simply freed as usual.
+  asio::awaitable<std::unique_ptr<Message>> recv_pooled();
+  void return_message(std::unique_ptr<Message>&& msg);
+
+  // Returns the number of bytes that have been sent but not yet written to the underlying transport.
+  virtual size_t send_buffer_bytes() const;
+  // Waits until at most max_bytes of sent data remain unwritten, or until the channel is disconnected. This is used to
+  // send large amounts of data (e.g. patch files) without queueing all of it in memory at once.
+  virtual asio::awaitable<void> wait_for_send_buffer(size_t max_bytes);
 
 protected:
   Channel(
@@ -102,6 +136,26 @@ protected:
   virtual void send_raw(std::string&& data) = 0;
   // Receives raw data on the underlying transport. Raises when the channel is disconnected.
   virtual asio::awaitable<void> recv_raw(void* data, size_t size) = 0;
+
+  void send_blocks(
+      uint16_t cmd, uint32_t flag, const std::pair<const void*, size_t>* blocks, size_t num_blocks, bool silent);
+  void send_framed_buffer(std::string&& send_data, uint16_t cmd, uint32_t flag, bool silent);
+
+  // Outbound command buffers are recycled once the transport is done with them, so in the steady state, sending a
+  // command doesn't allocate any memory (the returned buffers keep their capacity). Transports that don't return
+  // buffers to the pool still work; their sends just allocate as usual.
+  static constexpr size_t MAX_POOLED_SEND_BUFFERS = 0x40;
+  std::vector<std::string> send_buffer_pool;
+  std::string get_send_buffer();
+  void return_send_buffer(std::string&& buf);
+
+  // Messages returned by the receiver for recv_pooled to reuse. Messages with data buffers larger than
+  // MAX_POOLED_MESSAGE_CAPACITY aren't pooled, so an occasional large command (e.g. a BB character file) doesn't keep a
+  // large buffer allocated for the rest of the session.
+  static constexpr size_t MAX_POOLED_MESSAGES = 0x10;
+  static constexpr size_t MAX_POOLED_MESSAGE_CAPACITY = 0x1000;
+  std::vector<std::unique_ptr<Message>> message_pool;
+  asio::awaitable<void> recv_into(Message& msg);
 };
 
 // Standard channel type, used for most PSO clients. Represents an open TCP socket.
@@ -132,6 +186,9 @@ public:
   virtual void send_raw(std::string&& data);
   virtual asio::awaitable<void> recv_raw(void* data, size_t size);
 
+  virtual size_t send_buffer_bytes() const;
+  virtual asio::awaitable<void> wait_for_send_buffer(size_t max_bytes);
+
 private:
   SocketChannel(
       std::shared_ptr<asio::io_context> io_context,
@@ -144,9 +201,23 @@ private:
       bool censor_received_credentials,
       bool censor_sent_credentials);
 
-  std::deque<std::string> outbound_data;
+  // Data received from the socket but not yet consumed by recv_raw. recv_raw reads as much as is available (up to the
+  // buffer size) each time the buffer runs out, so a burst of commands from the client costs one read instead of two
+  // per command (one for the header and one for the body).
+  static constexpr size_t RECV_BUFFER_SIZE = 0x8000;
+  std::string recv_buffer;
+  size_t recv_buffer_offset = 0;
+  size_t recv_buffer_bytes = 0;
+
+  // Commands queued by send_raw but not yet written. send_task swaps this with sending_data, so neither vector needs
+  // to be reallocated once it has grown to the channel's typical batch size.
+  std::vector<std::string> outbound_data;
+  std::vector<std::string> sending_data;
+  std::vector<asio::const_buffer> sending_bufs;
+  size_t unwritten_bytes = 0; // Total size of outbound_data and sending_data
   bool should_disconnect = false;
   AsyncEvent send_buffer_nonempty_signal;
+  AsyncEvent send_buffer_written_signal;
 
   asio::awaitable<void> send_task();
 };
@@ -18,6 +18,7 @@
 #include "ProxySession.hh"
 #include "ReceiveCommands.hh"
 #include "Revision.hh"
+#include "SaveStore.hh"
 #include "SendCommands.hh"
 #include "Server.hh"
 #include "StaticGameData.hh"
@@ -359,6 +360,9 @@ ChatCommandDefinition cc_ban(
 
       std::string identifier = a.text.substr(space_pos + 1);
       auto target = s->find_client(&identifier);
+      if (!target) {
+        throw precondition_failed("$C6Player not found");
+      }
       if (!target->login) {
         // This should be impossible, but I'll bet it's not actually
         throw precondition_failed("$C6Client not logged in");
@@ -579,7 +583,7 @@ ChatCommandDefinition cc_cheat(
         if (!l->check_flag(Lobby::Flag::CHEATS_ENABLED) &&
             !a.c->login->account->check_flag(Account::Flag::CHEAT_ANYWHERE) &&
             s->data->cheat_flags.insufficient_minimum_level) {
-          size_t default_min_level = s->data->default_min_level_for_game(a.c->version(), l->episode, l->difficulty);
+          size_t default_min_level = l->require_data()->default_min_level_for_game(a.c->version(), l->episode, l->difficulty);
           if (l->min_level < default_min_level) {
             l->min_level = default_min_level;
             send_text_message_fmt(l, "$C6Minimum level set\nto {}", l->min_level + 1);
@@ -605,7 +609,7 @@ ChatCommandDefinition cc_checkchar(
         flags.emplace_back(false);
         for (size_t z = 0; z < s->data->num_backup_character_slots; z++) {
           std::string filename = a.c->backup_character_filename(a.c->login->account->account_id, z, is_ep3);
-          flags.emplace_back(std::filesystem::is_regular_file(filename));
+          flags.emplace_back(save_store->exists(filename));
         }
         std::string used_str = str_for_flag_ranges(flags);
         flags.flip();
@@ -622,7 +626,7 @@ ChatCommandDefinition cc_checkchar(
         try {
           if (is_ep3(a.c->version())) {
             std::string filename = a.c->backup_character_filename(a.c->login->account->account_id, index, true);
-            auto ch = phosg::load_object_file<PSOGCEp3CharacterFile::Character>(filename);
+            auto ch = save_store->get_object<PSOGCEp3CharacterFile::Character>(filename);
             send_text_message_fmt(a.c, "Slot {}: $C6{}$C7\n{} {}\nCLv: on {}.{}, off {}.{}",
                 index + 1, ch.disp.visual.name.decode(),
                 name_for_section_id(ch.disp.visual.sh.section_id), name_for_char_class(ch.disp.visual.sh.char_class),
@@ -630,7 +634,7 @@ ChatCommandDefinition cc_checkchar(
                 (ch.ep3_config.offline_clv_exp / 100) + 1, ch.ep3_config.offline_clv_exp % 100);
           } else {
             std::string filename = a.c->backup_character_filename(a.c->login->account->account_id, index, false);
-            auto ch = PSOCHARFile::load_shared(filename, false).character_file;
+            auto ch = PSOCHARFile::parse_shared(save_store->get(filename), false).character_file;
             send_text_message_fmt(a.c, "Slot {}: $C6{}$C7\n{} {}\nLevel {}",
                 index + 1, ch->disp.visual.name.decode(),
                 name_for_section_id(ch->disp.visual.sh.section_id), name_for_char_class(ch->disp.visual.sh.char_class),
@@ -667,8 +671,8 @@ ChatCommandDefinition cc_deletechar(
       }
 
       std::string filename = a.c->backup_character_filename(a.c->login->account->account_id, index, is_ep3(a.c->version()));
-      if (std::filesystem::is_regular_file(filename)) {
-        std::filesystem::remove(filename);
+      if (save_store->exists(filename)) {
+        save_store->remove(filename);
         send_text_message_fmt(a.c, "Character in slot\n{} deleted", index + 1);
       } else {
         send_text_message_fmt(a.c, "No character exists\nin slot {}", index + 1);
@@ -977,6 +981,7 @@ ChatCommandDefinition cc_edit(
         } else if (tokens.at(0) == "name") {
           std::vector<std::string> orig_tokens = phosg::split(a.text, ' ', 1);
           p->disp.visual.name.encode(orig_tokens.at(1), p->inventory.language);
+          s->update_lobby_client_index(a.c);
         } else if (tokens.at(0) == "npc") {
           if (tokens.at(1) == "none") {
             p->disp.visual.sh.extra_model = 0;
@@ -1215,6 +1220,8 @@ ChatCommandDefinition cc_item(
       a.check_is_game(true);
       auto s = a.c->require_server_state();
       a.check_cheats_enabled_or_allowed(s->data->cheat_flags.create_items);
+      auto l = a.c->lobby.lock();
+      auto data = l ? l->require_data() : s->data;
 
       ItemData item;
       bool was_enqueued = false;
@@ -1225,12 +1232,12 @@ ChatCommandDefinition cc_item(
         a.check_is_leader();
 
         if (a.text.starts_with("!")) {
-          item = s->data->parse_item_description(a.c->version(), a.text.substr(1));
+          item = data->parse_item_description(a.c->version(), a.text.substr(1));
           a.c->proxy_session->next_drop_item = item;
           was_enqueued = true;
 
         } else {
-          item = s->data->parse_item_description(a.c->version(), a.text);
+          item = data->parse_item_description(a.c->version(), a.text);
           item.id = phosg::random_object<uint32_t>() | 0x80000000;
 
           send_drop_stacked_item_to_channel(s, a.c->channel, item, a.c->floor, a.c->pos);
@@ -1238,8 +1245,10 @@ ChatCommandDefinition cc_item(
         }
 
       } else {
-        auto l = a.c->require_lobby();
-        item = s->data->parse_item_description(a.c->version(), a.text);
+        if (!l) {
+          throw std::runtime_error("client not in any lobby");
+        }
+        item = data->parse_item_description(a.c->version(), a.text);
         item.id = l->generate_item_id(0xFF);
 
         if ((l->drop_mode == ServerDropMode::SERVER_PRIVATE) || (l->drop_mode == ServerDropMode::SERVER_DUPLICATE)) {
@@ -1251,7 +1260,7 @@ ChatCommandDefinition cc_item(
         }
       }
 
-      std::string name = s->data->describe_item(a.c->version(), item, ItemNameIndex::Flag::INCLUDE_PSO_COLOR_ESCAPES);
+      std::string name = data->describe_item(a.c->version(), item, ItemNameIndex::Flag::INCLUDE_PSO_COLOR_ESCAPES);
       if (was_enqueued) {
         send_text_message(a.c, "$C7Next item:\n" + name);
       } else {
@@ -1289,6 +1298,9 @@ ChatCommandDefinition cc_kick(
 
       auto s = a.c->require_server_state();
       auto target = s->find_client(&a.text);
+      if (!target) {
+        throw precondition_failed("$C6Player not found");
+      }
       if (!target->login) {
         // This should be impossible, but I'll bet it's not actually
         throw precondition_failed("$C6Client not logged in");
@@ -1540,6 +1552,8 @@ ChatCommandDefinition cc_loadchar(
       } else {
         a.c->load_backup_character(a.c->login->account->account_id, index);
       }
+      // The loaded character may have a different name
+      s->update_lobby_client_index(a.c);
 
       if (a.c->version() == Version::BB_V4) {
         // On BB, it suffices to simply send the character file again
@@ -1761,7 +1775,7 @@ ChatCommandDefinition cc_minlevel(
       bool cheats_allowed = (l->check_flag(Lobby::Flag::CHEATS_ENABLED) ||
           a.c->login->account->check_flag(Account::Flag::CHEAT_ANYWHERE));
       if (!cheats_allowed && s->data->cheat_flags.insufficient_minimum_level) {
-        size_t default_min_level = s->data->default_min_level_for_game(a.c->version(), l->episode, l->difficulty);
+        size_t default_min_level = l->require_data()->default_min_level_for_game(a.c->version(), l->episode, l->difficulty);
         if (new_min_level < default_min_level) {
           throw precondition_failed("$C6Cannot set minimum\nlevel below {}", default_min_level + 1);
         }
@@ -2188,13 +2202,12 @@ ChatCommandDefinition cc_quest(
       a.check_is_proxy(false);
       a.check_is_game(true);
 
-      auto s = a.c->require_server_state();
-      auto q = s->data->quest_index->get(stoul(a.text));
+      auto l = a.c->require_lobby();
+      auto q = l->require_data()->quest_index->get(stoul(a.text));
       if (!q) {
         throw precondition_failed("$C6Quest not found");
       }
 
-      auto l = a.c->require_lobby();
       if (a.check_permissions && !a.c->check_flag(Client::Flag::DEBUG_ENABLED)) {
         if (l->count_clients() > 1) {
           throw precondition_failed("$C6This command can only\nbe used with no\nother players present");
@@ -2504,6 +2517,9 @@ ChatCommandDefinition cc_silence(
 
       auto s = a.c->require_server_state();
       auto target = s->find_client(&a.text);
+      if (!target) {
+        throw precondition_failed("$C6Player not found");
+      }
       if (!target->login) {
         // This should be impossible, but I'll bet it's not actually
         throw precondition_failed("$C6Client not logged in");
@@ -2819,7 +2835,7 @@ ChatCommandDefinition cc_switchchar(
         throw precondition_failed("Invalid slot number");
       }
       auto filename = Client::character_filename(a.c->login->bb_license->username, index);
-      if (!std::filesystem::is_regular_file(filename)) {
+      if (!save_store->exists(filename)) {
         throw precondition_failed("No character exists\nin that slot");
       }
 
@@ -2966,10 +2982,9 @@ ChatCommandDefinition cc_what(
       if (!nearest_fi) {
         throw precondition_failed("$C4No items are near you");
       } else {
-        auto s = a.c->require_server_state();
         send_text_message(
             a.c,
-            s->data->describe_item(a.c->version(), nearest_fi->data, ItemNameIndex::Flag::INCLUDE_PSO_COLOR_ESCAPES));
+            l->require_data()->describe_item(a.c->version(), nearest_fi->data, ItemNameIndex::Flag::INCLUDE_PSO_COLOR_ESCAPES));
       }
       co_return;
     });
@@ -2985,7 +3000,6 @@ static void whatobj_whatene_fn(const Args& a, bool include_objs, bool include_en
   }
 
   uint8_t area, layout_var;
-  auto s = a.c->require_server_state();
   if (l->episode != Episode::EP3) {
     area = l->area_for_floor(a.c->version(), a.c->floor);
     layout_var = (a.c->floor < 0x10) ? l->variations.entries[a.c->floor].layout.load() : 0x00;
@@ -3003,7 +3017,7 @@ static void whatobj_whatene_fn(const Args& a, bool include_objs, bool include_en
     VectorXYZF worldspace_pos;
     if (l->episode != Episode::EP3) {
       try {
-        const auto& room = s->data->room_layout_index->get_room(area, layout_var, def.set_entry->room);
+        const auto& room = l->require_data()->room_layout_index->get_room(area, layout_var, def.set_entry->room);
         // This is the order in which the game does the rotations; not sure why
         worldspace_pos = def.set_entry->pos.rotate_x(room.angle.x).rotate_z(room.angle.z).rotate_y(room.angle.y) + room.position;
       } catch (const std::out_of_range&) {
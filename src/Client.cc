@@ -13,6 +13,7 @@
 #include "HTTPServer.hh"
 #include "IPStackSimulator.hh"
 #include "Loggers.hh"
+#include "SaveStore.hh"
 #include "SendCommands.hh"
 #include "Server.hh"
 #include "Version.hh"
@@ -495,7 +496,7 @@ void Client::save_system_file() const {
     throw std::logic_error("no system file loaded");
   }
   std::string filename = this->system_filename();
-  phosg::save_object_file(filename, *this->system_data);
+  save_store->put_object(filename, *this->system_data);
   this->log.info_f("Saved system file {}", filename);
 }
 
@@ -534,7 +535,7 @@ void Client::save_guild_card_file() const {
     throw std::logic_error("no Guild Card file loaded");
   }
   std::string filename = this->guild_card_filename();
-  phosg::save_object_file(filename, *this->guild_card_data);
+  save_store->put_object(filename, *this->guild_card_data);
   this->log.info_f("Saved Guild Card file {}", filename);
 }
 
@@ -595,13 +596,13 @@ void Client::save_character_file(
     const std::string& filename,
     std::shared_ptr<const PSOBBBaseSystemFile> system,
     std::shared_ptr<const PSOBBCharacterFile> character) {
-  PSOCHARFile::save(filename, system, character);
+  save_store->put(filename, PSOCHARFile::serialize(system, character));
 }
 
 void Client::save_ep3_character_file(
     const std::string& filename,
     const PSOGCEp3CharacterFile::Character& character) {
-  phosg::save_file(filename, &character, sizeof(character));
+  save_store->put_object(filename, character);
 }
 
 void Client::save_character_file() {
@@ -640,7 +641,7 @@ void Client::create_character_file(
   this->save_character_file();
   this->log.info_f("Deleting bank file");
   this->bank_data.reset();
-  std::filesystem::remove(this->bank_filename());
+  save_store->remove(this->bank_filename());
 }
 
 void Client::create_battle_overlay(std::shared_ptr<const BattleRules> rules, std::shared_ptr<const LevelTable> level_table) {
@@ -774,9 +775,9 @@ std::shared_ptr<PlayerBank> Client::bank_file(bool allow_load) {
     try {
       // If there's a psobank file, load it and ignore the character file bank
       auto filename = this->bank_filename();
-      auto f = phosg::fopen_unique(filename, "rb");
+      std::string data = save_store->get(filename);
       this->bank_data = std::make_shared<PlayerBank>();
-      this->bank_data->load(f.get());
+      this->bank_data->load(data);
       this->log.info_f("Loaded bank data from {}", filename);
     } catch (const phosg::cannot_open_file&) {
       // If there isn't a psobank file, use the loaded character data if the bank character index matches the current
@@ -791,7 +792,7 @@ std::shared_ptr<PlayerBank> Client::bank_file(bool allow_load) {
         }
         std::string filename = this->character_filename(
             this->login->bb_license->username, this->bb_bank_character_index);
-        auto character = PSOCHARFile::load_shared(filename, false).character_file;
+        auto character = PSOCHARFile::parse_shared(save_store->get(filename), false).character_file;
         this->bank_data = std::make_shared<PlayerBank>(character->bank);
         this->log.info_f("Using bank data from {}", filename);
       } else {
@@ -817,8 +818,7 @@ std::shared_ptr<const PlayerBank> Client::bank_file(bool throw_if_missing) const
 }
 
 void Client::save_bank_file(const std::string& filename, const PlayerBank& bank) {
-  auto f = phosg::fopen_unique(filename, "wb");
-  bank.save(f.get());
+  save_store->put(filename, bank.serialize());
 }
 
 void Client::save_bank_file() const {
@@ -892,8 +892,8 @@ void Client::load_all_files() {
 
   if (!this->system_data) {
     std::string sys_filename = this->system_filename();
-    if (std::filesystem::is_regular_file(sys_filename)) {
-      this->system_data = std::make_shared<PSOBBBaseSystemFile>(phosg::load_object_file<PSOBBBaseSystemFile>(sys_filename, true));
+    if (save_store->exists(sys_filename)) {
+      this->system_data = std::make_shared<PSOBBBaseSystemFile>(save_store->get_object<PSOBBBaseSystemFile>(sys_filename, true));
       this->log.info_f("Loaded system data from {}", sys_filename);
     } else {
       this->log.info_f("System file is missing: {}", sys_filename);
@@ -902,8 +902,8 @@ void Client::load_all_files() {
 
   if (!this->character_data && (this->bb_character_index >= 0)) {
     std::string char_filename = this->character_filename();
-    if (std::filesystem::is_regular_file(char_filename)) {
-      auto psochar = PSOCHARFile::load_shared(char_filename, !this->system_data);
+    if (save_store->exists(char_filename)) {
+      auto psochar = PSOCHARFile::parse_shared(save_store->get(char_filename), !this->system_data);
       this->character_data = psochar.character_file;
       this->log.info_f("Loaded character data from {}", char_filename);
 
@@ -926,8 +926,8 @@ void Client::load_all_files() {
 
   if (!this->guild_card_data) {
     std::string card_filename = this->guild_card_filename();
-    if (std::filesystem::is_regular_file(card_filename)) {
-      this->guild_card_data = std::make_shared<PSOBBGuildCardFile>(phosg::load_object_file<PSOBBGuildCardFile>(card_filename));
+    if (save_store->exists(card_filename)) {
+      this->guild_card_data = std::make_shared<PSOBBGuildCardFile>(save_store->get_object<PSOBBGuildCardFile>(card_filename));
       this->guild_card_data->delete_duplicates();
       this->log.info_f("Loaded Guild Card data from {}", card_filename);
     } else {
@@ -1087,14 +1087,14 @@ void Client::save_all() {
 
 void Client::load_backup_character(uint32_t account_id, size_t index) {
   std::string filename = this->backup_character_filename(account_id, index, false);
-  this->character_data = PSOCHARFile::load_shared(filename, false).character_file;
+  this->character_data = PSOCHARFile::parse_shared(save_store->get(filename), false).character_file;
   this->update_character_data_after_load(this->character_data);
   this->v1_v2_last_reported_disp.reset();
 }
 
 std::shared_ptr<PSOGCEp3CharacterFile::Character> Client::load_ep3_backup_character(uint32_t account_id, size_t index) {
   std::string filename = this->backup_character_filename(account_id, index, true);
-  auto ch = std::make_shared<PSOGCEp3CharacterFile::Character>(phosg::load_object_file<PSOGCEp3CharacterFile::Character>(filename));
+  auto ch = std::make_shared<PSOGCEp3CharacterFile::Character>(save_store->get_object<PSOGCEp3CharacterFile::Character>(filename));
   this->character_data = PSOBBCharacterFile::create_from_file(*ch);
   this->ep3_config = std::make_shared<Episode3::PlayerConfig>(ch->ep3_config);
   this->update_character_data_after_load(this->character_data);
@@ -132,7 +132,9 @@ public:
   std::shared_ptr<Login> login;
   std::shared_ptr<ProxySession> proxy_session;
 
-  // Patch server state (only used for PC_PATCH and BB_PATCH versions)
+  // Patch server state (only used for PC_PATCH and BB_PATCH versions). The index is kept here so it stays alive for
+  // the whole patch session, even if the server's patch files are reloaded in the meantime.
+  std::shared_ptr<const PatchFileIndex> patch_file_index;
   std::vector<PatchFileChecksumRequest> patch_file_checksum_requests;
 
   // Network
@@ -155,6 +157,10 @@ public:
   std::weak_ptr<Lobby> lobby;
   uint8_t lobby_client_id = 0;
   uint8_t lobby_arrow_color = 0;
+  // Keys under which this client is currently in ServerState's lobby client indexes (see update_lobby_client_index)
+  bool lobby_index_valid = false;
+  uint32_t lobby_index_account_id = 0;
+  std::string lobby_index_name;
   int64_t preferred_lobby_id = -1; // <0 = none chosen
 
   asio::steady_timer save_game_data_timer;
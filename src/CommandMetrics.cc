@@ -0,0 +1,234 @@
+#include "CommandMetrics.hh"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <phosg/Strings.hh>
+
+CommandMetrics command_metrics;
+
+size_t LatencyHistogram::bucket_for_value(uint64_t usecs) {
+  if (usecs < SUB_BUCKETS) {
+    return usecs;
+  }
+  if (usecs >= 0x100000000) {
+    return NUM_BUCKETS - 1;
+  }
+  size_t msb = 63 - std::countl_zero(usecs);
+  size_t sub = (usecs >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_limit(size_t bucket_index) {
+  if (bucket_index < SUB_BUCKETS) {
+    return bucket_index + 1;
+  }
+  size_t msb = bucket_index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  size_t sub = bucket_index % SUB_BUCKETS;
+  return static_cast<uint64_t>(SUB_BUCKETS + sub + 1) << (msb - SUB_BUCKET_BITS);
+}
+
+void LatencyHistogram::add(uint64_t usecs) {
+  // Each histogram has only one writer, so the max doesn't need a compare-exchange loop
+  this->buckets[bucket_for_value(usecs)].fetch_add(1, std::memory_order_relaxed);
+  this->total_usecs.fetch_add(usecs, std::memory_order_relaxed);
+  if (usecs > this->max_usecs.load(std::memory_order_relaxed)) {
+    this->max_usecs.store(usecs, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogramSnapshot::merge(const LatencyHistogram& h) {
+  for (size_t z = 0; z < LatencyHistogram::NUM_BUCKETS; z++) {
+    uint64_t count = h.buckets[z].load(std::memory_order_relaxed);
+    this->buckets[z] += count;
+    this->count += count;
+  }
+  this->total_usecs += h.total_usecs.load(std::memory_order_relaxed);
+  this->max_usecs = std::max<uint64_t>(this->max_usecs, h.max_usecs.load(std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogramSnapshot::quantile(double q) const {
+  if (this->count == 0) {
+    return 0;
+  }
+  uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(q * this->count + 0.5));
+  uint64_t seen = 0;
+  for (size_t z = 0; z < LatencyHistogram::NUM_BUCKETS; z++) {
+    seen += this->buckets[z];
+    if (seen >= target) {
+      // The max is exact, so don't report a bucket limit larger than it
+      return std::min<uint64_t>(LatencyHistogram::bucket_limit(z) - 1, this->max_usecs);
+    }
+  }
+  return this->max_usecs;
+}
+
+uint64_t LatencyHistogramSnapshot::count_below(uint64_t limit) const {
+  uint64_t ret = 0;
+  for (size_t z = 0; (z < LatencyHistogram::NUM_BUCKETS) && (LatencyHistogram::bucket_limit(z) <= limit); z++) {
+    ret += this->buckets[z];
+  }
+  return ret;
+}
+
+CommandMetrics::Timer::Timer(Kind kind, Version version, uint8_t command, size_t size)
+    : kind(kind),
+      version(version),
+      command(command),
+      size(size),
+      start_time(phosg::now()) {}
+
+CommandMetrics::Timer::~Timer() {
+  uint64_t usecs = phosg::now() - this->start_time;
+  command_metrics.record_received(this->kind, this->version, this->command, this->size, usecs);
+}
+
+CommandMetrics::Entry& CommandMetrics::entry_for(Kind kind, Version version, uint8_t command) {
+  // The cached shard is tagged with its owner, in case there is ever more than one CommandMetrics object
+  thread_local const CommandMetrics* tl_owner = nullptr;
+  thread_local Shard* tl_shard = nullptr;
+  if (tl_owner != this) {
+    std::lock_guard g(this->shards_lock);
+    tl_shard = this->shards.emplace_back(std::make_unique<Shard>()).get();
+    tl_owner = this;
+  }
+
+  auto& slot = tl_shard->entries[static_cast<size_t>(kind)][static_cast<size_t>(version) * 0x100 + command];
+  Entry* e = slot.load(std::memory_order_relaxed);
+  if (!e) {
+    e = tl_shard->owned_entries.emplace_back(std::make_unique<Entry>()).get();
+    slot.store(e, std::memory_order_release);
+  }
+  return *e;
+}
+
+void CommandMetrics::record_received(Kind kind, Version version, uint8_t command, size_t size, uint64_t usecs) {
+  auto& e = this->entry_for(kind, version, command);
+  e.latency.add(usecs);
+  e.received_count.fetch_add(1, std::memory_order_relaxed);
+  e.received_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void CommandMetrics::record_sent(Kind kind, Version version, uint8_t command, size_t size) {
+  auto& e = this->entry_for(kind, version, command);
+  e.sent_count.fetch_add(1, std::memory_order_relaxed);
+  e.sent_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+std::vector<CommandMetrics::EntrySnapshot> CommandMetrics::snapshot() const {
+  std::vector<EntrySnapshot> ret;
+  std::lock_guard g(this->shards_lock);
+  for (size_t kind_index = 0; kind_index < 2; kind_index++) {
+    for (size_t z = 0; z < ENTRIES_PER_KIND; z++) {
+      EntrySnapshot* snap = nullptr;
+      for (const auto& shard : this->shards) {
+        const Entry* e = shard->entries[kind_index][z].load(std::memory_order_acquire);
+        if (!e) {
+          continue;
+        }
+        if (!snap) {
+          snap = &ret.emplace_back(EntrySnapshot{
+              .kind = static_cast<Kind>(kind_index),
+              .version = static_cast<Version>(z >> 8),
+              .command = static_cast<uint8_t>(z & 0xFF),
+              .latency = {},
+          });
+        }
+        snap->latency.merge(e->latency);
+        snap->received_count += e->received_count.load(std::memory_order_relaxed);
+        snap->received_bytes += e->received_bytes.load(std::memory_order_relaxed);
+        snap->sent_count += e->sent_count.load(std::memory_order_relaxed);
+        snap->sent_bytes += e->sent_bytes.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  return ret;
+}
+
+static const char* name_for_kind(CommandMetrics::Kind kind) {
+  return (kind == CommandMetrics::Kind::SUBCOMMAND) ? "subcommand" : "command";
+}
+
+static std::string labels_for_entry(const CommandMetrics::EntrySnapshot& e) {
+  return std::format("kind=\"{}\",version=\"{}\",command=\"{:02X}\"",
+      name_for_kind(e.kind), phosg::name_for_enum(e.version), e.command);
+}
+
+std::string CommandMetrics::prometheus_text() const {
+  auto entries = this->snapshot();
+
+  std::string ret;
+  ret += "# HELP newserv_command_metrics_start_time_seconds Time when command metrics collection began\n";
+  ret += "# TYPE newserv_command_metrics_start_time_seconds gauge\n";
+  ret += std::format("newserv_command_metrics_start_time_seconds {}\n", this->start_time_usecs / 1000000);
+
+  auto add_counter = [&](const char* name, const char* help, uint64_t EntrySnapshot::* field) -> void {
+    ret += std::format("# HELP {} {}\n# TYPE {} counter\n", name, help, name);
+    for (const auto& e : entries) {
+      if (e.*field) {
+        ret += std::format("{}{{{}}} {}\n", name, labels_for_entry(e), e.*field);
+      }
+    }
+  };
+  add_counter("newserv_commands_received_total", "Commands received from clients", &EntrySnapshot::received_count);
+  add_counter("newserv_command_received_bytes_total", "Bytes received from clients, including headers",
+      &EntrySnapshot::received_bytes);
+  add_counter("newserv_commands_sent_total", "Commands sent to clients", &EntrySnapshot::sent_count);
+  add_counter("newserv_command_sent_bytes_total", "Bytes sent to clients, including headers",
+      &EntrySnapshot::sent_bytes);
+
+  // The exported buckets are a fixed subset of the internal buckets (powers of two from 1us to about 33s), so the
+  // label set is the same on every scrape
+  static constexpr const char* name = "newserv_command_handler_duration_seconds";
+  ret += std::format("# HELP {} Time spent in command handlers\n# TYPE {} histogram\n", name, name);
+  for (const auto& e : entries) {
+    if (e.latency.count == 0) {
+      continue;
+    }
+    std::string labels = labels_for_entry(e);
+    for (size_t shift = 0; shift <= 25; shift++) {
+      uint64_t limit = 1ULL << shift;
+      ret += std::format("{}_bucket{{{},le=\"{}\"}} {}\n",
+          name, labels, static_cast<double>(limit) / 1000000.0, e.latency.count_below(limit));
+    }
+    ret += std::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, e.latency.count);
+    ret += std::format("{}_sum{{{}}} {}\n", name, labels, static_cast<double>(e.latency.total_usecs) / 1000000.0);
+    ret += std::format("{}_count{{{}}} {}\n", name, labels, e.latency.count);
+  }
+  return ret;
+}
+
+std::vector<std::string> CommandMetrics::summary_lines(size_t max_entries) const {
+  auto entries = this->snapshot();
+  std::sort(entries.begin(), entries.end(), [](const EntrySnapshot& a, const EntrySnapshot& b) -> bool {
+    if (a.latency.total_usecs != b.latency.total_usecs) {
+      return a.latency.total_usecs > b.latency.total_usecs;
+    }
+    return a.sent_bytes > b.sent_bytes;
+  });
+
+  std::vector<std::string> ret;
+  ret.emplace_back(std::format("Collecting since {} ({} ago)",
+      phosg::format_time(this->start_time_usecs), phosg::format_duration(phosg::now() - this->start_time_usecs)));
+  ret.emplace_back("VERSION     COMMAND  RECEIVED  TOTAL TIME  MEAN  P50  P99  MAX  BYTES IN  SENT  BYTES OUT");
+  for (const auto& e : entries) {
+    if (ret.size() >= max_entries + 2) {
+      break;
+    }
+    uint64_t mean = e.latency.count ? (e.latency.total_usecs / e.latency.count) : 0;
+    ret.emplace_back(std::format("{:<11} {}{:02X}  {}  {}  {}  {}  {}  {}  {}  {}  {}",
+        phosg::name_for_enum(e.version),
+        (e.kind == Kind::SUBCOMMAND) ? "6x" : "  ",
+        e.command,
+        e.received_count,
+        phosg::format_duration(e.latency.total_usecs),
+        phosg::format_duration(mean),
+        phosg::format_duration(e.latency.quantile(0.5)),
+        phosg::format_duration(e.latency.quantile(0.99)),
+        phosg::format_duration(e.latency.max_usecs),
+        phosg::format_size(e.received_bytes),
+        e.sent_count,
+        phosg::format_size(e.sent_bytes)));
+  }
+  return ret;
+}
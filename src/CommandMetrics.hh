@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <phosg/Time.hh>
+#include <string>
+#include <vector>
+
+#include "Version.hh"
+
+// Latency histogram with logarithmic buckets, in the style of HdrHistogram. Values 0-3 each have their own bucket;
+// above that, each power of two is split into 4 buckets, so any quantile computed from the histogram is within 25% of
+// the true value. Values of 2^32 or more (over an hour, in microseconds) all go in the last bucket.
+//
+// All fields are atomic so that the histogram can be read from any thread, but the histogram is only written by the
+// thread that owns it (see CommandMetrics below), so relaxed ordering is used throughout.
+struct LatencyHistogram {
+  static constexpr size_t SUB_BUCKET_BITS = 2;
+  static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr size_t NUM_BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+  std::atomic<uint64_t> total_usecs = 0;
+  std::atomic<uint64_t> max_usecs = 0;
+
+  static size_t bucket_for_value(uint64_t usecs);
+  // Returns the smallest value that is NOT in the given bucket (that is, all values in the bucket are less than this)
+  static uint64_t bucket_limit(size_t bucket_index);
+
+  void add(uint64_t usecs);
+};
+
+// A point-in-time copy of a LatencyHistogram, possibly merged from multiple threads
+struct LatencyHistogramSnapshot {
+  std::array<uint64_t, LatencyHistogram::NUM_BUCKETS> buckets{};
+  uint64_t count = 0;
+  uint64_t total_usecs = 0;
+  uint64_t max_usecs = 0;
+
+  void merge(const LatencyHistogram& h);
+  // Returns the upper bound of the bucket containing the given quantile (0.0-1.0)
+  uint64_t quantile(double q) const;
+  // Returns the number of values less than the given limit. The limit must be a power of two (these are exact bucket
+  // boundaries, so no interpolation is needed).
+  uint64_t count_below(uint64_t limit) const;
+};
+
+// Counters and latency histograms for each command and subcommand handler, for each client version. Each thread that
+// handles commands records to its own shard, so recording never contends with other threads; the shards are merged
+// only when a snapshot is taken (for the /y/metrics HTTP endpoint or the metrics shell command). Entries are allocated
+// the first time each command is seen on each thread, so unused commands cost only a null pointer.
+class CommandMetrics {
+public:
+  enum class Kind {
+    COMMAND = 0,
+    SUBCOMMAND,
+  };
+
+  struct Entry {
+    LatencyHistogram latency; // Counts only received commands that were dispatched to a handler
+    std::atomic<uint64_t> received_count = 0;
+    std::atomic<uint64_t> received_bytes = 0;
+    std::atomic<uint64_t> sent_count = 0;
+    std::atomic<uint64_t> sent_bytes = 0;
+  };
+
+  struct EntrySnapshot {
+    Kind kind;
+    Version version;
+    uint8_t command;
+    LatencyHistogramSnapshot latency;
+    uint64_t received_count = 0;
+    uint64_t received_bytes = 0;
+    uint64_t sent_count = 0;
+    uint64_t sent_bytes = 0;
+  };
+
+  // Measures the time between construction and destruction, and records it for a received command or subcommand.
+  // This is used in coroutines, so the time includes any time the handler spent suspended (e.g. waiting for another
+  // client or for the thread pool); that time is usually what makes a lobby lag, so it's intentionally included.
+  class Timer {
+  public:
+    Timer(Kind kind, Version version, uint8_t command, size_t size);
+    Timer(const Timer&) = delete;
+    Timer(Timer&&) = delete;
+    Timer& operator=(const Timer&) = delete;
+    Timer& operator=(Timer&&) = delete;
+    ~Timer();
+
+  private:
+    Kind kind;
+    Version version;
+    uint8_t command;
+    size_t size;
+    uint64_t start_time;
+  };
+
+  CommandMetrics() = default;
+  CommandMetrics(const CommandMetrics&) = delete;
+  CommandMetrics(CommandMetrics&&) = delete;
+  CommandMetrics& operator=(const CommandMetrics&) = delete;
+  CommandMetrics& operator=(CommandMetrics&&) = delete;
+  ~CommandMetrics() = default;
+
+  void record_received(Kind kind, Version version, uint8_t command, size_t size, uint64_t usecs);
+  void record_sent(Kind kind, Version version, uint8_t command, size_t size);
+
+  // Returns all entries that have been used on any thread, in order of kind, version, and command number
+  std::vector<EntrySnapshot> snapshot() const;
+  inline uint64_t start_time() const {
+    return this->start_time_usecs;
+  }
+
+  // Returns all metrics in the Prometheus text exposition format
+  std::string prometheus_text() const;
+  // Returns a human-readable table of the entries with the most total handler time
+  std::vector<std::string> summary_lines(size_t max_entries) const;
+
+private:
+  static constexpr size_t ENTRIES_PER_KIND = NUM_VERSIONS * 0x100;
+
+  struct Shard {
+    std::array<std::array<std::atomic<Entry*>, ENTRIES_PER_KIND>, 2> entries{};
+    std::vector<std::unique_ptr<Entry>> owned_entries;
+  };
+
+  uint64_t start_time_usecs = phosg::now();
+  mutable std::mutex shards_lock;
+  std::vector<std::unique_ptr<Shard>> shards; // Never shrinks, since threads hold raw pointers to their shards
+
+  Entry& entry_for(Kind kind, Version version, uint8_t command);
+};
+
+extern CommandMetrics command_metrics;
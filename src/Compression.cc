@@ -6,8 +6,13 @@
 #include <string.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
 #include <phosg/Strings.hh>
 #include <set>
+#include <thread>
 
 #include "Text.hh"
 
@@ -34,10 +39,12 @@ struct MapWindowIndex {
   size_t current_offset;
   std::set<size_t, std::function<bool(size_t, size_t)>> index;
 
-  MapWindowIndex(const void* data, size_t size)
+  // start_offset is the first offset to be added to the index; data before it is never matched. size is the end of
+  // the data; matches never extend beyond it.
+  MapWindowIndex(const void* data, size_t size, size_t start_offset = 0)
       : data(reinterpret_cast<const uint8_t*>(data)),
         size(size),
-        current_offset(0),
+        current_offset(start_offset),
         index(std::bind(&MapWindowIndex::set_comparator, this, std::placeholders::_1, std::placeholders::_2)) {}
 
   void advance() {
@@ -277,78 +284,169 @@ struct PRSPathNode {
   size_t from_offset = 0;
   CommandType from_command_type = CommandType::NONE;
   size_t bits_used = static_cast<size_t>(-1);
-
-  // Stream generation state
-  size_t to_offset = 0;
 };
 
-std::string prs_compress_optimal(const void* in_data_v, size_t in_size, ProgressCallback progress_fn) {
-  const uint8_t* in_data = reinterpret_cast<const uint8_t*>(in_data_v);
+struct PRSCommand {
+  PRSPathNode::CommandType type;
+  uint16_t size;
+  int16_t offset; // Relative to the command's position in the input; unused for literals
+};
 
-  std::vector<PRSPathNode> nodes;
-  nodes.resize(in_size + 1);
-  nodes[0].bits_used = 18; // Stop command: 2 control bits and 2 data bytes
+// Calls match_fn(offset, match_offset, match_size) for the longest match (of at least min_match_size bytes) at each
+// offset in [start_offset, end_offset). Matches may begin up to WindowLength bytes before start_offset, but never
+// extend beyond end_offset. If tick_fn is given, it's called every 0x1000 bytes.
+template <size_t WindowLength, size_t MaxMatchLength, typename MatchFnT>
+static void prs_index_matches(
+    const uint8_t* data,
+    size_t start_offset,
+    size_t end_offset,
+    size_t min_match_size,
+    MatchFnT&& match_fn,
+    const std::function<void()>& tick_fn = nullptr) {
+  MapWindowIndex<WindowLength, MaxMatchLength> window(
+      data, end_offset, (start_offset > WindowLength) ? (start_offset - WindowLength) : 0);
+  while (window.current_offset < start_offset) {
+    window.advance();
+  }
+  while (window.current_offset < end_offset) {
+    if (window.current_offset && (window.current_offset & 0xFFF) == 0 && tick_fn) {
+      tick_fn();
+    }
+    auto match = window.match();
+    if (match.second >= min_match_size) {
+      match_fn(window.current_offset, match.first, match.second);
+    }
+    window.advance();
+  }
+}
 
-  size_t copy_progress_max = 3 * in_size;
-  std::atomic<size_t> copy_progress = 0;
+// Populates the copy fields in nodes for the input range [start_offset, end_offset) using exact indexes. This is
+// what prs_compress_optimal does, but on a single thread.
+static void prs_index_matches_exact(
+    std::vector<PRSPathNode>& nodes, const uint8_t* data, size_t start_offset, size_t end_offset) {
+  prs_index_matches<0x100, 5>(data, start_offset, end_offset, 2,
+      [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+        auto& node = nodes[offset - start_offset];
+        node.short_copy_offset = match_offset - offset;
+        node.max_short_copy_size = match_size;
+      });
+  prs_index_matches<0x1FFF, 9>(data, start_offset, end_offset, 3,
+      [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+        auto& node = nodes[offset - start_offset];
+        node.long_copy_offset = match_offset - offset;
+        node.max_long_copy_size = match_size;
+      });
+  prs_index_matches<0x1FFF, 0x100>(data, start_offset, end_offset, 1,
+      [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+        auto& node = nodes[offset - start_offset];
+        node.extended_copy_offset = match_offset - offset;
+        node.max_extended_copy_size = match_size;
+      });
+}
 
-  // Populate all possible short copies
-  std::thread short_window_thread([&]() -> void {
-    WindowIndex<0x100, 5> window(in_data_v, in_size);
-    while (window.current_offset < in_size) {
-      if (window.current_offset && (window.current_offset & 0xFFF) == 0 && progress_fn) {
-        size_t progress = copy_progress.fetch_add(0x1000) + 0x1000;
-        progress_fn(CompressPhase::INDEX, progress, copy_progress_max, 0);
-      }
-      auto& node = nodes[window.current_offset];
-      auto match = window.match();
-      if (match.second >= 2) {
-        node.short_copy_offset = match.first - window.current_offset;
-        node.max_short_copy_size = match.second;
-      }
-      window.advance();
+// Populates the copy fields in nodes for the input range [start_offset, end_offset) using hash chains. Short copies
+// are found by following a chain of earlier occurrences of each 2-byte sequence; long and extended copies are found
+// via a separate chain keyed on 3-byte sequences, since those copies are never useful unless at least 3 bytes match.
+// At most max_candidates entries in each chain are examined at each offset, so this is much faster than
+// prs_index_matches_exact, but may miss some matches.
+static void prs_index_matches_hash_chain(
+    std::vector<PRSPathNode>& nodes,
+    const uint8_t* data,
+    size_t data_size,
+    size_t start_offset,
+    size_t end_offset,
+    size_t max_candidates) {
+  static constexpr size_t NONE = static_cast<size_t>(-1);
+  size_t base_offset = (start_offset > 0x1FFF) ? (start_offset - 0x1FFF) : 0;
+  std::vector<size_t> short_heads(0x10000, NONE);
+  std::vector<size_t> long_heads(0x10000, NONE);
+  std::vector<size_t> short_prev_offsets(end_offset - base_offset, NONE);
+  std::vector<size_t> long_prev_offsets(end_offset - base_offset, NONE);
+  auto short_key = [&](size_t offset) -> size_t {
+    return (data[offset] << 8) | data[offset + 1];
+  };
+  auto long_key = [&](size_t offset) -> size_t {
+    return (((data[offset] << 8) | data[offset + 1]) ^ (data[offset + 2] * 0x9E5)) & 0xFFFF;
+  };
+  auto add_offset = [&](size_t offset) -> void {
+    if (offset + 1 < data_size) {
+      size_t& head = short_heads[short_key(offset)];
+      short_prev_offsets[offset - base_offset] = head;
+      head = offset;
     }
-  });
+    if (offset + 2 < data_size) {
+      size_t& head = long_heads[long_key(offset)];
+      long_prev_offsets[offset - base_offset] = head;
+      head = offset;
+    }
+  };
+  auto match_size = [&](size_t offset, size_t match_offset, size_t max_size) -> size_t {
+    size_t size = 0;
+    while ((size < max_size) && (data[match_offset + size] == data[offset + size])) {
+      size++;
+    }
+    return size;
+  };
 
-  // Populate all possible long copies
-  std::thread long_window_thread([&]() -> void {
-    WindowIndex<0x1FFF, 9> window(in_data_v, in_size);
-    while (window.current_offset < in_size) {
-      if (window.current_offset && (window.current_offset & 0xFFF) == 0 && progress_fn) {
-        size_t progress = copy_progress.fetch_add(0x1000) + 0x1000;
-        progress_fn(CompressPhase::INDEX, progress, copy_progress_max, 0);
-      }
-      auto& node = nodes[window.current_offset];
-      auto match = window.match();
-      if (match.second >= 3) {
-        node.long_copy_offset = match.first - window.current_offset;
-        node.max_long_copy_size = match.second;
+  for (size_t offset = base_offset; offset < start_offset; offset++) {
+    add_offset(offset);
+  }
+  for (size_t offset = start_offset; offset < end_offset; offset++) {
+    auto& node = nodes[offset - start_offset];
+    size_t max_size = std::min<size_t>(0x100, end_offset - offset);
+
+    // Candidates are visited in order of decreasing offset, so only replace matches that are strictly longer
+    if (max_size >= 2) {
+      size_t remaining_candidates = max_candidates;
+      for (size_t match_offset = short_heads[short_key(offset)];
+          (match_offset != NONE) && (offset - match_offset <= 0x100) && (remaining_candidates > 0);
+          match_offset = short_prev_offsets[match_offset - base_offset], remaining_candidates--) {
+        size_t size = match_size(offset, match_offset, std::min<size_t>(max_size, 5));
+        if (node.max_short_copy_size < size) {
+          node.short_copy_offset = static_cast<ssize_t>(match_offset) - static_cast<ssize_t>(offset);
+          node.max_short_copy_size = size;
+          if (size == std::min<size_t>(max_size, 5)) {
+            break;
+          }
+        }
       }
-      window.advance();
     }
-  });
 
-  // Populate all possible extended copies
-  std::thread extended_window_thread([&]() -> void {
-    WindowIndex<0x1FFF, 0x100> window(in_data_v, in_size);
-    while (window.current_offset < in_size) {
-      if (window.current_offset && (window.current_offset & 0xFFF) == 0 && progress_fn) {
-        size_t progress = copy_progress.fetch_add(0x1000) + 0x1000;
-        progress_fn(CompressPhase::INDEX, progress, copy_progress_max, 0);
-      }
-      auto& node = nodes[window.current_offset];
-      auto match = window.match();
-      if (match.second >= 1) {
-        node.extended_copy_offset = match.first - window.current_offset;
-        node.max_extended_copy_size = match.second;
+    if (max_size >= 3) {
+      size_t remaining_candidates = max_candidates;
+      for (size_t match_offset = long_heads[long_key(offset)];
+          (match_offset != NONE) && (offset - match_offset <= 0x1FFF) && (remaining_candidates > 0);
+          match_offset = long_prev_offsets[match_offset - base_offset], remaining_candidates--) {
+        // Skip candidates that can't be longer than the current best match. (This also skips hash collisions.)
+        size_t best_size = node.max_extended_copy_size;
+        if (best_size && (data[match_offset + best_size - 1] != data[offset + best_size - 1])) {
+          continue;
+        }
+        size_t size = match_size(offset, match_offset, max_size);
+        if ((size >= 3) && (node.max_extended_copy_size < size)) {
+          int16_t relative_offset = static_cast<ssize_t>(match_offset) - static_cast<ssize_t>(offset);
+          if (node.max_long_copy_size < std::min<size_t>(size, 9)) {
+            node.long_copy_offset = relative_offset;
+            node.max_long_copy_size = std::min<size_t>(size, 9);
+          }
+          node.extended_copy_offset = relative_offset;
+          node.max_extended_copy_size = size;
+          if (size == max_size) {
+            break;
+          }
+        }
       }
-      window.advance();
     }
-  });
 
-  short_window_thread.join();
-  long_window_thread.join();
-  extended_window_thread.join();
+    add_offset(offset);
+  }
+}
+
+// Finds the sequence of commands that produces the smallest output for nodes.size() - 1 bytes of input, using the
+// copies recorded in nodes. nodes[0].bits_used must be set by the caller.
+static std::vector<PRSCommand> prs_find_shortest_path(
+    std::vector<PRSPathNode>& nodes, ProgressCallback progress_fn = nullptr) {
+  size_t in_size = nodes.size() - 1;
 
   // For each node, populate the literal value, and the best ways to get to the following nodes
   for (size_t z = 0; z < in_size; z++) {
@@ -404,6 +502,7 @@ std::string prs_compress_optimal(const void* in_data_v, size_t in_size, Progress
   }
 
   // Find the shortest path from the last node to the first node
+  std::vector<PRSCommand> ret;
   size_t last_progress_fn_call = static_cast<size_t>(-1);
   for (size_t z = in_size; z > 0;) {
     if ((z & ~0xFFF) != (last_progress_fn_call & ~0xFFF)) {
@@ -412,94 +511,264 @@ std::string prs_compress_optimal(const void* in_data_v, size_t in_size, Progress
         progress_fn(CompressPhase::BACKTRACE_OPTIMAL_PATH, z, in_size, 0);
       }
     }
-    size_t from_offset = nodes[z].from_offset;
-    nodes[from_offset].to_offset = z;
-    z = from_offset;
+    const auto& to_node = nodes[z];
+    const auto& from_node = nodes[to_node.from_offset];
+    auto& cmd = ret.emplace_back();
+    cmd.type = to_node.from_command_type;
+    cmd.size = z - to_node.from_offset;
+    switch (cmd.type) {
+      case PRSPathNode::CommandType::LITERAL:
+        cmd.offset = 0;
+        break;
+      case PRSPathNode::CommandType::SHORT_COPY:
+        cmd.offset = from_node.short_copy_offset;
+        break;
+      case PRSPathNode::CommandType::LONG_COPY:
+        cmd.offset = from_node.long_copy_offset;
+        break;
+      case PRSPathNode::CommandType::EXTENDED_COPY:
+        cmd.offset = from_node.extended_copy_offset;
+        break;
+      default:
+        throw std::logic_error("invalid copy type in shortest path");
+    }
+    z = to_node.from_offset;
+  }
+  std::reverse(ret.begin(), ret.end());
+  return ret;
+}
+
+// Writes a single command to the PRS command stream. data points to the command's position in the input.
+static void prs_write_command(LZSSInterleavedWriter& w, const PRSCommand& cmd, const uint8_t* data) {
+  switch (cmd.type) {
+    case PRSPathNode::CommandType::LITERAL:
+      if (cmd.size != 1) {
+        throw std::logic_error("incorrect size for LITERAL copy type");
+      }
+      w.write_control(true);
+      w.write_data(*data);
+      break;
+    case PRSPathNode::CommandType::SHORT_COPY: {
+      if (cmd.size < 2 || cmd.size > 5) {
+        throw std::logic_error("incorrect size for SHORT_COPY copy type");
+      }
+      uint8_t encoded_size = cmd.size - 2;
+      w.write_control(false);
+      w.flush_if_ready();
+      w.write_control(false);
+      w.flush_if_ready();
+      w.write_control(encoded_size & 2);
+      w.flush_if_ready();
+      w.write_control(encoded_size & 1);
+      w.write_data(cmd.offset & 0xFF);
+      break;
+    }
+    case PRSPathNode::CommandType::LONG_COPY: {
+      if (cmd.size < 2 || cmd.size > 9) {
+        throw std::logic_error("incorrect size for LONG_COPY copy type");
+      }
+      w.write_control(false);
+      w.flush_if_ready();
+      w.write_control(true);
+      uint16_t a = (cmd.offset << 3) | (cmd.size - 2);
+      w.write_data(a & 0xFF);
+      w.write_data(a >> 8);
+      break;
+    }
+    case PRSPathNode::CommandType::EXTENDED_COPY: {
+      if (cmd.size < 1 || cmd.size > 0x100) {
+        throw std::logic_error("incorrect size for EXTENDED_COPY copy type");
+      }
+      w.write_control(false);
+      w.flush_if_ready();
+      w.write_control(true);
+      uint16_t a = (cmd.offset << 3);
+      w.write_data(a & 0xFF);
+      w.write_data(a >> 8);
+      w.write_data(cmd.size - 1);
+      break;
+    }
+    default:
+      throw std::logic_error("invalid copy type in shortest path");
+  }
+  w.flush_if_ready();
+}
+
+static void prs_write_stop_command(LZSSInterleavedWriter& w) {
+  w.write_control(false);
+  w.flush_if_ready();
+  w.write_control(true);
+  w.write_data(0);
+  w.write_data(0);
+}
+
+std::string prs_compress_optimal(const void* in_data_v, size_t in_size, ProgressCallback progress_fn) {
+  const uint8_t* in_data = reinterpret_cast<const uint8_t*>(in_data_v);
+
+  std::vector<PRSPathNode> nodes;
+  nodes.resize(in_size + 1);
+  nodes[0].bits_used = 18; // Stop command: 2 control bits and 2 data bytes
+
+  size_t copy_progress_max = 3 * in_size;
+  std::atomic<size_t> copy_progress = 0;
+  std::function<void()> tick_fn = nullptr;
+  if (progress_fn) {
+    tick_fn = [&]() -> void {
+      size_t progress = copy_progress.fetch_add(0x1000) + 0x1000;
+      progress_fn(CompressPhase::INDEX, progress, copy_progress_max, 0);
+    };
   }
 
+  // Populate all possible short copies
+  std::thread short_window_thread([&]() -> void {
+    prs_index_matches<0x100, 5>(in_data, 0, in_size, 2,
+        [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+          auto& node = nodes[offset];
+          node.short_copy_offset = match_offset - offset;
+          node.max_short_copy_size = match_size;
+        },
+        tick_fn);
+  });
+
+  // Populate all possible long copies
+  std::thread long_window_thread([&]() -> void {
+    prs_index_matches<0x1FFF, 9>(in_data, 0, in_size, 3,
+        [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+          auto& node = nodes[offset];
+          node.long_copy_offset = match_offset - offset;
+          node.max_long_copy_size = match_size;
+        },
+        tick_fn);
+  });
+
+  // Populate all possible extended copies
+  std::thread extended_window_thread([&]() -> void {
+    prs_index_matches<0x1FFF, 0x100>(in_data, 0, in_size, 1,
+        [&](size_t offset, size_t match_offset, size_t match_size) -> void {
+          auto& node = nodes[offset];
+          node.extended_copy_offset = match_offset - offset;
+          node.max_extended_copy_size = match_size;
+        },
+        tick_fn);
+  });
+
+  short_window_thread.join();
+  long_window_thread.join();
+  extended_window_thread.join();
+
+  auto commands = prs_find_shortest_path(nodes, progress_fn);
+
   // Produce the PRS command stream from the shortest path
   LZSSInterleavedWriter w;
-  last_progress_fn_call = static_cast<size_t>(-1);
-  for (size_t offset = 0; offset < in_size;) {
+  size_t last_progress_fn_call = static_cast<size_t>(-1);
+  size_t offset = 0;
+  for (const auto& cmd : commands) {
     if ((offset & ~0xFFF) != (last_progress_fn_call & ~0xFFF)) {
       last_progress_fn_call = offset;
       if (progress_fn) {
         progress_fn(CompressPhase::GENERATE_RESULT, offset, in_size, w.size());
       }
     }
+    prs_write_command(w, cmd, in_data + offset);
+    offset += cmd.size;
+  }
+  prs_write_stop_command(w);
 
-    const auto& node = nodes[offset];
-    const auto& next_node = nodes[node.to_offset];
+  return std::move(w.close());
+}
 
-    size_t copy_size = node.to_offset - offset;
-    switch (next_node.from_command_type) {
-      case PRSPathNode::CommandType::LITERAL:
-        if (copy_size != 1) {
-          throw std::logic_error("incorrect size for LITERAL copy type");
-        }
-        w.write_control(true);
-        w.write_data(in_data[offset]);
-        break;
-      case PRSPathNode::CommandType::SHORT_COPY: {
-        if (copy_size < 2 || copy_size > 5) {
-          throw std::logic_error("incorrect size for SHORT_COPY copy type");
+std::string prs_compress_optimal(const std::string& data, ProgressCallback progress_fn) {
+  return prs_compress_optimal(data.data(), data.size(), progress_fn);
+}
+
+std::string prs_compress_parallel(
+    const void* in_data_v,
+    size_t in_size,
+    ssize_t compression_level,
+    size_t num_threads,
+    ProgressCallback progress_fn) {
+  const uint8_t* in_data = reinterpret_cast<const uint8_t*>(in_data_v);
+
+  // The segment size is fixed (rather than depending on num_threads) so the output doesn't depend on the number of
+  // threads used
+  static constexpr size_t SEGMENT_SIZE = 0x10000;
+  size_t num_segments = (in_size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+  if (num_threads == 0) {
+    num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  num_threads = std::min<size_t>(num_threads, num_segments);
+  compression_level = std::clamp<ssize_t>(compression_level, 1, PRS_PARALLEL_MAX_COMPRESSION_LEVEL);
+
+  std::vector<std::vector<PRSCommand>> segment_commands(num_segments);
+  std::atomic<size_t> next_segment_index = 0;
+  std::mutex lock;
+  std::exception_ptr exc;
+  size_t bytes_done = 0;
+
+  auto thread_fn = [&]() -> void {
+    for (size_t index = next_segment_index++; index < num_segments; index = next_segment_index++) {
+      size_t start_offset = index * SEGMENT_SIZE;
+      size_t end_offset = std::min<size_t>(start_offset + SEGMENT_SIZE, in_size);
+      try {
+        std::vector<PRSPathNode> nodes(end_offset - start_offset + 1);
+        nodes[0].bits_used = 0;
+        if (compression_level >= PRS_PARALLEL_MAX_COMPRESSION_LEVEL) {
+          prs_index_matches_exact(nodes, in_data, start_offset, end_offset);
+        } else {
+          prs_index_matches_hash_chain(
+              nodes, in_data, in_size, start_offset, end_offset, size_t(1) << compression_level);
         }
-        uint8_t encoded_size = copy_size - 2;
-        w.write_control(false);
-        w.flush_if_ready();
-        w.write_control(false);
-        w.flush_if_ready();
-        w.write_control(encoded_size & 2);
-        w.flush_if_ready();
-        w.write_control(encoded_size & 1);
-        w.write_data(node.short_copy_offset & 0xFF);
-        break;
-      }
-      case PRSPathNode::CommandType::LONG_COPY: {
-        if (copy_size < 2 || copy_size > 9) {
-          throw std::logic_error("incorrect size for LONG_COPY copy type");
+        segment_commands[index] = prs_find_shortest_path(nodes);
+      } catch (const std::exception&) {
+        std::lock_guard g(lock);
+        if (!exc) {
+          exc = std::current_exception();
         }
-        w.write_control(false);
-        w.flush_if_ready();
-        w.write_control(true);
-        uint16_t a = (node.long_copy_offset << 3) | (copy_size - 2);
-        w.write_data(a & 0xFF);
-        w.write_data(a >> 8);
-        break;
+        return;
       }
-      case PRSPathNode::CommandType::EXTENDED_COPY: {
-        if (copy_size < 1 || copy_size > 0x100) {
-          throw std::logic_error("incorrect size for EXTENDED_COPY copy type");
-        }
-        w.write_control(false);
-        w.flush_if_ready();
-        w.write_control(true);
-        uint16_t a = (node.extended_copy_offset << 3);
-        w.write_data(a & 0xFF);
-        w.write_data(a >> 8);
-        w.write_data(copy_size - 1);
-        break;
+      if (progress_fn) {
+        std::lock_guard g(lock);
+        bytes_done += end_offset - start_offset;
+        progress_fn(CompressPhase::CONSTRUCT_PATHS, bytes_done, in_size, 0);
       }
-      default:
-        throw std::logic_error("invalid copy type in shortest path");
     }
-    w.flush_if_ready();
+  };
 
-    offset = node.to_offset;
+  if (num_threads <= 1) {
+    thread_fn();
+  } else {
+    std::vector<std::thread> threads;
+    while (threads.size() < num_threads) {
+      threads.emplace_back(thread_fn);
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  if (exc) {
+    std::rethrow_exception(exc);
   }
 
-  // Write stop command
-  w.write_control(false);
-  w.flush_if_ready();
-  w.write_control(true);
-  w.write_data(0);
-  w.write_data(0);
+  // No command crosses a segment boundary, so the segments' commands can just be written in order
+  LZSSInterleavedWriter w;
+  size_t offset = 0;
+  for (const auto& commands : segment_commands) {
+    if (progress_fn) {
+      progress_fn(CompressPhase::GENERATE_RESULT, offset, in_size, w.size());
+    }
+    for (const auto& cmd : commands) {
+      prs_write_command(w, cmd, in_data + offset);
+      offset += cmd.size;
+    }
+  }
+  prs_write_stop_command(w);
 
   return std::move(w.close());
 }
 
-std::string prs_compress_optimal(const std::string& data, ProgressCallback progress_fn) {
-  return prs_compress_optimal(data.data(), data.size(), progress_fn);
+std::string prs_compress_parallel(
+    const std::string& data, ssize_t compression_level, size_t num_threads, ProgressCallback progress_fn) {
+  return prs_compress_parallel(data.data(), data.size(), compression_level, num_threads, progress_fn);
 }
 
 std::string prs_compress_pessimal(const void* vdata, size_t size) {
@@ -882,7 +1151,7 @@ std::string prs_compress_indexed(const std::string& data, ProgressCallback progr
   return prs_compress_indexed(data.data(), data.size(), progress_fn);
 }
 
-PRSDecompressResult prs_decompress_with_meta(
+static PRSDecompressResult prs_decompress_careful(
     const void* data, size_t size, size_t max_output_size, bool allow_unterminated) {
   // PRS is an LZ77-based compression algorithm. Compressed data is split into two streams: a control stream and a data
   // stream. The control stream is read one bit at a time, and the data stream is read one byte at a time. The streams
@@ -974,6 +1243,164 @@ PRSDecompressResult prs_decompress_with_meta(
   return {std::move(w.str()), r.where()};
 }
 
+// Reads a PRS command stream without producing any output. Returns false if the stream would cause
+// prs_decompress_careful to throw (that is, if it's truncated in the middle of a command or contains a backreference
+// to before the beginning of the output); otherwise, sets output_size and input_bytes_used to the values
+// prs_decompress_careful would produce if there were no maximum output size.
+static bool prs_scan(const uint8_t* in_data, size_t in_size, size_t& output_size, size_t& input_bytes_used) {
+  size_t in_offset = 0;
+  size_t out_size = 0;
+  uint16_t bits = 0x0000;
+  auto read_control = [&]() -> int {
+    if (!(bits & 0x0100)) {
+      if (in_offset >= in_size) {
+        return -1;
+      }
+      bits = 0xFF00 | in_data[in_offset++];
+    }
+    int ret = bits & 1;
+    bits >>= 1;
+    return ret;
+  };
+
+  while (in_offset < in_size) {
+    int c = read_control();
+    if (c < 0) {
+      return false;
+    }
+    if (c) {
+      if (in_offset >= in_size) {
+        return false;
+      }
+      in_offset++;
+      out_size++;
+      continue;
+    }
+
+    size_t distance;
+    size_t count;
+    c = read_control();
+    if (c < 0) {
+      return false;
+    } else if (c) {
+      if (in_size - in_offset < 2) {
+        return false;
+      }
+      uint16_t a = in_data[in_offset] | (in_data[in_offset + 1] << 8);
+      in_offset += 2;
+      if ((a >> 3) == 0) {
+        break;
+      }
+      distance = 0x2000 - (a >> 3);
+      if (a & 7) {
+        count = (a & 7) + 2;
+      } else if (in_offset < in_size) {
+        count = in_data[in_offset++] + 1;
+      } else {
+        return false;
+      }
+    } else {
+      int c1 = read_control();
+      int c2 = read_control();
+      if ((c1 < 0) || (c2 < 0) || (in_offset >= in_size)) {
+        return false;
+      }
+      count = ((c1 << 1) | c2) + 2;
+      distance = 0x100 - in_data[in_offset++];
+    }
+    if (distance > out_size) {
+      return false;
+    }
+    out_size += count;
+  }
+
+  output_size = out_size;
+  input_bytes_used = in_offset;
+  return true;
+}
+
+// Decompresses a PRS command stream which has already been checked by prs_scan into a buffer of exactly the size
+// returned by prs_scan. Since the input is known to be valid, there are no bounds checks on the input; the only checks
+// are on the output, to decide whether copies can be done in 8-byte chunks.
+static void prs_decompress_scanned(const uint8_t* in_data, uint8_t* out_data, size_t out_size) {
+  size_t in_offset = 0;
+  size_t out_offset = 0;
+  uint16_t bits = 0x0000;
+  auto read_control = [&]() -> bool {
+    if (!(bits & 0x0100)) {
+      bits = 0xFF00 | in_data[in_offset++];
+    }
+    bool ret = bits & 1;
+    bits >>= 1;
+    return ret;
+  };
+
+  while (out_offset < out_size) {
+    // If all 8 bits of a new control byte are 1 and there are at least 8 bytes left in the output, the next 8 commands
+    // must all be literals (prs_scan wouldn't have counted those output bytes otherwise)
+    if (!(bits & 0x0100) && (in_data[in_offset] == 0xFF) && (out_size - out_offset >= 8)) {
+      memcpy(out_data + out_offset, in_data + in_offset + 1, 8);
+      in_offset += 9;
+      out_offset += 8;
+      continue;
+    }
+
+    if (read_control()) {
+      out_data[out_offset++] = in_data[in_offset++];
+      continue;
+    }
+
+    size_t distance;
+    size_t count;
+    if (read_control()) {
+      uint16_t a = in_data[in_offset] | (in_data[in_offset + 1] << 8);
+      in_offset += 2;
+      distance = 0x2000 - (a >> 3);
+      count = (a & 7) ? ((a & 7) + 2) : (in_data[in_offset++] + 1);
+    } else {
+      count = read_control() << 1;
+      count = (count | read_control()) + 2;
+      distance = 0x100 - in_data[in_offset++];
+    }
+
+    uint8_t* dest = out_data + out_offset;
+    const uint8_t* src = dest - distance;
+    if ((distance >= 8) && (out_size - out_offset >= ((count + 7) & ~static_cast<size_t>(7)))) {
+      // Each 8-byte chunk only reads bytes that were written before it, so this is correct even if the ranges
+      // overlap. This may write up to 7 bytes past the end of the copy, but those bytes will be overwritten by later
+      // commands, since they're within the output size.
+      for (size_t z = 0; z < count; z += 8) {
+        memcpy(dest + z, src + z, 8);
+      }
+    } else if (distance == 1) {
+      memset(dest, *src, count);
+    } else if (distance >= count) {
+      memcpy(dest, src, count);
+    } else {
+      for (size_t z = 0; z < count; z++) {
+        dest[z] = src[z];
+      }
+    }
+    out_offset += count;
+  }
+}
+
+PRSDecompressResult prs_decompress_with_meta(
+    const void* data, size_t size, size_t max_output_size, bool allow_unterminated) {
+  // Scan the input first to find the output size and check for errors, then decompress it into a buffer of exactly
+  // the right size with no input bounds checks. If the input is malformed or the output would be too large, use the
+  // careful decompressor instead, which produces the appropriate exception or truncated result.
+  const uint8_t* in_data = reinterpret_cast<const uint8_t*>(data);
+  size_t output_size, input_bytes_used;
+  if (!prs_scan(in_data, size, output_size, input_bytes_used) ||
+      (max_output_size && (output_size > max_output_size))) {
+    return prs_decompress_careful(data, size, max_output_size, allow_unterminated);
+  }
+  PRSDecompressResult ret{std::string(output_size, '\0'), input_bytes_used};
+  prs_decompress_scanned(in_data, reinterpret_cast<uint8_t*>(ret.data.data()), output_size);
+  return ret;
+}
+
 PRSDecompressResult prs_decompress_with_meta(const std::string& data, size_t max_output_size, bool allow_unterminated) {
   return prs_decompress_with_meta(data.data(), data.size(), max_output_size, allow_unterminated);
 }
@@ -989,7 +1416,14 @@ std::string prs_decompress(const std::string& data, size_t max_output_size, bool
 }
 
 size_t prs_decompress_size(const void* data, size_t size, size_t max_output_size, bool allow_unterminated) {
-  size_t ret = 0;
+  size_t ret, input_bytes_used;
+  if (prs_scan(reinterpret_cast<const uint8_t*>(data), size, ret, input_bytes_used) &&
+      (!max_output_size || (ret <= max_output_size))) {
+    return ret;
+  }
+
+  // The input is malformed or too large; find out exactly where and how
+  ret = 0;
   phosg::StringReader r(data, size);
   ControlStreamReader cr(r);
 
@@ -1253,6 +1687,71 @@ std::string bc0_compress(const void* in_data_v, size_t in_size, ProgressCallback
   return std::move(w.close());
 }
 
+std::string bc0_compress_fast(const void* in_data_v, size_t in_size, size_t max_candidates) {
+  const uint8_t* in_data = reinterpret_cast<const uint8_t*>(in_data_v);
+
+  // Backreferences can only refer to the previous 0x1000 bytes, so the chain links are stored in a ring buffer of that
+  // size. A link is only overwritten after its offset has left the window, so following a chain never reaches it.
+  static constexpr size_t NONE = static_cast<size_t>(-1);
+  std::vector<size_t> heads(0x10000, NONE);
+  std::vector<size_t> prev_offsets(0x1000, NONE);
+  auto key = [&](size_t offset) -> size_t {
+    return (((in_data[offset] << 8) | in_data[offset + 1]) ^ (in_data[offset + 2] * 0x9E5)) & 0xFFFF;
+  };
+  auto add_offset = [&](size_t offset) -> void {
+    if (offset + 2 < in_size) {
+      size_t& head = heads[key(offset)];
+      prev_offsets[offset & 0xFFF] = head;
+      head = offset;
+    }
+  };
+
+  LZSSInterleavedWriter w;
+  for (size_t offset = 0; offset < in_size;) {
+    size_t max_size = std::min<size_t>(0x12, in_size - offset);
+    size_t match_offset = 0;
+    size_t match_size = 0;
+    if (max_size >= 3) {
+      size_t remaining_candidates = max_candidates;
+      for (size_t candidate_offset = heads[key(offset)];
+          (candidate_offset != NONE) && (offset - candidate_offset <= 0x1000) && (remaining_candidates > 0);
+          candidate_offset = prev_offsets[candidate_offset & 0xFFF], remaining_candidates--) {
+        size_t size = 0;
+        while ((size < max_size) && (in_data[candidate_offset + size] == in_data[offset + size])) {
+          size++;
+        }
+        // Candidates are visited in order of decreasing offset, so only replace matches that are strictly longer
+        if (size > match_size) {
+          match_offset = candidate_offset;
+          match_size = size;
+          if (size == max_size) {
+            break;
+          }
+        }
+      }
+    }
+
+    if (match_size >= 3) {
+      w.write_control(false);
+      size_t memo_offset = match_offset - 0x12;
+      w.write_data(memo_offset & 0xFF);
+      w.write_data(((memo_offset >> 4) & 0xF0) | (match_size - 3));
+    } else {
+      w.write_control(true);
+      w.write_data(in_data[offset]);
+      match_size = 1;
+    }
+    w.flush_if_ready();
+
+    for (size_t z = 0; z < match_size; z++) {
+      add_offset(offset + z);
+    }
+    offset += match_size;
+  }
+
+  return std::move(w.close());
+}
+
 std::string bc0_encode(const void* in_data_v, size_t in_size) {
   const uint8_t* in_data = reinterpret_cast<const uint8_t*>(in_data_v);
 
@@ -158,6 +158,26 @@ std::string prs_compress_indexed(const std::string& data, ProgressCallback progr
 std::string prs_compress_optimal(const void* vdata, size_t size, ProgressCallback progress_fn = nullptr);
 std::string prs_compress_optimal(const std::string& data, ProgressCallback progress_fn = nullptr);
 
+// Compresses data using PRS on multiple threads. The input is split into fixed-size segments which are compressed
+// independently (though copies may refer to data in previous segments) and concatenated into a single command stream,
+// so the output doesn't depend on num_threads. compression_level ranges from 1 (fastest) to
+// PRS_PARALLEL_MAX_COMPRESSION_LEVEL (smallest output); the maximum level searches exhaustively like
+// prs_compress_optimal does, and the output is only slightly larger than prs_compress_optimal's, since no command
+// crosses a segment boundary. Lower levels examine fewer earlier occurrences of each byte sequence. If num_threads is
+// 0, one thread per CPU core is used.
+constexpr ssize_t PRS_PARALLEL_MAX_COMPRESSION_LEVEL = 9;
+std::string prs_compress_parallel(
+    const void* vdata,
+    size_t size,
+    ssize_t compression_level = PRS_PARALLEL_MAX_COMPRESSION_LEVEL,
+    size_t num_threads = 0,
+    ProgressCallback progress_fn = nullptr);
+std::string prs_compress_parallel(
+    const std::string& data,
+    ssize_t compression_level = PRS_PARALLEL_MAX_COMPRESSION_LEVEL,
+    size_t num_threads = 0,
+    ProgressCallback progress_fn = nullptr);
+
 // Compresses data using PRS to the LARGEST possible output size. There is no practical use for this function except
 // for amusement.
 std::string prs_compress_pessimal(const void* vdata, size_t size);
@@ -191,6 +211,11 @@ std::string bc0_compress(const std::string& data, ProgressCallback progress_fn =
 std::string bc0_compress(const void* in_data_v, size_t in_size, ProgressCallback progress_fn = nullptr);
 std::string bc0_compress_optimal(const void* in_data_v, size_t in_size, ProgressCallback progress_fn = nullptr);
 
+// Compresses data using BC0 with a greedy hash-chain matcher. This is several times faster than bc0_compress and
+// produces slightly larger output; it's intended for data that must be compressed while a client is waiting (e.g. the
+// game join sync commands, if FastJoinSyncCompression is enabled). max_candidates limits how many earlier occurrences of each 3-byte sequence are examined.
+std::string bc0_compress_fast(const void* in_data_v, size_t in_size, size_t max_candidates = 16);
+
 // Encodes data in a BC0-compatible format without compression (similar to compression_level=-1 in prs_compress).
 std::string bc0_encode(const void* in_data_v, size_t in_size);
 
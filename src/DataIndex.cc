@@ -2,12 +2,20 @@
 
 #include <string.h>
 
+#include <algorithm>
+#include <asio.hpp>
+#include <condition_variable>
 #include <filesystem>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <phosg/Filesystem.hh>
 #include <phosg/Image.hh>
 #include <phosg/Network.hh>
 #include <phosg/Platform.hh>
+#include <phosg/Time.hh>
+#include <phosg/Tools.hh>
+#include <thread>
 
 #include "Compression.hh"
 #include "GameServer.hh"
@@ -472,7 +480,7 @@ void DataIndex::collect_network_addresses() {
   }
 }
 
-void DataIndex::load_config_early() {
+void DataIndex::load_config_early(bool update_log_levels) {
   if (this->config_filename.empty()) {
     throw std::logic_error("configuration filename is missing");
   }
@@ -515,6 +523,7 @@ void DataIndex::load_config_early() {
     } catch (const std::out_of_range&) {
     }
 
+    this->save_database_filename = this->config_json->get_string("SaveDatabaseFilename", "");
     this->set_port_configuration(parse_port_configuration(this->config_json->at("PortConfiguration")));
     try {
       auto spec = this->parse_port_spec(this->config_json->at("DNSServerPort"));
@@ -637,6 +646,7 @@ void DataIndex::load_config_early() {
   this->client_ping_interval_usecs = this->config_json->get_int("ClientPingInterval", 30000000);
   this->client_idle_timeout_usecs = this->config_json->get_int("ClientIdleTimeout", 60000000);
   this->patch_client_idle_timeout_usecs = this->config_json->get_int("PatchClientIdleTimeout", 300000000);
+  this->team_save_interval_usecs = this->config_json->get_int("TeamSaveInterval", 10000000);
 
   this->ip_stack_debug = this->config_json->get_bool("IPStackDebug", false);
   this->allow_unregistered_users = this->config_json->get_bool("AllowUnregisteredUsers", false);
@@ -704,6 +714,7 @@ void DataIndex::load_config_early() {
   }
 
   this->persistent_game_idle_timeout_usecs = this->config_json->get_int("PersistentGameIdleTimeout", 0);
+  this->fast_join_sync_compression = this->config_json->get_bool("FastJoinSyncCompression", false);
   this->cheat_mode_behavior = parse_behavior_switch("CheatModeBehavior", BehaviorSwitch::OFF_BY_DEFAULT);
   this->default_switch_assist_enabled = this->config_json->get_bool("EnableSwitchAssistByDefault", false);
   this->use_game_creator_section_id = this->config_json->get_bool("UseGameCreatorSectionID", false);
@@ -883,10 +894,8 @@ void DataIndex::load_config_early() {
   this->exp_share_multiplier = this->config_json->get_float("BBEXPShareMultiplier", 0.5f);
   this->server_global_drop_rate_multiplier = this->config_json->get_float("ServerGlobalDropRateMultiplier", 1.0f);
 
-  if (this->is_debug) {
-    set_all_log_levels(phosg::LogLevel::L_DEBUG);
-  } else {
-    set_log_levels_from_json(this->config_json->get("LogLevels", phosg::JSON::dict()));
+  if (update_log_levels) {
+    this->apply_log_levels();
   }
 
   try {
@@ -940,7 +949,7 @@ void DataIndex::load_config_early() {
     if (colors_json.size() != NUM_NON_PATCH_VERSIONS) {
       throw std::runtime_error("VersionNameColors list length is incorrect");
     }
-    auto new_colors = std::make_unique<std::array<uint32_t, NUM_NON_PATCH_VERSIONS>>();
+    auto new_colors = std::make_shared<std::array<uint32_t, NUM_NON_PATCH_VERSIONS>>();
     for (size_t z = 0; z < NUM_NON_PATCH_VERSIONS; z++) {
       new_colors->at(z) = colors_json.at(z)->as_int();
     }
@@ -1370,19 +1379,31 @@ void DataIndex::load_patch_indexes() {
   std::shared_ptr<PatchFileIndex> pc_patch_file_index;
   std::shared_ptr<PatchFileIndex> bb_patch_file_index;
 
+  // If the indexes were already loaded, only new and modified files are rehashed (see PatchFileIndex)
   if (std::filesystem::is_directory("system/patch-pc")) {
     config_log.info_f("Indexing PSO PC patch files");
-    pc_patch_file_index = std::make_shared<PatchFileIndex>("system/patch-pc");
+    pc_patch_file_index = std::make_shared<PatchFileIndex>("system/patch-pc", this->pc_patch_file_index);
   } else {
     config_log.info_f("PSO PC patch files not present");
   }
   if (std::filesystem::is_directory("system/patch-bb")) {
     config_log.info_f("Indexing PSO BB patch files");
-    bb_patch_file_index = std::make_shared<PatchFileIndex>("system/patch-bb");
+    bb_patch_file_index = std::make_shared<PatchFileIndex>("system/patch-bb", this->bb_patch_file_index);
     try {
       auto gsl_file = bb_patch_file_index->get("./data/data.gsl");
-      bb_data_gsl = std::make_shared<GSLArchive>(gsl_file->load_data(), false);
-      config_log.info_f("data.gsl found in BB patch files");
+      std::shared_ptr<const PatchFileIndex::File> prev_gsl_file;
+      try {
+        prev_gsl_file = this->bb_patch_file_index ? this->bb_patch_file_index->get("./data/data.gsl") : nullptr;
+      } catch (const std::out_of_range&) {
+      }
+      if (this->bb_data_gsl && prev_gsl_file && (prev_gsl_file->mtime == gsl_file->mtime) &&
+          (prev_gsl_file->size == gsl_file->size) && (prev_gsl_file->crc32 == gsl_file->crc32)) {
+        bb_data_gsl = this->bb_data_gsl;
+        config_log.info_f("data.gsl in BB patch files is unchanged");
+      } else {
+        bb_data_gsl = std::make_shared<GSLArchive>(gsl_file->load_data(), false);
+        config_log.info_f("data.gsl found in BB patch files");
+      }
     } catch (const std::out_of_range&) {
       config_log.info_f("data.gsl is not present in BB patch files");
     }
@@ -1506,69 +1527,63 @@ void DataIndex::load_maps() {
     }
   }
 
+  // Construct the supermaps for all free play variations up front, so games never have to wait for this. Many keys
+  // (e.g. the same variation on different difficulties) have the same set of map files, so each distinct set is only
+  // constructed once.
+  config_log.info_f("Constructing free play supermaps");
+  struct PendingSuperMap {
+    uint32_t free_play_key; // First key that uses this supermap
+    const std::array<std::shared_ptr<const MapFile>, NUM_VERSIONS>* map_files;
+    std::shared_ptr<const SuperMap> supermap;
+  };
+  std::vector<PendingSuperMap> pending_supermaps;
+  std::unordered_map<uint64_t, size_t> pending_index_for_source_hash_sum;
+  std::vector<std::pair<uint32_t, size_t>> pending_index_for_free_play_key;
+  for (const auto& [free_play_key, map_files] : new_map_files_for_free_play_key) {
+    uint64_t source_hash_sum = 0;
+    for (const auto& map_file : map_files) {
+      source_hash_sum += map_file ? map_file->source_hash() : 0;
+    }
+    auto emplace_ret = pending_index_for_source_hash_sum.emplace(source_hash_sum, pending_supermaps.size());
+    if (emplace_ret.second) {
+      pending_supermaps.emplace_back(PendingSuperMap{.free_play_key = free_play_key, .map_files = &map_files});
+    }
+    pending_index_for_free_play_key.emplace_back(free_play_key, emplace_ret.first->second);
+  }
+
+  uint64_t supermaps_start_time = phosg::now();
+  phosg::parallel_range(
+      pending_supermaps, [&](PendingSuperMap& pending, size_t) -> bool {
+        Episode episode = static_cast<Episode>((pending.free_play_key >> 28) & 0x0F);
+        pending.supermap = std::make_shared<SuperMap>(
+            *pending.map_files, SetDataTableBase::default_floor_to_area(Version::BB_V4, episode));
+        return false;
+      },
+      std::max<size_t>({1, this->num_worker_threads, std::thread::hardware_concurrency()}));
+
+  std::unordered_map<uint32_t, std::shared_ptr<const SuperMap>> new_supermap_for_free_play_key;
+  for (const auto& [free_play_key, pending_index] : pending_index_for_free_play_key) {
+    new_supermap_for_free_play_key.emplace(free_play_key, pending_supermaps[pending_index].supermap);
+  }
+  config_log.info_f("Constructed {} free play supermaps for {} variations in {}",
+      pending_supermaps.size(), new_supermap_for_free_play_key.size(),
+      phosg::format_duration(phosg::now() - supermaps_start_time));
+
   this->map_file_for_source_hash = std::move(new_map_file_for_source_hash);
   this->map_files_for_free_play_key = std::move(new_map_files_for_free_play_key);
+  this->supermap_for_free_play_key = std::move(new_supermap_for_free_play_key);
   this->room_layout_index = new_room_layout_index;
-  this->supermap_for_source_hash_sum.clear();
-  this->supermap_for_free_play_key.clear();
 }
 
 std::shared_ptr<const SuperMap> DataIndex::get_free_play_supermap(
-    Episode episode, GameMode mode, Difficulty difficulty, uint8_t floor, uint32_t layout, uint32_t entities) {
-  uint32_t free_play_key = this->free_play_key(episode, mode, difficulty, floor, layout, entities);
-  try {
-    return this->supermap_for_free_play_key.at(free_play_key);
-  } catch (const std::out_of_range&) {
-  }
-
-  const std::array<std::shared_ptr<const MapFile>, NUM_VERSIONS>* map_files;
-  try {
-    map_files = &this->map_files_for_free_play_key.at(free_play_key);
-  } catch (const std::out_of_range&) {
-    static_game_data_log.info_f("No maps exist for key {:08X}; cannot construct supermap", free_play_key);
-    this->supermap_for_free_play_key.emplace(free_play_key, nullptr);
-    return nullptr;
-  }
-
-  uint64_t source_hash_sum = 0;
-  for (auto map_file : *map_files) {
-    source_hash_sum += map_file ? map_file->source_hash() : 0;
-  }
-
-  // Uncomment for debugging
-  // phosg::fwrite_fmt(stderr, "SuperMap for {} {} {} {:02X} {:02X} {:02X} ({:08X}): {:016X} from",
-  //     name_for_episode(episode),
-  //     name_for_mode(mode),
-  //     name_for_difficulty(difficulty),
-  //     floor,
-  //     layout,
-  //     entities,
-  //     free_play_key,
-  //     source_hash_sum);
-  // for (const auto& map_file : it.second) {
-  //   if (map_file) {
-  //     phosg::fwrite_fmt(stderr, " {:016X}", map_file->source_hash());
-  //   } else {
-  //     phosg::fwrite_fmt(stderr, " ----------------");
-  //   }
-  // }
-  // fputc('\n', stderr);
-
-  std::shared_ptr<const SuperMap> supermap;
-  try {
-    supermap = this->supermap_for_source_hash_sum.at(source_hash_sum);
-    static_game_data_log.info_f("Linking existing free play supermap {:016X} for key {:08X}", source_hash_sum, free_play_key);
-  } catch (const std::out_of_range&) {
-    supermap = std::make_shared<SuperMap>(*map_files, SetDataTableBase::default_floor_to_area(Version::BB_V4, episode));
-    this->supermap_for_source_hash_sum.emplace(source_hash_sum, supermap);
-    static_game_data_log.info_f("Constructed free play supermap {:016X} for key {:08X}", source_hash_sum, free_play_key);
-  }
-  this->supermap_for_free_play_key.emplace(free_play_key, supermap);
-  return supermap;
+    Episode episode, GameMode mode, Difficulty difficulty, uint8_t floor, uint32_t layout, uint32_t entities) const {
+  // All supermaps are constructed in load_maps, so this never modifies the table and is safe to call from any thread
+  auto it = this->supermap_for_free_play_key.find(this->free_play_key(episode, mode, difficulty, floor, layout, entities));
+  return (it == this->supermap_for_free_play_key.end()) ? nullptr : it->second;
 }
 
 std::vector<std::shared_ptr<const SuperMap>> DataIndex::supermaps_for_variations(
-    Episode episode, GameMode mode, Difficulty difficulty, const Variations& variations) {
+    Episode episode, GameMode mode, Difficulty difficulty, const Variations& variations) const {
   std::vector<std::shared_ptr<const SuperMap>> ret;
   for (size_t floor = 0; floor < 0x12; floor++) {
     Variations::Entry e;
@@ -1995,9 +2010,9 @@ void DataIndex::generate_bb_stream_file() {
         filename, e.offset, e.size, e.checksum, sf->data.size());
   };
 
-  auto level_table_data = prs_compress_optimal(this->level_table_v4->serialize_binary_v4());
-  auto pmt_data = prs_compress_optimal(this->item_parameter_table(Version::BB_V4)->serialize_binary(Version::BB_V4));
-  auto mag_data = prs_compress_optimal(this->mag_metadata_table(Version::BB_V4)->serialize_binary(Version::BB_V4));
+  auto level_table_data = prs_compress_parallel(this->level_table_v4->serialize_binary_v4());
+  auto pmt_data = prs_compress_parallel(this->item_parameter_table(Version::BB_V4)->serialize_binary(Version::BB_V4));
+  auto mag_data = prs_compress_parallel(this->mag_metadata_table(Version::BB_V4)->serialize_binary(Version::BB_V4));
 
   const auto& bps = *this->battle_params;
   add_file("BattleParamEntry.dat", &bps.get_table(true, Episode::EP1), sizeof(BattleParamsIndex::Table));
@@ -2013,26 +2028,138 @@ void DataIndex::generate_bb_stream_file() {
   this->bb_stream_file = sf;
 }
 
-void DataIndex::load_all() {
+void DataIndex::apply_log_levels() const {
+  if (this->is_debug) {
+    set_all_log_levels(phosg::LogLevel::L_DEBUG);
+  } else {
+    set_log_levels_from_json(this->config_json->get("LogLevels", phosg::JSON::dict()));
+  }
+}
+
+void DataIndex::load_all(bool update_log_levels) {
+  uint64_t start_time = phosg::now();
+
+  // Almost everything depends on the config, so it must be loaded first
   this->collect_network_addresses();
-  this->load_config_early();
-  this->load_bb_private_keys();
-  this->load_bb_system_defaults();
-  this->load_patch_indexes();
-  this->load_ep3_cards();
-  this->load_ep3_maps();
-  this->compile_functions();
-  this->load_dol_files();
-  this->load_set_data_tables();
-  this->load_maps();
-  this->load_battle_params();
-  this->load_level_tables();
-  this->load_text_index();
-  this->load_word_select_table();
-  this->load_item_definitions();
-  this->load_item_name_indexes();
-  this->load_drop_tables();
-  this->load_config_late();
-  this->load_quest_index();
-  this->generate_bb_stream_file();
+  this->load_config_early(update_log_levels);
+  uint64_t config_end_time = phosg::now();
+
+  // The remaining loaders each write only their own members, so they can run concurrently as long as each one starts
+  // only after the loaders whose members it reads have finished. Steps must be added after their dependencies.
+  struct LoadStep {
+    const char* name;
+    std::function<void()> fn;
+    std::vector<size_t> dependents;
+    size_t remaining_dependencies = 0;
+    uint64_t start_time = 0;
+    uint64_t end_time = 0;
+  };
+  std::vector<LoadStep> steps;
+  auto add_step = [&](const char* name, std::function<void()> fn, std::initializer_list<const char*> dependencies) {
+    size_t index = steps.size();
+    auto& step = steps.emplace_back(LoadStep{.name = name, .fn = std::move(fn)});
+    for (const char* dep_name : dependencies) {
+      auto dep_it = std::find_if(steps.begin(), steps.end(), [&](const LoadStep& s) {
+        return !strcmp(s.name, dep_name);
+      });
+      if (dep_it == steps.end() || (dep_it == steps.begin() + index)) {
+        throw std::logic_error(std::format("load step {} depends on unknown step {}", name, dep_name));
+      }
+      dep_it->dependents.emplace_back(index);
+      step.remaining_dependencies++;
+    }
+  };
+
+  add_step("bb-keys", [this]() { this->load_bb_private_keys(); }, {});
+  add_step("bb-defaults", [this]() { this->load_bb_system_defaults(); }, {});
+  add_step("patch-files", [this]() { this->load_patch_indexes(); }, {});
+  add_step("ep3-cards", [this]() { this->load_ep3_cards(); }, {});
+  add_step("ep3-maps", [this]() { this->load_ep3_maps(); }, {});
+  add_step("functions", [this]() { this->compile_functions(); }, {});
+  add_step("dol-files", [this]() { this->load_dol_files(); }, {});
+  add_step("battle-params", [this]() { this->load_battle_params(); }, {});
+  add_step("level-tables", [this]() { this->load_level_tables(); }, {});
+  add_step("item-definitions", [this]() { this->load_item_definitions(); }, {});
+  add_step("quests", [this]() { this->load_quest_index(); }, {});
+  add_step("set-tables", [this]() { this->load_set_data_tables(); }, {"patch-files"});
+  add_step("maps", [this]() { this->load_maps(); }, {"patch-files", "set-tables"});
+  add_step("text-index", [this]() { this->load_text_index(); }, {"patch-files"});
+  add_step("word-select", [this]() { this->load_word_select_table(); }, {"text-index"});
+  add_step("item-name-index", [this]() { this->load_item_name_indexes(); }, {"item-definitions", "text-index"});
+  add_step("drop-tables", [this]() { this->load_drop_tables(); }, {"item-name-index"});
+  add_step("config-late", [this]() { this->load_config_late(); }, {"ep3-cards", "item-name-index"});
+  add_step("bb-stream-file", [this]() { this->generate_bb_stream_file(); },
+      {"battle-params", "level-tables", "item-definitions"});
+
+  // The server's thread pool isn't necessarily running yet (and may be small, since it's sized for request handling),
+  // so use a temporary pool for loading
+  size_t num_threads = std::min<size_t>(
+      steps.size(), std::max<size_t>({1, this->num_worker_threads, std::thread::hardware_concurrency()}));
+  asio::thread_pool pool(num_threads);
+  std::mutex lock;
+  std::condition_variable step_done;
+  size_t num_running = 0;
+  std::exception_ptr first_exception;
+
+  // Must be called while holding lock
+  std::function<void(size_t)> start_step = [&](size_t index) -> void {
+    num_running++;
+    asio::post(pool, [&, index]() -> void {
+      auto& step = steps[index];
+      step.start_time = phosg::now();
+      std::exception_ptr exc;
+      try {
+        step.fn();
+      } catch (...) {
+        exc = std::current_exception();
+      }
+      step.end_time = phosg::now();
+
+      std::lock_guard g(lock);
+      num_running--;
+      if (exc) {
+        config_log.error_f("Failed to load {}", step.name);
+        if (!first_exception) {
+          first_exception = exc;
+        }
+      } else if (!first_exception) {
+        for (size_t dependent_index : step.dependents) {
+          if (--steps[dependent_index].remaining_dependencies == 0) {
+            start_step(dependent_index);
+          }
+        }
+      }
+      step_done.notify_all();
+    });
+  };
+
+  {
+    std::unique_lock g(lock);
+    for (size_t z = 0; z < steps.size(); z++) {
+      if (steps[z].remaining_dependencies == 0) {
+        start_step(z);
+      }
+    }
+    step_done.wait(g, [&]() -> bool { return num_running == 0; });
+  }
+  pool.join();
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+
+  uint64_t end_time = phosg::now();
+  uint64_t total_step_usecs = 0;
+  for (const auto& step : steps) {
+    uint64_t step_usecs = step.end_time - step.start_time;
+    total_step_usecs += step_usecs;
+    config_log.info_f("Load timing: {} took {} (started at +{})",
+        step.name, phosg::format_duration(step_usecs), phosg::format_duration(step.start_time - config_end_time));
+  }
+  config_log.info_f("Load timing: config took {}; {} loaders took {} on {} threads ({} total); {} overall",
+      phosg::format_duration(config_end_time - start_time),
+      steps.size(),
+      phosg::format_duration(end_time - config_end_time),
+      num_threads,
+      phosg::format_duration(total_step_usecs),
+      phosg::format_duration(end_time - start_time));
 }
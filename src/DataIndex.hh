@@ -105,6 +105,7 @@ struct DataIndex {
   bool one_time_config_loaded = false;
 
   size_t num_worker_threads = 0;
+  std::string save_database_filename; // Empty = use individual files
 
   std::string name;
   std::unordered_map<std::string, PortConfiguration> name_to_port_config;
@@ -119,6 +120,7 @@ struct DataIndex {
   uint64_t client_ping_interval_usecs = 30000000;
   uint64_t client_idle_timeout_usecs = 60000000;
   uint64_t patch_client_idle_timeout_usecs = 300000000;
+  uint64_t team_save_interval_usecs = 10000000;
   bool is_debug = false;
   bool ip_stack_debug = false;
   bool allow_unregistered_users = false;
@@ -129,7 +131,7 @@ struct DataIndex {
   bool enable_chat_commands = true;
   char chat_command_sentinel = '\0'; // 0 = default (@ on 11/2000; $ on all other versions)
   size_t num_backup_character_slots = 16;
-  std::unique_ptr<std::array<uint32_t, NUM_NON_PATCH_VERSIONS>> version_name_colors;
+  std::shared_ptr<const std::array<uint32_t, NUM_NON_PATCH_VERSIONS>> version_name_colors;
   uint32_t client_customization_name_color = 0x00000000;
   uint8_t allowed_drop_modes_v1_v2_normal = 0x1F;
   uint8_t allowed_drop_modes_v1_v2_battle = 0x07;
@@ -154,6 +156,7 @@ struct DataIndex {
   std::unordered_map<uint16_t, IntegralExpression> quest_flag_rewrites_v4;
   std::unordered_map<std::string, std::pair<uint8_t, uint32_t>> quest_counter_fields; // For $qfread command
   uint64_t persistent_game_idle_timeout_usecs = 0;
+  bool fast_join_sync_compression = false;
   std::unordered_map<uint32_t, int64_t> enable_send_function_call_quest_numbers;
   bool enable_v3_v4_protected_subcommands = false;
   bool ep3_infinite_meseta = false;
@@ -186,7 +189,7 @@ struct DataIndex {
   std::shared_ptr<const PatchFileIndex> bb_patch_file_index;
   std::unordered_map<uint64_t, std::shared_ptr<const MapFile>> map_file_for_source_hash;
   std::map<uint32_t, std::array<std::shared_ptr<const MapFile>, NUM_VERSIONS>> map_files_for_free_play_key;
-  std::unordered_map<uint64_t, std::shared_ptr<const SuperMap>> supermap_for_source_hash_sum;
+  // Contains all valid free play keys; populated by load_maps and not modified afterward
   std::unordered_map<uint32_t, std::shared_ptr<const SuperMap>> supermap_for_free_play_key;
   std::shared_ptr<const RoomLayoutIndex> room_layout_index;
   std::shared_ptr<const BBStreamFile> bb_stream_file;
@@ -378,12 +381,14 @@ struct DataIndex {
         (static_cast<uint32_t>(entities) << 0);
   }
   std::shared_ptr<const SuperMap> get_free_play_supermap(
-      Episode episode, GameMode mode, Difficulty difficulty, uint8_t floor, uint32_t layout, uint32_t entities);
+      Episode episode, GameMode mode, Difficulty difficulty, uint8_t floor, uint32_t layout, uint32_t entities) const;
   std::vector<std::shared_ptr<const SuperMap>> supermaps_for_variations(
-      Episode episode, GameMode mode, Difficulty difficulty, const Variations& variations);
+      Episode episode, GameMode mode, Difficulty difficulty, const Variations& variations) const;
 
   void collect_network_addresses();
-  void load_config_early();
+  // The loggers are global, so when the server is running, load_config_early and load_all must be called with
+  // update_log_levels = false (ServerState::reload_data calls apply_log_levels afterward, on the io thread)
+  void load_config_early(bool update_log_levels = true);
   void load_config_late();
   void load_bb_private_keys();
   void load_bb_system_defaults();
@@ -408,5 +413,7 @@ struct DataIndex {
   void load_dol_files();
   void generate_bb_stream_file();
 
-  void load_all();
+  void load_all(bool update_log_levels = true);
+
+  void apply_log_levels() const;
 };
@@ -0,0 +1,182 @@
+#include "FileWriteQueue.hh"
+
+#include <filesystem>
+#include <phosg/Filesystem.hh>
+#include <phosg/Time.hh>
+
+#include "Loggers.hh"
+
+FileWriteQueue file_write_queue;
+
+phosg::JSON FileWriteQueue::Stats::json() const {
+  return phosg::JSON::dict({
+      {"QueueDepth", this->queue_depth},
+      {"MaxQueueDepth", this->max_queue_depth},
+      {"EnqueuedCount", this->enqueued_count},
+      {"CoalescedCount", this->coalesced_count},
+      {"CompletedCount", this->completed_count},
+      {"FailedCount", this->failed_count},
+      {"BytesWritten", this->bytes_written},
+      {"TotalWriteUsecs", this->total_write_usecs},
+      {"MaxWriteUsecs", this->max_write_usecs},
+      {"TotalLatencyUsecs", this->total_latency_usecs},
+      {"MaxLatencyUsecs", this->max_latency_usecs},
+  });
+}
+
+FileWriteQueue::~FileWriteQueue() {
+  this->stop();
+}
+
+void FileWriteQueue::start() {
+  std::lock_guard g(this->lock);
+  if (this->running) {
+    return;
+  }
+  this->should_exit = false;
+  this->running = true;
+  this->writer_thread = std::thread(&FileWriteQueue::writer_thread_fn, this);
+}
+
+void FileWriteQueue::stop() {
+  {
+    std::lock_guard g(this->lock);
+    if (!this->running) {
+      return;
+    }
+    this->should_exit = true;
+  }
+  this->work_available.notify_all();
+  this->writer_thread.join();
+
+  std::lock_guard g(this->lock);
+  this->running = false;
+  player_data_log.info_f("Save queue stopped after {} writes ({} coalesced, {} failed)",
+      this->current_stats.completed_count, this->current_stats.coalesced_count, this->current_stats.failed_count);
+}
+
+void FileWriteQueue::write(const std::string& filename, std::string&& data) {
+  this->enqueue(filename, std::move(data), false);
+}
+
+void FileWriteQueue::append(const std::string& filename, std::string&& data) {
+  this->enqueue(filename, std::move(data), true);
+}
+
+void FileWriteQueue::remove(const std::string& filename) {
+  this->enqueue(filename, std::nullopt, false);
+}
+
+void FileWriteQueue::enqueue(const std::string& filename, std::optional<std::string>&& data, bool append) {
+  uint64_t now = phosg::now();
+  {
+    std::lock_guard g(this->lock);
+    this->current_stats.enqueued_count++;
+    if (this->running) {
+      auto it = this->pending_ops.find(filename);
+      if (it != this->pending_ops.end()) {
+        // The writer hasn't started on the previous operation for this file yet, so just replace it (or for appends,
+        // add to it; appending to a pending write or delete results in a write). The enqueue time is intentionally not
+        // updated, so latency is measured from the oldest write that this one supersedes.
+        if (append && it->second.data) {
+          it->second.data->append(*data);
+        } else {
+          it->second.data = std::move(data);
+          it->second.append = false;
+        }
+        this->current_stats.coalesced_count++;
+      } else {
+        this->pending_ops.emplace(filename, PendingOperation{std::move(data), append, now});
+        this->queue.emplace_back(filename);
+        this->current_stats.queue_depth = this->queue.size();
+        this->current_stats.max_queue_depth = std::max(this->current_stats.max_queue_depth, this->queue.size());
+      }
+      this->work_available.notify_one();
+      return;
+    }
+  }
+
+  // The writer thread isn't running, so do the operation synchronously
+  this->execute(filename, data, append, now);
+}
+
+void FileWriteQueue::wait_for(const std::string& filename) {
+  std::unique_lock g(this->lock);
+  this->work_done.wait(g, [&]() -> bool {
+    return !this->pending_ops.count(filename) && (this->current_filename != filename);
+  });
+}
+
+void FileWriteQueue::flush() {
+  std::unique_lock g(this->lock);
+  this->work_done.wait(g, [&]() -> bool {
+    return this->queue.empty() && this->current_filename.empty();
+  });
+}
+
+FileWriteQueue::Stats FileWriteQueue::stats() const {
+  std::lock_guard g(this->lock);
+  return this->current_stats;
+}
+
+void FileWriteQueue::writer_thread_fn() {
+  std::unique_lock g(this->lock);
+  for (;;) {
+    this->work_available.wait(g, [&]() -> bool {
+      return this->should_exit || !this->queue.empty();
+    });
+    if (this->queue.empty()) {
+      break; // should_exit must be true
+    }
+
+    this->current_filename = std::move(this->queue.front());
+    this->queue.pop_front();
+    this->current_stats.queue_depth = this->queue.size();
+    auto op_it = this->pending_ops.find(this->current_filename);
+    PendingOperation op = std::move(op_it->second);
+    this->pending_ops.erase(op_it);
+
+    g.unlock();
+    try {
+      this->execute(this->current_filename, op.data, op.append, op.enqueue_time);
+    } catch (const std::exception& e) {
+      player_data_log.error_f("Failed to save {}: {}", this->current_filename, e.what());
+    }
+    g.lock();
+
+    this->current_filename.clear();
+    this->work_done.notify_all();
+  }
+}
+
+void FileWriteQueue::execute(
+    const std::string& filename, const std::optional<std::string>& data, bool append, uint64_t enqueue_time) {
+  uint64_t start_time = phosg::now();
+  try {
+    if (append) {
+      auto f = phosg::fopen_unique(filename, "ab");
+      phosg::fwritex(f.get(), *data);
+    } else if (data) {
+      std::string temp_filename = filename + ".tmp";
+      phosg::save_file(temp_filename, *data);
+      std::filesystem::rename(temp_filename, filename);
+    } else {
+      std::filesystem::remove(filename);
+    }
+  } catch (const std::exception&) {
+    std::lock_guard g(this->lock);
+    this->current_stats.failed_count++;
+    throw;
+  }
+  uint64_t end_time = phosg::now();
+
+  std::lock_guard g(this->lock);
+  uint64_t write_usecs = end_time - start_time;
+  uint64_t latency_usecs = end_time - enqueue_time;
+  this->current_stats.completed_count++;
+  this->current_stats.bytes_written += data ? data->size() : 0;
+  this->current_stats.total_write_usecs += write_usecs;
+  this->current_stats.max_write_usecs = std::max(this->current_stats.max_write_usecs, write_usecs);
+  this->current_stats.total_latency_usecs += latency_usecs;
+  this->current_stats.max_latency_usecs = std::max(this->current_stats.max_latency_usecs, latency_usecs);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <phosg/JSON.hh>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Writes (and deletes) files on a background thread, so slow disks don't stall the game thread. Callers serialize the
+// data on their own thread and pass the result here. If a file is written again before the writer has started on the
+// previous write for it, the previous write is replaced rather than performed, so frequently-saved files are written
+// at most once per writer pass. Operations on the same file always complete in the order they were enqueued. Files
+// are written to a temporary name and renamed into place, so a crash never leaves a truncated file behind. Appends are
+// the exception: they're written directly to the end of the existing file, and pending appends to the same file are
+// combined instead of replaced.
+//
+// Until start() is called (and after stop() returns), all operations are performed synchronously on the calling
+// thread and exceptions propagate to the caller. This is the case in replays and in CLI actions.
+class FileWriteQueue {
+public:
+  struct Stats {
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    uint64_t enqueued_count = 0;
+    uint64_t coalesced_count = 0;
+    uint64_t completed_count = 0;
+    uint64_t failed_count = 0;
+    uint64_t bytes_written = 0;
+    uint64_t total_write_usecs = 0; // Time spent doing disk I/O
+    uint64_t max_write_usecs = 0;
+    uint64_t total_latency_usecs = 0; // Time from (first) enqueue to completion
+    uint64_t max_latency_usecs = 0;
+
+    phosg::JSON json() const;
+  };
+
+  FileWriteQueue() = default;
+  FileWriteQueue(const FileWriteQueue&) = delete;
+  FileWriteQueue(FileWriteQueue&&) = delete;
+  FileWriteQueue& operator=(const FileWriteQueue&) = delete;
+  FileWriteQueue& operator=(FileWriteQueue&&) = delete;
+  ~FileWriteQueue();
+
+  void start();
+  // Completes all pending operations, then stops the writer thread. This is the shutdown barrier; after it returns,
+  // everything that was enqueued is on disk.
+  void stop();
+
+  void write(const std::string& filename, std::string&& data);
+  void append(const std::string& filename, std::string&& data);
+  void remove(const std::string& filename);
+
+  // Blocks until there are no pending operations for the given file. This must be called before reading any file
+  // that may have been written via this queue.
+  void wait_for(const std::string& filename);
+  // Blocks until all pending operations are complete
+  void flush();
+
+  Stats stats() const;
+
+private:
+  struct PendingOperation {
+    std::optional<std::string> data; // Missing = delete the file
+    bool append;
+    uint64_t enqueue_time;
+  };
+
+  mutable std::mutex lock;
+  std::condition_variable work_available;
+  std::condition_variable work_done;
+  std::deque<std::string> queue; // Filenames, in order of first enqueue
+  std::unordered_map<std::string, PendingOperation> pending_ops; // Not yet started
+  std::string current_filename; // Empty if writer is idle
+  std::thread writer_thread;
+  bool running = false;
+  bool should_exit = false;
+  Stats current_stats;
+
+  void enqueue(const std::string& filename, std::optional<std::string>&& data, bool append);
+  void writer_thread_fn();
+  void execute(const std::string& filename, const std::optional<std::string>& data, bool append, uint64_t enqueue_time);
+};
+
+// Used by FilesystemSaveStore for all account, team, and player data writes
+extern FileWriteQueue file_write_queue;
@@ -44,11 +44,27 @@ std::shared_ptr<Client> GameServer::connect_channel(std::shared_ptr<Channel> ch,
 
   this->log.info_f("Client connected: C-{:X} via TSI-{}-{}-{}",
       c->id, port, phosg::name_for_enum(ch->version), phosg::name_for_enum(initial_state));
+  c->channel->record_metrics = true;
+  this->start_capture(c, port);
 
   asio::co_spawn(*this->io_context, this->handle_connected_client(c), asio::detached);
   return c;
 }
 
+void GameServer::start_capture(std::shared_ptr<Client> c, uint16_t port) {
+  if (!this->state->replay_capture) {
+    return;
+  }
+  c->channel->capture = this->state->replay_capture;
+  c->channel->capture_client_id = c->id;
+  c->channel->capture->add_event(ReplayCaptureEvent{
+      .type = ReplayCaptureEvent::Type::CONNECT,
+      .client_id = c->id,
+      .timestamp = phosg::now(),
+      .port = port,
+      .version = c->channel->version});
+}
+
 std::shared_ptr<Client> GameServer::get_client() const {
   if (this->clients.empty()) {
     throw std::runtime_error("no clients on game server");
@@ -133,6 +149,8 @@ std::shared_ptr<Client> GameServer::create_client(
       false);
   auto c = std::make_shared<Client>(this->shared_from_this(), channel, listen_sock->behavior);
   this->log.info_f("Client connected: C-{:X} via {}", c->id, listen_sock->name);
+  c->channel->record_metrics = true;
+  this->start_capture(c, listen_sock->endpoint.port());
 
   this->state->client_for_id.emplace(c->id, c);
   return c;
@@ -159,13 +177,20 @@ asio::awaitable<void> GameServer::handle_client(std::shared_ptr<Client> c) {
   }
 
   while (c->channel->connected()) {
-    auto msg = std::make_unique<Channel::Message>(co_await c->channel->recv());
+    auto msg = co_await c->channel->recv_pooled();
     asio::co_spawn(co_await asio::this_coro::executor, this->handle_client_command(c, std::move(msg)), asio::detached);
   }
 }
 
 asio::awaitable<void> GameServer::destroy_client(std::shared_ptr<Client> c) {
   this->log.info_f("Running cleanup tasks for {}", c->channel->name);
+  if (c->channel->capture) {
+    c->channel->capture->add_event(ReplayCaptureEvent{
+        .type = ReplayCaptureEvent::Type::DISCONNECT,
+        .client_id = c->channel->capture_client_id,
+        .timestamp = phosg::now()});
+    c->channel->capture.reset();
+  }
 
   // The client may not actually be disconnected yet if an uncaught exception occurred in a handler task
   c->channel->disconnect();
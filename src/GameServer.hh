@@ -39,6 +39,8 @@ protected:
   std::shared_ptr<ServerState> state;
 
   asio::awaitable<void> handle_client_command(std::shared_ptr<Client> c, std::unique_ptr<Channel::Message> msg);
+  // Attaches the client's channel to state->replay_capture, if it's set
+  void start_capture(std::shared_ptr<Client> c, uint16_t port);
 
   [[nodiscard]] virtual std::shared_ptr<Client> create_client(
       std::shared_ptr<GameServerSocket> listen_sock, asio::ip::tcp::socket&& client_sock);
@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 
+#include "CommandMetrics.hh"
+#include "FileWriteQueue.hh"
 #include "GameServer.hh"
 #include "IPStackSimulator.hh"
 #include "Loggers.hh"
@@ -630,6 +632,20 @@ HTTPServer::HTTPServer(std::shared_ptr<ServerState> state)
     co_return res;
   });
 
+  this->router.add(HTTPRequest::Method::GET, "/y/teams/ranking", [this](ArgsT&&) -> RetT {
+    auto res = std::make_shared<phosg::JSON>(phosg::JSON::list());
+    for (const auto& team : this->state->team_index->ranking()) {
+      res->emplace_back(phosg::JSON::dict({
+          {"TeamID", team->team_id},
+          {"Name", team->name},
+          {"Points", team->points},
+          {"SpentPoints", team->spent_points},
+          {"MemberCount", team->num_members()},
+      }));
+    }
+    co_return res;
+  });
+
   this->router.add(HTTPRequest::Method::GET, "/y/team/:team_id", [this](ArgsT&& args) -> RetT {
     uint32_t team_id = args.get_param<uint32_t>("team_id");
     auto team = this->state->team_index->get_by_id(team_id);
@@ -673,6 +689,7 @@ HTTPServer::HTTPServer(std::shared_ptr<ServerState> state)
         {"ClientCount", this->state->game_server->all_clients().size() - ProxySession::num_proxy_sessions},
         {"ProxySessionCount", ProxySession::num_proxy_sessions},
         {"ServerName", this->state->data->name},
+        {"SaveQueue", file_write_queue.stats().json()},
     });
   };
 
@@ -680,6 +697,11 @@ HTTPServer::HTTPServer(std::shared_ptr<ServerState> state)
     co_return std::make_shared<phosg::JSON>(generate_server_info_json());
   });
 
+  this->router.add(HTTPRequest::Method::GET, "/y/metrics", [](ArgsT&&) -> RetT {
+    co_return RawResponse{
+        .content_type = "text/plain; version=0.0.4", .filename = "", .data = command_metrics.prometheus_text()};
+  });
+
   this->router.add(HTTPRequest::Method::GET, "/y/config", [this](ArgsT&&) -> RetT {
     co_return this->state->data->config_json;
   });
@@ -982,7 +1004,8 @@ HTTPServer::HTTPServer(std::shared_ptr<ServerState> state)
   this->router.add(HTTPRequest::Method::GET, "/y/data/quest/:quest_num/:version/:language/json", [get_quest_version](ArgsT&& args) -> RetT {
     co_return get_quest_version(args)->json_contents;
   });
-  this->router.add(HTTPRequest::Method::GET, "/y/data/quest/:quest_num/:version/:language/:ext", [get_quest_version, encode_quest_file](ArgsT&& args) -> RetT {
+  this->router.add(HTTPRequest::Method::GET, "/y/data/quest/:quest_num/:version/:language/:ext", [this, get_quest_version, encode_quest_file](ArgsT&& args) -> RetT {
+    auto quest_index = this->state->data->quest_index;
     auto vq = get_quest_version(args);
     auto ext = args.params.at("ext");
     std::shared_ptr<const std::string> contents;
@@ -992,6 +1015,13 @@ HTTPServer::HTTPServer(std::shared_ptr<ServerState> state)
       contents = vq->dat_contents;
     } else if (ext == "pvr") {
       contents = vq->pvr_contents;
+    } else if ((ext == "qst") || (ext == "download-qst")) {
+      bool is_download = (ext == "download-qst");
+      contents = co_await call_on_thread_pool(
+          *this->state->thread_pool, [quest_index, vq, is_download]() -> std::shared_ptr<const std::string> {
+            return quest_index->qst_data(vq, is_download);
+          });
+      co_return encode_quest_file(contents, std::format("quest{}.qst", vq->meta.quest_number));
     } else {
       throw HTTPError(400, "Invalid quest file type");
     }
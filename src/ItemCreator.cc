@@ -332,8 +332,8 @@ ItemCreator::DropResult ItemCreator::on_monster_item_drop(EnemyType enemy_type,
 }
 
 ItemData ItemCreator::check_rare_specs_and_create_rare_item(
-    const std::vector<RareItemSet::ExpandedDrop>& specs, uint8_t area, bool force_rare) {
-  if (specs.empty()) {
+    std::span<const RareItemSet::CompiledDrop> drops, uint8_t area, bool force_rare) {
+  if (drops.empty()) {
     return ItemData();
   }
 
@@ -343,25 +343,27 @@ ItemData ItemCreator::check_rare_specs_and_create_rare_item(
   // actually more rare than they should be. In the original client, this only matters for boxes, because enemies could
   // not have multiple specs. Also, the original code uses 0xFFFFFFFF as the maximum here; we use 0x100000000 instead,
   // which makes all rare items SLIGHTLY more rare.
-  int64_t det = force_rare ? 0 : this->rand_int(0x100000000);
+  uint64_t det = force_rare ? 0 : this->rand_int(0x100000000);
   if (this->is_legacy_replay) {
     // For some old tests, we waste a few replay values because they used the old (non-stacked) logic. New tests should
     // not use this codepath.
-    for (size_t z = 1; z < specs.size(); z++) {
+    for (size_t z = 1; z < drops.size(); z++) {
       this->rand_int(0x100000000);
     }
   }
-  this->log.info_f("{} specs to check with det={:08X}", specs.size(), det);
-  for (const auto& spec : specs) {
-    if (this->log.should_log(phosg::LogLevel::L_INFO)) {
-      this->log.info_f("Checking spec {:08X} => {} with det={:08X}", spec.probability, spec.data.hex(), det);
-    }
-    det -= spec.probability;
-    if (det < 0) {
-      return this->create_rare_item(spec.data, area);
+  this->log.info_f("{} specs to check with det={:08X}", drops.size(), det);
+
+  // The chosen drop is the first one whose cumulative probability is greater than det
+  auto it = std::upper_bound(drops.begin(), drops.end(), det,
+      [](uint64_t value, const RareItemSet::CompiledDrop& drop) -> bool { return value < drop.cumulative_probability; });
+  if (this->log.should_log(phosg::LogLevel::L_INFO)) {
+    for (auto log_it = drops.begin(); log_it != ((it == drops.end()) ? it : (it + 1)); log_it++) {
+      uint64_t remaining_det = det - (log_it->cumulative_probability - log_it->drop.probability);
+      this->log.info_f("Checking spec {:08X} => {} with det={:08X}",
+          log_it->drop.probability, log_it->drop.data.hex(), remaining_det);
     }
   }
-  return ItemData();
+  return (it == drops.end()) ? ItemData() : this->create_rare_item(it->drop.data, area);
 }
 
 ItemData ItemCreator::check_rare_specs_and_create_rare_box_item(uint8_t area, bool force_rare) {
@@ -371,8 +373,8 @@ ItemData ItemCreator::check_rare_specs_and_create_rare_box_item(uint8_t area, bo
 
   uint8_t table_index = this->table_index_for_area(area);
   Episode episode = episode_for_area(area);
-  auto specs = this->rare_item_set->get_box_specs(this->mode, episode, this->difficulty, this->section_id, table_index);
-  return this->check_rare_specs_and_create_rare_item(specs, area, force_rare);
+  auto drops = this->rare_item_set->box_drops(this->mode, episode, this->difficulty, this->section_id, table_index);
+  return this->check_rare_specs_and_create_rare_item(drops, area, force_rare);
 }
 
 uint32_t ItemCreator::rand_int(uint64_t max) {
@@ -414,9 +416,8 @@ ItemData ItemCreator::check_rare_spec_and_create_rare_enemy_item(EnemyType enemy
   // can have multiple rare drops if JSONRareItemSet is used (the other RareItemSet implementations never return
   // multiple drops for an enemy type).
   Episode episode = episode_for_area(area);
-  auto specs = this->rare_item_set->get_enemy_specs(
-      this->mode, episode, this->difficulty, this->section_id, enemy_type);
-  return this->check_rare_specs_and_create_rare_item(specs, area, force_rare);
+  auto drops = this->rare_item_set->enemy_drops(this->mode, episode, this->difficulty, this->section_id, enemy_type);
+  return this->check_rare_specs_and_create_rare_item(drops, area, force_rare);
 }
 
 ItemData ItemCreator::create_rare_item(const ItemData& drop_item, uint8_t area) {
@@ -131,7 +131,7 @@ private:
   ItemData check_rare_spec_and_create_rare_enemy_item(EnemyType enemy_type, uint8_t area, bool force_rare);
   ItemData check_rare_specs_and_create_rare_box_item(uint8_t area, bool force_rare);
   ItemData check_rare_specs_and_create_rare_item(
-      const std::vector<RareItemSet::ExpandedDrop>& specs, uint8_t area, bool force_rare);
+      std::span<const RareItemSet::CompiledDrop> drops, uint8_t area, bool force_rare);
   ItemData create_rare_item(const ItemData& drop_item, uint8_t area);
 
   void generate_rare_weapon_bonuses(ItemData& item, Episode episode, uint32_t random_sample);
@@ -0,0 +1,723 @@
+#include "LoadTestSession.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <phosg/Encoding.hh>
+#include <phosg/Network.hh>
+#include <phosg/Random.hh>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+
+#include "EnemyType.hh"
+#include "GameServer.hh"
+#include "Loggers.hh"
+#include "Menu.hh"
+#include "PSOProtocol.hh"
+#include "Text.hh"
+
+static const char* name_for_operation(LoadTestStats::Operation op) {
+  switch (op) {
+    case LoadTestStats::Operation::LOGIN:
+      return "login";
+    case LoadTestStats::Operation::CREATE_GAME:
+      return "create-game";
+    case LoadTestStats::Operation::MOVE:
+      return "move";
+    case LoadTestStats::Operation::KILL_ENEMY:
+      return "kill-enemy";
+    case LoadTestStats::Operation::PICK_UP_ITEM:
+      return "pick-up-item";
+    case LoadTestStats::Operation::LEAVE_GAME:
+      return "leave-game";
+  }
+  throw std::logic_error("invalid load test operation");
+}
+
+void LoadTestStats::print(FILE* stream, uint64_t elapsed_usecs) const {
+  double elapsed_secs = static_cast<double>(std::max<uint64_t>(elapsed_usecs, 1)) / 1000000.0;
+  phosg::fwrite_fmt(stream, "Load test ran for {} with {} clients\n",
+      phosg::format_duration(elapsed_usecs), this->num_clients);
+  phosg::fwrite_fmt(stream, "Clients: {} logged in, {} finished, {} failed\n",
+      this->clients_logged_in, this->clients_finished, this->clients_failed);
+  phosg::fwrite_fmt(stream, "Games: {} created, {} enemies killed, {} items dropped, {} items picked up\n",
+      this->games_created, this->enemies_killed, this->items_dropped, this->items_picked_up);
+  phosg::fwrite_fmt(stream, "Commands: {} sent ({:.1f}/sec), {} received ({:.1f}/sec)\n",
+      this->commands_sent, static_cast<double>(this->commands_sent) / elapsed_secs,
+      this->commands_received, static_cast<double>(this->commands_received) / elapsed_secs);
+  phosg::fwrite_fmt(stream, "Bytes: {} sent, {} received\n",
+      phosg::format_size(this->bytes_sent), phosg::format_size(this->bytes_received));
+
+  phosg::fwrite_fmt(stream, "{:<14} {:>10} {:>12} {:>12} {:>12}\n", "OPERATION", "COUNT", "P50", "P99", "MAX");
+  for (size_t z = 0; z < NUM_OPERATIONS; z++) {
+    std::vector<uint64_t> sorted = this->latencies_usecs[z];
+    const char* name = name_for_operation(static_cast<Operation>(z));
+    if (sorted.empty()) {
+      phosg::fwrite_fmt(stream, "{:<14} {:>10} {:>12} {:>12} {:>12}\n", name, 0, "-", "-", "-");
+      continue;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    phosg::fwrite_fmt(stream, "{:<14} {:>10} {:>12} {:>12} {:>12}\n",
+        name,
+        sorted.size(),
+        phosg::format_duration(sorted[((sorted.size() - 1) * 50) / 100]),
+        phosg::format_duration(sorted[((sorted.size() - 1) * 99) / 100]),
+        phosg::format_duration(sorted.back()));
+  }
+}
+
+LoadTestSession::LoadTestSession(
+    std::shared_ptr<asio::io_context> io_context,
+    std::shared_ptr<const DataIndex> data,
+    std::shared_ptr<ServerState> local_state,
+    const std::string& remote_host,
+    std::shared_ptr<LoadTestStats> stats,
+    Version version,
+    size_t client_index,
+    uint64_t start_delay_usecs,
+    uint64_t end_time,
+    uint64_t step_usecs,
+    size_t kills_per_game)
+    : io_context(io_context),
+      data(data),
+      local_state(local_state),
+      remote_host(remote_host),
+      stats(stats),
+      version(version),
+      client_index(client_index),
+      start_delay_usecs(start_delay_usecs),
+      end_time(end_time),
+      step_usecs(step_usecs),
+      kills_per_game(kills_per_game),
+      log(std::format("[LoadTestSession:{}:{}] ", client_index, phosg::name_for_enum(version)),
+          proxy_server_log.min_level),
+      rand(0x4C540000 + client_index),
+      serial_number(0x4C540000 + client_index),
+      access_key(is_v1_or_v2(version) ? "12345678" : "123456789012"),
+      password("load-test"),
+      hardware_id(generate_random_hardware_id(version)),
+      prev_cmd_data(0),
+      client_config(0) {
+  switch (version) {
+    case Version::DC_V2:
+    case Version::PC_V2:
+    case Version::GC_V3:
+    case Version::XB_V3:
+      break;
+    default:
+      throw std::runtime_error("unsupported version for load testing");
+  }
+
+  PlayerVisualConfigV4 visual;
+  visual.name.encode(std::format("LT{}", client_index), Language::ENGLISH);
+  visual.sh.char_class = client_index % (is_v1_or_v2(version) ? 9 : 12);
+  visual.sh.section_id = client_index % 10;
+  this->character = PSOBBCharacterFile::create_from_config(
+      this->serial_number, Language::ENGLISH, visual, this->data->level_table(version));
+}
+
+asio::awaitable<void> LoadTestSession::connect(uint16_t port) {
+  if (this->channel) {
+    this->channel->disconnect();
+  }
+
+  std::string name = std::format("LT-{}", this->client_index);
+  if (this->local_state) {
+    const auto& port_config = this->data->number_to_port_config.at(port);
+    auto client_channel = std::make_shared<PeerChannel>(
+        this->io_context, this->version, Language::ENGLISH, name,
+        phosg::TerminalFormat::END, phosg::TerminalFormat::END, false, false);
+    auto server_channel = std::make_shared<PeerChannel>(
+        this->io_context, port_config.version, Language::ENGLISH, "",
+        phosg::TerminalFormat::END, phosg::TerminalFormat::END, false, false);
+    PeerChannel::link_peers(client_channel, server_channel);
+    this->local_state->game_server->connect_channel(server_channel, port, port_config.behavior);
+    this->channel = client_channel;
+
+  } else {
+    auto sock = std::make_unique<asio::ip::tcp::socket>(co_await async_connect_tcp(this->remote_host, port));
+    this->channel = SocketChannel::create(
+        this->io_context,
+        std::move(sock),
+        this->version,
+        Language::ENGLISH,
+        name,
+        phosg::TerminalFormat::END,
+        phosg::TerminalFormat::END,
+        false,
+        false);
+  }
+}
+
+asio::awaitable<void> LoadTestSession::run() {
+  if (this->start_delay_usecs) {
+    co_await async_sleep(std::chrono::microseconds(this->start_delay_usecs));
+  }
+
+  try {
+    uint64_t login_start = phosg::now();
+    co_await this->connect(this->data->game_server_port_for_version(this->version));
+    co_await this->recv_until(0x67);
+    this->stats->add_latency(Operation::LOGIN, phosg::now() - login_start);
+    this->stats->clients_logged_in++;
+
+    while (this->channel->connected() && (phosg::now() < this->end_time)) {
+      co_await this->play_game();
+    }
+    this->channel->disconnect();
+    this->stats->clients_finished++;
+
+  } catch (const std::exception& e) {
+    this->log.warning_f("Session failed: {}", e.what());
+    if (this->channel) {
+      this->channel->disconnect();
+    }
+    this->stats->clients_failed++;
+  }
+}
+
+void LoadTestSession::send(uint16_t command, uint32_t flag, const void* data, size_t size) {
+  this->channel->send(command, flag, data, size);
+  this->stats->commands_sent++;
+  this->stats->bytes_sent += size + 4;
+}
+
+void LoadTestSession::send_93_9D_9E(bool extended) {
+  std::string name = this->character->disp.visual.name.decode();
+  if (is_v2(this->version)) {
+    C_LoginExtended_PC_9D ret;
+    ret.player_tag = this->guild_card_number ? 0xFFFF0000 : 0x00010000;
+    ret.guild_card_number = this->guild_card_number;
+    ret.hardware_id = this->hardware_id;
+    ret.sub_version = default_sub_version_for_version(this->version);
+    ret.is_extended = extended ? 1 : 0;
+    ret.language = Language::ENGLISH;
+    ret.serial_number.encode(std::format("{:08X}", this->serial_number));
+    ret.access_key.encode(this->access_key);
+    ret.serial_number2 = ret.serial_number;
+    ret.access_key2 = ret.access_key;
+    ret.login_character_name.encode(name);
+    size_t data_size = extended
+        ? ((this->version == Version::PC_V2) ? sizeof(ret) : sizeof(C_LoginExtended_DC_GC_9D))
+        : sizeof(C_Login_DC_PC_GC_9D);
+    this->send(0x9D, 0x01, &ret, data_size);
+
+  } else if (this->version == Version::GC_V3) {
+    C_LoginExtended_GC_9E ret;
+    ret.player_tag = this->guild_card_number ? 0xFFFF0000 : 0x00010000;
+    ret.guild_card_number = this->guild_card_number;
+    ret.hardware_id = this->hardware_id;
+    ret.sub_version = default_sub_version_for_version(this->version);
+    ret.is_extended = extended ? 1 : 0;
+    ret.language = Language::ENGLISH;
+    ret.serial_number.encode(std::format("{:08X}", this->serial_number));
+    ret.access_key.encode(this->access_key);
+    ret.serial_number2 = ret.serial_number;
+    ret.access_key2 = ret.access_key;
+    ret.login_character_name.encode(name);
+    ret.client_config = this->client_config;
+    this->send(0x9E, 0x01, &ret, extended ? sizeof(ret) : sizeof(C_Login_PC_GC_9E));
+
+  } else if (this->version == Version::XB_V3) {
+    C_LoginExtended_XB_9E ret;
+    ret.player_tag = this->guild_card_number ? 0xFFFF0000 : 0x00010000;
+    ret.guild_card_number = this->guild_card_number;
+    ret.hardware_id = this->hardware_id;
+    ret.sub_version = default_sub_version_for_version(this->version);
+    ret.is_extended = extended ? 1 : 0;
+    ret.language = Language::ENGLISH;
+    ret.serial_number.encode(std::format("LoadTest{}", this->client_index));
+    ret.access_key.encode(std::format("{:016X}", 0x0009000000000000 | this->serial_number));
+    ret.serial_number2 = ret.serial_number;
+    ret.access_key2 = ret.access_key;
+    ret.login_character_name.encode(name);
+    ret.xb_netloc.internal_ipv4_address = this->rand.next();
+    ret.xb_netloc.external_ipv4_address = this->rand.next();
+    ret.xb_netloc.port = 9500;
+    ret.xb_netloc.mac_address.clear(0);
+    ret.xb_netloc.sg_ip_address = this->rand.next();
+    ret.xb_netloc.spi = this->rand.next();
+    ret.xb_netloc.account_id = 0x0009100000000000 | this->serial_number;
+    ret.xb_netloc.unknown_a3.clear(0);
+    ret.xb_user_id_high = 0x00090000;
+    ret.xb_user_id_low = this->serial_number;
+    this->send(0x9E, 0x01, &ret, extended ? sizeof(ret) : sizeof(C_Login_DC_PC_GC_9D));
+
+  } else {
+    throw std::runtime_error("unsupported version");
+  }
+}
+
+void LoadTestSession::send_61_98(bool is_98) {
+  uint8_t command = is_98 ? 0x98 : 0x61;
+  auto disp = convert_player_disp_data<PlayerDispDataV123, PlayerDispDataV4>(
+      this->character->disp, Language::ENGLISH, Language::ENGLISH);
+
+  if (this->version == Version::DC_V2) {
+    C_CharacterData_DCv2_61_98 ret;
+    ret.inventory = this->character->inventory;
+    ret.disp = disp;
+    ret.records.challenge = this->character->challenge_records;
+    ret.records.battle = this->character->battle_records;
+    ret.choice_search_config = this->character->choice_search_config;
+    this->send(command, 0x02, ret);
+
+  } else if (this->version == Version::PC_V2) {
+    C_CharacterData_PC_61_98 ret;
+    ret.inventory = this->character->inventory;
+    ret.disp = disp;
+    ret.records.challenge = this->character->challenge_records;
+    ret.records.battle = this->character->battle_records;
+    ret.choice_search_config = this->character->choice_search_config;
+    this->send(command, 0x02, ret);
+
+  } else if (is_v3(this->version)) {
+    C_CharacterData_V3_61_98 ret;
+    ret.inventory = this->character->inventory;
+    ret.disp = disp;
+    ret.records.challenge = this->character->challenge_records;
+    ret.records.battle = this->character->battle_records;
+    ret.choice_search_config = this->character->choice_search_config;
+    ret.info_board.encode(this->character->info_board.decode());
+    this->send(command, 0x03, ret);
+
+  } else {
+    throw std::runtime_error("unsupported version");
+  }
+}
+
+void LoadTestSession::send_chat(const std::string& text) {
+  std::string data(8, '\0');
+  data += uses_utf16(this->version) ? tt_utf8_to_utf16("\tE" + text) : tt_utf8_to_ascii("\tE" + text);
+  data.resize((data.size() + 4) & (~3));
+  this->send(0x06, 0x00, data.data(), data.size());
+}
+
+asio::awaitable<Channel::Message> LoadTestSession::recv_until(uint16_t command) {
+  for (;;) {
+    auto msg = co_await this->channel->recv();
+    this->stats->commands_received++;
+    this->stats->bytes_received += msg.data.size() + 4;
+    co_await this->on_message(msg);
+    if (msg.command == command) {
+      co_return msg;
+    }
+  }
+}
+
+asio::awaitable<void> LoadTestSession::sync() {
+  this->send(0x8A, 0x00);
+  co_await this->recv_until(0x8A);
+}
+
+asio::awaitable<void> LoadTestSession::on_message(Channel::Message& msg) {
+  for (size_t z = 0; z < 0x28 && z < msg.data.size(); z++) {
+    this->prev_cmd_data[z] = msg.data[z];
+  }
+
+  switch (msg.command) {
+    case 0x02:
+    case 0x17:
+    case 0x91:
+    case 0x9B: {
+      const auto& cmd = msg.check_size_t<S_ServerInitDefault_DC_PC_V3_02_17_91_9B>(0xFFFF);
+      if (uses_v3_encryption(this->version)) {
+        this->channel->crypt_in = std::make_shared<PSOV3Encryption>(cmd.server_key);
+        this->channel->crypt_out = std::make_shared<PSOV3Encryption>(cmd.client_key);
+      } else {
+        this->channel->crypt_in = std::make_shared<PSOV2Encryption>(cmd.server_key);
+        this->channel->crypt_out = std::make_shared<PSOV2Encryption>(cmd.client_key);
+      }
+
+      if ((msg.command == 0x02) || (this->version == Version::XB_V3)) {
+        this->send_93_9D_9E(this->version == Version::XB_V3);
+
+      } else if (is_v2(this->version)) {
+        C_Login_DC_PC_V3_9A ret;
+        ret.serial_number.encode(std::format("{:08X}", this->serial_number));
+        ret.access_key.encode(this->access_key);
+        ret.player_tag = this->guild_card_number ? 0xFFFF0000 : 0x00010000;
+        ret.guild_card_number = this->guild_card_number;
+        ret.sub_version = default_sub_version_for_version(this->version);
+        ret.serial_number2 = ret.serial_number;
+        ret.access_key2 = ret.access_key;
+        this->send(0x9A, 0x00, ret);
+
+      } else {
+        C_VerifyAccount_V3_DB ret;
+        ret.serial_number.encode(std::format("{:08X}", this->serial_number));
+        ret.access_key.encode(this->access_key);
+        ret.sub_version = default_sub_version_for_version(this->version);
+        ret.serial_number2 = ret.serial_number;
+        ret.access_key2 = ret.access_key;
+        ret.password.encode(this->password);
+        this->send(0xDB, 0x00, ret);
+      }
+      break;
+    }
+
+    case 0x90:
+    case 0x9A:
+      if (msg.flag == 1) {
+        C_Register_DC_PC_V3_9C ret;
+        ret.hardware_id = this->hardware_id;
+        ret.sub_version = default_sub_version_for_version(this->version);
+        ret.language = Language::ENGLISH;
+        if (this->version == Version::XB_V3) {
+          ret.serial_number.encode(std::format("LoadTest{}", this->client_index));
+          ret.access_key.encode(std::format("{:016X}", 0x0009000000000000 | this->serial_number));
+          ret.password.encode("xbox-pso");
+        } else {
+          ret.serial_number.encode(std::format("{:08X}", this->serial_number));
+          ret.access_key.encode(this->access_key);
+          ret.password.encode(this->password);
+        }
+        this->send(0x9C, 0x00, ret);
+      } else if (msg.flag == 0 || msg.flag == 2) {
+        this->send_93_9D_9E(true);
+      } else {
+        throw std::runtime_error("login failed");
+      }
+      break;
+
+    case 0x92:
+    case 0x9C:
+      if (msg.flag == 0) {
+        throw std::runtime_error("server rejected login credentials");
+      }
+      this->send_93_9D_9E(true);
+      break;
+
+    case 0x9F:
+      this->send(0x9F, 0x00, this->client_config);
+      break;
+
+    case 0xB2: {
+      C_ExecuteCodeResult_B3 ret;
+      ret.checksum = 0;
+      ret.return_value = 0;
+      this->send(0xB3, 0x00, ret);
+      break;
+    }
+
+    case 0x04: {
+      const auto& cmd = msg.check_size_t<S_UpdateClientConfig_V3_04>(0x08, sizeof(S_UpdateClientConfig_V3_04));
+      if (!is_v1_or_v2(this->version)) {
+        for (size_t z = 0; z < 0x20; z++) {
+          size_t read_index = z + 8;
+          this->client_config[z] = (read_index < msg.data.size())
+              ? msg.data[read_index]
+              : this->prev_cmd_data[read_index];
+        }
+      }
+      this->guild_card_number = cmd.guild_card_number;
+      if (!this->sent_96) {
+        C_CharSaveInfo_DCv2_PC_V3_BB_96 ret;
+        ret.creation_timestamp = this->character->creation_timestamp;
+        ret.event_counter = this->character->save_count;
+        this->send(0x96, 0x00, ret);
+        this->sent_96 = true;
+      }
+      break;
+    }
+
+    case 0x97:
+      this->send(0xB1, 0x00);
+      break;
+
+    case 0x95:
+      this->send_61_98(false);
+      break;
+
+    case 0xB1:
+      this->send(0x99, 0x00);
+      break;
+
+    case 0x1A:
+    case 0xD5:
+      if (is_v3(this->version)) {
+        this->send(0xD6, 0x00);
+      }
+      break;
+
+    case 0x1D:
+      this->send(0x1D, 0x00);
+      break;
+
+    case 0x07:
+    case 0x1F:
+    case 0xA0:
+    case 0xA1: {
+      auto handle_command = [&]<typename CmdT>() {
+        const auto* items = check_size_vec_t<CmdT>(msg.data, msg.flag + 1);
+        for (size_t z = 1; z <= msg.flag; z++) {
+          if ((items[z].menu_id == MenuID::MAIN) && (items[z].item_id == MainMenuItemID::GO_TO_LOBBY)) {
+            C_MenuSelectionBase_10 ret;
+            ret.menu_id = items[z].menu_id;
+            ret.item_id = items[z].item_id;
+            this->send(0x10, 0x00, ret);
+            return;
+          }
+        }
+        throw std::runtime_error("server sent a menu with no lobby option");
+      };
+      if (uses_utf16(this->version)) {
+        handle_command.operator()<S_MenuItem_PC_BB_08>();
+      } else {
+        handle_command.operator()<S_MenuItem_DC_V3_08_Ep3_E6>();
+      }
+      break;
+    }
+
+    case 0x19: {
+      const auto& cmd = msg.check_size_t<S_Reconnect_19>(sizeof(S_Reconnect_19), 0xFFFF);
+      co_await this->connect(cmd.port);
+      break;
+    }
+
+    case 0x83: {
+      const auto* items = check_size_vec_t<S_LobbyListEntry_83>(msg.data, msg.flag, true);
+      this->lobby_menu_items.clear();
+      for (size_t z = 0; z < msg.flag; z++) {
+        this->lobby_menu_items.emplace_back(items[z]);
+      }
+      break;
+    }
+
+    case 0x13:
+    case 0xA7:
+      if (!is_v1_or_v2(this->version)) {
+        const auto& cmd = msg.check_size_t<S_WriteFile_13_A7>();
+        C_WriteFileConfirmation_V3_BB_13_A7 ret;
+        ret.filename.encode(cmd.filename.decode());
+        this->send(msg.command, msg.flag, ret);
+      }
+      break;
+
+    case 0x60:
+    case 0x62:
+    case 0x6C:
+    case 0x6D:
+      this->on_subcommand(msg.data);
+      break;
+
+    default:
+      // Everything else (lobby and game updates, text messages, etc.) doesn't need a response
+      break;
+  }
+}
+
+void LoadTestSession::on_subcommand(const std::string& data) {
+  if (data.empty()) {
+    return;
+  }
+
+  if (static_cast<uint8_t>(data[0]) == 0x5F) {
+    const auto& cmd = check_size_t<G_DropItem_DC_6x5F>(data, 0xFFFF);
+    this->pending_items.emplace_back(PendingItem{
+        .item_id = cmd.item.item.id, .floor = cmd.item.floor, .pos = cmd.item.pos});
+    this->stats->items_dropped++;
+
+  } else if (static_cast<uint8_t>(data[0]) == 0x59) {
+    const auto& cmd = check_size_t<G_PickUpItem_6x59>(data, 0xFFFF);
+    if (cmd.header.client_id == this->lobby_client_id) {
+      this->stats->items_picked_up++;
+    }
+  }
+}
+
+std::vector<LoadTestSession::TargetEnemy> LoadTestSession::target_enemies_for_game(const Channel::Message& msg) {
+  Variations variations;
+  Difficulty difficulty = Difficulty::NORMAL;
+  uint8_t event = 0;
+  uint32_t random_seed = 0;
+  auto handle_command = [&]<typename CmdT>() {
+    const auto& cmd = msg.check_size_t<CmdT>(0xFFFF);
+    this->lobby_client_id = cmd.client_id;
+    variations = cmd.variations;
+    difficulty = cmd.difficulty;
+    event = cmd.event;
+    random_seed = cmd.random_seed;
+  };
+  if (this->version == Version::DC_V2) {
+    handle_command.operator()<S_JoinGame_DC_64>();
+  } else if (this->version == Version::PC_V2) {
+    handle_command.operator()<S_JoinGame_PC_64>();
+  } else if (this->version == Version::GC_V3) {
+    handle_command.operator()<S_JoinGame_GC_64>();
+  } else {
+    handle_command.operator()<S_JoinGame_XB_64>();
+  }
+
+  // Build the same map the server uses, so we can send valid enemy indexes in 6x0A and 6x60
+  std::vector<TargetEnemy> ret;
+  try {
+    auto supermaps = this->data->supermaps_for_variations(Episode::EP1, GameMode::NORMAL, difficulty, variations);
+    auto map = std::make_shared<MapState>(
+        this->client_index,
+        difficulty,
+        event,
+        random_seed,
+        MapState::DEFAULT_RARE_ENEMIES,
+        std::make_shared<MT19937Generator>(random_seed),
+        supermaps);
+    uint8_t area = map->floor_to_area.at(1);
+    for (auto ene_st : map->iter_enemy_states(this->version)) {
+      if (ret.size() >= this->kills_per_game) {
+        break;
+      }
+      if (ene_st->super_ene->floor != 1) {
+        continue;
+      }
+      const auto* set_entry = ene_st->super_ene->version(this->version).set_entry;
+      uint16_t index = map->index_for_enemy_state(this->version, ene_st);
+      if (!set_entry || (index == 0xFFFF)) {
+        continue;
+      }
+      auto target_ene_st = MapState::resolve_enemy_alias(ene_st);
+      EnemyType type = target_ene_st->type(this->version, area, difficulty, event);
+      uint8_t rt_index = type_definition_for_enemy(type).rt_index;
+      if (rt_index == 0xFF) {
+        continue;
+      }
+      ret.emplace_back(TargetEnemy{
+          .index = index, .floor = 1, .rt_index = rt_index, .area = area, .room = set_entry->room});
+    }
+  } catch (const std::exception& e) {
+    this->log.warning_f("Cannot construct map; no enemies will be killed in this game ({})", e.what());
+  }
+  return ret;
+}
+
+void LoadTestSession::send_move_to(float x, float z, bool walk) {
+  this->pos.x = x;
+  this->pos.z = z;
+  if (walk) {
+    G_WalkToPosition_6x40 cmd;
+    cmd.header = {0x40, sizeof(cmd) / 4, this->lobby_client_id};
+    cmd.pos = this->pos;
+    this->send(0x60, 0x00, cmd);
+  } else {
+    G_MoveToPosition_6x41_6x42 cmd;
+    cmd.header = {0x42, sizeof(cmd) / 4, this->lobby_client_id};
+    cmd.pos = this->pos;
+    this->send(0x60, 0x00, cmd);
+  }
+}
+
+asio::awaitable<void> LoadTestSession::play_game() {
+  uint64_t create_start = phosg::now();
+  if (this->version == Version::PC_V2) {
+    C_CreateGame_PC_C1 ret;
+    ret.name.encode(std::format("LT{:X}", this->rand.next()));
+    ret.password.encode(std::format("{:X}", this->rand.next()));
+    ret.difficulty = Difficulty::NORMAL;
+    ret.episode = 1;
+    this->send(0xC1, 0x00, ret);
+  } else {
+    C_CreateGame_DC_V3_0C_C1_Ep3_EC ret;
+    ret.name.encode(std::format("LT{:X}", this->rand.next()));
+    ret.password.encode(std::format("{:X}", this->rand.next()));
+    ret.difficulty = Difficulty::NORMAL;
+    ret.episode = 1;
+    this->send(0xC1, 0x00, ret);
+  }
+  auto join_msg = co_await this->recv_until(0x64);
+  this->stats->add_latency(Operation::CREATE_GAME, phosg::now() - create_start);
+  this->stats->games_created++;
+
+  auto targets = this->target_enemies_for_game(join_msg);
+  this->pending_items.clear();
+  for (size_t z = 0; z < this->character->inventory.num_items; z++) {
+    this->character->inventory.items[z].data.id = 0x00010000 + z;
+  }
+  this->send(0x6F, 0x00);
+  // We're always the leader in our own game, so we can use server drops if the server allows it. If it doesn't, the
+  // 6x60 commands are forwarded to nobody and no items drop, but everything else still works.
+  this->send_chat("$dropmode shared");
+  G_SetPlayerFloor_6x1F floor_cmd;
+  floor_cmd.header = {0x1F, sizeof(floor_cmd) / 4, this->lobby_client_id};
+  floor_cmd.floor = 1;
+  this->send(0x60, 0x00, floor_cmd);
+  co_await this->sync();
+
+  auto random_coord = [&]() -> float {
+    return static_cast<float>(static_cast<int32_t>(this->rand.next() % 201) - 100);
+  };
+  this->pos = VectorXZF{random_coord(), random_coord()};
+
+  for (size_t z = 0; (z < this->kills_per_game) && (phosg::now() < this->end_time); z++) {
+    co_await async_sleep(std::chrono::microseconds(this->step_usecs));
+    uint64_t move_start = phosg::now();
+    for (size_t w = 0; w < 3; w++) {
+      this->send_move_to(this->pos.x + (random_coord() / 10), this->pos.z + (random_coord() / 10), false);
+    }
+    this->send_move_to(this->pos.x + (random_coord() / 20), this->pos.z + (random_coord() / 20), true);
+    co_await this->sync();
+    this->stats->add_latency(Operation::MOVE, phosg::now() - move_start);
+
+    if (z < targets.size()) {
+      const auto& target = targets[z];
+      co_await async_sleep(std::chrono::microseconds(this->step_usecs));
+      uint64_t kill_start = phosg::now();
+
+      G_UpdateEnemyState_DC_PC_XB_BB_6x0A kill_cmd;
+      kill_cmd.header = {0x0A, sizeof(kill_cmd) / 4, static_cast<uint16_t>(target.index | 0x1000)};
+      kill_cmd.enemy_index = target.index;
+      kill_cmd.total_damage = 9999;
+      uint32_t game_flags = 0x00000A00; // Dead + hit by attack
+      kill_cmd.game_flags = is_big_endian(this->version) ? phosg::bswap32(game_flags) : game_flags;
+      this->send(0x60, 0x00, kill_cmd);
+
+      G_StandardDropItemRequest_PC_V3_BB_6x60 drop_cmd;
+      drop_cmd.floor = target.floor;
+      drop_cmd.rt_index = target.rt_index;
+      drop_cmd.entity_index = target.index;
+      drop_cmd.pos = VectorXZF{this->pos.x + 5, this->pos.z + 5};
+      drop_cmd.room = target.room;
+      drop_cmd.ignore_def = 0;
+      drop_cmd.effective_area = target.area;
+      if (this->version == Version::DC_V2) {
+        drop_cmd.header = {0x60, sizeof(G_StandardDropItemRequest_DC_6x60) / 4, 0};
+        this->send(0x60, 0x00, &drop_cmd, sizeof(G_StandardDropItemRequest_DC_6x60));
+      } else {
+        drop_cmd.header = {0x60, sizeof(drop_cmd) / 4, 0};
+        this->send(0x60, 0x00, drop_cmd);
+      }
+      co_await this->sync();
+      this->stats->add_latency(Operation::KILL_ENEMY, phosg::now() - kill_start);
+      this->stats->enemies_killed++;
+    }
+
+    while (!this->pending_items.empty() && (phosg::now() < this->end_time)) {
+      auto item = this->pending_items.front();
+      this->pending_items.pop_front();
+      co_await async_sleep(std::chrono::microseconds(this->step_usecs));
+      uint64_t pick_up_start = phosg::now();
+      this->send_move_to(item.pos.x, item.pos.z, false);
+      G_PickUpItemRequest_6x5A pick_up_cmd;
+      pick_up_cmd.header = {0x5A, sizeof(pick_up_cmd) / 4, this->lobby_client_id};
+      pick_up_cmd.item_id = item.item_id;
+      pick_up_cmd.floor = item.floor;
+      this->send(0x60, 0x00, pick_up_cmd);
+      co_await this->sync();
+      this->stats->add_latency(Operation::PICK_UP_ITEM, phosg::now() - pick_up_start);
+    }
+  }
+
+  // Leave the game and go back to one of the lobbies. The server takes the character's inventory from the 98 command
+  // on these versions, so items picked up in this game don't accumulate across games.
+  uint64_t leave_start = phosg::now();
+  this->send_61_98(true);
+  if (this->lobby_menu_items.empty()) {
+    throw std::runtime_error("server did not send a lobby list");
+  }
+  const auto& item = this->lobby_menu_items[this->client_index % this->lobby_menu_items.size()];
+  C_LobbySelection_84 ret84;
+  ret84.menu_id = item.menu_id;
+  ret84.item_id = item.item_id;
+  this->send(0x84, 0x00, ret84);
+  co_await this->recv_until(0x67);
+  this->stats->add_latency(Operation::LEAVE_GAME, phosg::now() - leave_start);
+}
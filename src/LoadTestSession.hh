@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Channel.hh"
+#include "DataIndex.hh"
+#include "Map.hh"
+#include "PSOEncryption.hh"
+#include "PSOProtocol.hh"
+#include "SaveFileFormats.hh"
+#include "ServerState.hh"
+
+// Statistics collected by all the clients in a load test. All sessions in a load test run on the same io_context
+// thread, so this doesn't need to be thread-safe.
+struct LoadTestStats {
+  enum class Operation {
+    LOGIN = 0, // Connection to first lobby join (67)
+    CREATE_GAME, // C1 to 64
+    MOVE, // 6x42 and 6x40 commands, then a round trip
+    KILL_ENEMY, // 6x0A and 6x60, then a round trip (includes the 6x5F if the enemy dropped an item)
+    PICK_UP_ITEM, // 6x42 and 6x5A, then a round trip (includes the 6x59)
+    LEAVE_GAME, // 98 and 84 to 67
+  };
+  static constexpr size_t NUM_OPERATIONS = 6;
+
+  size_t num_clients = 0;
+  size_t clients_logged_in = 0;
+  size_t clients_finished = 0;
+  size_t clients_failed = 0;
+  size_t games_created = 0;
+  size_t enemies_killed = 0;
+  size_t items_dropped = 0;
+  size_t items_picked_up = 0;
+  size_t commands_sent = 0;
+  size_t commands_received = 0;
+  uint64_t bytes_sent = 0;
+  uint64_t bytes_received = 0;
+  std::array<std::vector<uint64_t>, NUM_OPERATIONS> latencies_usecs;
+
+  inline void add_latency(Operation op, uint64_t usecs) {
+    this->latencies_usecs[static_cast<size_t>(op)].emplace_back(usecs);
+  }
+  inline bool all_clients_done() const {
+    return (this->clients_finished + this->clients_failed) >= this->num_clients;
+  }
+
+  void print(FILE* stream, uint64_t elapsed_usecs) const;
+};
+
+// A scripted client used for load testing. Each session logs in, goes to a lobby, and then repeatedly creates a game,
+// walks around, kills enemies on the first floor, picks up the items they drop, and leaves the game, until the end
+// time is reached. Sessions connect to the server either in-process via PeerChannel (if local_state is given) or via
+// TCP to remote_host, using the ports from the server's configuration. Only DC v2, PC, GC, and Xbox are supported.
+class LoadTestSession {
+public:
+  LoadTestSession(
+      std::shared_ptr<asio::io_context> io_context,
+      std::shared_ptr<const DataIndex> data,
+      std::shared_ptr<ServerState> local_state,
+      const std::string& remote_host,
+      std::shared_ptr<LoadTestStats> stats,
+      Version version,
+      size_t client_index,
+      uint64_t start_delay_usecs,
+      uint64_t end_time,
+      uint64_t step_usecs,
+      size_t kills_per_game);
+  LoadTestSession(const LoadTestSession&) = delete;
+  LoadTestSession(LoadTestSession&&) = delete;
+  LoadTestSession& operator=(const LoadTestSession&) = delete;
+  LoadTestSession& operator=(LoadTestSession&&) = delete;
+  ~LoadTestSession() = default;
+
+  asio::awaitable<void> run();
+
+protected:
+  using Operation = LoadTestStats::Operation;
+
+  struct TargetEnemy {
+    uint16_t index;
+    uint8_t floor;
+    uint8_t rt_index;
+    uint8_t area;
+    uint16_t room;
+  };
+  struct PendingItem {
+    uint32_t item_id;
+    uint8_t floor;
+    VectorXZF pos;
+  };
+
+  // Config (set by caller)
+  std::shared_ptr<asio::io_context> io_context;
+  std::shared_ptr<const DataIndex> data;
+  std::shared_ptr<ServerState> local_state;
+  std::string remote_host;
+  std::shared_ptr<LoadTestStats> stats;
+  Version version;
+  size_t client_index;
+  uint64_t start_delay_usecs;
+  uint64_t end_time;
+  uint64_t step_usecs;
+  size_t kills_per_game;
+
+  // State (set during session)
+  phosg::PrefixedLogger log;
+  MT19937Generator rand;
+  std::shared_ptr<Channel> channel;
+  uint32_t serial_number;
+  std::string access_key;
+  std::string password;
+  uint64_t hardware_id;
+  uint32_t guild_card_number = 0;
+  std::shared_ptr<PSOBBCharacterFile> character;
+  parray<uint8_t, 0x28> prev_cmd_data;
+  parray<uint8_t, 0x20> client_config;
+  bool sent_96 = false;
+  std::vector<S_LobbyListEntry_83> lobby_menu_items;
+
+  uint8_t lobby_client_id = 0;
+  VectorXZF pos;
+  std::deque<PendingItem> pending_items;
+
+  asio::awaitable<void> connect(uint16_t port);
+  void send(uint16_t command, uint32_t flag, const void* data = nullptr, size_t size = 0);
+  template <typename CmdT>
+  void send(uint16_t command, uint32_t flag, const CmdT& data) {
+    this->send(command, flag, &data, sizeof(data));
+  }
+  void send_93_9D_9E(bool extended);
+  void send_61_98(bool is_98);
+  void send_chat(const std::string& text);
+
+  // Receives commands (responding to any that need automatic responses) until one with the given command number
+  // arrives, then returns it
+  asio::awaitable<Channel::Message> recv_until(uint16_t command);
+  // Sends 8A and waits for the response. The server handles commands from each client in order, so when this returns,
+  // the server has finished processing all previously-sent commands.
+  asio::awaitable<void> sync();
+  asio::awaitable<void> on_message(Channel::Message& msg);
+  void on_subcommand(const std::string& data);
+
+  asio::awaitable<void> play_game();
+  std::vector<TargetEnemy> target_enemies_for_game(const Channel::Message& msg);
+  void send_move_to(float x, float z, bool walk);
+};
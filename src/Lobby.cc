@@ -143,6 +143,7 @@ uint32_t Lobby::FloorItemManager::reassign_all_item_ids(uint32_t next_item_id) {
 
 Lobby::Lobby(std::shared_ptr<ServerState> s, uint32_t id, bool is_game)
     : server_state(s),
+      data(is_game ? s->data : nullptr),
       log(std::format("[{}:{:X}] ", is_game ? "Game" : "Lobby", id), lobby_log.min_level),
       creation_time(phosg::now()),
       lobby_id(id),
@@ -173,7 +174,7 @@ uint8_t Lobby::area_for_floor(Version version, uint8_t floor) const {
   if (this->quest) {
     return this->quest->meta.floor_assignments.at(floor).area;
   }
-  auto sdt = this->require_server_state()->data->set_data_table(version, this->episode, this->mode, this->difficulty);
+  auto sdt = this->require_data()->set_data_table(version, this->episode, this->mode, this->difficulty);
   return sdt->default_floor_to_area(this->episode).at(floor);
 }
 
@@ -185,6 +186,10 @@ std::shared_ptr<ServerState> Lobby::require_server_state() const {
   return s;
 }
 
+std::shared_ptr<DataIndex> Lobby::require_data() const {
+  return this->data ? this->data : this->require_server_state()->data;
+}
+
 std::shared_ptr<Lobby::ChallengeParameters> Lobby::require_challenge_params() const {
   if (!this->challenge_params) {
     throw std::runtime_error("challenge params are missing");
@@ -215,15 +220,16 @@ void Lobby::create_item_creator(Version logic_version) {
   if (effective_section_id >= 10) {
     effective_section_id = 0x00;
   }
+  auto data = this->require_data();
   this->item_creator = std::make_shared<ItemCreator>(
-      s->data->common_item_set(logic_version, this->quest),
-      s->data->rare_item_set(logic_version, this->quest),
-      s->data->armor_random_set,
-      s->data->tool_random_set,
-      s->data->weapon_random_set(this->difficulty),
-      s->data->tekker_adjustment_set,
-      s->data->item_parameter_table(logic_version),
-      s->data->item_stack_limits(logic_version),
+      data->common_item_set(logic_version, this->quest),
+      data->rare_item_set(logic_version, this->quest),
+      data->armor_random_set,
+      data->tool_random_set,
+      data->weapon_random_set(this->difficulty),
+      data->tekker_adjustment_set,
+      data->item_parameter_table(logic_version),
+      data->item_stack_limits(logic_version),
       (this->mode == GameMode::SOLO) ? GameMode::NORMAL : this->mode,
       this->difficulty,
       effective_section_id,
@@ -272,13 +278,12 @@ void Lobby::load_maps() {
 
   if (this->quest) {
     this->log.info_f("Loading quest supermap");
-    auto supermap = this->quest->get_supermap(this->random_seed);
+    auto supermap = this->require_data()->quest_index->get_supermap(this->quest, this->random_seed);
     this->map_state = std::make_shared<MapState>(
         this->lobby_id, this->difficulty, this->event, this->random_seed, this->rare_enemy_rates, this->rand_crypt, supermap);
   } else {
     this->log.info_f("Loading free play supermaps");
-    auto s = this->require_server_state();
-    auto supermaps = s->data->supermaps_for_variations(this->episode, this->mode, this->difficulty, this->variations);
+    auto supermaps = this->require_data()->supermaps_for_variations(this->episode, this->mode, this->difficulty, this->variations);
     this->map_state = std::make_shared<MapState>(
         this->lobby_id, this->difficulty, this->event, this->random_seed, this->rare_enemy_rates, this->rand_crypt, supermaps);
   }
@@ -298,7 +303,6 @@ void Lobby::load_maps() {
 }
 
 void Lobby::create_ep3_server() {
-  auto s = this->require_server_state();
   if (!this->ep3_server) {
     this->log.info_f("Creating Episode 3 server state");
   } else {
@@ -307,14 +311,15 @@ void Lobby::create_ep3_server() {
   auto tourn = this->tournament_match ? this->tournament_match->tournament.lock() : nullptr;
 
   bool is_nte = this->is_ep3_nte();
+  auto data = this->require_data();
   Episode3::Server::Options options = {
-      .card_index = is_nte ? s->data->ep3_card_index_trial : s->data->ep3_card_index,
-      .map_index = s->data->ep3_map_index,
-      .behavior_flags = s->data->ep3_behavior_flags,
+      .card_index = is_nte ? data->ep3_card_index_trial : data->ep3_card_index,
+      .map_index = data->ep3_map_index,
+      .behavior_flags = data->ep3_behavior_flags,
       .opt_rand_stream = nullptr,
       .rand_crypt = this->rand_crypt,
       .tournament = tourn,
-      .trap_card_ids = s->data->ep3_trap_card_ids,
+      .trap_card_ids = data->ep3_trap_card_ids,
       .output_queue = nullptr,
   };
   if (is_nte) {
@@ -420,6 +425,7 @@ void Lobby::add_client(std::shared_ptr<Client> c, ssize_t required_client_id) {
   c->lobby_client_id = index;
   c->lobby = this->weak_from_this();
   c->lobby_arrow_color = 0;
+  this->require_server_state()->update_lobby_client_index(c);
 
   // If there's no one else in the lobby, set the leader id as well
   size_t leader_index;
@@ -507,6 +513,7 @@ void Lobby::remove_client(std::shared_ptr<Client> c) {
     auto c_lobby = c->lobby.lock();
     if (c_lobby.get() == this) {
       c->lobby.reset();
+      this->require_server_state()->update_lobby_client_index(c);
     }
   }
 
@@ -593,23 +600,6 @@ void Lobby::move_client_to_lobby(std::shared_ptr<Lobby> dest_lobby, std::shared_
   dest_lobby->add_client(c, required_client_id);
 }
 
-std::shared_ptr<Client> Lobby::find_client(const std::string* identifier, uint64_t account_id) {
-  for (size_t x = 0; x < this->max_clients; x++) {
-    auto lc = this->clients[x];
-    if (!lc) {
-      continue;
-    }
-    if (account_id && lc->login && (lc->login->account->account_id == account_id)) {
-      return lc;
-    }
-    if (identifier && (lc->character_file()->disp.visual.name.eq(*identifier, lc->language()))) {
-      return lc;
-    }
-  }
-
-  throw std::out_of_range("client not found");
-}
-
 Lobby::JoinError Lobby::join_error_for_client(std::shared_ptr<Client> c, const std::string* password) const {
   if (this->count_clients() >= this->max_clients) {
     return JoinError::FULL;
@@ -20,6 +20,7 @@
 #include "StaticGameData.hh"
 #include "Text.hh"
 
+struct DataIndex;
 class ServerState;
 
 struct Lobby : public std::enable_shared_from_this<Lobby> {
@@ -89,6 +90,9 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   };
 
   std::weak_ptr<ServerState> server_state;
+  // For games, the DataIndex that was current when the game was created; reloads don't affect games in progress.
+  // Null for lobbies, which always use the current DataIndex.
+  std::shared_ptr<DataIndex> data;
   phosg::PrefixedLogger log;
 
   uint64_t creation_time;
@@ -108,6 +112,15 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   std::unique_ptr<QuestFlags> quest_flags_known; // If null, ALL quest flags are known
   std::unique_ptr<QuestFlags> quest_flag_values;
   std::unique_ptr<SwitchFlags> switch_flags;
+  // Most recent compressed game join sync payload (6x6B-6x6E) for each version and subcommand. Joining players usually
+  // receive the same state as the previous joiner on the same version, so this avoids compressing it again. Entries are
+  // reused only if the decompressed data is identical, so they never need to be explicitly invalidated when the game
+  // state changes; see send_game_join_sync_command.
+  struct JoinSyncCacheEntry {
+    std::string decompressed_data;
+    std::string compressed_data;
+  };
+  std::unordered_map<uint16_t, JoinSyncCacheEntry> join_sync_cache;
 
   // Game config
   // Bits in allowed_versions specify who is allowed to join this game. The bits are indexed as (1 << version), where
@@ -199,6 +212,7 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   uint8_t area_for_floor(Version version, uint8_t floor) const;
 
   std::shared_ptr<ServerState> require_server_state() const;
+  std::shared_ptr<DataIndex> require_data() const;
   std::shared_ptr<ChallengeParameters> require_challenge_params() const;
   void create_item_creator(Version logic_version = Version::UNKNOWN);
   uint8_t effective_section_id() const; // Returns 0xFF if not assigned (e.g. empty persistent game)
@@ -236,8 +250,6 @@ struct Lobby : public std::enable_shared_from_this<Lobby> {
   void move_client_to_lobby(
       std::shared_ptr<Lobby> dest_lobby, std::shared_ptr<Client> c, ssize_t required_client_id = -1);
 
-  std::shared_ptr<Client> find_client(const std::string* identifier = nullptr, uint64_t account_id = 0);
-
   enum class JoinError {
     ALLOWED = 0,
     FULL,
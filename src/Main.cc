@@ -29,22 +29,27 @@
 #include "DNSServer.hh"
 #include "DOLFileIndex.hh"
 #include "DownloadSession.hh"
+#include "FileWriteQueue.hh"
 #include "GSLArchive.hh"
 #include "GameServer.hh"
 #include "HTTPServer.hh"
 #include "IPStackSimulator.hh"
 #include "ImageEncoder.hh"
+#include "LoadTestSession.hh"
 #include "Loggers.hh"
 #include "NetworkAddresses.hh"
 #include "PPKArchive.hh"
 #include "PSOGCObjectGraph.hh"
 #include "PSOProtocol.hh"
 #include "PatchDownloadSession.hh"
+#include "PatchFileWatcher.hh"
 #include "Quest.hh"
 #include "QuestScript.hh"
+#include "ReplayCapture.hh"
 #include "ReplaySession.hh"
 #include "Revision.hh"
 #include "SaveFileFormats.hh"
+#include "SaveStore.hh"
 #include "SendCommands.hh"
 #include "Server.hh"
 #include "ServerShell.hh"
@@ -262,7 +267,12 @@ static void a_compress_decompress_fn(phosg::Arguments& args) {
   bool is_big_endian = args.get<bool>("big-endian");
   bool is_optimal = args.get<bool>("optimal");
   bool is_pessimal = args.get<bool>("pessimal");
-  int8_t compression_level = args.get<int8_t>("compression-level", 0);
+  bool is_parallel = args.get<bool>("parallel");
+  bool is_fast = args.get<bool>("fast");
+  int8_t compression_level = args.get<int8_t>(
+      "compression-level", is_parallel ? PRS_PARALLEL_MAX_COMPRESSION_LEVEL : 0);
+  size_t num_threads = args.get<size_t>("threads", 0);
+  size_t iterations = std::max<size_t>(args.get<size_t>("iterations", 1), 1);
   size_t bytes = args.get<size_t>("bytes", 0);
   std::string seed = args.get<std::string>("seed");
 
@@ -290,38 +300,61 @@ static void a_compress_decompress_fn(phosg::Arguments& args) {
         phase_name, input_progress, input_bytes, progress, output_progress, size_ratio);
   };
 
-  uint64_t start = phosg::now();
-  if (!is_decompress && (is_prs || is_pr2 || is_prc)) {
-    if (is_optimal) {
-      data = prs_compress_optimal(data.data(), data.size(), optimal_progress_fn);
-    } else if (is_pessimal) {
-      data = prs_compress_pessimal(data.data(), data.size());
-    } else {
-      data = prs_compress(data, compression_level, progress_fn);
-    }
-  } else if (is_decompress && (is_prs || is_pr2 || is_prc)) {
-    data = prs_decompress(data, bytes, (bytes != 0));
-  } else if (!is_decompress && is_bc0) {
-    if (is_optimal) {
-      data = bc0_compress_optimal(data.data(), data.size(), optimal_progress_fn);
-    } else if (compression_level < 0) {
-      data = bc0_encode(data.data(), data.size());
+  auto run = [&](const std::string& input_data) -> std::string {
+    if (!is_decompress && (is_prs || is_pr2 || is_prc)) {
+      if (is_optimal) {
+        return prs_compress_optimal(input_data.data(), input_data.size(), optimal_progress_fn);
+      } else if (is_pessimal) {
+        return prs_compress_pessimal(input_data.data(), input_data.size());
+      } else if (is_parallel) {
+        return prs_compress_parallel(input_data, compression_level, num_threads, optimal_progress_fn);
+      } else {
+        return prs_compress(input_data, compression_level, progress_fn);
+      }
+    } else if (is_decompress && (is_prs || is_pr2 || is_prc)) {
+      return prs_decompress(input_data, bytes, (bytes != 0));
+    } else if (!is_decompress && is_bc0) {
+      if (is_optimal) {
+        return bc0_compress_optimal(input_data.data(), input_data.size(), optimal_progress_fn);
+      } else if (is_fast) {
+        return bc0_compress_fast(input_data.data(), input_data.size());
+      } else if (compression_level < 0) {
+        return bc0_encode(input_data.data(), input_data.size());
+      } else {
+        return bc0_compress(input_data, progress_fn);
+      }
+    } else if (is_decompress && is_bc0) {
+      return bc0_decompress(input_data);
     } else {
-      data = bc0_compress(data, progress_fn);
+      throw std::logic_error("invalid behavior");
     }
-  } else if (is_decompress && is_bc0) {
-    data = bc0_decompress(data);
-  } else {
-    throw std::logic_error("invalid behavior");
-  }
-  uint64_t end = phosg::now();
-  std::string time_str = phosg::format_duration(end - start);
+  };
 
-  float size_ratio = static_cast<float>(data.size() * 100) / input_bytes;
-  double bytes_per_sec = input_bytes / (static_cast<double>(end - start) / 1000000.0);
-  std::string bytes_per_sec_str = phosg::format_size(bytes_per_sec);
-  phosg::log_info_f("{} (0x{:X}) bytes input => {} (0x{:X}) bytes output ({:g}%) in {} ({} / sec)",
-      input_bytes, input_bytes, data.size(), data.size(), size_ratio, time_str, bytes_per_sec_str);
+  // With --iterations, the same input is processed multiple times and the throughput of each pass is reported, so
+  // different compressors and settings can be compared. Throughput is measured in uncompressed bytes (that is, input
+  // bytes when compressing and output bytes when decompressing).
+  std::string input_data = std::move(data);
+  uint64_t total_usecs = 0;
+  for (size_t iteration = 0; iteration < iterations; iteration++) {
+    uint64_t start = phosg::now();
+    data = run(input_data);
+    uint64_t end = phosg::now();
+    total_usecs += end - start;
+    std::string time_str = phosg::format_duration(end - start);
+
+    float size_ratio = static_cast<float>(data.size() * 100) / input_bytes;
+    size_t uncompressed_bytes = is_decompress ? data.size() : input_bytes;
+    double bytes_per_sec = uncompressed_bytes / (static_cast<double>(end - start) / 1000000.0);
+    std::string bytes_per_sec_str = phosg::format_size(bytes_per_sec);
+    phosg::log_info_f("{} (0x{:X}) bytes input => {} (0x{:X}) bytes output ({:g}%) in {} ({} / sec)",
+        input_bytes, input_bytes, data.size(), data.size(), size_ratio, time_str, bytes_per_sec_str);
+  }
+  if (iterations > 1) {
+    size_t uncompressed_bytes = is_decompress ? data.size() : input_bytes;
+    double bytes_per_sec = (uncompressed_bytes * iterations) / (static_cast<double>(total_usecs) / 1000000.0);
+    phosg::log_info_f("{} iterations in {} ({} / sec on average)",
+        iterations, phosg::format_duration(total_usecs), phosg::format_size(bytes_per_sec));
+  }
 
   if (is_pr2 || is_prc) {
     if (is_decompress && (data.size() != pr2_expected_size)) {
@@ -370,7 +403,15 @@ Action a_compress_prc("compress-prc", "\
     in valid PRS data which is about 9/8 the size of the input.\n\
     There is also a compressor which produces the absolute smallest output\n\
     size, but uses much more memory and CPU time. To use this compressor, use\n\
-    the --optimal option.\n",
+    the --optimal option.\n\
+    For PRS, PR2, and PRC, the --parallel option compresses on multiple threads\n\
+    (one per CPU core by default; use --threads=N to override this). With this\n\
+    option, --compression-level ranges from 1 (fastest) to 9 (default; output\n\
+    is only slightly larger than with --optimal).\n\
+    For BC0, the --fast option uses a faster compressor which produces\n\
+    slightly larger output.\n\
+    To measure throughput, use --iterations=N to process the input N times and\n\
+    report the time taken by each pass (this also works for decompression).\n",
     a_compress_decompress_fn);
 Action a_decompress_prs("decompress-prs", nullptr, a_compress_decompress_fn);
 Action a_decompress_bc0("decompress-bc0", nullptr, a_compress_decompress_fn);
@@ -380,7 +421,10 @@ Action a_decompress_prc("decompress-prc", "\
   decompress-pr2 [INPUT-FILENAME [OUTPUT-FILENAME]]\n\
   decompress-prc [INPUT-FILENAME [OUTPUT-FILENAME]]\n\
   decompress-bc0 [INPUT-FILENAME [OUTPUT-FILENAME]]\n\
-    Decompress data compressed using the PRS, PR2, PRC, or BC0 algorithms.\n",
+    Decompress data compressed using the PRS, PR2, PRC, or BC0 algorithms.\n\
+    To measure decompression speed, use --iterations=N to decompress the input\n\
+    N times and report the throughput (in decompressed bytes per second) of\n\
+    each pass and the average.\n",
     a_compress_decompress_fn);
 
 Action a_prs_size(
@@ -456,6 +500,56 @@ Action a_psov2_encrypt_single_test(
       progress_fn(0, 0, 0xFFFFFFFF, 0);
     });
 
+Action a_encryption_benchmark(
+    "encryption-benchmark", "\
+  encryption-benchmark [--size=BYTES] [--iterations=COUNT]\n\
+    Measure the throughput of the V2, V3, and BB ciphers by encrypting a buffer\n\
+    of random data repeatedly (default 64KB, 4096 times).\n",
+    +[](phosg::Arguments& args) {
+      size_t size = args.get<size_t>("size", 0x10000) & ~7;
+      size_t iterations = args.get<size_t>("iterations", 0x1000);
+      if (size == 0 || iterations == 0) {
+        throw std::invalid_argument("size and iterations must be nonzero");
+      }
+
+      std::string data(size, '\0');
+      for (size_t z = 0; z < size; z += 4) {
+        *reinterpret_cast<uint32_t*>(data.data() + z) = phosg::random_object<uint32_t>();
+      }
+
+      auto run = [&](const char* name, auto&& fn) -> void {
+        uint64_t start = phosg::now();
+        for (size_t z = 0; z < iterations; z++) {
+          fn(data.data(), data.size());
+        }
+        uint64_t elapsed = std::max<uint64_t>(phosg::now() - start, 1);
+        double gb_per_sec = static_cast<double>(size * iterations) / (static_cast<double>(elapsed) * 1000.0);
+        phosg::log_info_f("{}: {} in {} ({:g} GB/s)",
+            name, phosg::format_size(size * iterations), phosg::format_duration(elapsed), gb_per_sec);
+      };
+
+      PSOV2Encryption v2_crypt(phosg::random_object<uint32_t>());
+      run("V2", [&](void* d, size_t s) { v2_crypt.encrypt(d, s); });
+      PSOV3Encryption v3_crypt(phosg::random_object<uint32_t>());
+      run("V3", [&](void* d, size_t s) { v3_crypt.encrypt(d, s); });
+
+      PSOBBEncryption::KeyFile key;
+      for (size_t z = 0; z < key.initial_keys.as32.size(); z++) {
+        key.initial_keys.as32[z] = phosg::random_object<uint32_t>();
+      }
+      for (size_t z = 0; z < key.private_keys.as32.size(); z++) {
+        key.private_keys.as32[z] = phosg::random_object<uint32_t>();
+      }
+      key.subtype = PSOBBEncryption::Subtype::STANDARD;
+      std::string bb_seed(0x30, '\0');
+      for (size_t z = 0; z < bb_seed.size(); z++) {
+        bb_seed[z] = phosg::random_object<uint8_t>();
+      }
+      PSOBBEncryption bb_crypt(key, bb_seed.data(), bb_seed.size());
+      run("BB (encrypt)", [&](void* d, size_t s) { bb_crypt.encrypt(d, s); });
+      run("BB (decrypt)", [&](void* d, size_t s) { bb_crypt.decrypt(d, s); });
+    });
+
 static void a_encrypt_decrypt_fn(phosg::Arguments& args) {
   bool is_decrypt = (args.get<std::string>(0) == "decrypt-data");
   std::string seed = args.get<std::string>("seed");
@@ -1719,21 +1813,46 @@ Action a_assemble_quest_script(
     Assemble the input quest script (.txt file) into a compressed .bin file\n\
     usable as an online quest script. If --decompressed is given, produces an\n\
     uncompressed .bind file instead. If --disable-strict is given, allows some\n\
-    invalid behaviors (e.g. calling an undefined label by number).\n",
+    invalid behaviors (e.g. calling an undefined label by number). If\n\
+    --compile-cache=DIRECTORY is given, uses the quest compile cache in that\n\
+    directory (as the server does when loading quests), and prints the cache\n\
+    statistics afterward.\n",
     +[](phosg::Arguments& args) {
-      std::string text = read_input_data(args);
-
       const std::string& input_filename = args.get<std::string>(1, false);
       std::string include_dir = (!input_filename.empty() && (input_filename != "-"))
           ? phosg::dirname(input_filename)
           : ".";
 
-      auto result = assemble_quest_script(
-          text,
-          {include_dir, "system/quests/includes"},
-          {include_dir, "system/quests/includes", "system/client-functions/System"},
-          !args.get<bool>("disable-strict"));
-      std::string result_data = std::move(result.data);
+      bool strict = !args.get<bool>("disable-strict");
+      auto assemble = [&](const std::string& text) -> AssembledQuestScript {
+        return assemble_quest_script(
+            text,
+            {include_dir, "system/quests/includes"},
+            {include_dir, "system/quests/includes", "system/client-functions/System"},
+            strict);
+      };
+
+      std::string result_data;
+      const std::string& compile_cache_dir = args.get<std::string>("compile-cache", false);
+      if (!compile_cache_dir.empty()) {
+        if (input_filename.empty() || (input_filename == "-")) {
+          throw std::invalid_argument("--compile-cache requires an input filename");
+        }
+        QuestCompileCache compile_cache(compile_cache_dir);
+        std::string filename = std::filesystem::path(input_filename).filename().string();
+        auto res = compile_cache.get_or_compile(input_filename, filename, [&](const std::string& source_data) {
+          // The cache records the included files' digests only if the assembled script is returned
+          QuestCompileCache::Result ret;
+          ret.filename = filename;
+          ret.assembled = std::make_shared<AssembledQuestScript>(assemble(source_data));
+          ret.data = std::move(ret.assembled->data);
+          return ret;
+        });
+        result_data = std::move(res.data);
+        phosg::fwrite_fmt(stderr, "Quest compile cache: {}\n", compile_cache.stats().str());
+      } else {
+        result_data = std::move(assemble(read_input_data(args)).data);
+      }
       bool compress = !args.get<bool>("decompressed");
       if (compress) {
         if (args.get<bool>("optimal")) {
@@ -2297,6 +2416,32 @@ Action a_compare_rare_item_set(
 
       rs1->print_diff(stdout, *rs2);
     });
+Action a_check_rare_item_set(
+    "check-rare-item-set", "\
+  check-rare-item-set INPUT-FILENAME\n\
+    Load a rare item set (in any format accepted by convert-rare-item-set) and\n\
+    check that the compiled drop tables used for drop rolls match the parsed\n\
+    set for every game mode, episode, difficulty, section ID, enemy type, and\n\
+    box area.\n",
+    +[](phosg::Arguments& args) {
+      std::string input_filename = args.get<std::string>(1, false);
+      if (input_filename.empty() || (input_filename == "-")) {
+        throw std::runtime_error("input filename must be given");
+      }
+
+      auto di = std::make_shared<DataIndex>(get_config_filename(args));
+      di->load_config_early();
+      di->load_patch_indexes();
+      di->load_text_index();
+      di->load_item_definitions();
+      di->load_item_name_indexes();
+      di->load_drop_tables();
+
+      auto rs = load_rare_item_set(
+          input_filename, is_v1(get_cli_version(args, Version::BB_V4)), di->item_name_index(Version::BB_V4));
+      rs->verify_compiled_tables();
+      phosg::fwrite_fmt(stderr, "Compiled drop tables match\n");
+    });
 
 static std::shared_ptr<CommonItemSet> load_common_item_set(
     const std::string& filename, const std::string& ct_filename, bool big_endian) {
@@ -3515,10 +3660,10 @@ Action a_check_supermaps(
         map_state->verify();
 
         phosg::fwrite_fmt(stderr, "  map state ok: 0x{:X} objects, 0x{:X} enemies, 0x{:X} enemy sets, 0x{:X} events\n",
-            map_state->object_states.size(),
-            map_state->enemy_states.size(),
-            map_state->enemy_set_states.size(),
-            map_state->event_states.size());
+            map_state->num_object_states(),
+            map_state->num_enemy_states(),
+            map_state->num_enemy_set_states(),
+            map_state->num_event_states());
       }
 
       SuperMap::EfficiencyStats all_free_maps_eff;
@@ -3637,10 +3782,10 @@ Action a_check_supermaps(
         map_state->verify();
 
         phosg::fwrite_fmt(stderr, "  map state ok: 0x{:X} objects, 0x{:X} enemies, 0x{:X} enemy sets, 0x{:X} events\n",
-            map_state->object_states.size(),
-            map_state->enemy_states.size(),
-            map_state->enemy_set_states.size(),
-            map_state->event_states.size());
+            map_state->num_object_states(),
+            map_state->num_enemy_states(),
+            map_state->num_enemy_set_states(),
+            map_state->num_event_states());
       }
       phosg::fwrite_fmt(stderr, "ALL QUEST MAPS: {}\n", all_quests_eff.str());
     });
@@ -4442,6 +4587,167 @@ Action a_disassemble_ep3_battle_record(
       Episode3::BattleRecord(read_input_data(args)).print(stdout);
     });
 
+static const std::vector<std::string> SAVE_DATABASE_DIRECTORIES = {"system/licenses", "system/teams", "system/players"};
+
+Action a_import_save_database(
+    "import-save-database", "\
+  import-save-database DATABASE-FILENAME\n\
+    Copy all accounts, teams, and player data from the system/licenses,\n\
+    system/teams, and system/players directories into a single-file save\n\
+    database, creating it if it doesn't exist. Entries already in the database\n\
+    are overwritten. To make the server use the database, set\n\
+    SaveDatabaseFilename in config.json.\n",
+    +[](phosg::Arguments& args) {
+      FilesystemSaveStore files;
+      LogSaveStore db(args.get<std::string>(1));
+      uint64_t start = phosg::now();
+      size_t count = copy_save_store_directories(files, db, SAVE_DATABASE_DIRECTORIES);
+      phosg::log_info_f("Imported {} entries in {}", count, phosg::format_duration(phosg::now() - start));
+    });
+
+Action a_export_save_database(
+    "export-save-database", "\
+  export-save-database DATABASE-FILENAME\n\
+    Write all accounts, teams, and player data from a single-file save database\n\
+    to the system/licenses, system/teams, and system/players directories.\n\
+    Existing files with the same names are overwritten.\n",
+    +[](phosg::Arguments& args) {
+      LogSaveStore db(args.get<std::string>(1));
+      FilesystemSaveStore files;
+      uint64_t start = phosg::now();
+      size_t count = copy_save_store_directories(db, files, SAVE_DATABASE_DIRECTORIES);
+      phosg::log_info_f("Exported {} entries in {}", count, phosg::format_duration(phosg::now() - start));
+    });
+
+Action a_convert_replay_log(
+    "convert-replay-log", "\
+  convert-replay-log INPUT-FILENAME OUTPUT-FILENAME\n\
+    Convert a replay log between the text format (as in tests/*.test.txt) and\n\
+    the binary capture format written by the server when the --replay-capture\n\
+    option is given. The direction of conversion is determined by the input\n\
+    file's contents. Both formats can be replayed with --replay-log.\n",
+    +[](phosg::Arguments& args) {
+      std::string input_filename = args.get<std::string>(1);
+      std::string output_filename = args.get<std::string>(2);
+      uint64_t start = phosg::now();
+      if (ReplayCapture::is_capture_file(input_filename)) {
+        auto capture = ReplayCapture::from_file(input_filename);
+        auto f = phosg::fopen_unique(output_filename, "wt");
+        capture->print_text_log(f.get());
+      } else {
+        auto in_f = phosg::fopen_unique(input_filename, "rt");
+        auto capture = ReplayCapture::from_text_log(in_f.get());
+        ReplayCaptureWriter w(output_filename, capture->flags());
+        auto cursor = capture->begin();
+        ReplayCaptureEvent ev;
+        while (cursor.next(ev)) {
+          w.add_event(ev);
+        }
+        w.flush();
+      }
+      phosg::log_info_f("Converted {} in {}", input_filename, phosg::format_duration(phosg::now() - start));
+    });
+
+Action a_load_test(
+    "load-test", "\
+  load-test [OPTIONS...]\n\
+    Run many scripted clients against the game server and report command\n\
+    latencies and throughput. Each client logs in, joins a lobby, and then\n\
+    repeatedly creates a game, walks around, kills enemies, picks up the items\n\
+    they drop, and leaves the game. By default, the server runs in-process\n\
+    (using the configuration given by --config) and the clients connect to it\n\
+    without using any sockets. Options:\n\
+      --remote=HOST: Connect to a server at HOST via TCP instead, using the\n\
+          ports from the configuration file.\n\
+      --clients=N: Number of clients to run (default 100).\n\
+      --versions=VERSION[,VERSION...]: Versions to use for the clients, in\n\
+          rotation (default GC_V3). Supported versions are DC_V2, PC_V2, GC_V3,\n\
+          and XB_V3.\n\
+      --duration=SECONDS: How long to run the test for (default 30).\n\
+      --ramp-up=SECONDS: Spread client logins over this period (default 0).\n\
+      --step-interval=MSECS: Delay between each client action (default 100).\n\
+      --kills-per-game=N: Kill this many enemies before leaving each game\n\
+          (default 10).\n\
+      --verbose: Don\'t suppress the server\'s informational logs.\n",
+    +[](phosg::Arguments& args) {
+      size_t num_clients = args.get<size_t>("clients", 100);
+      uint64_t duration_usecs = args.get<uint64_t>("duration", 30) * 1000000;
+      uint64_t ramp_up_usecs = args.get<uint64_t>("ramp-up", 0) * 1000000;
+      uint64_t step_usecs = args.get<uint64_t>("step-interval", 100) * 1000;
+      size_t kills_per_game = args.get<size_t>("kills-per-game", 10);
+      std::string remote_host = args.get<std::string>("remote", false);
+
+      std::vector<Version> versions;
+      std::string versions_str = args.get<std::string>("versions", false);
+      for (const auto& name : phosg::split(versions_str.empty() ? "GC_V3" : versions_str, ',')) {
+        versions.emplace_back(phosg::enum_for_name<Version>(name.c_str()));
+      }
+      if (num_clients == 0) {
+        throw std::invalid_argument("at least one client is required");
+      }
+
+#ifndef PHOSG_WINDOWS
+      signal(SIGPIPE, SIG_IGN);
+#endif
+
+      auto data_index = std::make_shared<DataIndex>(get_config_filename(args));
+      data_index->load_all();
+      if (!args.get<bool>("verbose")) {
+        set_all_log_levels(phosg::LogLevel::L_WARNING);
+      }
+
+      std::shared_ptr<ServerState> state;
+      std::shared_ptr<asio::io_context> io_context;
+      if (remote_host.empty()) {
+        state = ServerState::create_shared(data_index, true);
+        state->game_server = std::make_shared<GameServer>(state);
+        io_context = state->io_context;
+      } else {
+        io_context = std::make_shared<asio::io_context>(1);
+      }
+
+      auto stats = std::make_shared<LoadTestStats>();
+      stats->num_clients = num_clients;
+      uint64_t start_time = phosg::now();
+      uint64_t end_time = start_time + duration_usecs;
+      std::vector<std::shared_ptr<LoadTestSession>> sessions;
+      for (size_t z = 0; z < num_clients; z++) {
+        auto session = std::make_shared<LoadTestSession>(
+            io_context,
+            data_index,
+            state,
+            remote_host,
+            stats,
+            versions[z % versions.size()],
+            z,
+            (ramp_up_usecs * z) / num_clients,
+            end_time,
+            step_usecs,
+            kills_per_game);
+        asio::co_spawn(*io_context, session->run(), asio::detached);
+        sessions.emplace_back(std::move(session));
+      }
+
+      // Clients finish the game they're in after the end time, so give them some extra time before giving up on them
+      auto wait_for_sessions = [&]() -> asio::awaitable<void> {
+        uint64_t give_up_time = end_time + 10000000;
+        while (!stats->all_clients_done() && (phosg::now() < give_up_time)) {
+          co_await async_sleep(std::chrono::milliseconds(100));
+        }
+        io_context->stop();
+      };
+      asio::co_spawn(*io_context, wait_for_sessions(), asio::detached);
+
+      phosg::log_info_f("Starting {} clients", num_clients);
+      io_context->run();
+      stats->print(stdout, phosg::now() - start_time);
+      if (!stats->all_clients_done() || stats->clients_failed) {
+        size_t num_unfinished = num_clients - stats->clients_finished - stats->clients_failed;
+        throw std::runtime_error(std::format(
+            "{} clients failed and {} clients did not finish", stats->clients_failed, num_unfinished));
+      }
+    });
+
 Action a_run_server_replay_log(
     "", nullptr, +[](phosg::Arguments& args) {
       {
@@ -4481,20 +4787,32 @@ Action a_run_server_replay_log(
         data_index->is_debug = true;
       }
       data_index->load_all();
+      if (replay_log_filenames.empty() && !data_index->save_database_filename.empty()) {
+        config_log.info_f("Opening save database {}", data_index->save_database_filename);
+        save_store = std::make_shared<LogSaveStore>(data_index->save_database_filename);
+      }
       auto state = ServerState::create_shared(data_index, !replay_log_filenames.empty());
 
       std::shared_ptr<ServerShell> shell;
       std::shared_ptr<SignalWatcher> signal_watcher;
+      std::shared_ptr<PatchFileWatcher> patch_file_watcher;
       std::map<std::string, std::shared_ptr<ReplaySession>> replay_sessions;
       size_t completed_replay_count = 0;
 
+      auto load_replay_session = [](std::shared_ptr<ServerState> state, const std::string& log_filename) {
+        phosg::log_info_f("[Replay] Loading {}", log_filename);
+        if (ReplayCapture::is_capture_file(log_filename)) {
+          return std::make_shared<ReplaySession>(state, ReplayCapture::from_file(log_filename));
+        }
+        auto log_f = phosg::fopen_unique(log_filename, "rt");
+        return std::make_shared<ReplaySession>(state, log_f.get());
+      };
+
       auto run_replay = [&](const std::string& log_filename) -> asio::awaitable<void> {
         auto replay_state = state->clone_shared();
         replay_state->game_server = std::make_shared<GameServer>(replay_state);
 
-        phosg::log_info_f("[Replay] Loading {}", log_filename);
-        auto log_f = phosg::fopen_unique(log_filename, "rt");
-        auto replay_session = std::make_shared<ReplaySession>(replay_state, log_f.get());
+        auto replay_session = load_replay_session(replay_state, log_filename);
         replay_sessions.emplace(log_filename, replay_session);
 
         phosg::log_info_f("[Replay] {} ...", log_filename);
@@ -4530,6 +4848,16 @@ Action a_run_server_replay_log(
         state->io_context->stop();
       };
 
+      // Replays can be captured too; the capture then contains the commands the server sent during the replay. (This is
+      // used by tests/replay-capture.test.sh.)
+      std::string replay_capture_filename = args.get<std::string>("replay-capture", false);
+      if (!replay_capture_filename.empty()) {
+        config_log.info_f("Recording game server traffic to {}", replay_capture_filename);
+        uint32_t capture_flags = (state->use_psov2_rand_crypt ? ReplayCapture::Flag::USE_PSOV2_RAND_CRYPT : 0) |
+            (state->use_legacy_item_random_behavior ? ReplayCapture::Flag::USE_LEGACY_ITEM_RANDOM_BEHAVIOR : 0);
+        state->replay_capture = std::make_shared<ReplayCaptureWriter>(replay_capture_filename, capture_flags);
+      }
+
       if (!replay_log_filenames.empty()) {
         // TODO: Do this properly via a config option, you lazy bum
         state->data->dol_file_index = std::make_shared<DOLFileIndex>();
@@ -4541,9 +4869,7 @@ Action a_run_server_replay_log(
           }
         } else {
           for (const auto& log_filename : replay_log_filenames) {
-            phosg::log_info_f("[Replay] Loading {}", log_filename);
-            auto log_f = phosg::fopen_unique(log_filename, "rt");
-            replay_sessions.emplace(log_filename, std::make_shared<ReplaySession>(state, log_f.get()));
+            replay_sessions.emplace(log_filename, load_replay_session(state, log_filename));
           }
           asio::co_spawn(*state->io_context, run_replays_sequentially(), asio::detached);
         }
@@ -4635,6 +4961,14 @@ Action a_run_server_replay_log(
         config_log.info_f("Enabling signal watcher");
         signal_watcher = std::make_shared<SignalWatcher>(state);
 #endif
+
+        patch_file_watcher = std::make_shared<PatchFileWatcher>(
+            state, std::vector<std::string>{"system/patch-pc", "system/patch-bb"});
+
+        asio::co_spawn(*state->io_context, state->team_save_task(), asio::detached);
+
+        config_log.info_f("Starting save queue");
+        file_write_queue.start();
       }
 
 #ifndef PHOSG_WINDOWS
@@ -4663,6 +4997,16 @@ Action a_run_server_replay_log(
 
       state->io_context->run();
       config_log.info_f("Normal shutdown");
+      if (state->replay_capture) {
+        state->replay_capture->flush();
+        config_log.info_f("Wrote {} bytes to replay capture", state->replay_capture->get_bytes_written());
+        state->replay_capture.reset();
+      }
+      if (state->team_index) {
+        state->team_index->flush();
+      }
+      save_store->flush();
+      file_write_queue.stop();
 
       if (!replay_sessions.empty()) {
         size_t num_failed_replays = 0;
@@ -6152,40 +6152,40 @@ bool MapState::EntityIterator::operator!=(const EntityIterator& other) const {
   return !this->operator==(other);
 }
 
-std::shared_ptr<MapState::ObjectState>& MapState::ObjectIterator::operator*() {
+std::shared_ptr<MapState::ObjectState> MapState::ObjectIterator::operator*() {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   const auto& obj = fc.super_map->version(this->version).objects.at(this->relative_index);
-  return this->map_state->object_states.at(fc.base_super_ids.base_object_index + obj->super_id);
+  return this->map_state->object_state_for_k_id(fc.base_super_ids.base_object_index + obj->super_id);
 }
 size_t MapState::ObjectIterator::num_entities_on_current_floor() const {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   return fc.super_map ? fc.super_map->version(this->version).objects.size() : 0;
 }
 
-std::shared_ptr<MapState::EnemyState>& MapState::EnemyIterator::operator*() {
+std::shared_ptr<MapState::EnemyState> MapState::EnemyIterator::operator*() {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   const auto& ene = fc.super_map->version(this->version).enemies.at(this->relative_index);
-  return this->map_state->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id);
+  return this->map_state->enemy_state_for_e_id(fc.base_super_ids.base_enemy_index + ene->super_id);
 }
 size_t MapState::EnemyIterator::num_entities_on_current_floor() const {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   return fc.super_map ? fc.super_map->version(this->version).enemies.size() : 0;
 }
 
-std::shared_ptr<MapState::EnemyState>& MapState::EnemySetIterator::operator*() {
+std::shared_ptr<MapState::EnemyState> MapState::EnemySetIterator::operator*() {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   const auto& ene = fc.super_map->version(this->version).enemy_sets.at(this->relative_index);
-  return this->map_state->enemy_set_states.at(fc.base_super_ids.base_enemy_set_index + ene->super_set_id);
+  return this->map_state->enemy_state_for_set_id(fc.base_super_ids.base_enemy_set_index + ene->super_set_id);
 }
 size_t MapState::EnemySetIterator::num_entities_on_current_floor() const {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   return fc.super_map ? fc.super_map->version(this->version).enemy_sets.size() : 0;
 }
 
-std::shared_ptr<MapState::EventState>& MapState::EventIterator::operator*() {
+std::shared_ptr<MapState::EventState> MapState::EventIterator::operator*() {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
   const auto& ev = fc.super_map->version(this->version).events.at(this->relative_index);
-  return this->map_state->event_states.at(fc.base_super_ids.base_event_index + ev->super_id);
+  return this->map_state->event_state_for_w_id(fc.base_super_ids.base_event_index + ev->super_id);
 }
 size_t MapState::EventIterator::num_entities_on_current_floor() const {
   const auto& fc = this->map_state->floor_config_entries.at(this->floor);
@@ -6212,6 +6212,10 @@ MapState::MapState(
   this->floor_to_area = floor_map_defs[0]->floor_to_area;
 
   this->floor_config_entries.resize(0x12);
+  if (floor_map_defs.size() > this->floor_config_entries.size()) {
+    floor_map_defs.resize(this->floor_config_entries.size());
+  }
+  this->reserve_states(floor_map_defs);
   for (size_t floor = 0; floor < this->floor_config_entries.size(); floor++) {
     auto& this_fc = this->floor_config_entries[floor];
     this_fc.super_map = (floor < floor_map_defs.size()) ? floor_map_defs[floor] : nullptr;
@@ -6231,10 +6235,10 @@ MapState::MapState(
           next_indexes.base_enemy_set_index = this_indexes.base_enemy_set_index + entities.enemy_sets.size();
           next_indexes.base_event_index = this_indexes.base_event_index + entities.events.size();
         }
-        next_fc.base_super_ids.base_object_index = this->object_states.size();
-        next_fc.base_super_ids.base_enemy_index = this->enemy_states.size();
-        next_fc.base_super_ids.base_enemy_set_index = this->enemy_set_states.size();
-        next_fc.base_super_ids.base_event_index = this->event_states.size();
+        next_fc.base_super_ids.base_object_index = this->states->objects.size();
+        next_fc.base_super_ids.base_enemy_index = this->states->enemies.size();
+        next_fc.base_super_ids.base_enemy_set_index = this->states->enemy_set_e_ids.size();
+        next_fc.base_super_ids.base_event_index = this->states->events.size();
       } else {
         for (Version v : ALL_NON_PATCH_VERSIONS) {
           next_fc.base_indexes_for_version(v) = this_fc.base_indexes_for_version(v);
@@ -6263,6 +6267,7 @@ MapState::MapState(
       bb_rare_rates(bb_rare_rates) {
   FloorConfig& fc = this->floor_config_entries.emplace_back();
   fc.super_map = quest_map_def;
+  this->reserve_states({quest_map_def});
   this->index_super_map(fc, rand_crypt);
   this->compute_dynamic_object_base_indexes();
   this->verify();
@@ -6273,17 +6278,36 @@ MapState::MapState()
       bb_rare_rates(this->DEFAULT_RARE_ENEMIES) {}
 
 void MapState::reset() {
-  for (auto& obj_st : this->object_states) {
-    obj_st->reset();
+  for (auto& obj_st : this->states->objects) {
+    obj_st.reset();
   }
-  for (auto& ene_st : this->enemy_states) {
-    ene_st->reset();
+  for (auto& ene_st : this->states->enemies) {
+    ene_st.reset();
   }
-  for (auto& ev_st : this->event_states) {
-    ev_st->reset();
+  for (auto& ev_st : this->states->events) {
+    ev_st.reset();
   }
 }
 
+void MapState::reserve_states(const std::vector<std::shared_ptr<const SuperMap>>& super_maps) {
+  size_t num_objects = this->states->objects.size();
+  size_t num_enemies = this->states->enemies.size();
+  size_t num_enemy_sets = this->states->enemy_set_e_ids.size();
+  size_t num_events = this->states->events.size();
+  for (const auto& super_map : super_maps) {
+    if (super_map) {
+      num_objects += super_map->all_objects().size();
+      num_enemies += super_map->all_enemies().size();
+      num_enemy_sets += super_map->all_enemy_sets().size();
+      num_events += super_map->all_events().size();
+    }
+  }
+  this->states->objects.reserve(num_objects);
+  this->states->enemies.reserve(num_enemies);
+  this->states->enemy_set_e_ids.reserve(num_enemy_sets);
+  this->states->events.reserve(num_events);
+}
+
 void MapState::index_super_map(const FloorConfig& fc, std::shared_ptr<RandomGenerator> rand_crypt) {
   if (!fc.super_map) {
     throw std::logic_error("cannot index floor config with no map definition");
@@ -6292,26 +6316,34 @@ void MapState::index_super_map(const FloorConfig& fc, std::shared_ptr<RandomGene
     throw std::runtime_error("supermaps have different floor configs");
   }
 
+  auto& states = *this->states;
+  if ((states.objects.capacity() - states.objects.size() < fc.super_map->all_objects().size()) ||
+      (states.enemies.capacity() - states.enemies.size() < fc.super_map->all_enemies().size()) ||
+      (states.events.capacity() - states.events.size() < fc.super_map->all_events().size())) {
+    throw std::logic_error("entity state storage was not reserved before indexing supermap");
+  }
+  states.super_maps.emplace_back(fc.super_map);
+
   for (const auto& obj : fc.super_map->all_objects()) {
-    auto& obj_st = this->object_states.emplace_back(std::make_shared<ObjectState>());
-    obj_st->k_id = this->object_states.size() - 1;
-    obj_st->super_obj = obj;
+    auto& obj_st = states.objects.emplace_back();
+    obj_st.k_id = states.objects.size() - 1;
+    obj_st.super_obj = obj.get();
   }
 
   for (const auto& ene : fc.super_map->all_enemies()) {
-    auto& ene_st = this->enemy_states.emplace_back(std::make_shared<EnemyState>());
+    auto* ene_st = &states.enemies.emplace_back();
 
+    ene_st->e_id = states.enemies.size() - 1;
     if (ene->child_index == 0) {
-      this->enemy_set_states.emplace_back(ene_st);
+      states.enemy_set_e_ids.emplace_back(ene_st->e_id);
     }
-    ene_st->e_id = this->enemy_states.size() - 1;
-    ene_st->set_id = this->enemy_set_states.size() - 1;
-    ene_st->super_ene = ene;
+    ene_st->set_id = states.enemy_set_e_ids.size() - 1;
+    ene_st->super_ene = ene.get();
 
     if (ene->alias_target_ene) {
       ssize_t delta = ene->alias_target_ene->super_id - ene->super_id;
-      ene_st->alias_target_ene_st = this->enemy_states.at(ene_st->e_id + delta);
-      if (ene_st->alias_target_ene_st->super_ene != ene->alias_target_ene) {
+      ene_st->alias_target_ene_st = &states.enemies.at(ene_st->e_id + delta);
+      if (ene_st->alias_target_ene_st->super_ene != ene->alias_target_ene.get()) {
         throw std::logic_error("found incorrect alias target state for enemy");
       }
       if (ene_st->alias_target_ene_st->super_ene->alias_target_ene) {
@@ -6387,14 +6419,14 @@ void MapState::index_super_map(const FloorConfig& fc, std::shared_ptr<RandomGene
   }
 
   for (const auto& ev : fc.super_map->all_events()) {
-    auto& ev_st = this->event_states.emplace_back(std::make_shared<EventState>());
-    ev_st->w_id = this->event_states.size() - 1;
-    ev_st->super_ev = ev;
+    auto& ev_st = states.events.emplace_back();
+    ev_st.w_id = states.events.size() - 1;
+    ev_st.super_ev = ev.get();
   }
 }
 
 void MapState::compute_dynamic_object_base_indexes() {
-  this->dynamic_obj_base_k_id = this->object_states.size();
+  this->dynamic_obj_base_k_id = this->states->objects.size();
 
   // Compute the maximum object ID for each version. We can't just use the last object because that object may not
   // exist on all versions, and we can't just look at the last floor, because that floor may be empty on some versions.
@@ -6455,7 +6487,7 @@ std::shared_ptr<MapState::ObjectState> MapState::object_state_for_index(Version
           throw std::out_of_range("there are no objects on the specified floor");
         }
         const auto& obj = fc.super_map->version(version).objects.at(object_index - base_object_index);
-        return this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id);
+        return this->object_state_for_k_id(fc.base_super_ids.base_object_index + obj->super_id);
       }
     }
     throw std::out_of_range("the specified enemy does not exist");
@@ -6481,7 +6513,7 @@ std::shared_ptr<MapState::ObjectState> MapState::object_state_for_index(Version
       throw std::out_of_range("there are no objects on the specified floor");
     }
     const auto& obj = fc.super_map->version(version).objects.at(object_index - base_object_index);
-    return this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id);
+    return this->object_state_for_k_id(fc.base_super_ids.base_object_index + obj->super_id);
 
   } else {
     size_t k_id_delta = object_index - dynamic_obj_base_index;
@@ -6498,7 +6530,7 @@ std::vector<std::shared_ptr<MapState::ObjectState>> MapState::object_states_for_
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& obj : fc.super_map->objects_for_floor_room_group(version, floor, room, group)) {
-      ret.emplace_back(this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id));
+      ret.emplace_back(this->object_state_for_k_id(fc.base_super_ids.base_object_index + obj->super_id));
     }
   }
   return ret;
@@ -6510,7 +6542,7 @@ std::vector<std::shared_ptr<MapState::ObjectState>> MapState::door_states_for_sw
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& obj : fc.super_map->doors_for_switch_flag(version, floor, switch_flag)) {
-      ret.emplace_back(this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id));
+      ret.emplace_back(this->object_state_for_k_id(fc.base_super_ids.base_object_index + obj->super_id));
     }
   }
   return ret;
@@ -6526,7 +6558,7 @@ std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_index(Version ve
         throw std::out_of_range("there are no enemies on the specified floor");
       }
       const auto& ene = fc.super_map->version(version).enemies.at(enemy_index - base_enemy_index);
-      return this->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id);
+      return this->enemy_state_for_e_id(fc.base_super_ids.base_enemy_index + ene->super_id);
     }
   }
   throw std::out_of_range("the specified enemy does not exist");
@@ -6542,7 +6574,7 @@ std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_index(Version ve
     throw std::out_of_range("there are no enemies on the specified floor");
   }
   const auto& ene = fc.super_map->version(version).enemies.at(enemy_index - base_enemy_index);
-  return this->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id);
+  return this->enemy_state_for_e_id(fc.base_super_ids.base_enemy_index + ene->super_id);
 }
 
 std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_set_index(Version version, uint8_t floor, uint16_t enemy_set_index) {
@@ -6555,7 +6587,7 @@ std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_set_index(Versio
     throw std::out_of_range("there are no enemies on the specified floor");
   }
   const auto& ene = fc.super_map->version(version).enemies.at(enemy_set_index - base_enemy_set_index);
-  return this->enemy_states.at(fc.base_super_ids.base_enemy_set_index + ene->super_set_id);
+  return this->enemy_state_for_e_id(fc.base_super_ids.base_enemy_set_index + ene->super_set_id);
 }
 
 std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_floor_type(Version version, uint8_t floor, EnemyType type) {
@@ -6563,7 +6595,7 @@ std::shared_ptr<MapState::EnemyState> MapState::enemy_state_for_floor_type(Versi
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     const auto& ene = fc.super_map->enemy_for_floor_type(version, floor, type);
-    return this->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id);
+    return this->enemy_state_for_e_id(fc.base_super_ids.base_enemy_index + ene->super_id);
   }
   throw std::out_of_range("map definition missing for floor");
 }
@@ -6574,7 +6606,7 @@ std::vector<std::shared_ptr<MapState::EnemyState>> MapState::enemy_states_for_fl
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& ene : fc.super_map->enemies_for_floor_room_wave(version, floor, room, wave_number)) {
-      ret.emplace_back(this->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id));
+      ret.emplace_back(this->enemy_state_for_e_id(fc.base_super_ids.base_enemy_index + ene->super_id));
     }
   }
   return ret;
@@ -6590,7 +6622,7 @@ std::shared_ptr<MapState::EventState> MapState::event_state_for_index(Version ve
     throw std::out_of_range("there are no events on the specified floor");
   }
   const auto& ev = fc.super_map->version(version).events.at(event_index - base_event_index);
-  return this->event_states.at(fc.base_super_ids.base_event_index + ev->super_id);
+  return this->event_state_for_w_id(fc.base_super_ids.base_event_index + ev->super_id);
 }
 
 std::vector<std::shared_ptr<MapState::EventState>> MapState::event_states_for_id(Version version, uint8_t floor, uint32_t event_id) {
@@ -6598,7 +6630,7 @@ std::vector<std::shared_ptr<MapState::EventState>> MapState::event_states_for_id
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& ev : fc.super_map->events_for_id(version, floor, event_id)) {
-      ret.emplace_back(this->event_states.at(fc.base_super_ids.base_event_index + ev->super_id));
+      ret.emplace_back(this->event_state_for_w_id(fc.base_super_ids.base_event_index + ev->super_id));
     }
   }
   return ret;
@@ -6609,7 +6641,7 @@ std::vector<std::shared_ptr<MapState::EventState>> MapState::event_states_for_fl
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& ev : fc.super_map->events_for_floor(version, floor)) {
-      ret.emplace_back(this->event_states.at(fc.base_super_ids.base_event_index + ev->super_id));
+      ret.emplace_back(this->event_state_for_w_id(fc.base_super_ids.base_event_index + ev->super_id));
     }
   }
   return ret;
@@ -6621,7 +6653,7 @@ std::vector<std::shared_ptr<MapState::EventState>> MapState::event_states_for_fl
   auto& fc = this->floor_config(floor);
   if (fc.super_map) {
     for (const auto& ev : fc.super_map->events_for_floor_room_wave(version, floor, room, wave_number)) {
-      ret.emplace_back(this->event_states.at(fc.base_super_ids.base_event_index + ev->super_id));
+      ret.emplace_back(this->event_state_for_w_id(fc.base_super_ids.base_event_index + ev->super_id));
     }
   }
   return ret;
@@ -6654,8 +6686,8 @@ void MapState::import_object_states_from_sync(
     for (; object_index < fc_end_object_index; object_index++) {
       const auto& entry = entries[object_index];
       const auto& obj = entities.objects.at(object_index - base_indexes.base_object_index);
-      auto& obj_st = this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id);
-      if (obj_st->super_obj != obj) {
+      auto* obj_st = &this->states->objects.at(fc.base_super_ids.base_object_index + obj->super_id);
+      if (obj_st->super_obj != obj.get()) {
         throw std::logic_error("super object link is incorrect");
       }
       if (obj_st->game_flags != entry.flags) {
@@ -6690,9 +6722,9 @@ void MapState::import_enemy_states_from_sync(Version from_version, const SyncEne
     for (; enemy_index < std::min<size_t>(fc_end_enemy_index, entry_count); enemy_index++) {
       const auto& entry = entries[enemy_index];
       const auto& ene = entities.enemies.at(enemy_index - base_indexes.base_enemy_index);
-      auto& ene_st = this->enemy_states.at(fc.base_super_ids.base_enemy_index + ene->super_id);
+      auto* ene_st = &this->states->enemies.at(fc.base_super_ids.base_enemy_index + ene->super_id);
       // Only set the state if it's not an alias
-      if (ene_st->super_ene == ene) {
+      if (ene_st->super_ene == ene.get()) {
         if (ene_st->game_flags != entry.flags) {
           this->log.info_f("({:04X} => E-{:03X}) Game flags from client ({:08X}) do not match game flags from map ({:08X})",
               enemy_index, ene_st->e_id, entry.flags, ene_st->game_flags);
@@ -6746,8 +6778,8 @@ void MapState::import_flag_states_from_sync(
       for (; object_index < std::min<size_t>(fc_end_object_index, object_set_flags_count); object_index++) {
         uint16_t set_flags = object_set_flags[object_index];
         const auto& obj = entities.objects.at(object_index - base_indexes.base_object_index);
-        auto& obj_st = this->object_states.at(fc.base_super_ids.base_object_index + obj->super_id);
-        if (obj_st->super_obj != obj) {
+        auto* obj_st = &this->states->objects.at(fc.base_super_ids.base_object_index + obj->super_id);
+        if (obj_st->super_obj != obj.get()) {
           throw std::logic_error("super object link is incorrect");
         }
         if (obj_st->set_flags != set_flags) {
@@ -6782,8 +6814,9 @@ void MapState::import_flag_states_from_sync(
       for (; enemy_set_index < std::min<size_t>(fc_end_enemy_set_index, enemy_set_flags_count); enemy_set_index++) {
         uint16_t set_flags = enemy_set_flags[enemy_set_index];
         const auto& ene = entities.enemy_sets.at(enemy_set_index - base_indexes.base_enemy_set_index);
-        auto& ene_st = this->enemy_set_states.at(fc.base_super_ids.base_enemy_set_index + ene->super_set_id);
-        if (ene_st->super_ene != ene) {
+        auto* ene_st = &this->states->enemies.at(
+            this->states->enemy_set_e_ids.at(fc.base_super_ids.base_enemy_set_index + ene->super_set_id));
+        if (ene_st->super_ene != ene.get()) {
           throw std::logic_error("super enemy link is incorrect");
         }
         if (ene_st->set_flags != set_flags) {
@@ -6817,7 +6850,7 @@ void MapState::import_flag_states_from_sync(
       for (; event_index < std::min<size_t>(fc_end_event_index, event_flags_count); event_index++) {
         uint16_t flags = event_flags[event_index];
         const auto& ev = entities.events.at(event_index - base_indexes.base_event_index);
-        auto& ev_st = this->event_states.at(fc.base_super_ids.base_event_index + ev->super_id);
+        auto* ev_st = &this->states->events.at(fc.base_super_ids.base_event_index + ev->super_id);
         if (ev_st->flags != flags) {
           this->log.info_f("({:04X} => W-{:03X}) Set flags from client ({:04X}) do not match flags from map ({:04X})",
               event_index, ev_st->w_id, flags, ev_st->flags);
@@ -6847,29 +6880,30 @@ void MapState::verify() const {
         total_event_count += fc.super_map->all_events().size();
       }
     }
-    if (this->object_states.size() != total_object_count) {
+    const auto& states = *this->states;
+    if (states.objects.size() != total_object_count) {
       throw std::logic_error(std::format(
           "map state object count (0x{:X}) does not match supermap object count (0x{:X})",
-          this->object_states.size(), total_object_count));
+          states.objects.size(), total_object_count));
     }
-    if (this->enemy_states.size() != total_enemy_count) {
+    if (states.enemies.size() != total_enemy_count) {
       throw std::logic_error(std::format(
           "map state enemy count (0x{:X}) does not match supermap enemy count (0x{:X})",
-          this->enemy_states.size(), total_enemy_count));
+          states.enemies.size(), total_enemy_count));
     }
-    if (this->enemy_set_states.size() != total_enemy_set_count) {
+    if (states.enemy_set_e_ids.size() != total_enemy_set_count) {
       throw std::logic_error(std::format(
           "map state enemy set count (0x{:X}) does not match supermap enemy set count (0x{:X})",
-          this->enemy_set_states.size(), total_enemy_set_count));
+          states.enemy_set_e_ids.size(), total_enemy_set_count));
     }
-    if (this->event_states.size() != total_event_count) {
+    if (states.events.size() != total_event_count) {
       throw std::logic_error(std::format(
           "map state event count (0x{:X}) does not match supermap event count (0x{:X})",
-          this->event_states.size(), total_event_count));
+          states.events.size(), total_event_count));
     }
 
-    for (size_t k_id = 0; k_id < this->object_states.size(); k_id++) {
-      const auto& obj_st = this->object_states[k_id];
+    for (size_t k_id = 0; k_id < states.objects.size(); k_id++) {
+      const auto* obj_st = &states.objects[k_id];
       if (obj_st->k_id != k_id) {
         throw std::logic_error("mismatched object state k_id");
       }
@@ -6878,8 +6912,8 @@ void MapState::verify() const {
         throw std::logic_error("mismatched object state super_id");
       }
     }
-    for (size_t e_id = 0; e_id < this->enemy_states.size(); e_id++) {
-      const auto& ene_st = this->enemy_states[e_id];
+    for (size_t e_id = 0; e_id < states.enemies.size(); e_id++) {
+      const auto* ene_st = &states.enemies[e_id];
       if (ene_st->e_id != e_id) {
         throw std::logic_error("mismatched enemy state e_id");
       }
@@ -6888,8 +6922,8 @@ void MapState::verify() const {
         throw std::logic_error("mismatched enemy state super_id");
       }
     }
-    for (size_t set_id = 0; set_id < this->enemy_set_states.size(); set_id++) {
-      const auto& ene_st = this->enemy_set_states[set_id];
+    for (size_t set_id = 0; set_id < states.enemy_set_e_ids.size(); set_id++) {
+      const auto* ene_st = &states.enemies.at(states.enemy_set_e_ids[set_id]);
       if (ene_st->set_id != set_id) {
         throw std::logic_error("mismatched enemy set state set_id");
       }
@@ -6898,8 +6932,8 @@ void MapState::verify() const {
         throw std::logic_error("mismatched enemy set state super_set_id");
       }
     }
-    for (size_t w_id = 0; w_id < this->event_states.size(); w_id++) {
-      const auto& ev_st = this->event_states[w_id];
+    for (size_t w_id = 0; w_id < states.events.size(); w_id++) {
+      const auto* ev_st = &states.events[w_id];
       if (ev_st->w_id != w_id) {
         throw std::logic_error("mismatched event state w_id");
       }
@@ -6941,15 +6975,15 @@ void MapState::verify() const {
       remaining_bb_rare_indexes.emplace(index);
     }
 
-    for (const auto& ene : this->enemy_states) {
-      if (!ene->is_rare(Version::BB_V4)) {
+    for (const auto& ene : states.enemies) {
+      if (!ene.is_rare(Version::BB_V4)) {
         continue;
       }
-      if (ene->super_ene->is_default_rare_bb) {
+      if (ene.super_ene->is_default_rare_bb) {
         continue;
       }
-      size_t base_enemy_index = this->floor_config(ene->super_ene->floor).base_indexes_for_version(Version::BB_V4).base_enemy_index;
-      size_t enemy_index = base_enemy_index + ene->super_ene->version(Version::BB_V4).relative_enemy_index;
+      size_t base_enemy_index = this->floor_config(ene.super_ene->floor).base_indexes_for_version(Version::BB_V4).base_enemy_index;
+      size_t enemy_index = base_enemy_index + ene.super_ene->version(Version::BB_V4).relative_enemy_index;
       if (!remaining_bb_rare_indexes.erase(enemy_index)) {
         throw std::logic_error(std::format("BB random rare enemy index {:04X} not present in indexes set", enemy_index));
       }
@@ -6992,11 +7026,11 @@ void MapState::print(FILE* stream) const {
 
   phosg::fwrite_fmt(stream, "Objects:\n");
   phosg::fwrite_fmt(stream, "  FL OBJID DCTE DCPR DCV1 DCV2 PCTE PCV2 GCTE GCV3 E3TE GCE3 XBV3 BBV4 OBJECT\n");
-  for (const auto& obj_st : this->object_states) {
-    phosg::fwrite_fmt(stream, "  {:02X} K-{:03X}", obj_st->super_obj->floor, obj_st->k_id);
-    const auto& fc = this->floor_config(obj_st->super_obj->floor);
+  for (const auto& obj_st : this->states->objects) {
+    phosg::fwrite_fmt(stream, "  {:02X} K-{:03X}", obj_st.super_obj->floor, obj_st.k_id);
+    const auto& fc = this->floor_config(obj_st.super_obj->floor);
     for (Version v : ALL_NON_PATCH_VERSIONS) {
-      const auto& obj_v = obj_st->super_obj->version(v);
+      const auto& obj_v = obj_st.super_obj->version(v);
       if (obj_v.relative_object_index == 0xFFFF) {
         fputs(" ----", stream);
       } else {
@@ -7004,18 +7038,18 @@ void MapState::print(FILE* stream) const {
         phosg::fwrite_fmt(stream, " {:04X}", index);
       }
     }
-    std::string obj_str = obj_st->super_obj->str();
+    std::string obj_str = obj_st.super_obj->str();
     phosg::fwrite_fmt(stream, " {} game_flags={:04X} set_flags={:04X} item_drop_checked={}\n",
-        obj_str, obj_st->game_flags, obj_st->set_flags, obj_st->item_drop_checked ? "true" : "false");
+        obj_str, obj_st.game_flags, obj_st.set_flags, obj_st.item_drop_checked ? "true" : "false");
   }
 
   phosg::fwrite_fmt(stream, "Enemies:\n");
   phosg::fwrite_fmt(stream, "  FL ENEID DCTE----- DCPR----- DCV1----- DCV2----- PCTE----- PCV2----- GCTE----- GCV3----- EP3TE---- GCEP3---- XBV3----- BBV4----- ENEMY\n");
-  for (const auto& ene_st : this->enemy_states) {
-    phosg::fwrite_fmt(stream, "  {:02X} E-{:03X}", ene_st->super_ene->floor, ene_st->e_id);
-    const auto& fc = this->floor_config(ene_st->super_ene->floor);
+  for (const auto& ene_st : this->states->enemies) {
+    phosg::fwrite_fmt(stream, "  {:02X} E-{:03X}", ene_st.super_ene->floor, ene_st.e_id);
+    const auto& fc = this->floor_config(ene_st.super_ene->floor);
     for (Version v : ALL_NON_PATCH_VERSIONS) {
-      const auto& ene_v = ene_st->super_ene->version(v);
+      const auto& ene_v = ene_st.super_ene->version(v);
       if (ene_v.relative_enemy_index == 0xFFFF) {
         fputs(" ---------", stream);
       } else {
@@ -7024,9 +7058,9 @@ void MapState::print(FILE* stream) const {
         phosg::fwrite_fmt(stream, " {:04X}-{:04X}", index, set_index);
       }
     }
-    std::string ene_str = ene_st->super_ene->str();
+    std::string ene_str = ene_st.super_ene->str();
     phosg::fwrite_fmt(stream, " {} total_damage={:04X} rare_flags={:04X} game_flags={:08X} set_flags={:04X} server_flags={:04X}\n",
-        ene_str, ene_st->total_damage, ene_st->rare_flags, ene_st->game_flags, ene_st->set_flags, ene_st->server_flags);
+        ene_str, ene_st.total_damage, ene_st.rare_flags, ene_st.game_flags, ene_st.set_flags, ene_st.server_flags);
   }
 
   if (this->bb_rare_enemy_indexes.empty()) {
@@ -7041,11 +7075,11 @@ void MapState::print(FILE* stream) const {
 
   phosg::fwrite_fmt(stream, "Events:\n");
   phosg::fwrite_fmt(stream, "  FL EVTID DCTE DCPR DCV1 DCV2 PCTE PCV2 GCTE GCV3 E3TE GCE3 XBV3 BBV4 EVENT\n");
-  for (const auto& ev_st : this->event_states) {
-    phosg::fwrite_fmt(stream, "  {:02X} W-{:03X}", ev_st->super_ev->floor, ev_st->w_id);
-    const auto& fc = this->floor_config(ev_st->super_ev->floor);
+  for (const auto& ev_st : this->states->events) {
+    phosg::fwrite_fmt(stream, "  {:02X} W-{:03X}", ev_st.super_ev->floor, ev_st.w_id);
+    const auto& fc = this->floor_config(ev_st.super_ev->floor);
     for (Version v : ALL_NON_PATCH_VERSIONS) {
-      const auto& ev_v = ev_st->super_ev->version(v);
+      const auto& ev_v = ev_st.super_ev->version(v);
       if (ev_v.relative_event_index == 0xFFFF) {
         fputs(" ----", stream);
       } else {
@@ -7053,7 +7087,7 @@ void MapState::print(FILE* stream) const {
         phosg::fwrite_fmt(stream, " {:04X}", index);
       }
     }
-    phosg::fwrite_fmt(stream, " {} set_flags={:04X}\n", ev_st->super_ev->str(), ev_st->flags);
+    phosg::fwrite_fmt(stream, " {} set_flags={:04X}\n", ev_st.super_ev->str(), ev_st.flags);
   }
 }
 
@@ -736,13 +736,15 @@ public:
   static const std::shared_ptr<const RareEnemyRates> NO_RARE_ENEMIES;
   static const std::shared_ptr<const RareEnemyRates> DEFAULT_RARE_ENEMIES;
 
+  // The state structures are trivially copyable, and are stored contiguously (see StateStorage below). The super_*
+  // pointers are non-owning; the storage holds references to the supermaps they point into.
   struct ObjectState {
     // WARNING: super_obj CAN BE NULL! This is not the case for enemies and events; their super entities are never
     // null. In the case of objects, dynamic objects like player-set traps have object IDs past the end of the map's
     // object list, and when queried, the MapState will return a temporary ObjectState with a null super_obj. (In these
     // cases, only k_id is needed for correctness.)
-    std::shared_ptr<const SuperMap::Object> super_obj;
-    size_t k_id = 0;
+    const SuperMap::Object* super_obj = nullptr;
+    uint32_t k_id = 0;
     uint16_t game_flags = 0;
     uint16_t set_flags = 0;
     bool item_drop_checked = false;
@@ -762,8 +764,8 @@ public:
   };
 
   struct EnemyState {
-    std::shared_ptr<EnemyState> alias_target_ene_st; // Null for most enemies
-    std::shared_ptr<const SuperMap::Enemy> super_ene;
+    EnemyState* alias_target_ene_st = nullptr; // Null for most enemies; see resolve_enemy_alias
+    const SuperMap::Enemy* super_ene = nullptr;
     enum Flag {
       LAST_HIT_MASK = 0x0003,
       ITEM_DROPPED = 0x0004,
@@ -773,14 +775,14 @@ public:
       ALL_HITS_MASK_FIRST = 0x0100,
       ALL_HITS_MASK = 0x0F00,
     };
-    size_t e_id = 0;
-    size_t set_id = 0;
+    uint32_t e_id = 0;
+    uint32_t set_id = 0;
     uint32_t game_flags = 0; // From 6x0A
     uint16_t total_damage = 0;
-    uint16_t rare_flags = 0;
-    uint16_t mericarand_variant_flags = 0;
     uint16_t set_flags = 0; // Only used if super_ene->child_index == 0
     uint16_t server_flags = 0;
+    uint16_t rare_flags = 0;
+    uint16_t mericarand_variant_flags = 0;
 
     inline void reset() {
       this->game_flags = 0;
@@ -847,8 +849,8 @@ public:
   };
 
   struct EventState {
-    std::shared_ptr<const SuperMap::Event> super_ev;
-    size_t w_id = 0;
+    const SuperMap::Event* super_ev = nullptr;
+    uint32_t w_id = 0;
     uint16_t flags = 0;
 
     inline void reset() {
@@ -899,7 +901,7 @@ public:
   class ObjectIterator : public EntityIterator {
   public:
     using EntityIterator::EntityIterator;
-    std::shared_ptr<ObjectState>& operator*();
+    std::shared_ptr<ObjectState> operator*();
 
   protected:
     virtual size_t num_entities_on_current_floor() const;
@@ -908,7 +910,7 @@ public:
   class EnemyIterator : public EntityIterator {
   public:
     using EntityIterator::EntityIterator;
-    std::shared_ptr<EnemyState>& operator*();
+    std::shared_ptr<EnemyState> operator*();
 
   protected:
     virtual size_t num_entities_on_current_floor() const;
@@ -917,7 +919,7 @@ public:
   class EnemySetIterator : public EntityIterator {
   public:
     using EntityIterator::EntityIterator;
-    std::shared_ptr<EnemyState>& operator*();
+    std::shared_ptr<EnemyState> operator*();
 
   protected:
     virtual size_t num_entities_on_current_floor() const;
@@ -926,7 +928,7 @@ public:
   class EventIterator : public EntityIterator {
   public:
     using EntityIterator::EntityIterator;
-    std::shared_ptr<EventState>& operator*();
+    std::shared_ptr<EventState> operator*();
 
   protected:
     virtual size_t num_entities_on_current_floor() const;
@@ -954,10 +956,20 @@ public:
   uint8_t event = 0;
   uint32_t random_seed = 0;
   std::shared_ptr<const RareEnemyRates> bb_rare_rates;
-  std::vector<std::shared_ptr<ObjectState>> object_states;
-  std::vector<std::shared_ptr<EnemyState>> enemy_states;
-  std::vector<std::shared_ptr<EnemyState>> enemy_set_states;
-  std::vector<std::shared_ptr<EventState>> event_states;
+
+  // All entity states for the game, indexed by k_id, e_id, and w_id. Each entity type's states are in a single
+  // contiguous array (so creating and resetting a game's state doesn't involve any per-entity allocations or pointer
+  // chasing), and the shared_ptrs returned by the accessor functions below share ownership of the entire storage
+  // object instead of owning individual states. This means states returned by these functions remain valid even if
+  // the MapState is destroyed or replaced.
+  struct StateStorage {
+    std::vector<std::shared_ptr<const SuperMap>> super_maps; // Keeps the super_* pointers in the states valid
+    std::vector<ObjectState> objects;
+    std::vector<EnemyState> enemies;
+    std::vector<uint32_t> enemy_set_e_ids; // Indexed by set_id
+    std::vector<EventState> events;
+  };
+  std::shared_ptr<StateStorage> states = std::make_shared<StateStorage>();
   std::vector<size_t> bb_rare_enemy_indexes;
   size_t dynamic_obj_base_k_id = 0;
   std::array<size_t, NUM_VERSIONS> dynamic_obj_base_index_for_version = {};
@@ -985,6 +997,9 @@ public:
 
   ~MapState() = default;
 
+  // reserve_states must be called with all supermaps before index_super_map is called for any of them, since
+  // index_super_map stores pointers to the states of alias target enemies.
+  void reserve_states(const std::vector<std::shared_ptr<const SuperMap>>& super_maps);
   void index_super_map(const FloorConfig& floor_config, std::shared_ptr<RandomGenerator> rand_crypt);
   void compute_dynamic_object_base_indexes();
 
@@ -997,6 +1012,38 @@ public:
   // Resets states of all entities to their initial values. Used when restarting battles/challenges.
   void reset();
 
+  inline size_t num_object_states() const {
+    return this->states->objects.size();
+  }
+  inline size_t num_enemy_states() const {
+    return this->states->enemies.size();
+  }
+  inline size_t num_enemy_set_states() const {
+    return this->states->enemy_set_e_ids.size();
+  }
+  inline size_t num_event_states() const {
+    return this->states->events.size();
+  }
+
+  inline std::shared_ptr<ObjectState> object_state_for_k_id(size_t k_id) {
+    return std::shared_ptr<ObjectState>(this->states, &this->states->objects.at(k_id));
+  }
+  inline std::shared_ptr<EnemyState> enemy_state_for_e_id(size_t e_id) {
+    return std::shared_ptr<EnemyState>(this->states, &this->states->enemies.at(e_id));
+  }
+  inline std::shared_ptr<EnemyState> enemy_state_for_set_id(size_t set_id) {
+    return this->enemy_state_for_e_id(this->states->enemy_set_e_ids.at(set_id));
+  }
+  inline std::shared_ptr<EventState> event_state_for_w_id(size_t w_id) {
+    return std::shared_ptr<EventState>(this->states, &this->states->events.at(w_id));
+  }
+
+  // Returns the state of the enemy that ene_st is an alias for, or ene_st itself if it isn't an alias. The returned
+  // pointer shares ownership with ene_st.
+  static inline std::shared_ptr<EnemyState> resolve_enemy_alias(const std::shared_ptr<EnemyState>& ene_st) {
+    return ene_st->alias_target_ene_st ? std::shared_ptr<EnemyState>(ene_st, ene_st->alias_target_ene_st) : ene_st;
+  }
+
   inline Range<ObjectIterator> iter_object_states(Version version) {
     return Range<ObjectIterator>{.map_state = this, .version = version};
   }
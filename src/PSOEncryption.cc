@@ -9,6 +9,14 @@
 #include <stdexcept>
 #include <string>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#define HAVE_AVX2_DISPATCH
+#endif
+
 RandomGenerator::RandomGenerator(uint32_t seed) : initial_seed(seed) {}
 
 DisabledRandomGenerator::DisabledRandomGenerator() : RandomGenerator(0) {}
@@ -42,6 +50,70 @@ uint32_t PSOLFGEncryption::next() {
   return this->stream[this->offset++];
 }
 
+using XORWordsFn = void (*)(uint8_t* data, const uint32_t* key, size_t count);
+
+static void xor_words_scalar(uint8_t* data, const uint32_t* key, size_t count) {
+  for (size_t z = 0; z < count; z++) {
+    uint32_t v;
+    memcpy(&v, data + (z << 2), sizeof(v));
+    v ^= key[z];
+    memcpy(data + (z << 2), &v, sizeof(v));
+  }
+}
+
+#if defined(__SSE2__)
+static void xor_words_sse2(uint8_t* data, const uint32_t* key, size_t count) {
+  size_t z = 0;
+  for (; z + 4 <= count; z += 4) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + (z << 2)));
+    __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + z));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + (z << 2)), _mm_xor_si128(d, k));
+  }
+  xor_words_scalar(data + (z << 2), key + z, count - z);
+}
+#endif
+
+#if defined(HAVE_AVX2_DISPATCH)
+__attribute__((target("avx2"))) static void xor_words_avx2(uint8_t* data, const uint32_t* key, size_t count) {
+  size_t z = 0;
+  for (; z + 8 <= count; z += 8) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + (z << 2)));
+    __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + z));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + (z << 2)), _mm256_xor_si256(d, k));
+  }
+  xor_words_sse2(data + (z << 2), key + z, count - z);
+}
+#endif
+
+static XORWordsFn choose_xor_words_fn() {
+#if defined(HAVE_AVX2_DISPATCH)
+  if (__builtin_cpu_supports("avx2")) {
+    return xor_words_avx2;
+  }
+#endif
+#if defined(__SSE2__)
+  return xor_words_sse2;
+#else
+  return xor_words_scalar;
+#endif
+}
+
+static const XORWordsFn xor_words = choose_xor_words_fn();
+
+void PSOLFGEncryption::xor_stream(void* vdata, size_t count) {
+  uint8_t* data = reinterpret_cast<uint8_t*>(vdata);
+  while (count > 0) {
+    if (this->offset == this->end_offset) {
+      this->update_stream();
+    }
+    size_t span = std::min<size_t>(count, this->end_offset - this->offset);
+    xor_words(data, &this->stream[this->offset], span);
+    this->offset += span;
+    data += (span << 2);
+    count -= span;
+  }
+}
+
 void PSOLFGEncryption::encrypt(void* vdata, size_t size) {
   this->encrypt_t<false>(vdata, size);
 }
@@ -176,6 +248,49 @@ PSOEncryption::Type PSOV3Encryption::type() const {
   return Type::V3;
 }
 
+// Each 8-byte block is encrypted independently of the others (the cipher is used in ECB mode), so we process several
+// blocks in lockstep. Each round depends on the previous round's table lookups, so working on a single block leaves
+// most of the CPU's load units idle; interleaving independent blocks lets their lookups overlap.
+template <size_t NumBlocks>
+static inline void bb_standard_crypt_blocks(le_uint32_t* data, const le_uint32_t* private_keys, const uint32_t* keys) {
+  auto f = [private_keys](uint32_t x) -> uint32_t {
+    return ((private_keys[x >> 0x18] + private_keys[((x >> 0x10) & 0xFF) + 0x100]) ^
+               private_keys[((x >> 0x08) & 0xFF) + 0x200]) +
+        private_keys[(x & 0xFF) + 0x300];
+  };
+
+  uint32_t a[NumBlocks], b[NumBlocks];
+  for (size_t z = 0; z < NumBlocks; z++) {
+    a[z] = data[z * 2] ^ keys[0];
+  }
+  for (size_t z = 0; z < NumBlocks; z++) {
+    b[z] = f(a[z]) ^ keys[1] ^ data[z * 2 + 1];
+  }
+  for (size_t z = 0; z < NumBlocks; z++) {
+    a[z] ^= f(b[z]) ^ keys[2];
+  }
+  for (size_t z = 0; z < NumBlocks; z++) {
+    b[z] ^= f(a[z]) ^ keys[3];
+  }
+  for (size_t z = 0; z < NumBlocks; z++) {
+    a[z] ^= f(b[z]) ^ keys[4];
+  }
+  for (size_t z = 0; z < NumBlocks; z++) {
+    data[z * 2] = b[z] ^ keys[5];
+    data[z * 2 + 1] = a[z];
+  }
+}
+
+static void bb_standard_crypt(le_uint32_t* data, size_t num_dwords, const le_uint32_t* private_keys, const uint32_t* keys) {
+  size_t z = 0;
+  for (; z + 8 <= num_dwords; z += 8) {
+    bb_standard_crypt_blocks<4>(data + z, private_keys, keys);
+  }
+  for (; z < num_dwords; z += 2) {
+    bb_standard_crypt_blocks<1>(data + z, private_keys, keys);
+  }
+}
+
 PSOBBEncryption::PSOBBEncryption(const KeyFile& key, const void* original_seed, size_t seed_size) : state(key) {
   this->apply_seed(original_seed, seed_size);
 }
@@ -230,42 +345,11 @@ void PSOBBEncryption::encrypt(void* vdata, size_t size) {
     if (size & 7) {
       throw std::invalid_argument("size must be a multiple of 8");
     }
-
-    size_t num_dwords = size >> 2;
-    le_uint32_t* data = reinterpret_cast<le_uint32_t*>(vdata);
-    uint32_t edx, ebx, ebp, esi, edi;
-
-    edx = 0;
-    while (edx < num_dwords) {
-      ebx = data[edx] ^ this->state.initial_keys.as32[0];
-      ebp = ((this->state.private_keys.as32[(ebx >> 0x18)] +
-                 this->state.private_keys.as32[((ebx >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebx >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebx & 0xFF) + 0x300];
-      ebp = ebp ^ this->state.initial_keys.as32[1];
-      ebp ^= data[edx + 1];
-      edi = ((this->state.private_keys.as32[(ebp >> 0x18)] +
-                 this->state.private_keys.as32[((ebp >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebp >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebp & 0xFF) + 0x300];
-      edi = edi ^ this->state.initial_keys.as32[2];
-      ebx = ebx ^ edi;
-      esi = ((this->state.private_keys.as32[(ebx >> 0x18)] +
-                 this->state.private_keys.as32[((ebx >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebx >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebx & 0xFF) + 0x300];
-      ebp = ebp ^ esi ^ this->state.initial_keys.as32[3];
-      edi = ((this->state.private_keys.as32[(ebp >> 0x18)] +
-                 this->state.private_keys.as32[((ebp >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebp >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebp & 0xFF) + 0x300];
-      edi = edi ^ this->state.initial_keys.as32[4];
-      ebp = ebp ^ this->state.initial_keys.as32[5];
-      ebx = ebx ^ edi;
-      data[edx] = ebp;
-      data[edx + 1] = ebx;
-      edx += 2;
+    uint32_t keys[6];
+    for (size_t z = 0; z < 6; z++) {
+      keys[z] = this->state.initial_keys.as32[z];
     }
+    bb_standard_crypt(reinterpret_cast<le_uint32_t*>(vdata), size >> 2, this->state.private_keys.as32.data(), keys);
   }
 }
 
@@ -318,42 +402,12 @@ void PSOBBEncryption::decrypt(void* vdata, size_t size) {
     if (size & 7) {
       throw std::invalid_argument("size must be a multiple of 8");
     }
-    size_t num_dwords = size >> 2;
-    le_uint32_t* dwords = reinterpret_cast<le_uint32_t*>(vdata);
-    uint32_t edx, ebx, ebp, esi, edi;
-
-    edx = 0;
-    while (edx < num_dwords) {
-      ebx = dwords[edx];
-      ebx = ebx ^ this->state.initial_keys.as32[5];
-      ebp = ((this->state.private_keys.as32[(ebx >> 0x18)] +
-                 this->state.private_keys.as32[((ebx >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebx >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebx & 0xFF) + 0x300];
-      ebp = ebp ^ this->state.initial_keys.as32[4];
-      ebp ^= dwords[edx + 1];
-      edi = ((this->state.private_keys.as32[(ebp >> 0x18)] +
-                 this->state.private_keys.as32[((ebp >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebp >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebp & 0xFF) + 0x300];
-      edi = edi ^ this->state.initial_keys.as32[3];
-      ebx = ebx ^ edi;
-      esi = ((this->state.private_keys.as32[(ebx >> 0x18)] +
-                 this->state.private_keys.as32[((ebx >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebx >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebx & 0xFF) + 0x300];
-      ebp = ebp ^ esi ^ this->state.initial_keys.as32[2];
-      edi = ((this->state.private_keys.as32[(ebp >> 0x18)] +
-                 this->state.private_keys.as32[((ebp >> 0x10) & 0xFF) + 0x100]) ^
-                this->state.private_keys.as32[((ebp >> 0x8) & 0xFF) + 0x200]) +
-          this->state.private_keys.as32[(ebp & 0xFF) + 0x300];
-      edi = edi ^ this->state.initial_keys.as32[1];
-      ebp = ebp ^ this->state.initial_keys.as32[0];
-      ebx = ebx ^ edi;
-      dwords[edx] = ebp;
-      dwords[edx + 1] = ebx;
-      edx += 2;
+    // Decryption is the same as encryption, but with the initial keys used in reverse order
+    uint32_t keys[6];
+    for (size_t z = 0; z < 6; z++) {
+      keys[z] = this->state.initial_keys.as32[5 - z];
     }
+    bb_standard_crypt(reinterpret_cast<le_uint32_t*>(vdata), size >> 2, this->state.private_keys.as32.data(), keys);
   }
 }
 
@@ -1,54 +1,312 @@
 #include "PatchFileIndex.hh"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define PATCH_CRC32_PCLMUL_AVAILABLE
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <phosg/Filesystem.hh>
-#include <phosg/Hash.hh>
 #include <phosg/Strings.hh>
+#include <phosg/Time.hh>
 #include <stdexcept>
+#include <thread>
+#include <unordered_set>
 
 #include "Loggers.hh"
 
+// Returns the file's modification time in nanoseconds since the filesystem clock's epoch (which is not necessarily the
+// Unix epoch). This is only compared for equality (against the checksum cache, the previous index, and after hashing),
+// so it must return the same value every time for an unchanged file; converting to system_clock would not, since that
+// requires sampling both clocks' current times.
 int64_t file_mtime_int(const std::string& path) {
-  auto mtime = std::filesystem::last_write_time(path);
-  auto sctp = std::chrono::time_point_cast<std::chrono::nanoseconds>(
-      mtime - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now());
-  return sctp.time_since_epoch().count();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::filesystem::last_write_time(path).time_since_epoch())
+      .count();
+}
+
+// Standard (zlib-compatible) CRC32. On x86-64 CPUs that support it, most of the data is folded 64 bytes at a time with
+// carry-less multiplication (PCLMULQDQ), as described in Intel's "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction" paper (the constants below are the bit-reflected ones from that paper for the CRC32
+// polynomial). Everything else is computed 8 bytes at a time with the slicing-by-8 method. The functions below take
+// and return the internal CRC state (that is, the CRC before the final inversion).
+static constexpr std::array<std::array<uint32_t, 0x100>, 8> generate_crc32_tables() {
+  std::array<std::array<uint32_t, 0x100>, 8> ret{};
+  for (uint32_t z = 0; z < 0x100; z++) {
+    uint32_t crc = z;
+    for (size_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+    }
+    ret[0][z] = crc;
+  }
+  for (uint32_t z = 0; z < 0x100; z++) {
+    for (size_t table = 1; table < 8; table++) {
+      ret[table][z] = (ret[table - 1][z] >> 8) ^ ret[0][ret[table - 1][z] & 0xFF];
+    }
+  }
+  return ret;
+}
+static constexpr auto crc32_tables = generate_crc32_tables();
+
+static uint32_t crc32_update_slicing_by_8(uint32_t crc, const uint8_t* p, size_t size) {
+  for (; size >= 8; size -= 8, p += 8) {
+    uint32_t lo = (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24)) ^ crc;
+    uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<uint32_t>(p[7]) << 24);
+    crc = crc32_tables[7][lo & 0xFF] ^ crc32_tables[6][(lo >> 8) & 0xFF] ^ crc32_tables[5][(lo >> 16) & 0xFF] ^
+        crc32_tables[4][lo >> 24] ^ crc32_tables[3][hi & 0xFF] ^ crc32_tables[2][(hi >> 8) & 0xFF] ^
+        crc32_tables[1][(hi >> 16) & 0xFF] ^ crc32_tables[0][hi >> 24];
+  }
+  for (; size > 0; size--, p++) {
+    crc = (crc >> 8) ^ crc32_tables[0][(crc ^ *p) & 0xFF];
+  }
+  return crc;
+}
+
+#ifdef PATCH_CRC32_PCLMUL_AVAILABLE
+// Multiplies both halves of x by the corresponding constants in k and adds (xors) the results to next
+__attribute__((target("pclmul,sse4.1"))) static inline __m128i crc32_pclmul_fold(__m128i k, __m128i x, __m128i next) {
+  __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// size must be at least 0x40 and a multiple of 0x10
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_update_pclmul(
+    uint32_t crc, const uint8_t* p, size_t size) {
+  alignas(16) static const uint64_t k1k2[2] = {0x0154442BD4, 0x01C6E41596};
+  alignas(16) static const uint64_t k3k4[2] = {0x01751997D0, 0x00CCAA009E};
+  alignas(16) static const uint64_t k5k0[2] = {0x0163CD6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[2] = {0x01DB710641, 0x01F7011641}; // P(x) and mu, for Barrett reduction
+
+  // Fold 4 blocks of 16 bytes in parallel
+  __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+  __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+  __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+  __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  for (p += 0x40, size -= 0x40; size >= 0x40; size -= 0x40, p += 0x40) {
+    x1 = crc32_pclmul_fold(k, x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00)));
+    x2 = crc32_pclmul_fold(k, x2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10)));
+    x3 = crc32_pclmul_fold(k, x3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20)));
+    x4 = crc32_pclmul_fold(k, x4, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30)));
+  }
+
+  // Fold the 4 blocks into one, then fold in any remaining 16-byte blocks
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+  x1 = crc32_pclmul_fold(k, x1, x2);
+  x1 = crc32_pclmul_fold(k, x1, x3);
+  x1 = crc32_pclmul_fold(k, x1, x4);
+  for (; size >= 0x10; size -= 0x10, p += 0x10) {
+    x1 = crc32_pclmul_fold(k, x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+
+  // Fold 128 bits down to 64, then reduce to 32 bits
+  __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00), x2);
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+  return _mm_extract_epi32(_mm_xor_si128(x1, x2), 1);
+}
+
+static bool cpu_supports_pclmul() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+static const bool use_pclmul_crc32 = cpu_supports_pclmul();
+#endif
+
+static uint32_t fast_crc32(const void* data, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  uint32_t crc = 0xFFFFFFFF;
+#ifdef PATCH_CRC32_PCLMUL_AVAILABLE
+  if (use_pclmul_crc32 && (size >= 0x40)) {
+    size_t folded_size = size & ~static_cast<size_t>(0x0F);
+    crc = crc32_update_pclmul(crc, p, folded_size);
+    p += folded_size;
+    size -= folded_size;
+  }
+#endif
+  return ~crc32_update_slicing_by_8(crc, p, size);
+}
+
+// Returns the CRC32 of the concatenation of two byte strings, given their CRC32s and the length of the second one.
+// This is the same algorithm as zlib's crc32_combine.
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec; vec >>= 1, mat++) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+  for (size_t n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+static uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  if (len2 == 0) {
+    return crc1;
+  }
+
+  // odd = operator for one zero bit; even = operator for two zero bits
+  uint32_t even[32];
+  uint32_t odd[32];
+  odd[0] = 0xEDB88320;
+  for (size_t n = 1, row = 1; n < 32; n++, row <<= 1) {
+    odd[n] = row;
+  }
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+
+  // Apply len2 zero bytes to crc1 (the first square puts the operator for one zero byte in even)
+  for (;;) {
+    gf2_matrix_square(even, odd);
+    if (len2 & 1) {
+      crc1 = gf2_matrix_times(even, crc1);
+    }
+    len2 >>= 1;
+    if (len2 == 0) {
+      break;
+    }
+    gf2_matrix_square(odd, even);
+    if (len2 & 1) {
+      crc1 = gf2_matrix_times(odd, crc1);
+    }
+    len2 >>= 1;
+    if (len2 == 0) {
+      break;
+    }
+  }
+  return crc1 ^ crc2;
 }
 
-PatchFileIndex::File::File(PatchFileIndex* index) : index(index), crc32(0), size(0) {}
+PatchFileIndex::OpenFile::OpenFile(const std::string& path) : path(path), bytes(0) {
+#ifndef PHOSG_WINDOWS
+  this->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (this->fd < 0) {
+    throw phosg::cannot_open_file(path);
+  }
+  struct stat st;
+  if (fstat(this->fd, &st) != 0) {
+    int error = errno;
+    close(this->fd);
+    throw std::runtime_error(std::format("cannot stat {}: {}", path, phosg::string_for_error(error)));
+  }
+  this->bytes = st.st_size;
+#ifdef PHOSG_LINUX
+  // Chunks are read in order, so let the kernel read ahead
+  posix_fadvise(this->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+  this->loaded_data = phosg::load_file(path);
+  this->bytes = this->loaded_data.size();
+#endif
+}
+
+PatchFileIndex::OpenFile::~OpenFile() {
+#ifndef PHOSG_WINDOWS
+  close(this->fd);
+#endif
+}
+
+void PatchFileIndex::OpenFile::read(std::string& buf, size_t offset, size_t size) const {
+  buf.resize(size);
+#ifndef PHOSG_WINDOWS
+  for (size_t bytes_read = 0; bytes_read < size;) {
+    ssize_t ret = pread(this->fd, buf.data() + bytes_read, size - bytes_read, offset + bytes_read);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::format("cannot read {}: {}", this->path, phosg::string_for_error(errno)));
+    }
+    if (ret == 0) {
+      throw std::runtime_error(std::format("{} is shorter than expected (has it been truncated?)", this->path));
+    }
+    bytes_read += ret;
+  }
+#else
+  if (offset + size > this->loaded_data.size()) {
+    throw std::runtime_error(std::format("{} is shorter than expected", this->path));
+  }
+  memcpy(buf.data(), this->loaded_data.data() + offset, size);
+#endif
+}
+
+PatchFileIndex::File::File(PatchFileIndex* index) : index(index), crc32(0), size(0), mtime(0) {}
+
+std::string PatchFileIndex::File::relative_path() const {
+  return phosg::join(this->path_directories, "/") + "/" + this->name;
+}
 
 std::shared_ptr<const std::string> PatchFileIndex::File::load_data() {
-  if (!this->loaded_data) {
-    std::string relative_path = phosg::join(this->path_directories, "/") + "/" + this->name;
-    std::string full_path = this->index->root_dir + "/" + relative_path;
-    patch_index_log.debug_f("Loading data for {}", relative_path);
-    this->loaded_data = std::make_shared<std::string>(phosg::load_file(full_path));
-    this->size = this->loaded_data->size();
+  std::lock_guard g(this->index->load_data_lock);
+  std::string relative_path = this->relative_path();
+  patch_index_log.debug_f("Loading data for {}", relative_path);
+  auto ret = std::make_shared<std::string>(phosg::load_file(this->index->root_dir + "/" + relative_path));
+  this->size = ret->size();
+  return ret;
+}
+
+std::shared_ptr<const PatchFileIndex::OpenFile> PatchFileIndex::File::open_data() const {
+  std::string relative_path = this->relative_path();
+  patch_index_log.debug_f("Opening {}", relative_path);
+  auto ret = std::make_shared<OpenFile>(this->index->root_dir + "/" + relative_path);
+  if (ret->size() != this->size) {
+    throw std::runtime_error(std::format("patch file {} has changed size since it was indexed", relative_path));
   }
-  return this->loaded_data;
+  return ret;
 }
 
-PatchFileIndex::PatchFileIndex(const std::string& root_dir) : root_dir(root_dir) {
-  std::string metadata_cache_filename = root_dir + "/.metadata-cache.json";
-  phosg::JSON metadata_cache_json;
-  try {
-    std::string metadata_text = phosg::load_file(metadata_cache_filename);
-    metadata_cache_json = phosg::JSON::parse(metadata_text);
-    patch_index_log.debug_f("Loaded patch metadata cache from {}", metadata_cache_filename);
-  } catch (const std::exception& e) {
-    metadata_cache_json = phosg::JSON::dict();
-    patch_index_log.warning_f("Cannot load patch metadata cache from {}: {}", metadata_cache_filename, e.what());
+void PatchFileIndex::File::read_chunk(const OpenFile& f, size_t chunk_index, std::string& buf) const {
+  size_t offset = chunk_index * CHUNK_SIZE;
+  f.read(buf, offset, std::min<size_t>(this->size - offset, CHUNK_SIZE));
+  if (fast_crc32(buf.data(), buf.size()) != this->chunk_crcs.at(chunk_index)) {
+    throw std::runtime_error(std::format(
+        "chunk {} of patch file {} has changed since it was indexed", chunk_index, this->relative_path()));
   }
+}
 
-  // Assuming it's rare for patch files to change, we skip writing the metadata cache if no files were changed at all
-  // (which should usually be the case)
-  bool should_write_metadata_cache = false;
-  phosg::JSON new_metadata_cache_json = phosg::JSON::dict();
+PatchFileIndex::PatchFileIndex(const std::string& root_dir, std::shared_ptr<const PatchFileIndex> previous)
+    : root_dir(root_dir) {
+  std::string metadata_cache_filename = root_dir + "/.metadata-cache.json";
+  phosg::JSON metadata_cache_json = phosg::JSON::dict();
+  if (!previous) {
+    try {
+      std::string metadata_text = phosg::load_file(metadata_cache_filename);
+      metadata_cache_json = phosg::JSON::parse(metadata_text);
+      patch_index_log.debug_f("Loaded patch metadata cache from {}", metadata_cache_filename);
+    } catch (const std::exception& e) {
+      patch_index_log.warning_f("Cannot load patch metadata cache from {}: {}", metadata_cache_filename, e.what());
+    }
+  }
 
+  std::vector<std::shared_ptr<File>> files_to_hash;
   std::vector<std::string> path_directories;
   std::function<void(const std::string&)> collect_dir = [&](const std::string& dir) -> void {
     path_directories.emplace_back(dir);
@@ -74,61 +332,42 @@ PatchFileIndex::PatchFileIndex(const std::string& root_dir) : root_dir(root_dir)
         auto f = std::make_shared<File>(this);
         f->path_directories = path_directories;
         f->name = item;
+        f->mtime = file_mtime_int(full_item_path);
+        f->size = std::filesystem::file_size(full_item_path);
 
-        int64_t file_mtime = file_mtime_int(full_item_path);
-
-        std::string compute_crc32s_message; // If not empty, should compute crc32s
-        phosg::JSON cache_item_json;
-        try {
-          cache_item_json = metadata_cache_json.at(relative_item_path);
-          uint64_t cached_size = cache_item_json.get_int(0);
-          int64_t cached_mtime = cache_item_json.get_int(1);
-          if (file_mtime != cached_mtime) {
-            throw std::runtime_error("file has been modified");
+        const char* source = nullptr; // If null, should compute crc32s
+        if (previous) {
+          auto prev_it = previous->files_by_name.find(relative_item_path);
+          if ((prev_it != previous->files_by_name.end()) &&
+              (prev_it->second->mtime == f->mtime) &&
+              (prev_it->second->size == f->size)) {
+            f->crc32 = prev_it->second->crc32;
+            f->chunk_crcs = prev_it->second->chunk_crcs;
+            source = "from previous index";
           }
-          if (std::filesystem::file_size(full_item_path) != cached_size) {
-            throw std::runtime_error("file size has changed");
-          }
-          f->size = cached_size;
-          f->crc32 = cache_item_json.get_int(2);
-          for (const auto& chunk_crc32_json : cache_item_json.get_list(3)) {
-            f->chunk_crcs.emplace_back(chunk_crc32_json->as_int());
-          }
-
-        } catch (const std::exception& e) {
-          compute_crc32s_message = e.what();
-        }
-
-        if (!compute_crc32s_message.empty()) {
-          auto data = f->load_data(); // Sets f->size
-          f->crc32 = phosg::crc32(data->data(), f->size);
-          for (size_t x = 0; x < data->size(); x += this->CHUNK_SIZE) {
-            size_t chunk_bytes = std::min<size_t>(f->size - x, this->CHUNK_SIZE);
-            f->chunk_crcs.emplace_back(phosg::crc32(data->data() + x, chunk_bytes));
-          }
-
-          // File was modified or cache item was missing; make a new cache item
-          auto chunk_crcs_item = phosg::JSON::list();
-          for (uint32_t chunk_crc : f->chunk_crcs) {
-            chunk_crcs_item.emplace_back(chunk_crc);
-          }
-          new_metadata_cache_json.emplace(
-              relative_item_path, phosg::JSON::list({f->size, file_mtime, f->crc32, std::move(chunk_crcs_item)}));
-          should_write_metadata_cache = true;
-
         } else {
-          // File was not modified and cache item was valid; just use the existing cache item
-          new_metadata_cache_json.emplace(relative_item_path, std::move(cache_item_json));
+          try {
+            const auto& cache_item_json = metadata_cache_json.at(relative_item_path);
+            if ((static_cast<uint64_t>(cache_item_json.get_int(0)) == f->size) &&
+                (cache_item_json.get_int(1) == f->mtime)) {
+              f->crc32 = cache_item_json.get_int(2);
+              for (const auto& chunk_crc32_json : cache_item_json.get_list(3)) {
+                f->chunk_crcs.emplace_back(chunk_crc32_json->as_int());
+              }
+              source = "from cache";
+            }
+          } catch (const std::exception&) {
+          }
         }
 
         this->files_by_patch_order.emplace_back(f);
         this->files_by_name.emplace(relative_item_path, f);
-        if (compute_crc32s_message.empty()) {
-          patch_index_log.debug_f("Added file {} ({} bytes; {} chunks; {:08X} from cache)",
-              full_item_path, f->size, f->chunk_crcs.size(), f->crc32);
+        if (source) {
+          patch_index_log.debug_f("Added file {} ({} bytes; {} chunks; {:08X} {})",
+              full_item_path, f->size, f->chunk_crcs.size(), f->crc32, source);
         } else {
-          patch_index_log.debug_f("Added file {} ({} bytes; {} chunks; {:08X} [{}])",
-              full_item_path, f->size, f->chunk_crcs.size(), f->crc32, compute_crc32s_message);
+          patch_index_log.debug_f("Added file {} ({} bytes; checksums pending)", full_item_path, f->size);
+          files_to_hash.emplace_back(f);
         }
       }
     }
@@ -138,16 +377,160 @@ PatchFileIndex::PatchFileIndex(const std::string& root_dir) : root_dir(root_dir)
 
   collect_dir(".");
 
-  if (should_write_metadata_cache) {
+  if (!files_to_hash.empty()) {
+    uint64_t start_time = phosg::now();
+    auto dropped_files = this->compute_checksums(files_to_hash);
+    patch_index_log.info_f("Computed checksums for {} new or modified files in {}",
+        files_to_hash.size() - dropped_files.size(), phosg::format_duration(phosg::now() - start_time));
+    // Files that changed while being hashed are left out of this index; the directory watcher will reindex again once
+    // they stop changing
+    if (!dropped_files.empty()) {
+      std::unordered_set<const File*> dropped_set;
+      for (const auto& f : dropped_files) {
+        dropped_set.emplace(f.get());
+        this->files_by_name.erase(f->relative_path());
+      }
+      std::erase_if(this->files_by_patch_order, [&](const auto& f) -> bool { return dropped_set.count(f.get()); });
+    }
+  }
+
+  // Assuming it's rare for patch files to change, we skip writing the metadata cache if no files were changed at all
+  // (which should usually be the case)
+  bool files_deleted = previous && std::any_of(
+      previous->files_by_name.begin(), previous->files_by_name.end(), [&](const auto& it) -> bool {
+        return !this->files_by_name.count(it.first);
+      });
+  if (files_to_hash.empty() && !files_deleted) {
+    patch_index_log.debug_f("No files were modified; skipping metadata cache update");
+    return;
+  }
+
+  auto new_metadata_cache_json = phosg::JSON::dict();
+  for (const auto& [relative_item_path, f] : this->files_by_name) {
+    auto chunk_crcs_item = phosg::JSON::list();
+    for (uint32_t chunk_crc : f->chunk_crcs) {
+      chunk_crcs_item.emplace_back(chunk_crc);
+    }
+    new_metadata_cache_json.emplace(
+        relative_item_path, phosg::JSON::list({f->size, f->mtime, f->crc32, std::move(chunk_crcs_item)}));
+  }
+  // The cache is written to a temporary file and renamed into place, so a crash or a concurrent reindex never leaves
+  // a partially-written cache behind
+  try {
+    std::string temp_filename = metadata_cache_filename + ".tmp";
+    phosg::save_file(temp_filename, new_metadata_cache_json.serialize());
+    std::filesystem::rename(temp_filename, metadata_cache_filename);
+    patch_index_log.debug_f("Saved patch metadata cache to {}", metadata_cache_filename);
+  } catch (const std::exception& e) {
+    patch_index_log.warning_f("Cannot save patch metadata cache to {}: {}", metadata_cache_filename, e.what());
+  }
+}
+
+std::vector<std::shared_ptr<PatchFileIndex::File>> PatchFileIndex::compute_checksums(
+    const std::vector<std::shared_ptr<File>>& files) {
+  // Each chunk is hashed independently, then the whole-file checksums are assembled from the chunk checksums. This
+  // spreads the work evenly across threads even when one large file is most of the update.
+  struct Job {
+    const OpenFile* file;
+    size_t file_index;
+    size_t offset;
+    size_t size;
+    uint32_t* result;
+  };
+  std::vector<std::shared_ptr<const OpenFile>> open_files(files.size());
+  std::vector<std::atomic<bool>> files_failed(files.size());
+  std::vector<Job> jobs;
+  for (size_t file_index = 0; file_index < files.size(); file_index++) {
+    const auto& f = files[file_index];
+    std::string full_path = this->root_dir + "/" + f->relative_path();
     try {
-      phosg::save_file(metadata_cache_filename, new_metadata_cache_json.serialize());
-      patch_index_log.debug_f("Saved patch metadata cache to {}", metadata_cache_filename);
+      open_files[file_index] = std::make_shared<OpenFile>(full_path);
     } catch (const std::exception& e) {
-      patch_index_log.warning_f("Cannot save patch metadata cache to {}: {}", metadata_cache_filename, e.what());
+      patch_index_log.warning_f("Cannot open {}; skipping it: {}", full_path, e.what());
+      files_failed[file_index] = true;
+      continue;
+    }
+    // The file may have changed since it was listed; the checksums must match the data that will actually be sent
+    if (open_files[file_index]->size() != f->size) {
+      patch_index_log.warning_f("{} changed while it was being indexed; skipping it", full_path);
+      files_failed[file_index] = true;
+      continue;
+    }
+    f->chunk_crcs.resize((f->size + CHUNK_SIZE - 1) / CHUNK_SIZE, 0);
+    for (size_t z = 0; z < f->chunk_crcs.size(); z++) {
+      size_t offset = z * CHUNK_SIZE;
+      jobs.emplace_back(Job{
+          .file = open_files[file_index].get(),
+          .file_index = file_index,
+          .offset = offset,
+          .size = std::min<size_t>(f->size - offset, CHUNK_SIZE),
+          .result = &f->chunk_crcs[z],
+      });
     }
-  } else {
-    patch_index_log.debug_f("No files were modified; skipping metadata cache update");
   }
+
+  std::atomic<size_t> next_job_index = 0;
+  auto thread_fn = [&]() -> void {
+    std::string buf;
+    for (size_t job_index = next_job_index++; job_index < jobs.size(); job_index = next_job_index++) {
+      const auto& job = jobs[job_index];
+      if (files_failed[job.file_index]) {
+        continue;
+      }
+      try {
+        job.file->read(buf, job.offset, job.size);
+      } catch (const std::exception& e) {
+        patch_index_log.warning_f(
+            "Cannot read {}; skipping it: {}", files[job.file_index]->relative_path(), e.what());
+        files_failed[job.file_index] = true;
+        continue;
+      }
+      *job.result = fast_crc32(buf.data(), buf.size());
+    }
+  };
+  size_t num_threads = std::min<size_t>(std::max<size_t>(std::thread::hardware_concurrency(), 1), jobs.size());
+  std::vector<std::thread> threads;
+  while (threads.size() + 1 < num_threads) {
+    threads.emplace_back(thread_fn);
+  }
+  if (num_threads > 0) {
+    thread_fn();
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+
+  // If a file was written to while it was being hashed, the checksums may describe a mix of the old and new data, so
+  // check that its size and modification time are the same as when it was listed
+  std::vector<std::shared_ptr<File>> dropped_files;
+  for (size_t file_index = 0; file_index < files.size(); file_index++) {
+    const auto& f = files[file_index];
+    if (!files_failed[file_index]) {
+      std::string full_path = this->root_dir + "/" + f->relative_path();
+      try {
+        if ((file_mtime_int(full_path) != f->mtime) || (std::filesystem::file_size(full_path) != f->size)) {
+          patch_index_log.warning_f("{} changed while it was being indexed; skipping it", full_path);
+          files_failed[file_index] = true;
+        }
+      } catch (const std::exception& e) {
+        patch_index_log.warning_f("Cannot stat {}; skipping it: {}", full_path, e.what());
+        files_failed[file_index] = true;
+      }
+    }
+    if (files_failed[file_index]) {
+      dropped_files.emplace_back(f);
+    }
+  }
+
+  for (const auto& f : files) {
+    f->crc32 = 0;
+    for (size_t z = 0; z < f->chunk_crcs.size(); z++) {
+      size_t chunk_size = std::min<size_t>(f->size - z * CHUNK_SIZE, CHUNK_SIZE);
+      f->crc32 = crc32_combine(f->crc32, f->chunk_crcs[z], chunk_size);
+    }
+  }
+
+  return dropped_files;
 }
 
 const std::vector<std::shared_ptr<PatchFileIndex::File>>& PatchFileIndex::all_files() const {
@@ -4,6 +4,8 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
+#include <phosg/Platform.hh>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -11,29 +13,81 @@
 class PatchFileIndex {
 public:
   static constexpr size_t CHUNK_SIZE = 0x6000;
+  // Maximum number of bytes the patch server queues on a client's connection at once during a download. The server
+  // waits for the queued data to be written to the socket before sending more chunks.
+  static constexpr size_t SEND_WINDOW_BYTES = CHUNK_SIZE * 8;
 
-  explicit PatchFileIndex(const std::string& root_dir);
+  // If previous is given, files whose size and modification time haven't changed since it was built reuse its
+  // checksums, so only new and modified files are read. Otherwise, the metadata cache file in root_dir is used for
+  // the same purpose. Files that need checksums are hashed on multiple threads.
+  explicit PatchFileIndex(const std::string& root_dir, std::shared_ptr<const PatchFileIndex> previous = nullptr);
+
+  // An open patch file, read in pieces with pread. Patch files are never memory-mapped: if a file were truncated or
+  // rewritten in place while mapped (e.g. while an update is being copied into a patch directory), reading from the
+  // mapping would crash the server with SIGBUS. Reading past the end of a file that has shrunk throws instead.
+  class OpenFile {
+  public:
+    explicit OpenFile(const std::string& path);
+    OpenFile(const OpenFile&) = delete;
+    OpenFile(OpenFile&&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+    OpenFile& operator=(OpenFile&&) = delete;
+    ~OpenFile();
+
+    // Size of the file when it was opened
+    inline size_t size() const {
+      return this->bytes;
+    }
+    // Replaces the contents of buf with size bytes from the file, starting at offset. Throws if the file doesn't
+    // contain that many bytes at that offset.
+    void read(std::string& buf, size_t offset, size_t size) const;
+
+  private:
+    std::string path;
+    size_t bytes;
+#ifndef PHOSG_WINDOWS
+    int fd;
+#else
+    std::string loaded_data;
+#endif
+  };
 
   struct File {
     PatchFileIndex* index;
     std::vector<std::string> path_directories;
     std::string name;
-    std::shared_ptr<const std::string> loaded_data;
     std::vector<uint32_t> chunk_crcs;
     uint32_t crc32;
     uint32_t size;
+    int64_t mtime;
 
     explicit File(PatchFileIndex* index);
+    std::string relative_path() const;
+    // Reads the entire file from disk. The data isn't cached; callers that need it repeatedly should keep it.
     std::shared_ptr<const std::string> load_data();
+    // Opens the file for sending to a client. Throws if its size has changed since it was indexed.
+    std::shared_ptr<const OpenFile> open_data() const;
+    // Replaces the contents of buf with the given chunk of the file. Throws if the chunk doesn't match the checksum
+    // computed when the file was indexed, so a client is never sent data that doesn't match the checksums it was given.
+    void read_chunk(const OpenFile& f, size_t chunk_index, std::string& buf) const;
   };
 
   const std::vector<std::shared_ptr<File>>& all_files() const;
   std::shared_ptr<File> get(const std::string& filename) const;
+  inline const std::string& get_root_dir() const {
+    return this->root_dir;
+  }
 
 private:
+  // Computes checksums for the given files. Returns the files that couldn't be read or that changed while they were
+  // being hashed; these must not be indexed, since their checksums may not match what would be sent.
+  std::vector<std::shared_ptr<File>> compute_checksums(const std::vector<std::shared_ptr<File>>& files);
+
   std::vector<std::shared_ptr<File>> files_by_patch_order;
   std::unordered_map<std::string, std::shared_ptr<File>> files_by_name;
   std::string root_dir;
+  // Held while loading file data, since background reloads can read files from the current index
+  std::mutex load_data_lock;
 };
 
 struct PatchFileChecksumRequest {
@@ -0,0 +1,153 @@
+#include "PatchFileWatcher.hh"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef PHOSG_LINUX
+#include <sys/inotify.h>
+#endif
+
+#include <filesystem>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+
+PatchFileWatcher::PatchFileWatcher(std::shared_ptr<ServerState> state, const std::vector<std::string>& root_dirs)
+    : log("[PatchFileWatcher] "),
+      state(state),
+      reindex_timer(*this->state->io_context)
+#ifdef PHOSG_LINUX
+      ,
+      inotify_stream(*this->state->io_context)
+#endif
+{
+#ifdef PHOSG_LINUX
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    this->log.warning_f("Cannot create inotify instance: {}", phosg::string_for_error(errno));
+    return;
+  }
+  this->inotify_stream.assign(fd);
+
+  for (const auto& root_dir : root_dirs) {
+    if (std::filesystem::is_directory(root_dir)) {
+      this->add_watches(root_dir);
+    }
+  }
+  if (this->dir_for_watch_descriptor.empty()) {
+    this->log.info_f("No patch directories to watch");
+    return;
+  }
+  this->log.info_f("Watching {} patch directories for changes", this->dir_for_watch_descriptor.size());
+  asio::co_spawn(*this->state->io_context, this->read_events_task(), asio::detached);
+#else
+  (void)root_dirs;
+#endif
+}
+
+#ifdef PHOSG_LINUX
+void PatchFileWatcher::add_watches(const std::string& dir) {
+  static constexpr uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+  int wd = inotify_add_watch(this->inotify_stream.native_handle(), dir.c_str(), mask);
+  if (wd < 0) {
+    this->log.warning_f("Cannot watch directory {}: {}", dir, phosg::string_for_error(errno));
+    return;
+  }
+  this->dir_for_watch_descriptor[wd] = dir;
+
+  try {
+    for (const auto& item : std::filesystem::directory_iterator(dir)) {
+      if (item.is_directory() && !item.path().filename().string().starts_with(".")) {
+        this->add_watches(item.path().string());
+      }
+    }
+  } catch (const std::filesystem::filesystem_error& e) {
+    // The directory may have been deleted or renamed since the event that caused it to be watched
+    this->log.warning_f("Cannot list directory {}: {}", dir, e.what());
+  }
+}
+
+asio::awaitable<void> PatchFileWatcher::read_events_task() {
+  // inotify_event contains an int, so the buffer must be suitably aligned
+  std::vector<uint32_t> buf(0x4000);
+  for (;;) {
+    size_t bytes = co_await this->inotify_stream.async_read_some(
+        asio::buffer(buf.data(), buf.size() * sizeof(uint32_t)), asio::use_awaitable);
+
+    bool changed = false;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(buf.data());
+    for (size_t offset = 0; offset + sizeof(struct inotify_event) <= bytes;) {
+      const auto* ev = reinterpret_cast<const struct inotify_event*>(data + offset);
+      offset += sizeof(struct inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        // Some events were lost; a reindex will find any changes regardless
+        changed = true;
+        continue;
+      }
+      if (ev->mask & IN_IGNORED) {
+        this->dir_for_watch_descriptor.erase(ev->wd);
+        continue;
+      }
+      auto dir_it = this->dir_for_watch_descriptor.find(ev->wd);
+      if (dir_it == this->dir_for_watch_descriptor.end()) {
+        continue;
+      }
+      // Hidden files aren't part of the index (and the index writes its metadata cache to a hidden file, which would
+      // otherwise cause another reindex every time)
+      std::string name = ev->len ? ev->name : "";
+      if (name.starts_with(".")) {
+        continue;
+      }
+      if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+        this->add_watches(dir_it->second + "/" + name);
+      }
+      this->log.debug_f("Change detected: {}/{}", dir_it->second, name);
+      changed = true;
+    }
+
+    if (changed) {
+      this->on_change();
+    }
+  }
+}
+#endif
+
+void PatchFileWatcher::on_change() {
+  this->last_change_time = phosg::now();
+  if (!this->reindex_pending) {
+    this->reindex_pending = true;
+    asio::co_spawn(*this->state->io_context, this->reindex_task(), asio::detached);
+  }
+}
+
+asio::awaitable<void> PatchFileWatcher::reindex_task() {
+  for (;;) {
+    uint64_t now_usecs;
+    while ((now_usecs = phosg::now()) < this->last_change_time + QUIET_USECS) {
+      this->reindex_timer.expires_after(std::chrono::microseconds(this->last_change_time + QUIET_USECS - now_usecs));
+      co_await this->reindex_timer.async_wait(asio::use_awaitable);
+    }
+
+    if (this->state->data_reload_in_progress) {
+      // Another reload (e.g. from the shell) is running; wait for it to finish, then try again
+      this->last_change_time = phosg::now();
+      continue;
+    }
+
+    uint64_t change_time = this->last_change_time;
+    try {
+      this->log.info_f("Reindexing patch files");
+      co_await this->state->reload_data([](DataIndex& data) -> void { data.load_patch_indexes(); });
+      this->log.info_f("Patch files reindexed");
+    } catch (const std::exception& e) {
+      // Retrying wouldn't help if the files are unreadable or invalid, so don't try again until they change
+      this->log.warning_f("Failed to reindex patch files: {}", e.what());
+    }
+
+    // If more changes occurred during the reindex, do it again
+    if (this->last_change_time == change_time) {
+      break;
+    }
+  }
+  this->reindex_pending = false;
+}
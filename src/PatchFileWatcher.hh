@@ -0,0 +1,47 @@
+#pragma once
+
+#include <asio.hpp>
+#include <memory>
+#include <phosg/Platform.hh>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ServerState.hh"
+
+// Watches the patch directories for changes and reindexes them when files are added, replaced, or deleted, so patch
+// updates don't require a manual reload. This is only implemented on Linux (via inotify); on other platforms, it does
+// nothing and the patch files must be reloaded with the reload shell command instead.
+//
+// Reindexing is done via ServerState::reload_data, so it runs on the thread pool and the new indexes are published all
+// at once. Only new and modified files are rehashed (see PatchFileIndex). Changes are batched: reindexing begins only
+// after no changes have been seen for QUIET_USECS, so copying a large update into a patch directory causes one reindex
+// after the copy is done rather than one per file.
+class PatchFileWatcher {
+public:
+  static constexpr uint64_t QUIET_USECS = 2000000;
+
+  PatchFileWatcher(std::shared_ptr<ServerState> state, const std::vector<std::string>& root_dirs);
+  PatchFileWatcher(const PatchFileWatcher&) = delete;
+  PatchFileWatcher(PatchFileWatcher&&) = delete;
+  PatchFileWatcher& operator=(const PatchFileWatcher&) = delete;
+  PatchFileWatcher& operator=(PatchFileWatcher&&) = delete;
+  ~PatchFileWatcher() = default;
+
+protected:
+  phosg::PrefixedLogger log;
+  std::shared_ptr<ServerState> state;
+  asio::steady_timer reindex_timer;
+  uint64_t last_change_time = 0;
+  bool reindex_pending = false;
+#ifdef PHOSG_LINUX
+  asio::posix::stream_descriptor inotify_stream;
+  std::unordered_map<int, std::string> dir_for_watch_descriptor;
+
+  void add_watches(const std::string& dir);
+  asio::awaitable<void> read_events_task();
+#endif
+
+  void on_change();
+  asio::awaitable<void> reindex_task();
+};
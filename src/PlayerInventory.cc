@@ -1,5 +1,7 @@
 #include "PlayerInventory.hh"
 
+#include <phosg/Strings.hh>
+
 void PlayerBank::load(FILE* f) {
   le_uint32_t num_items;
   le_uint32_t meseta;
@@ -13,6 +15,16 @@ void PlayerBank::load(FILE* f) {
   }
 }
 
+void PlayerBank::load(const std::string& data) {
+  phosg::StringReader r(data);
+  uint32_t num_items = r.get<le_uint32_t>();
+  this->meseta = r.get<le_uint32_t>();
+  this->items.reserve(num_items);
+  while (this->items.size() < num_items) {
+    this->items.emplace_back(r.get<PlayerBankItem>());
+  }
+}
+
 void PlayerBank::save(FILE* f) const {
   le_uint32_t num_items = this->items.size();
   le_uint32_t meseta = this->meseta;
@@ -23,6 +35,16 @@ void PlayerBank::save(FILE* f) const {
   }
 }
 
+std::string PlayerBank::serialize() const {
+  phosg::StringWriter w;
+  w.put<le_uint32_t>(this->items.size());
+  w.put<le_uint32_t>(this->meseta);
+  for (const auto& item : this->items) {
+    w.put(item);
+  }
+  return std::move(w.str());
+}
+
 uint32_t PlayerBank::bb_checksum() const {
   le_uint32_t num_items = this->items.size();
   le_uint32_t meseta = this->meseta;
@@ -371,7 +371,9 @@ struct PlayerBank {
   }
 
   void load(FILE* f);
+  void load(const std::string& data);
   void save(FILE* f) const;
+  std::string serialize() const;
 
   uint32_t bb_checksum() const;
 
@@ -8,6 +8,7 @@
 #include <phosg/Hash.hh>
 #include <phosg/Random.hh>
 #include <phosg/Strings.hh>
+#include <phosg/Time.hh>
 #include <phosg/Tools.hh>
 #include <string>
 #include <unordered_map>
@@ -16,6 +17,7 @@
 #include "Compression.hh"
 #include "Loggers.hh"
 #include "PSOEncryption.hh"
+#include "QuestCompileCache.hh"
 #include "QuestScript.hh"
 #include "SaveFileFormats.hh"
 #include "Text.hh"
@@ -351,6 +353,8 @@ std::shared_ptr<const SuperMap> Quest::get_supermap(int64_t random_seed) const {
   bool save_to_cache = true;
   bool any_map_file_present = false;
   std::array<std::shared_ptr<const MapFile>, NUM_VERSIONS> map_files;
+  // Many versions of a quest usually have the same map data, so only materialize each distinct map file once
+  std::unordered_map<uint64_t, std::shared_ptr<const MapFile>> materialized_for_source_hash;
   for (Version v : ALL_NON_PATCH_VERSIONS) {
     auto vq = this->version(v, Language::ENGLISH);
     if (vq && vq->map_file) {
@@ -360,7 +364,11 @@ std::shared_ptr<const SuperMap> Quest::get_supermap(int64_t random_seed) const {
           return nullptr;
         }
         save_to_cache = false;
-        map_file = map_file->materialize_random_sections(random_seed);
+        auto& materialized = materialized_for_source_hash[map_file->source_hash()];
+        if (!materialized) {
+          materialized = map_file->materialize_random_sections(random_seed);
+        }
+        map_file = materialized;
       }
       map_files.at(static_cast<size_t>(v)) = map_file;
       any_map_file_present = true;
@@ -381,6 +389,15 @@ std::shared_ptr<const SuperMap> Quest::get_supermap(int64_t random_seed) const {
   return supermap;
 }
 
+bool Quest::has_random_sections() const {
+  for (const auto& [_, vq] : this->versions) {
+    if (vq->map_file && vq->map_file->has_random_sections()) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool Quest::has_version(Version v, Language language) const {
   return this->versions.count(this->versions_key(v, language));
 }
@@ -412,9 +429,45 @@ std::shared_ptr<const VersionedQuest> Quest::version(Version v, Language languag
   return it->second;
 }
 
+static QuestCompileCache::Result compile_quest_file(
+    const std::string& path, const std::string& filename, const std::string& source_data) {
+  QuestCompileCache::Result ret;
+  ret.filename = filename;
+  if (filename.ends_with(".gci")) {
+    ret.data = decode_gci_data(source_data);
+    ret.filename.resize(ret.filename.size() - 4);
+  } else if (filename.ends_with(".vms")) {
+    ret.data = decode_vms_data(source_data);
+    ret.filename.resize(ret.filename.size() - 4);
+  } else if (filename.ends_with(".dlq")) {
+    ret.data = decode_dlq_data(source_data);
+    ret.filename.resize(ret.filename.size() - 4);
+  } else if (filename.ends_with(".bin.txt")) {
+    std::string include_dir = phosg::dirname(path);
+    ret.assembled = std::make_shared<AssembledQuestScript>(assemble_quest_script(
+        source_data,
+        {include_dir, "system/quests/includes"},
+        {include_dir, "system/quests/includes", "system/client-functions/System"}));
+    ret.data = std::move(ret.assembled->data);
+    ret.filename.resize(ret.filename.size() - 4);
+    if (ret.filename.ends_with(".bin")) {
+      ret.filename.push_back('d');
+    }
+  } else {
+    ret.data = source_data;
+  }
+
+  std::string lower_filename = phosg::tolower(ret.filename);
+  if (lower_filename.ends_with(".bind") || lower_filename.ends_with(".mnmd") || lower_filename.ends_with(".datd")) {
+    ret.data = prs_compress_optimal(ret.data);
+  }
+  return ret;
+}
+
 QuestIndex::QuestIndex(
     const std::string& directory, std::shared_ptr<const QuestCategoryIndex> category_index, bool raise_on_any_failure)
-    : directory(directory), category_index(category_index) {
+    : directory(directory), category_index(category_index), compile_cache_directory(directory + "/.compile-cache") {
+  QuestCompileCache compile_cache(this->compile_cache_directory);
 
   struct FileData {
     std::string filename;
@@ -498,26 +551,14 @@ QuestIndex::QuestIndex(
       try {
         std::string orig_filename = filename;
         std::string file_data;
-        if (filename.ends_with(".gci")) {
-          file_data = decode_gci_data(phosg::load_file(file_path));
-          filename.resize(filename.size() - 4);
-        } else if (filename.ends_with(".vms")) {
-          file_data = decode_vms_data(phosg::load_file(file_path));
-          filename.resize(filename.size() - 4);
-        } else if (filename.ends_with(".dlq")) {
-          file_data = decode_dlq_data(phosg::load_file(file_path));
-          filename.resize(filename.size() - 4);
-        } else if (filename.ends_with(".bin.txt")) {
-          std::string include_dir = phosg::dirname(file_path);
-          assembled = std::make_shared<AssembledQuestScript>(assemble_quest_script(
-              phosg::load_file(file_path),
-              {include_dir, "system/quests/includes"},
-              {include_dir, "system/quests/includes", "system/client-functions/System"}));
-          file_data = std::move(assembled->data);
-          filename.resize(filename.size() - 4);
-          if (filename.ends_with(".bin")) {
-            filename.push_back('d');
-          }
+        if (QuestCompileCache::should_cache(filename)) {
+          // Note that .bind, .mnmd, and .datd files are already compressed when they come out of the cache
+          auto res = compile_cache.get_or_compile(file_path, filename, [&](const std::string& source_data) {
+            return compile_quest_file(file_path, filename, source_data);
+          });
+          filename = std::move(res.filename);
+          file_data = std::move(res.data);
+          assembled = std::move(res.assembled);
         } else {
           file_data = phosg::load_file(file_path);
         }
@@ -537,11 +578,11 @@ QuestIndex::QuestIndex(
         } else if (extension == "bin" || extension == "mnm") {
           add_bin_file(file_basename, orig_filename, std::move(file_data), assembled);
         } else if (extension == "bind" || extension == "mnmd") {
-          add_bin_file(file_basename, orig_filename, prs_compress_optimal(file_data), assembled);
+          add_bin_file(file_basename, orig_filename, std::move(file_data), assembled);
         } else if (extension == "dat") {
           add_dat_file(file_basename, orig_filename, std::move(file_data));
         } else if (extension == "datd") {
-          add_dat_file(file_basename, orig_filename, prs_compress_optimal(file_data));
+          add_dat_file(file_basename, orig_filename, std::move(file_data));
         } else if (extension == "pvr") {
           add_file(pvr_files, file_basename, orig_filename, std::move(file_data), true);
         } else if (extension == "qst") {
@@ -567,6 +608,9 @@ QuestIndex::QuestIndex(
       }
     }
   }
+  compile_cache.prune();
+  this->compile_cache_stats = compile_cache.stats();
+  static_game_data_log.info_f("Quest compile cache: {}", this->compile_cache_stats.str());
 
   // All quests have a bin file (even in Episode 3, though its format is different), so we use bin_files as the primary
   // list of all quests that should be indexed
@@ -734,6 +778,142 @@ QuestIndex::QuestIndex(
   }
 }
 
+QuestIndex::EncodedQuestCacheEntry QuestIndex::get_or_create_encoded_quest(
+    uint64_t key, std::function<EncodedQuestCacheEntry()> create_fn) const {
+  {
+    std::lock_guard g(this->encoded_quest_cache_lock);
+    auto it = this->encoded_quest_cache.find(key);
+    if (it != this->encoded_quest_cache.end()) {
+      this->encoded_quest_cache_lru.splice(
+          this->encoded_quest_cache_lru.begin(), this->encoded_quest_cache_lru, it->second.lru_it);
+      return it->second;
+    }
+  }
+
+  // Encoding can take a while, so don't hold the lock while doing it. If another thread encodes the same quest at the
+  // same time, one of the results is discarded.
+  auto entry = create_fn();
+
+  std::lock_guard g(this->encoded_quest_cache_lock);
+  auto emplace_ret = this->encoded_quest_cache.emplace(key, entry);
+  if (!emplace_ret.second) {
+    return emplace_ret.first->second;
+  }
+  this->encoded_quest_cache_lru.emplace_front(key);
+  emplace_ret.first->second.lru_it = this->encoded_quest_cache_lru.begin();
+  this->encoded_quest_cache_bytes += entry.size;
+  while ((this->encoded_quest_cache_bytes > MAX_ENCODED_QUEST_CACHE_BYTES) &&
+      (this->encoded_quest_cache_lru.size() > 1)) {
+    auto evict_it = this->encoded_quest_cache.find(this->encoded_quest_cache_lru.back());
+    this->encoded_quest_cache_bytes -= evict_it->second.size;
+    this->encoded_quest_cache.erase(evict_it);
+    this->encoded_quest_cache_lru.pop_back();
+  }
+  return entry;
+}
+
+phosg::JSON QuestIndex::RandomSuperMapCacheStats::json() const {
+  return phosg::JSON::dict({
+      {"Hits", this->hits},
+      {"Misses", this->misses},
+      {"Evictions", this->evictions},
+      {"BuildUsecs", this->build_usecs},
+      {"MaxBuildUsecs", this->max_build_usecs},
+  });
+}
+
+std::string QuestIndex::RandomSuperMapCacheStats::str() const {
+  size_t total = this->hits + this->misses;
+  return std::format("{} hits, {} misses ({:g}% hit rate), {} evictions, {} building ({} max)",
+      this->hits, this->misses, total ? ((this->hits * 100.0) / total) : 0.0, this->evictions,
+      phosg::format_duration(this->build_usecs), phosg::format_duration(this->max_build_usecs));
+}
+
+std::shared_ptr<const SuperMap> QuestIndex::get_supermap(std::shared_ptr<const Quest> q, int64_t random_seed) const {
+  if ((random_seed < 0) || !q->has_random_sections()) {
+    return q->get_supermap(random_seed);
+  }
+
+  // The random sections are generated from a PSOV2Encryption stream seeded with the entire random seed, so there is
+  // no smaller part of the seed that determines the layout
+  uint64_t key = (static_cast<uint64_t>(q->meta.quest_number) << 32) | static_cast<uint32_t>(random_seed);
+  {
+    std::lock_guard g(this->random_supermap_cache_lock);
+    auto it = this->random_supermap_cache.find(key);
+    // The quest check is necessary because the Quest object may not be from this index, if the game was created
+    // before the quests were reloaded
+    if ((it != this->random_supermap_cache.end()) && (it->second.quest == q)) {
+      this->random_supermap_cache_lru.splice(
+          this->random_supermap_cache_lru.begin(), this->random_supermap_cache_lru, it->second.lru_it);
+      this->random_supermap_cache_stats.hits++;
+      return it->second.supermap;
+    }
+  }
+
+  uint64_t start_time = phosg::now();
+  auto supermap = q->get_supermap(random_seed);
+  uint64_t build_usecs = phosg::now() - start_time;
+
+  std::lock_guard g(this->random_supermap_cache_lock);
+  auto& stats = this->random_supermap_cache_stats;
+  stats.misses++;
+  stats.build_usecs += build_usecs;
+  stats.max_build_usecs = std::max<uint64_t>(stats.max_build_usecs, build_usecs);
+  auto it = this->random_supermap_cache.find(key);
+  if (it != this->random_supermap_cache.end()) {
+    this->random_supermap_cache_lru.erase(it->second.lru_it);
+    this->random_supermap_cache.erase(it);
+  }
+  this->random_supermap_cache_lru.emplace_front(key);
+  this->random_supermap_cache.emplace(key, RandomSuperMapCacheEntry{
+      .quest = q, .supermap = supermap, .lru_it = this->random_supermap_cache_lru.begin()});
+  while (this->random_supermap_cache_lru.size() > MAX_RANDOM_SUPERMAP_CACHE_ENTRIES) {
+    this->random_supermap_cache.erase(this->random_supermap_cache_lru.back());
+    this->random_supermap_cache_lru.pop_back();
+    stats.evictions++;
+  }
+  return supermap;
+}
+
+QuestIndex::RandomSuperMapCacheStats QuestIndex::random_supermap_cache_stats_snapshot() const {
+  std::lock_guard g(this->random_supermap_cache_lock);
+  return this->random_supermap_cache_stats;
+}
+
+static uint64_t encoded_quest_cache_key(
+    std::shared_ptr<const VersionedQuest> vq, Language language, uint8_t type) {
+  return (static_cast<uint64_t>(vq->meta.quest_number) << 32) |
+      (static_cast<uint64_t>(vq->meta.version) << 24) |
+      (static_cast<uint64_t>(vq->meta.language) << 16) |
+      (static_cast<uint64_t>(language) << 8) |
+      static_cast<uint64_t>(type);
+}
+
+std::shared_ptr<const VersionedQuest> QuestIndex::download_quest(
+    std::shared_ptr<const VersionedQuest> vq, Language language) const {
+  uint64_t key = encoded_quest_cache_key(vq, language, 0);
+  return this->get_or_create_encoded_quest(key, [&]() -> EncodedQuestCacheEntry {
+    EncodedQuestCacheEntry entry;
+    auto dlq = vq->create_download_quest(language);
+    entry.size = dlq->bin_contents->size() + (dlq->dat_contents ? dlq->dat_contents->size() : 0);
+    entry.download_vq = std::move(dlq);
+    return entry;
+  }).download_vq;
+}
+
+std::shared_ptr<const std::string> QuestIndex::qst_data(
+    std::shared_ptr<const VersionedQuest> vq, bool is_download, Language language) const {
+  uint64_t key = encoded_quest_cache_key(vq, language, is_download ? 2 : 1);
+  return this->get_or_create_encoded_quest(key, [&]() -> EncodedQuestCacheEntry {
+    EncodedQuestCacheEntry entry;
+    auto data = std::make_shared<std::string>(
+        is_download ? this->download_quest(vq, language)->encode_qst() : vq->encode_qst());
+    entry.size = data->size();
+    entry.qst_data = std::move(data);
+    return entry;
+  }).qst_data;
+}
+
 phosg::JSON QuestIndex::json() const {
   auto categories_json = phosg::JSON::dict();
   for (const auto& cat : this->category_index->categories) {
@@ -756,6 +936,7 @@ phosg::JSON QuestIndex::json() const {
       {"Directory", this->directory},
       {"Categories", std::move(categories_json)},
       {"Quests", std::move(quests_json)},
+      {"RandomSuperMapCache", this->random_supermap_cache_stats_snapshot().json()},
   });
 }
 
@@ -2,8 +2,10 @@
 
 #include <stdint.h>
 
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -13,6 +15,7 @@
 #include "ItemParameterTable.hh"
 #include "Map.hh"
 #include "PlayerSubordinates.hh"
+#include "QuestCompileCache.hh"
 #include "QuestMetadata.hh"
 #include "QuestScript.hh"
 #include "RareItemSet.hh"
@@ -106,7 +109,10 @@ struct Quest {
 
   phosg::JSON json() const;
 
+  // Constructs a new supermap on every call if the quest has random sections; in that case, use
+  // QuestIndex::get_supermap instead, which caches the results.
   std::shared_ptr<const SuperMap> get_supermap(int64_t random_seed) const;
+  bool has_random_sections() const;
 
   const std::string& name_for_language(Language language) const;
 
@@ -132,6 +138,8 @@ struct QuestIndex {
   std::map<uint32_t, std::shared_ptr<Quest>> quests_by_number;
   std::map<std::string, std::shared_ptr<Quest>> quests_by_name;
   std::map<uint32_t, std::map<uint32_t, std::shared_ptr<Quest>>> quests_by_category_id_and_number;
+  std::string compile_cache_directory;
+  QuestCompileCache::Stats compile_cache_stats; // From when the index was loaded
 
   QuestIndex(const std::string& directory, std::shared_ptr<const QuestCategoryIndex> category_index, bool raise_on_any_failure);
   phosg::JSON json() const;
@@ -150,6 +158,60 @@ struct QuestIndex {
       uint32_t category_id,
       IncludeCondition include_condition = nullptr,
       size_t limit = 0) const;
+
+  // These are equivalent to vq->create_download_quest(language) and vq->encode_qst() (or the download quest's
+  // encode_qst()), but the results are cached, so each quest version is only encoded once per language. vq must be
+  // from this index. The cache is bounded by size, and since it's part of the QuestIndex, it's discarded when quests
+  // are reloaded. These functions can be called from any thread.
+  std::shared_ptr<const VersionedQuest> download_quest(
+      std::shared_ptr<const VersionedQuest> vq, Language language = Language::UNKNOWN) const;
+  std::shared_ptr<const std::string> qst_data(
+      std::shared_ptr<const VersionedQuest> vq, bool is_download, Language language = Language::UNKNOWN) const;
+
+  struct RandomSuperMapCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    uint64_t build_usecs = 0; // Time spent constructing supermaps (that is, on misses)
+    uint64_t max_build_usecs = 0;
+
+    phosg::JSON json() const;
+    std::string str() const;
+  };
+  // Equivalent to q->get_supermap(random_seed), but if the quest has random sections, the results for recently-used
+  // seeds are cached. The cache is bounded by entry count and is discarded when quests are reloaded. This function can
+  // be called from any thread.
+  std::shared_ptr<const SuperMap> get_supermap(std::shared_ptr<const Quest> q, int64_t random_seed) const;
+  RandomSuperMapCacheStats random_supermap_cache_stats_snapshot() const;
+
+private:
+  static constexpr size_t MAX_RANDOM_SUPERMAP_CACHE_ENTRIES = 0x40;
+
+  struct RandomSuperMapCacheEntry {
+    std::shared_ptr<const Quest> quest;
+    std::shared_ptr<const SuperMap> supermap;
+    std::list<uint64_t>::iterator lru_it;
+  };
+  mutable std::mutex random_supermap_cache_lock;
+  mutable std::unordered_map<uint64_t, RandomSuperMapCacheEntry> random_supermap_cache;
+  mutable std::list<uint64_t> random_supermap_cache_lru; // Most recently used at front
+  mutable RandomSuperMapCacheStats random_supermap_cache_stats;
+
+  static constexpr size_t MAX_ENCODED_QUEST_CACHE_BYTES = 0x4000000; // 64MB
+
+  struct EncodedQuestCacheEntry {
+    std::shared_ptr<const VersionedQuest> download_vq;
+    std::shared_ptr<const std::string> qst_data;
+    size_t size = 0;
+    std::list<uint64_t>::iterator lru_it;
+  };
+  mutable std::mutex encoded_quest_cache_lock;
+  mutable std::unordered_map<uint64_t, EncodedQuestCacheEntry> encoded_quest_cache;
+  mutable std::list<uint64_t> encoded_quest_cache_lru; // Most recently used at front
+  mutable size_t encoded_quest_cache_bytes = 0;
+
+  EncodedQuestCacheEntry get_or_create_encoded_quest(
+      uint64_t key, std::function<EncodedQuestCacheEntry()> create_fn) const;
 };
 
 std::string encode_download_quest_data(
@@ -0,0 +1,197 @@
+#include "QuestCompileCache.hh"
+
+#include <filesystem>
+#include <phosg/Filesystem.hh>
+#include <phosg/Hash.hh>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+
+#include "FileWriteQueue.hh"
+#include "Loggers.hh"
+#include "Revision.hh"
+
+// Change this if the format of cache entries changes. Changes to the assembler or compressor don't require changing
+// this, since the build's revision and timestamp are part of every key.
+static constexpr uint32_t ENTRY_FORMAT_VERSION = 2;
+static constexpr uint32_t ENTRY_MAGIC = 0x51434345; // 'QCCE'
+
+static uint64_t build_hash() {
+  static const std::string build_str = std::format(
+      "{}:{}:{}", ENTRY_FORMAT_VERSION, GIT_REVISION_HASH, BUILD_TIMESTAMP);
+  static const uint64_t ret = phosg::fnv1a64(build_str.data(), build_str.size());
+  return ret;
+}
+
+// Entry names are only 64-bit hashes, so entries also contain a strong digest of each file they depend on, which is
+// checked on every hit
+static std::string content_digest(const std::string& data) {
+  return phosg::SHA256(data).bin();
+}
+
+phosg::JSON QuestCompileCache::Stats::json() const {
+  return phosg::JSON::dict({
+      {"Hits", this->hits},
+      {"Misses", this->misses},
+      {"Stale", this->stale},
+      {"WriteFailures", this->write_failures},
+      {"Pruned", this->pruned},
+      {"HitBytes", this->hit_bytes},
+      {"CompileUsecs", this->compile_usecs},
+  });
+}
+
+std::string QuestCompileCache::Stats::str() const {
+  return std::format(
+      "{} hits ({} bytes), {} misses ({} stale; {} compiling), {} write failures, {} pruned",
+      this->hits, this->hit_bytes, this->misses, this->stale, phosg::format_duration(this->compile_usecs),
+      this->write_failures, this->pruned);
+}
+
+QuestCompileCache::QuestCompileCache(const std::string& directory) : directory(directory) {
+  try {
+    std::filesystem::create_directories(this->directory);
+  } catch (const std::exception& e) {
+    static_game_data_log.warning_f("Cannot create quest compile cache directory {}: {}", this->directory, e.what());
+  }
+}
+
+bool QuestCompileCache::should_cache(const std::string& orig_filename) {
+  std::string filename = phosg::tolower(orig_filename);
+  return filename.ends_with(".gci") ||
+      filename.ends_with(".vms") ||
+      filename.ends_with(".dlq") ||
+      filename.ends_with(".bin.txt") ||
+      filename.ends_with(".bind") ||
+      filename.ends_with(".mnmd") ||
+      filename.ends_with(".datd");
+}
+
+QuestCompileCache::Result QuestCompileCache::get_or_compile(
+    const std::string& path,
+    const std::string& filename,
+    std::function<Result(const std::string& source_data)> compile_fn) {
+  std::string source_data = phosg::load_file(path);
+  uint64_t key = phosg::fnv1a64(filename.data(), filename.size(), build_hash());
+  key = phosg::fnv1a64(source_data.data(), source_data.size(), key);
+  std::string entry_name = std::format("{:016X}", key);
+  std::string entry_path = this->directory + "/" + entry_name;
+  this->used_entry_names.emplace(entry_name);
+
+  try {
+    std::string entry_data = phosg::load_file(entry_path);
+    phosg::StringReader r(entry_data);
+    if (r.get_u32l() != ENTRY_MAGIC) {
+      throw std::runtime_error("incorrect entry signature");
+    }
+    if (r.get_u64l() != source_data.size()) {
+      throw std::runtime_error("source size does not match");
+    }
+    if (r.read(0x20) != content_digest(source_data)) {
+      throw std::runtime_error("source digest does not match");
+    }
+
+    Result ret;
+    ret.filename = r.read(r.get_u32l());
+    if (r.get_u8()) {
+      ret.assembled = std::make_shared<AssembledQuestScript>();
+      ret.assembled->meta.quest_number = r.get_u32l();
+      ret.assembled->meta.version = static_cast<Version>(r.get_u8());
+      ret.assembled->meta.language = static_cast<Language>(r.get_u8());
+    }
+    bool is_stale = false;
+    for (size_t num_includes = r.get_u32l(); num_includes > 0; num_includes--) {
+      std::string include_path = r.read(r.get_u32l());
+      uint64_t expected_size = r.get_u64l();
+      std::string expected_digest = r.read(0x20);
+      if (!is_stale) {
+        try {
+          std::string include_data = phosg::load_file(include_path);
+          is_stale = (include_data.size() != expected_size) || (content_digest(include_data) != expected_digest);
+        } catch (const phosg::cannot_open_file&) {
+          is_stale = true;
+        }
+      }
+    }
+
+    if (!is_stale) {
+      ret.data = r.read(r.remaining());
+      this->current_stats.hits++;
+      this->current_stats.hit_bytes += ret.data.size();
+      return ret;
+    }
+    this->current_stats.stale++;
+
+  } catch (const phosg::cannot_open_file&) {
+    // Not cached yet
+  } catch (const std::exception& e) {
+    static_game_data_log.warning_f(
+        "({}) Ignoring invalid quest compile cache entry {}: {}", filename, entry_name, e.what());
+  }
+
+  this->current_stats.misses++;
+  uint64_t start_time = phosg::now();
+  Result ret = compile_fn(source_data);
+  this->current_stats.compile_usecs += phosg::now() - start_time;
+
+  phosg::StringWriter w;
+  w.put_u32l(ENTRY_MAGIC);
+  w.put_u64l(source_data.size());
+  w.write(content_digest(source_data));
+  w.put_u32l(ret.filename.size());
+  w.write(ret.filename);
+  w.put_u8(ret.assembled ? 1 : 0);
+  if (ret.assembled) {
+    w.put_u32l(ret.assembled->meta.quest_number);
+    w.put_u8(static_cast<uint8_t>(ret.assembled->meta.version));
+    w.put_u8(static_cast<uint8_t>(ret.assembled->meta.language));
+    w.put_u32l(ret.assembled->included_filenames.size());
+    for (const auto& include_path : ret.assembled->included_filenames) {
+      std::string include_data = phosg::load_file(include_path);
+      w.put_u32l(include_path.size());
+      w.write(include_path);
+      w.put_u64l(include_data.size());
+      w.write(content_digest(include_data));
+    }
+  } else {
+    w.put_u32l(0);
+  }
+  w.write(ret.data);
+
+  try {
+    file_write_queue.write(entry_path, std::move(w.str()));
+  } catch (const std::exception& e) {
+    this->current_stats.write_failures++;
+    static_game_data_log.warning_f(
+        "({}) Cannot write quest compile cache entry {}: {}", filename, entry_name, e.what());
+  }
+
+  return ret;
+}
+
+void QuestCompileCache::prune() {
+  try {
+    for (const auto& item : std::filesystem::directory_iterator(this->directory)) {
+      std::string name = item.path().filename().string();
+      if (!name.ends_with(".tmp") && !this->used_entry_names.count(name)) {
+        std::filesystem::remove(item.path());
+        this->current_stats.pruned++;
+      }
+    }
+  } catch (const std::exception& e) {
+    static_game_data_log.warning_f("Cannot prune quest compile cache directory {}: {}", this->directory, e.what());
+  }
+}
+
+size_t QuestCompileCache::clear(const std::string& directory) {
+  if (!std::filesystem::is_directory(directory)) {
+    return 0;
+  }
+  // Wait for any pending entry writes first, so they don't reappear after this returns
+  file_write_queue.flush();
+  size_t ret = 0;
+  for (const auto& item : std::filesystem::directory_iterator(directory)) {
+    std::filesystem::remove(item.path());
+    ret++;
+  }
+  return ret;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <phosg/JSON.hh>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "QuestScript.hh"
+
+// Stores the results of the slow steps in loading quest files (assembling .bin.txt files, compressing .bind/.datd
+// files, and decoding .gci/.vms/.dlq files) on disk, so they aren't redone every time the quest index is loaded.
+// Entries are keyed on a hash of the source file's name and contents and the server build (so changes to the
+// assembler or compressor invalidate everything). Each entry also records the source file's size and SHA-256 digest,
+// which are verified on every hit. Entries for assembled scripts also record the size and SHA-256 digest of each
+// included file, and are ignored if any of those files has changed.
+class QuestCompileCache {
+public:
+  struct Result {
+    std::string filename; // Source filename with the extensions handled by the compile function removed
+    std::string data;
+    // Only quest_number, version, and language are restored in entries loaded from the cache. data is not used.
+    std::shared_ptr<AssembledQuestScript> assembled;
+  };
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0; // Includes stale entries
+    size_t stale = 0; // Entry existed, but an included file had changed
+    size_t write_failures = 0;
+    size_t pruned = 0;
+    uint64_t hit_bytes = 0;
+    uint64_t compile_usecs = 0; // Time spent in compile functions (that is, on misses)
+
+    phosg::JSON json() const;
+    std::string str() const;
+  };
+
+  explicit QuestCompileCache(const std::string& directory);
+
+  inline const std::string& get_directory() const {
+    return this->directory;
+  }
+  inline const Stats& stats() const {
+    return this->current_stats;
+  }
+
+  // Returns true if the given filename's loading process has a step that is worth caching
+  static bool should_cache(const std::string& filename);
+
+  // Returns the cached result for the given source file if present and valid; otherwise, calls compile_fn and caches
+  // its result
+  Result get_or_compile(
+      const std::string& path,
+      const std::string& filename,
+      std::function<Result(const std::string& source_data)> compile_fn);
+
+  // Deletes all entries that weren't used by get_or_compile on this object (e.g. for quest files that were changed or
+  // deleted since the last load)
+  void prune();
+  // Deletes all entries. Returns the number of entries deleted.
+  static size_t clear(const std::string& directory);
+
+private:
+  std::string directory;
+  std::unordered_set<std::string> used_entry_names;
+  Stats current_stats;
+};
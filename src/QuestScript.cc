@@ -3988,6 +3988,7 @@ AssembledQuestScript assemble_quest_script(
   include_file("", text, -1);
 
   // Process all includes
+  std::vector<std::string> included_filenames;
   for (size_t z = 0; z < lines.size(); z++) {
     if (lines[z].text.starts_with(".include ")) {
       std::string filename = lines[z].text.substr(9);
@@ -4007,6 +4008,7 @@ AssembledQuestScript assemble_quest_script(
         if (std::filesystem::is_regular_file(include_path)) {
           found = true;
           include_file(filename, phosg::load_file(include_path), z);
+          included_filenames.emplace_back(include_path);
           break;
         }
       }
@@ -4250,6 +4252,7 @@ AssembledQuestScript assemble_quest_script(
     for (const auto& include_dir : native_include_directories) {
       std::string path = include_dir + "/" + filename;
       if (std::filesystem::is_regular_file(path)) {
+        included_filenames.emplace_back(path);
         return phosg::load_file(path);
       }
     }
@@ -4783,6 +4786,7 @@ AssembledQuestScript assemble_quest_script(
   w.write(code_w.str());
   w.write(label_table.data(), label_table.size() * sizeof(label_table[0]));
   ret.data = std::move(w.str());
+  ret.included_filenames = std::move(included_filenames);
 
   return ret;
 }
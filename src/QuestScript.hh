@@ -4,6 +4,8 @@
 
 #include <phosg/Encoding.hh>
 #include <phosg/Tools.hh>
+#include <string>
+#include <vector>
 
 #include "QuestMetadata.hh"
 #include "StaticGameData.hh"
@@ -148,6 +150,7 @@ std::string disassemble_quest_script(
 struct AssembledQuestScript {
   std::string data;
   QuestMetadata meta;
+  std::vector<std::string> included_filenames; // Paths of all files used via .include, .include_bin, or .include_native
 };
 AssembledQuestScript assemble_quest_script(
     const std::string& text,
@@ -233,6 +233,7 @@ RareItemSet::RareItemSet(const AFSArchive& afs, bool is_v1) {
       }
     }
   }
+  this->compile();
 }
 
 std::string RareItemSet::gsl_entry_name_for_table(
@@ -260,6 +261,7 @@ RareItemSet::RareItemSet(const GSLArchive& gsl, bool is_big_endian) {
       }
     }
   }
+  this->compile();
 }
 
 RareItemSet::RareItemSet(const std::string& rel_data, bool is_big_endian) {
@@ -279,6 +281,7 @@ RareItemSet::RareItemSet(const std::string& rel_data, bool is_big_endian) {
       }
     }
   }
+  this->compile();
 }
 
 RareItemSet::RareItemSet(const phosg::JSON& json, std::shared_ptr<const ItemNameIndex> name_index) {
@@ -359,6 +362,7 @@ RareItemSet::RareItemSet(const phosg::JSON& json, std::shared_ptr<const ItemName
       }
     }
   }
+  this->compile();
 }
 
 std::string RareItemSet::serialize_afs(bool is_v1) const {
@@ -847,6 +851,7 @@ void RareItemSet::multiply_all_rates(double factor) {
       }
     }
   }
+  this->compile();
 }
 
 void RareItemSet::print_collection(
@@ -994,23 +999,177 @@ void RareItemSet::print_diff(FILE* stream, const RareItemSet& other) const {
   }
 }
 
+static std::vector<RareItemSet::ExpandedDrop> expanded_drops_for_compiled_drops(
+    std::span<const RareItemSet::CompiledDrop> drops) {
+  std::vector<RareItemSet::ExpandedDrop> ret;
+  ret.reserve(drops.size());
+  for (const auto& drop : drops) {
+    ret.emplace_back(drop.drop);
+  }
+  return ret;
+}
+
 std::vector<RareItemSet::ExpandedDrop> RareItemSet::get_enemy_specs(
     GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, EnemyType enemy_type) const {
-  try {
-    return this->get_collection(mode, episode, difficulty, secid).enemy_specs.at(enemy_type);
-  } catch (const std::out_of_range&) {
-    static const std::vector<ExpandedDrop> empty_vector;
-    return empty_vector;
-  }
+  return expanded_drops_for_compiled_drops(this->enemy_drops(mode, episode, difficulty, secid, enemy_type));
 }
 
 std::vector<RareItemSet::ExpandedDrop> RareItemSet::get_box_specs(
     GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, uint8_t area_norm) const {
-  try {
-    return this->get_collection(mode, episode, difficulty, secid).box_specs.at(area_norm);
-  } catch (const std::out_of_range&) {
-    static const std::vector<ExpandedDrop> empty_vector;
-    return empty_vector;
+  return expanded_drops_for_compiled_drops(this->box_drops(mode, episode, difficulty, secid, area_norm));
+}
+
+void RareItemSet::verify_compiled_tables() const {
+  static const std::vector<ExpandedDrop> empty_vector;
+  auto check_drops = [&](const std::vector<ExpandedDrop>& expected, std::span<const CompiledDrop> compiled,
+                         const std::string& context) -> void {
+    if (compiled.size() != expected.size()) {
+      throw std::runtime_error(std::format(
+          "{}: compiled table has {} drops; collection has {} drops", context, compiled.size(), expected.size()));
+    }
+    uint64_t cumulative_probability = 0;
+    for (size_t z = 0; z < expected.size(); z++) {
+      cumulative_probability += expected[z].probability;
+      if (compiled[z].drop != expected[z]) {
+        throw std::runtime_error(std::format(
+            "{}: compiled drop {} ({}) does not match collection ({})",
+            context, z, compiled[z].drop.str(), expected[z].str()));
+      }
+      if (compiled[z].cumulative_probability != cumulative_probability) {
+        throw std::runtime_error(std::format(
+            "{}: compiled drop {} has cumulative probability {}; expected {}",
+            context, z, compiled[z].cumulative_probability, cumulative_probability));
+      }
+    }
+  };
+
+  size_t max_box_areas = this->compiled_row_size - NUM_ENEMY_TYPE_SLOTS;
+  for (GameMode mode : ALL_GAME_MODES_V4) {
+    for (Episode episode : ALL_EPISODES_V4) {
+      for (Difficulty difficulty : ALL_DIFFICULTIES_V234) {
+        for (uint8_t section_id = 0; section_id < 10; section_id++) {
+          const SpecCollection* collection = nullptr;
+          try {
+            collection = &this->get_collection(mode, episode, difficulty, section_id);
+          } catch (const std::out_of_range&) {
+          }
+
+          for (size_t type_index = 0; type_index < NUM_ENEMY_TYPE_SLOTS; type_index++) {
+            EnemyType type = static_cast<EnemyType>(type_index);
+            const std::vector<ExpandedDrop>* expected = &empty_vector;
+            if (collection) {
+              auto it = collection->enemy_specs.find(type);
+              if (it != collection->enemy_specs.end()) {
+                expected = &it->second;
+              }
+            }
+            check_drops(*expected, this->enemy_drops(mode, episode, difficulty, section_id, type), std::format(
+                "{} {} {} {} {}", name_for_mode(mode), abbreviation_for_episode(episode),
+                abbreviation_for_difficulty(difficulty), name_for_section_id(section_id), phosg::name_for_enum(type)));
+          }
+
+          size_t num_box_areas = std::max<size_t>(max_box_areas, collection ? collection->box_specs.size() : 0);
+          for (size_t area_norm = 0; area_norm < num_box_areas; area_norm++) {
+            const auto& expected = (collection && (area_norm < collection->box_specs.size()))
+                ? collection->box_specs[area_norm]
+                : empty_vector;
+            check_drops(expected, this->box_drops(mode, episode, difficulty, section_id, area_norm), std::format(
+                "{} {} {} {} box area {:02X}", name_for_mode(mode), abbreviation_for_episode(episode),
+                abbreviation_for_difficulty(difficulty), name_for_section_id(section_id), area_norm));
+          }
+        }
+      }
+    }
+  }
+}
+
+std::span<const RareItemSet::CompiledDrop> RareItemSet::enemy_drops(
+    GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, EnemyType enemy_type) const {
+  if (static_cast<size_t>(enemy_type) >= NUM_ENEMY_TYPE_SLOTS) {
+    return {};
+  }
+  return this->compiled_drops_for_slot(mode, episode, difficulty, secid, static_cast<size_t>(enemy_type));
+}
+
+std::span<const RareItemSet::CompiledDrop> RareItemSet::box_drops(
+    GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, uint8_t area_norm) const {
+  return this->compiled_drops_for_slot(mode, episode, difficulty, secid, NUM_ENEMY_TYPE_SLOTS + area_norm);
+}
+
+std::span<const RareItemSet::CompiledDrop> RareItemSet::compiled_drops_for_slot(
+    GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, size_t slot) const {
+  uint16_t key = this->key_for_params(mode, episode, difficulty, secid);
+  if ((key >= this->compiled_table_for_key.size()) || (slot >= this->compiled_row_size)) {
+    return {};
+  }
+  int16_t row = this->compiled_table_for_key[key];
+  if (row < 0) {
+    return {};
+  }
+  const auto& range = this->compiled_ranges[row * this->compiled_row_size + slot];
+  return std::span<const CompiledDrop>(this->compiled_drops.data() + range.start, range.count);
+}
+
+void RareItemSet::compile() {
+  size_t max_box_areas = 0;
+  for (const auto& [_, collection] : this->collections) {
+    max_box_areas = std::max<size_t>(max_box_areas, collection.box_specs.size());
+  }
+
+  this->compiled_table_for_key.clear();
+  this->compiled_row_size = NUM_ENEMY_TYPE_SLOTS + max_box_areas;
+  this->compiled_ranges.clear();
+  this->compiled_drops.clear();
+
+  auto add_drops = [&](const std::vector<ExpandedDrop>& specs, DropRange& range) -> void {
+    range.start = this->compiled_drops.size();
+    range.count = specs.size();
+    uint64_t cumulative_probability = 0;
+    for (const auto& spec : specs) {
+      cumulative_probability += spec.probability;
+      this->compiled_drops.emplace_back(CompiledDrop{.cumulative_probability = cumulative_probability, .drop = spec});
+    }
+  };
+
+  // Multiple keys can refer to the same collection (via the fallback in get_collection), so each collection is only
+  // compiled once
+  std::unordered_map<const SpecCollection*, int16_t> row_for_collection;
+  for (GameMode mode : ALL_GAME_MODES_V4) {
+    for (Episode episode : ALL_EPISODES_V4) {
+      for (Difficulty difficulty : ALL_DIFFICULTIES_V234) {
+        for (uint8_t section_id = 0; section_id < 10; section_id++) {
+          const SpecCollection* collection;
+          try {
+            collection = &this->get_collection(mode, episode, difficulty, section_id);
+          } catch (const std::out_of_range&) {
+            continue;
+          }
+
+          auto row_it = row_for_collection.find(collection);
+          if (row_it == row_for_collection.end()) {
+            int16_t row = row_for_collection.size();
+            row_it = row_for_collection.emplace(collection, row).first;
+            this->compiled_ranges.resize(this->compiled_ranges.size() + this->compiled_row_size);
+            DropRange* ranges = &this->compiled_ranges[row * this->compiled_row_size];
+            for (const auto& [enemy_type, specs] : collection->enemy_specs) {
+              if (static_cast<size_t>(enemy_type) >= NUM_ENEMY_TYPE_SLOTS) {
+                throw std::runtime_error("invalid enemy type in rare item set");
+              }
+              add_drops(specs, ranges[static_cast<size_t>(enemy_type)]);
+            }
+            for (size_t area_norm = 0; area_norm < collection->box_specs.size(); area_norm++) {
+              add_drops(collection->box_specs[area_norm], ranges[NUM_ENEMY_TYPE_SLOTS + area_norm]);
+            }
+          }
+
+          uint16_t key = this->key_for_params(mode, episode, difficulty, section_id);
+          if (this->compiled_table_for_key.size() <= key) {
+            this->compiled_table_for_key.resize(key + 1, -1);
+          }
+          this->compiled_table_for_key[key] = row_it->second;
+        }
+      }
+    }
   }
 }
 
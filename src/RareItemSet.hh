@@ -6,6 +6,7 @@
 #include <memory>
 #include <phosg/JSON.hh>
 #include <random>
+#include <span>
 #include <string>
 
 #include "AFSArchive.hh"
@@ -29,6 +30,14 @@ public:
     std::string str(std::shared_ptr<const ItemNameIndex> name_index) const;
   };
 
+  // Drops in the compiled tables (see enemy_drops and box_drops). These are aligned so that no drop spans two cache
+  // lines.
+  struct alignas(32) CompiledDrop {
+    uint64_t cumulative_probability; // Sum of the probabilities of this drop and all drops before it in the same list
+    ExpandedDrop drop;
+  };
+  static_assert(sizeof(CompiledDrop) == 32, "CompiledDrop size is incorrect");
+
   RareItemSet();
   RareItemSet(const AFSArchive& afs, bool is_v1);
   RareItemSet(const GSLArchive& gsl, bool is_big_endian);
@@ -36,11 +45,24 @@ public:
   RareItemSet(const phosg::JSON& json, std::shared_ptr<const ItemNameIndex> name_index = nullptr);
   ~RareItemSet() = default;
 
+  // These return the drops for the given enemy type or box area from the compiled tables, without allocating or
+  // copying anything; they're used for drop rolls. The cumulative probabilities are nondecreasing, so the drop for a
+  // random value can be found by binary search.
+  std::span<const CompiledDrop> enemy_drops(
+      GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, EnemyType enemy_type) const;
+  std::span<const CompiledDrop> box_drops(
+      GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, uint8_t area_norm) const;
+
+  // These return copies of the drops returned by enemy_drops and box_drops, without the cumulative probabilities
   std::vector<ExpandedDrop> get_enemy_specs(
       GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, EnemyType enemy_type) const;
   std::vector<ExpandedDrop> get_box_specs(
       GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, uint8_t area_norm) const;
 
+  // Checks that the compiled tables contain exactly the drops in the collections they were built from, for every game
+  // mode, episode, difficulty, section ID, enemy type, and box area. Throws if any difference is found.
+  void verify_compiled_tables() const;
+
   bool has_entries_for_game_config(GameMode mode, Episode episode, Difficulty difficulty) const;
 
   std::string serialize_afs(bool is_v1) const;
@@ -123,6 +145,24 @@ protected:
 
   std::unordered_map<uint16_t, SpecCollection> collections;
 
+  // Flattened copy of collections, rebuilt by compile() whenever collections changes. compiled_table_for_key maps the
+  // result of key_for_params to a row in compiled_ranges (or -1 if there's no collection for that key; the Battle and
+  // Solo fallback to Normal is resolved here). Each row has one DropRange for each EnemyType, followed by one for each
+  // box area_norm, each of which refers to a contiguous run of compiled_drops.
+  struct DropRange {
+    uint32_t start = 0;
+    uint32_t count = 0;
+  };
+  static constexpr size_t NUM_ENEMY_TYPE_SLOTS = static_cast<size_t>(EnemyType::MAX_VALUE);
+  std::vector<int16_t> compiled_table_for_key;
+  size_t compiled_row_size = NUM_ENEMY_TYPE_SLOTS;
+  std::vector<DropRange> compiled_ranges;
+  std::vector<CompiledDrop> compiled_drops;
+
+  void compile();
+  std::span<const CompiledDrop> compiled_drops_for_slot(
+      GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid, size_t slot) const;
+
   const SpecCollection& get_collection(GameMode mode, Episode episode, Difficulty difficulty, uint8_t secid) const;
 
   static std::string gsl_entry_name_for_table(GameMode mode, Episode episode, Difficulty difficulty, uint8_t section_id);
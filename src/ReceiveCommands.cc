@@ -12,6 +12,7 @@
 #include <phosg/Time.hh>
 
 #include "ChatCommands.hh"
+#include "CommandMetrics.hh"
 #include "Compression.hh"
 #include "Episode3/Tournament.hh"
 #include "GameServer.hh"
@@ -616,6 +617,7 @@ static asio::awaitable<void> on_04_U(std::shared_ptr<Client> c, Channel::Message
 
     auto index = is_bb ? s->data->bb_patch_file_index : s->data->pc_patch_file_index;
     if (index.get()) {
+      c->patch_file_index = index;
       c->channel->send(0x0B, 0x00); // Start patch session; go to root directory
 
       std::vector<std::string> path_directories;
@@ -654,8 +656,13 @@ asio::awaitable<void> on_0F_U(std::shared_ptr<Client> c, Channel::Message& msg)
 }
 
 asio::awaitable<void> on_10_U(std::shared_ptr<Client> c, Channel::Message&) {
+  // Take ownership of the requests, since the client's commands are handled concurrently and this handler suspends
+  // while the download is in progress
+  auto requests = std::move(c->patch_file_checksum_requests);
+  c->patch_file_checksum_requests.clear();
+
   S_StartFileDownloads_Patch_11 start_cmd = {0, 0};
-  for (const auto& req : c->patch_file_checksum_requests) {
+  for (const auto& req : requests) {
     if (!req.response_received) {
       throw std::runtime_error("client did not respond to checksum request");
     }
@@ -672,21 +679,32 @@ asio::awaitable<void> on_10_U(std::shared_ptr<Client> c, Channel::Message&) {
   if (start_cmd.num_files) {
     c->channel->send(0x11, 0x00, start_cmd);
     std::vector<std::string> path_directories;
-    for (const auto& req : c->patch_file_checksum_requests) {
+    for (const auto& req : requests) {
       if (req.needs_update()) {
         send_patch_change_to_directory(c, path_directories, req.file->path_directories);
 
         S_OpenFile_Patch_06 open_cmd = {0, req.file->size, {req.file->name, Language::ENGLISH}};
         c->channel->send(0x06, 0x00, open_cmd);
 
+        // Chunks are read from the file only as fast as the client receives them, so the amount of file data
+        // buffered per client is bounded by the send window rather than by the size of the patch. If the file has
+        // changed since it was indexed, read_chunk throws and the client is disconnected; it will get the new version
+        // after the patch directory is reindexed.
+        auto f = req.file->open_data();
+        std::string chunk_data;
         for (size_t x = 0; x < req.file->chunk_crcs.size(); x++) {
-          auto data = req.file->load_data();
-          size_t chunk_size = std::min<uint32_t>(req.file->size - (x * PatchFileIndex::CHUNK_SIZE), PatchFileIndex::CHUNK_SIZE);
+          co_await c->channel->wait_for_send_buffer(PatchFileIndex::SEND_WINDOW_BYTES);
+          if (!c->channel->connected()) {
+            co_return;
+          }
+          // The client is still receiving data, so don't let it time out
+          c->reschedule_ping_and_timeout_timers();
 
+          req.file->read_chunk(*f, x, chunk_data);
           std::vector<std::pair<const void*, size_t>> blocks;
-          S_WriteFileHeader_Patch_07 cmd_header = {x, req.file->chunk_crcs[x], chunk_size};
+          S_WriteFileHeader_Patch_07 cmd_header = {x, req.file->chunk_crcs[x], chunk_data.size()};
           blocks.emplace_back(&cmd_header, sizeof(cmd_header));
-          blocks.emplace_back(data->data() + (x * PatchFileIndex::CHUNK_SIZE), chunk_size);
+          blocks.emplace_back(chunk_data.data(), chunk_data.size());
           c->channel->send(0x07, 0x00, blocks);
         }
 
@@ -698,7 +716,6 @@ asio::awaitable<void> on_10_U(std::shared_ptr<Client> c, Channel::Message&) {
   }
 
   c->channel->send(0x12, 0x00);
-  co_return;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1631,7 +1648,7 @@ static bool add_next_game_client(std::shared_ptr<Lobby> l) {
     state_cmd.state.first_team_turn = 0xFF;
     state_cmd.state.tournament_flag = 0x01;
     state_cmd.state.client_sc_card_types.clear(Episode3::CardType::INVALID_FF);
-    if ((c->version() != Version::GC_EP3_NTE) && !(s->data->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
+    if ((c->version() != Version::GC_EP3_NTE) && !(l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
       uint8_t mask_key = (phosg::random_object<uint32_t>() % 0xFF) + 1;
       set_mask_for_ep3_game_command(&state_cmd, sizeof(state_cmd), mask_key);
     }
@@ -1792,8 +1809,8 @@ static bool start_ep3_battle_table_game_if_ready(std::shared_ptr<Lobby> l, int16
   }
   game->tournament_match = tourn_match;
   game->ep3_ex_result_values = (tourn_match && tourn && tourn->get_final_match() == tourn_match)
-      ? s->data->ep3_tournament_final_round_ex_values
-      : s->data->ep3_tournament_ex_values;
+      ? game->require_data()->ep3_tournament_final_round_ex_values
+      : game->require_data()->ep3_tournament_ex_values;
   game->clients_to_add.clear();
   for (const auto& it : game_clients) {
     game->clients_to_add.emplace(it.first, it.second);
@@ -1965,8 +1982,8 @@ static asio::awaitable<void> on_CA_Ep3(std::shared_ptr<Client> c, Channel::Messa
   if (!l->ep3_server || l->ep3_server->battle_finished) {
     auto s = c->require_server_state();
 
-    if (s->data->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_RECORDING) {
-      l->battle_record = std::make_shared<Episode3::BattleRecord>(s->data->ep3_behavior_flags);
+    if (l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_RECORDING) {
+      l->battle_record = std::make_shared<Episode3::BattleRecord>(l->require_data()->ep3_behavior_flags);
       for (auto existing_c : l->clients) {
         if (existing_c) {
           auto existing_p = existing_c->character_file();
@@ -2012,7 +2029,7 @@ static asio::awaitable<void> on_CA_Ep3(std::shared_ptr<Client> c, Channel::Messa
       for (const auto& rc : rl->clients) {
         if (rc) {
           rc->ep3_prev_battle_record = l->battle_record;
-          if ((s->data->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_STATUS_MESSAGES)) {
+          if ((l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_STATUS_MESSAGES)) {
             send_text_message(rc, "$C7Recording complete");
           }
         }
@@ -2046,13 +2063,13 @@ static asio::awaitable<void> on_CA_Ep3(std::shared_ptr<Client> c, Channel::Messa
 
     uint32_t meseta_reward = 0;
     auto& round_rewards = loser_team->has_any_human_players()
-        ? s->data->ep3_defeat_player_meseta_rewards
-        : s->data->ep3_defeat_com_meseta_rewards;
+        ? l->require_data()->ep3_defeat_player_meseta_rewards
+        : l->require_data()->ep3_defeat_com_meseta_rewards;
     meseta_reward = (l->tournament_match->round_num - 1 < round_rewards.size())
         ? round_rewards[l->tournament_match->round_num - 1]
         : round_rewards.back();
     if (tourn && (l->tournament_match == tourn->get_final_match())) {
-      meseta_reward += s->data->ep3_final_round_meseta_bonus;
+      meseta_reward += l->require_data()->ep3_final_round_meseta_bonus;
     }
     for (const auto& player : winner_team->players) {
       if (player.is_human()) {
@@ -2393,7 +2410,6 @@ static void on_quest_loaded(std::shared_ptr<Lobby> l) {
   // Replace the free-play map with the quest's map
   l->load_maps();
 
-  auto s = l->require_server_state();
 
   // Delete all floor items
   for (auto& m : l->floor_item_managers) {
@@ -2418,7 +2434,7 @@ static void on_quest_loaded(std::shared_ptr<Lobby> l) {
         lc->change_bank(lc->bb_character_index);
       }
       lc->create_challenge_overlay(
-          lc->version(), l->quest->meta.challenge_template_index, s->data->level_table(lc->version()));
+          lc->version(), l->quest->meta.challenge_template_index, l->require_data()->level_table(lc->version()));
       lc->log.info_f("Created challenge overlay");
       l->assign_inventory_and_bank_item_ids(lc, true);
 
@@ -2426,7 +2442,7 @@ static void on_quest_loaded(std::shared_ptr<Lobby> l) {
       if (is_v4(lc->version())) {
         lc->change_bank(lc->bb_character_index);
       }
-      lc->create_battle_overlay(l->quest->meta.battle_rules, s->data->level_table(lc->version()));
+      lc->create_battle_overlay(l->quest->meta.battle_rules, l->require_data()->level_table(lc->version()));
       lc->log.info_f("Created battle overlay");
     }
   }
@@ -2807,12 +2823,13 @@ static void on_10_quest_categories(std::shared_ptr<Client> c, uint32_t item_id)
 
   } else {
     auto s = c->require_server_state();
-    if (!s->data->quest_index) {
+    std::shared_ptr<Lobby> l = c->lobby.lock();
+    auto data = l ? l->require_data() : s->data;
+    if (!data->quest_index) {
       send_lobby_message_box(c, "$C7Quests are not available.");
       return;
     }
 
-    std::shared_ptr<Lobby> l = c->lobby.lock();
     Episode episode = l ? l->episode : Episode::NONE;
     uint16_t version_flags = (1 << static_cast<size_t>(c->version())) | (l ? l->quest_version_flags() : 0);
     QuestIndex::IncludeCondition include_condition = nullptr;
@@ -2820,7 +2837,7 @@ static void on_10_quest_categories(std::shared_ptr<Client> c, uint32_t item_id)
       include_condition = l->quest_include_condition();
     }
 
-    const auto& quests = s->data->quest_index->filter(episode, version_flags, item_id, include_condition);
+    const auto& quests = data->quest_index->filter(episode, version_flags, item_id, include_condition);
     send_quest_menu(c, quests, !l);
   }
 }
@@ -2831,18 +2848,19 @@ static void on_10_quest_menu(std::shared_ptr<Client> c, uint32_t item_id) {
   }
 
   auto s = c->require_server_state();
-  if (!s->data->quest_index) {
+  // If the client is not in a lobby, send it as a download quest; otherwise, they must be in a game to load a quest.
+  auto l = c->lobby.lock();
+  auto data = l ? l->require_data() : s->data;
+  if (!data->quest_index) {
     send_lobby_message_box(c, "$C7Quests are not\navailable.");
     return;
   }
-  auto q = s->data->quest_index->get(item_id);
+  auto q = data->quest_index->get(item_id);
   if (!q) {
     send_lobby_message_box(c, "$C7Quest does not exist.");
     return;
   }
 
-  // If the client is not in a lobby, send it as a download quest; otherwise, they must be in a game to load a quest.
-  auto l = c->lobby.lock();
   if (l && !l->is_game()) {
     send_lobby_message_box(c, "$C7Quests cannot be\nloaded in lobbies.");
     return;
@@ -2869,7 +2887,7 @@ static void on_10_quest_menu(std::shared_ptr<Client> c, uint32_t item_id) {
       send_lobby_message_box(c, "$C7Quest does not exist\nfor this game version.");
       return;
     }
-    vq = vq->create_download_quest(c->language());
+    vq = data->quest_index->download_quest(vq, c->language());
     std::string xb_filename = vq->xb_filename();
     QuestFileType type = vq->pvr_contents ? QuestFileType::DOWNLOAD_WITH_PVR : QuestFileType::DOWNLOAD_WITHOUT_PVR;
     send_open_quest_file(c, q->meta.name, vq->bin_filename(), xb_filename, vq->meta.quest_number, type, vq->bin_contents);
@@ -3550,6 +3568,9 @@ static asio::awaitable<void> on_61_98(std::shared_ptr<Client> c, Channel::Messag
   }
   player->inventory.decode_from_client(c->version());
   c->channel->language = player->inventory.language;
+  // The player's name may have changed, so update the lobby client index. This must be done after the language is
+  // updated, since the name is decoded using it.
+  s->update_lobby_client_index(c);
   c->login->account->save();
 
   c->update_channel_name();
@@ -4072,7 +4093,6 @@ static asio::awaitable<void> on_E2_BB(std::shared_ptr<Client> c, Channel::Messag
 }
 
 static asio::awaitable<void> on_DF_BB(std::shared_ptr<Client> c, Channel::Message& msg) {
-  auto s = c->require_server_state();
   auto l = c->require_lobby();
   if (!l->is_game()) {
     throw std::runtime_error("challenge mode config command sent outside of game");
@@ -4118,7 +4138,7 @@ static asio::awaitable<void> on_DF_BB(std::shared_ptr<Client> c, Channel::Messag
           if (is_v4(lc->version())) {
             lc->change_bank(lc->bb_character_index);
           }
-          lc->create_challenge_overlay(lc->version(), l->quest->meta.challenge_template_index, s->data->level_table(lc->version()));
+          lc->create_challenge_overlay(lc->version(), l->quest->meta.challenge_template_index, l->require_data()->level_table(lc->version()));
           lc->log.info_f("Created challenge overlay");
           l->assign_inventory_and_bank_item_ids(lc, true);
         }
@@ -4184,10 +4204,10 @@ static asio::awaitable<void> on_DF_BB(std::shared_ptr<Client> c, Channel::Messag
           ? p->challenge_records.ep2_online_award_state
           : p->challenge_records.ep1_online_award_state;
       award_state.rank_award_flags |= cmd.rank_bitmask;
-      p->add_item(cmd.item, *s->data->item_stack_limits(c->version()));
+      p->add_item(cmd.item, *l->require_data()->item_stack_limits(c->version()));
       l->on_item_id_generated_externally(cmd.item.id);
       l->log.info_f("(Challenge mode) Item awarded to player {}: {}",
-          c->lobby_client_id, s->data->describe_item(Version::BB_V4, cmd.item));
+          c->lobby_client_id, l->require_data()->describe_item(Version::BB_V4, cmd.item));
       break;
     }
   }
@@ -4216,12 +4236,8 @@ static asio::awaitable<void> on_40(std::shared_ptr<Client> c, Channel::Message&
         cmd.searcher_guild_card_number.load()));
   }
 
-  std::shared_ptr<Client> result;
-  try {
-    auto s = c->require_server_state();
-    result = s->find_client(nullptr, cmd.target_guild_card_number);
-  } catch (const std::out_of_range&) {
-  }
+  auto s = c->require_server_state();
+  auto result = s->find_client(nullptr, cmd.target_guild_card_number);
 
   if (result) {
     if (!result->blocked_senders.count(c->login->account->account_id)) {
@@ -4394,11 +4410,7 @@ static asio::awaitable<void> on_81(std::shared_ptr<Client> c, Channel::Message&
   }
 
   auto s = c->require_server_state();
-  std::shared_ptr<Client> target;
-  try {
-    target = s->find_client(nullptr, to_guild_card_number);
-  } catch (const std::out_of_range&) {
-  }
+  auto target = s->find_client(nullptr, to_guild_card_number);
 
   if (!target || !target->login) {
     // TODO: We should store pending messages for accounts somewhere, and send them when the player signs on again.
@@ -4535,11 +4547,12 @@ std::shared_ptr<Lobby> create_game_generic(
   }
 
   std::shared_ptr<Lobby> game = s->create_lobby(true);
+  auto data = game->require_data();
   game->name = name;
   game->episode = episode;
   game->mode = mode;
   game->difficulty = difficulty;
-  game->allowed_versions = s->data->compatibility_groups.at(static_cast<size_t>(creator_c->version()));
+  game->allowed_versions = data->compatibility_groups.at(static_cast<size_t>(creator_c->version()));
   static_assert(NUM_VERSIONS == 14, "Don't forget to update the group compatibility restrictions");
   if (!allow_v1 || (difficulty == Difficulty::ULTIMATE) || (mode == GameMode::CHALLENGE) || (mode == GameMode::SOLO)) {
     game->forbid_version(Version::DC_NTE);
@@ -4594,13 +4607,13 @@ std::shared_ptr<Lobby> create_game_generic(
     game->floor_item_managers.emplace_back(game->lobby_id, game->floor_item_managers.size());
   }
 
-  if (s->data->behavior_enabled(s->data->cheat_mode_behavior)) {
+  if (data->behavior_enabled(data->cheat_mode_behavior)) {
     game->set_flag(Lobby::Flag::CHEATS_ENABLED);
   }
-  if (!s->data->behavior_can_be_overridden(s->data->cheat_mode_behavior)) {
+  if (!data->behavior_can_be_overridden(data->cheat_mode_behavior)) {
     game->set_flag(Lobby::Flag::CANNOT_CHANGE_CHEAT_MODE);
   }
-  if (s->data->use_game_creator_section_id) {
+  if (data->use_game_creator_section_id) {
     game->set_flag(Lobby::Flag::USE_CREATOR_SECTION_ID);
   }
   if (watched_lobby || battle_player) {
@@ -4631,8 +4644,8 @@ std::shared_ptr<Lobby> create_game_generic(
     game->battle_player = battle_player;
     battle_player->set_lobby(game);
   }
-  game->base_exp_multiplier = s->data->bb_global_exp_multiplier;
-  game->exp_share_multiplier = s->data->exp_share_multiplier;
+  game->base_exp_multiplier = data->bb_global_exp_multiplier;
+  game->exp_share_multiplier = data->exp_share_multiplier;
 
   const std::unordered_map<uint16_t, IntegralExpression>* quest_flag_rewrites;
   switch (creator_c->version()) {
@@ -4642,31 +4655,31 @@ std::shared_ptr<Lobby> create_game_generic(
     case Version::DC_V2:
     case Version::PC_NTE:
     case Version::PC_V2:
-      quest_flag_rewrites = &s->data->quest_flag_rewrites_v1_v2;
+      quest_flag_rewrites = &data->quest_flag_rewrites_v1_v2;
       if (game->mode == GameMode::BATTLE) {
-        game->drop_mode = s->data->default_drop_mode_v1_v2_battle;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v1_v2_battle;
+        game->drop_mode = data->default_drop_mode_v1_v2_battle;
+        game->allowed_drop_modes = data->allowed_drop_modes_v1_v2_battle;
       } else if (game->mode == GameMode::CHALLENGE) {
-        game->drop_mode = s->data->default_drop_mode_v1_v2_challenge;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v1_v2_challenge;
+        game->drop_mode = data->default_drop_mode_v1_v2_challenge;
+        game->allowed_drop_modes = data->allowed_drop_modes_v1_v2_challenge;
       } else {
-        game->drop_mode = s->data->default_drop_mode_v1_v2_normal;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v1_v2_normal;
+        game->drop_mode = data->default_drop_mode_v1_v2_normal;
+        game->allowed_drop_modes = data->allowed_drop_modes_v1_v2_normal;
       }
       break;
     case Version::GC_NTE:
     case Version::GC_V3:
     case Version::XB_V3:
-      quest_flag_rewrites = &s->data->quest_flag_rewrites_v3;
+      quest_flag_rewrites = &data->quest_flag_rewrites_v3;
       if (game->mode == GameMode::BATTLE) {
-        game->drop_mode = s->data->default_drop_mode_v3_battle;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v3_battle;
+        game->drop_mode = data->default_drop_mode_v3_battle;
+        game->allowed_drop_modes = data->allowed_drop_modes_v3_battle;
       } else if (game->mode == GameMode::CHALLENGE) {
-        game->drop_mode = s->data->default_drop_mode_v3_challenge;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v3_challenge;
+        game->drop_mode = data->default_drop_mode_v3_challenge;
+        game->allowed_drop_modes = data->allowed_drop_modes_v3_challenge;
       } else {
-        game->drop_mode = s->data->default_drop_mode_v3_normal;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v3_normal;
+        game->drop_mode = data->default_drop_mode_v3_normal;
+        game->allowed_drop_modes = data->allowed_drop_modes_v3_normal;
       }
       break;
     case Version::GC_EP3_NTE:
@@ -4676,16 +4689,16 @@ std::shared_ptr<Lobby> create_game_generic(
       game->allowed_drop_modes = (1 << static_cast<size_t>(game->drop_mode));
       break;
     case Version::BB_V4:
-      quest_flag_rewrites = &s->data->quest_flag_rewrites_v4;
+      quest_flag_rewrites = &data->quest_flag_rewrites_v4;
       if (game->mode == GameMode::BATTLE) {
-        game->drop_mode = s->data->default_drop_mode_v4_battle;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v4_battle;
+        game->drop_mode = data->default_drop_mode_v4_battle;
+        game->allowed_drop_modes = data->allowed_drop_modes_v4_battle;
       } else if (game->mode == GameMode::CHALLENGE) {
-        game->drop_mode = s->data->default_drop_mode_v4_challenge;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v4_challenge;
+        game->drop_mode = data->default_drop_mode_v4_challenge;
+        game->allowed_drop_modes = data->allowed_drop_modes_v4_challenge;
       } else {
-        game->drop_mode = s->data->default_drop_mode_v4_normal;
-        game->allowed_drop_modes = s->data->allowed_drop_modes_v4_normal;
+        game->drop_mode = data->default_drop_mode_v4_normal;
+        game->allowed_drop_modes = data->allowed_drop_modes_v4_normal;
       }
       // Disallow CLIENT mode on BB
       if (game->drop_mode == ServerDropMode::CLIENT) {
@@ -4713,9 +4726,9 @@ std::shared_ptr<Lobby> create_game_generic(
   bool is_solo = (game->mode == GameMode::SOLO);
 
   if (game->mode == GameMode::CHALLENGE) {
-    game->rare_enemy_rates = s->data->rare_enemy_rates_challenge;
+    game->rare_enemy_rates = data->rare_enemy_rates_challenge;
   } else {
-    game->rare_enemy_rates = s->data->rare_enemy_rates(game->difficulty);
+    game->rare_enemy_rates = data->rare_enemy_rates(game->difficulty);
   }
 
   if (game->episode != Episode::EP3) {
@@ -4729,7 +4742,7 @@ std::shared_ptr<Lobby> create_game_generic(
       auto vars_str = game->variations.str();
       game->log.info_f("Using variations from client override: {}", vars_str);
     } else {
-      auto sdt = s->data->set_data_table(creator_c->version(), game->episode, game->mode, game->difficulty);
+      auto sdt = data->set_data_table(creator_c->version(), game->episode, game->mode, game->difficulty);
       game->variations = sdt->generate_variations(game->episode, is_solo, game->rand_crypt);
       auto vars_str = game->variations.str();
       game->log.info_f("Using random variations: {}", vars_str);
@@ -5205,8 +5218,8 @@ static asio::awaitable<void> on_D2_V3_BB(std::shared_ptr<Client> c, Channel::Mes
 
       // Delete items that are being given away
       for (const auto& item : c->pending_item_trade->items) {
-        size_t amount = item.stack_size(*s->data->item_stack_limits(c->version()));
-        p->remove_item(item.id, amount, *s->data->item_stack_limits(c->version()));
+        size_t amount = item.stack_size(*l->require_data()->item_stack_limits(c->version()));
+        p->remove_item(item.id, amount, *l->require_data()->item_stack_limits(c->version()));
 
         // This is a special case: when the trade is executed, the client deletes the traded items from its own
         // inventory automatically, so we should NOT send the 6x29 to that client; we should only send it to the other
@@ -5222,7 +5235,7 @@ static asio::awaitable<void> on_D2_V3_BB(std::shared_ptr<Client> c, Channel::Mes
       for (const auto& trade_item : other_c->pending_item_trade->items) {
         ItemData added_item = trade_item;
         added_item.id = l->generate_item_id(c->lobby_client_id);
-        p->add_item(added_item, *s->data->item_stack_limits(c->version()));
+        p->add_item(added_item, *l->require_data()->item_stack_limits(c->version()));
         send_create_inventory_item_to_lobby(c, c->lobby_client_id, added_item);
       }
       send_command(c, 0xD3, 0x00);
@@ -5410,10 +5423,8 @@ static asio::awaitable<void> on_EA_BB(std::shared_ptr<Client> c, Channel::Messag
       if (team && team->members.at(c->login->account->account_id).privilege_level() >= 0x30) {
         const auto& cmd = check_size_t<C_AddOrRemoveTeamMember_BB_03EA_05EA>(msg.data);
         auto s = c->require_server_state();
-        std::shared_ptr<Client> added_c;
-        try {
-          added_c = s->find_client(nullptr, cmd.guild_card_number);
-        } catch (const std::out_of_range&) {
+        auto added_c = s->find_client(nullptr, cmd.guild_card_number);
+        if (!added_c) {
           send_command(c, 0x04EA, 0x00000006);
         }
 
@@ -5457,15 +5468,7 @@ static asio::awaitable<void> on_EA_BB(std::shared_ptr<Client> c, Channel::Messag
           removed_account->save();
           send_command(c, 0x06EA, 0x00000000);
 
-          std::shared_ptr<Client> removed_c;
-          if (is_removing_self) {
-            removed_c = c;
-          } else {
-            try {
-              removed_c = s->find_client(nullptr, cmd.guild_card_number);
-            } catch (const std::out_of_range&) {
-            }
-          }
+          auto removed_c = is_removing_self ? c : s->find_client(nullptr, cmd.guild_card_number);
           uint32_t removed_account_id = (removed_c && removed_c->login) ? removed_c->login->account->account_id : 0;
           send_team_metadata_change_notifications(s, team, removed_account_id, TeamMetadataChange::TEAM_MEMBER_COUNT);
         } else {
@@ -5482,10 +5485,9 @@ static asio::awaitable<void> on_EA_BB(std::shared_ptr<Client> c, Channel::Messag
         static const std::string required_end("\0\0", 2);
         if (msg.data.ends_with(required_end)) {
           for (const auto& it : team->members) {
-            try {
-              auto target_c = s->find_client(nullptr, it.second.account_id);
+            auto target_c = s->find_client(nullptr, it.second.account_id);
+            if (target_c) {
               send_command(target_c, 0x07EA, 0x00000000, msg.data);
-            } catch (const std::out_of_range&) {
             }
           }
         }
@@ -5978,7 +5980,11 @@ asio::awaitable<void> on_command(std::shared_ptr<Client> c, std::unique_ptr<Chan
   } else {
     auto fn = handlers[msg->command & 0xFF][static_cast<size_t>(c->version())];
     if (fn) {
+      CommandMetrics::Timer timer(CommandMetrics::Kind::COMMAND, c->version(), msg->command & 0xFF,
+          msg->data.size() + ((c->version() == Version::BB_V4) ? 8 : 4));
       co_await fn(c, *msg);
+      // The handler is done with the message, so its buffer can be reused for a later command
+      c->channel->return_message(std::move(msg));
     } else {
       c->log.warning_f("Unknown command: size={:04X} command={:04X} flag={:08X}", msg->data.size(), msg->command, msg->flag);
       throw std::invalid_argument("unimplemented command");
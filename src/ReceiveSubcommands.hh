@@ -106,12 +106,12 @@ public:
       Version from_version,
       bool from_client_customization);
 
-  G_SyncPlayerDispAndInventory_DCNTE_6x70 as_dc_nte(std::shared_ptr<ServerState> s) const;
-  G_SyncPlayerDispAndInventory_DC112000_6x70 as_dc_112000(std::shared_ptr<ServerState> s) const;
-  G_SyncPlayerDispAndInventory_DC_PC_6x70 as_dc_pc(std::shared_ptr<ServerState> s, Version to_version) const;
-  G_SyncPlayerDispAndInventory_GC_6x70 as_gc_gcnte(std::shared_ptr<ServerState> s, Version to_version) const;
-  G_SyncPlayerDispAndInventory_XB_6x70 as_xb(std::shared_ptr<ServerState> s) const;
-  G_SyncPlayerDispAndInventory_BB_6x70 as_bb(std::shared_ptr<ServerState> s, Language language) const;
+  G_SyncPlayerDispAndInventory_DCNTE_6x70 as_dc_nte(std::shared_ptr<const DataIndex> data) const;
+  G_SyncPlayerDispAndInventory_DC112000_6x70 as_dc_112000(std::shared_ptr<const DataIndex> data) const;
+  G_SyncPlayerDispAndInventory_DC_PC_6x70 as_dc_pc(std::shared_ptr<const DataIndex> data, Version to_version) const;
+  G_SyncPlayerDispAndInventory_GC_6x70 as_gc_gcnte(std::shared_ptr<const DataIndex> data, Version to_version) const;
+  G_SyncPlayerDispAndInventory_XB_6x70 as_xb(std::shared_ptr<const DataIndex> data) const;
+  G_SyncPlayerDispAndInventory_BB_6x70 as_bb(std::shared_ptr<const DataIndex> data, Language language) const;
 
   uint64_t default_xb_user_id() const;
   void clear_v1_unused_item_fields();
@@ -0,0 +1,561 @@
+#include "ReplayCapture.hh"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef PHOSG_WINDOWS
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <phosg/Encoding.hh>
+#include <phosg/Filesystem.hh>
+#include <phosg/Strings.hh>
+#include <phosg/Time.hh>
+#include <unordered_map>
+
+#include "FileWriteQueue.hh"
+#include "PSOProtocol.hh"
+#include "Text.hh"
+
+struct ReplayCaptureFileHeader {
+  static constexpr uint64_t MAGIC = 0x59414C504552534E; // 'NSREPLAY'
+  static constexpr uint32_t FORMAT_VERSION = 1;
+  le_uint64_t magic = MAGIC;
+  le_uint32_t format_version = FORMAT_VERSION;
+  le_uint32_t flags = 0;
+} __packed_ws__(ReplayCaptureFileHeader, 0x10);
+
+struct ReplayCaptureRecordHeader {
+  static constexpr uint8_t HAS_MASK = 0x01; // The mask (data_size bytes) follows the data
+  uint8_t type = 0;
+  uint8_t flags = 0;
+  le_uint16_t port = 0; // CONNECT only
+  le_uint32_t data_size = 0; // For CONNECT, the data is the version name
+  le_uint64_t client_id = 0;
+  le_uint64_t timestamp = 0;
+  le_uint32_t source_line = 0;
+  le_uint32_t unused = 0;
+} __packed_ws__(ReplayCaptureRecordHeader, 0x20);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ReplayCapture
+
+ReplayCapture::ReplayCapture(std::string&& data) : owned_data(std::move(data)) {
+  this->data = this->owned_data.data();
+  this->size = this->owned_data.size();
+  this->check_header();
+}
+
+ReplayCapture::~ReplayCapture() {
+#ifndef PHOSG_WINDOWS
+  if (this->mapped_data) {
+    munmap(this->mapped_data, this->mapped_size);
+  }
+#endif
+}
+
+std::shared_ptr<ReplayCapture> ReplayCapture::from_file(const std::string& filename) {
+#ifdef PHOSG_WINDOWS
+  return std::make_shared<ReplayCapture>(phosg::load_file(filename));
+#else
+  auto f = phosg::fopen_unique(filename, "rb");
+  struct stat st;
+  if (fstat(fileno(f.get()), &st) != 0) {
+    throw std::runtime_error(std::format("cannot stat {}: {}", filename, strerror(errno)));
+  }
+  std::shared_ptr<ReplayCapture> ret(new ReplayCapture());
+  ret->mapped_size = st.st_size;
+  if (ret->mapped_size < sizeof(ReplayCaptureFileHeader)) {
+    throw std::runtime_error(std::format("{} is too small to be a replay capture", filename));
+  }
+  ret->mapped_data = mmap(nullptr, ret->mapped_size, PROT_READ, MAP_PRIVATE, fileno(f.get()), 0);
+  if (ret->mapped_data == MAP_FAILED) {
+    ret->mapped_data = nullptr;
+    throw std::runtime_error(std::format("cannot map {}: {}", filename, strerror(errno)));
+  }
+  // Events are only ever read in order, so let the kernel read ahead and drop pages behind the cursor
+  madvise(ret->mapped_data, ret->mapped_size, MADV_SEQUENTIAL);
+  ret->data = reinterpret_cast<const char*>(ret->mapped_data);
+  ret->size = ret->mapped_size;
+  ret->check_header();
+  return ret;
+#endif
+}
+
+bool ReplayCapture::is_capture_file(const std::string& filename) {
+  auto f = phosg::fopen_unique(filename, "rb");
+  le_uint64_t magic = 0;
+  return (fread(&magic, sizeof(magic), 1, f.get()) == 1) && (magic == ReplayCaptureFileHeader::MAGIC);
+}
+
+void ReplayCapture::check_header() const {
+  if (this->size < sizeof(ReplayCaptureFileHeader)) {
+    throw std::runtime_error("replay capture is too small");
+  }
+  const auto& header = *reinterpret_cast<const ReplayCaptureFileHeader*>(this->data);
+  if (header.magic != ReplayCaptureFileHeader::MAGIC) {
+    throw std::runtime_error("replay capture has incorrect signature");
+  }
+  if (header.format_version != ReplayCaptureFileHeader::FORMAT_VERSION) {
+    throw std::runtime_error(std::format(
+        "replay capture has unsupported format version {}", static_cast<uint32_t>(header.format_version)));
+  }
+}
+
+uint32_t ReplayCapture::flags() const {
+  return reinterpret_cast<const ReplayCaptureFileHeader*>(this->data)->flags;
+}
+
+ReplayCapture::Cursor ReplayCapture::begin() const {
+  return Cursor(this);
+}
+
+ReplayCapture::Cursor::Cursor(const ReplayCapture* capture)
+    : capture(capture), offset(sizeof(ReplayCaptureFileHeader)) {}
+
+bool ReplayCapture::Cursor::next(ReplayCaptureEvent& ev) {
+  if (this->offset >= this->capture->size) {
+    return false;
+  }
+  if (this->capture->size - this->offset < sizeof(ReplayCaptureRecordHeader)) {
+    throw std::runtime_error(std::format("replay capture is truncated at offset 0x{:X}", this->offset));
+  }
+  const auto& header = *reinterpret_cast<const ReplayCaptureRecordHeader*>(this->capture->data + this->offset);
+  bool has_mask = (header.flags & ReplayCaptureRecordHeader::HAS_MASK);
+  size_t record_size = sizeof(header) + header.data_size * (has_mask ? 2 : 1);
+  if (this->capture->size - this->offset < record_size) {
+    throw std::runtime_error(std::format("replay capture is truncated at offset 0x{:X}", this->offset));
+  }
+  if (header.type > static_cast<uint8_t>(ReplayCaptureEvent::Type::SHELL)) {
+    throw std::runtime_error(std::format(
+        "replay capture contains invalid event type {:02X} at offset 0x{:X}", header.type, this->offset));
+  }
+
+  const char* data = this->capture->data + this->offset + sizeof(header);
+  ev.type = static_cast<ReplayCaptureEvent::Type>(header.type);
+  ev.client_id = header.client_id;
+  ev.timestamp = header.timestamp;
+  ev.source_line = header.source_line;
+  ev.port = 0;
+  ev.version = Version::UNKNOWN;
+  ev.data = std::string_view();
+  ev.mask = std::string_view();
+  switch (ev.type) {
+    case ReplayCaptureEvent::Type::CONNECT:
+      ev.port = header.port;
+      ev.version = phosg::enum_for_name<Version>(std::string(data, header.data_size));
+      break;
+    case ReplayCaptureEvent::Type::DISCONNECT:
+      break;
+    case ReplayCaptureEvent::Type::SEND:
+    case ReplayCaptureEvent::Type::RECEIVE:
+      ev.data = std::string_view(data, header.data_size);
+      if (has_mask) {
+        ev.mask = std::string_view(data + header.data_size, header.data_size);
+      }
+      break;
+    case ReplayCaptureEvent::Type::SHELL:
+      ev.data = std::string_view(data, header.data_size);
+      break;
+  }
+
+  this->offset += record_size;
+  return true;
+}
+
+static std::string encode_chat_message(Version version, const std::string& message) {
+  std::string encoded_message;
+  encoded_message.resize(8, 0);
+  encoded_message += uses_utf16(version) ? tt_utf8_to_utf16("\tE" + message) : tt_utf8_to_ascii("\tE" + message);
+  encoded_message.resize((encoded_message.size() + 3) & (~3));
+  return prepend_command_header(version, true, 0x06, 0x00, encoded_message);
+}
+
+std::shared_ptr<ReplayCapture> ReplayCapture::from_text_log(FILE* f) {
+  ReplayCaptureWriter w(0);
+  uint32_t flags = 0;
+
+  struct ClientInfo {
+    Version version;
+    bool disconnected = false;
+  };
+  std::unordered_map<uint64_t, ClientInfo> clients;
+
+  // Commands span multiple lines, so they're only written when the line after the end of the hex dump is read
+  ReplayCaptureEvent parsing_command;
+  bool is_parsing_command = false;
+  std::string parsing_data;
+  std::string parsing_mask;
+  auto finish_parsing_command = [&]() -> void {
+    parsing_command.data = parsing_data;
+    // Only write the mask if any bytes are masked
+    parsing_command.mask = (parsing_mask.find_first_not_of('\xFF') == std::string::npos)
+        ? std::string_view()
+        : std::string_view(parsing_mask);
+    w.add_event(parsing_command);
+    is_parsing_command = false;
+    parsing_data.clear();
+    parsing_mask.clear();
+  };
+
+  auto add_chat_message = [&](uint64_t client_id, const std::string& message, size_t line_num) -> void {
+    try {
+      std::string data = encode_chat_message(clients.at(client_id).version, message);
+      w.add_event(ReplayCaptureEvent{
+          .type = ReplayCaptureEvent::Type::SEND, .client_id = client_id, .source_line = line_num, .data = data});
+    } catch (const std::exception& e) {
+      throw std::runtime_error(std::format("(ev-line {}) Failed to generate chat message ({})", line_num, e.what()));
+    }
+  };
+
+  size_t line_num = 0;
+  while (!feof(f)) {
+    line_num++;
+    std::string line = phosg::fgets(f);
+    if (line.ends_with("\n")) {
+      line.resize(line.size() - 1);
+    }
+    if (line.empty()) {
+      continue;
+    }
+
+    if (is_parsing_command) {
+      std::string expected_start = std::format("{:04X} |", parsing_data.size());
+      if (line.starts_with(expected_start)) {
+        // Parse out the hex part of the hex/ASCII dump
+        std::string mask_bytes;
+        parsing_data += phosg::parse_data_string(line.substr(expected_start.size(), 16 * 3 + 1), &mask_bytes);
+        parsing_mask += mask_bytes;
+        continue;
+      } else {
+        finish_parsing_command();
+      }
+    }
+
+    if (line == "### use psov2 crypt") {
+      flags |= Flag::USE_PSOV2_RAND_CRYPT;
+    }
+    if (line == "### use legacy item random behavior") {
+      flags |= Flag::USE_LEGACY_ITEM_RANDOM_BEHAVIOR;
+    }
+    if (line.starts_with("### cc ")) {
+      // ### cc $<chat command>
+      if (clients.size() != 1) {
+        throw std::runtime_error(std::format(
+            "(ev-line {}) Bare `cc` shortcut cannot be used with multiple clients connected; use `on C-X cc` instead",
+            line_num));
+      }
+      add_chat_message(clients.begin()->first, line.substr(7), line_num);
+      continue;
+
+    } else if (line.starts_with("### on C-")) {
+      // ### on C-{} cc <chat command>
+      size_t end_offset;
+      uint64_t client_id;
+      try {
+        client_id = stoull(line.substr(9), &end_offset, 16);
+      } catch (const std::exception& e) {
+        throw std::runtime_error(std::format("(ev-line {}) Failed to generate chat message ({})", line_num, e.what()));
+      }
+      if (line.compare(end_offset + 9, 4, " cc ") != 0) {
+        throw std::runtime_error(std::format(
+            "(ev-line {}) Failed to generate chat message (malformed `on C-X cc $...` shortcut command)", line_num));
+      }
+      add_chat_message(client_id, line.substr(end_offset + 13), line_num);
+      continue;
+
+    } else if (line.starts_with("### shell ")) {
+      // ### shell <shell command>
+      std::string command = line.substr(10);
+      w.add_event(ReplayCaptureEvent{
+          .type = ReplayCaptureEvent::Type::SHELL, .source_line = line_num, .data = command});
+      continue;
+
+    } else if (line.starts_with("I ")) {
+      // I <pid/ts> - [GameServer] Client connected: C-1 via TG-9000-GC_V3-gc-jp10-game_server
+      // I <pid/ts> - [GameServer] Client connected: C-3 via TSI-9000-GC_V3-game_server
+      size_t offset = line.find(" - [GameServer] Client connected: C-");
+      if (offset != std::string::npos) {
+        auto tokens = phosg::split(line, ' ');
+
+        if (!tokens[8].starts_with("C-")) {
+          throw std::runtime_error(std::format(
+              "(ev-line {}) Client connection message missing client ID token", line_num));
+        }
+        uint64_t client_id = stoull(tokens[8].substr(2), nullptr, 16);
+
+        auto listen_tokens = phosg::split(tokens[10], '-');
+        if (listen_tokens.size() < 4) {
+          throw std::runtime_error(std::format(
+              "(ev-line {}) Client connection message listening socket token format is incorrect", line_num));
+        }
+        uint16_t port = stoul(listen_tokens[1], nullptr, 10);
+        Version version = phosg::enum_for_name<Version>(listen_tokens[2]);
+
+        if (!clients.emplace(client_id, ClientInfo{.version = version}).second) {
+          throw std::runtime_error(std::format("(ev-line {}) Duplicate client ID in input log", line_num));
+        }
+        w.add_event(ReplayCaptureEvent{
+            .type = ReplayCaptureEvent::Type::CONNECT,
+            .client_id = client_id,
+            .source_line = line_num,
+            .port = port,
+            .version = version});
+        continue;
+      }
+
+      // I <pid/ts> - [GameServer] Running cleanup tasks for C-{}
+      offset = line.find(" - [GameServer] Running cleanup tasks for C-");
+      if (offset != std::string::npos) {
+        auto tokens = phosg::split(line, ' ');
+        if (tokens.size() < 11) {
+          throw std::runtime_error(std::format(
+              "(ev-line {}) Client disconnection message has incorrect token count", line_num));
+        }
+        if (!tokens[10].starts_with("C-")) {
+          throw std::runtime_error(std::format(
+              "(ev-line {}) Client disconnection message missing client ID token", line_num));
+        }
+        uint64_t client_id = stoul(tokens[10].substr(2), nullptr, 16);
+        auto client_it = clients.find(client_id);
+        if (client_it == clients.end()) {
+          throw std::runtime_error(std::format("(ev-line {}) Unknown disconnecting client ID in input log", line_num));
+        }
+        if (client_it->second.disconnected) {
+          throw std::runtime_error(std::format("(ev-line {}) Client has multiple disconnect events", line_num));
+        }
+        client_it->second.disconnected = true;
+        w.add_event(ReplayCaptureEvent{
+            .type = ReplayCaptureEvent::Type::DISCONNECT, .client_id = client_id, .source_line = line_num});
+        continue;
+      }
+
+      // I <pid/ts> - [Commands] Sending to C-{:X} (...)
+      // I <pid/ts> - [Commands] Received from C-{:X} (...)
+      offset = line.find(" - [Commands] Sending to C-");
+      if (offset == std::string::npos) {
+        offset = line.find(" - [Commands] Received from C-");
+      }
+      if (offset != std::string::npos) {
+        auto tokens = phosg::split(line, ' ');
+        if (tokens.size() < 10) {
+          throw std::runtime_error(std::format("(ev-line {}) Command header line too short", line_num));
+        }
+        bool from_client = (tokens[6] == "Received");
+        uint64_t client_id = stoull(tokens[8].substr(2), nullptr, 16);
+        if (!clients.count(client_id)) {
+          throw std::runtime_error(std::format("(ev-line {}) Input log contains command for missing client", line_num));
+        }
+        parsing_command = ReplayCaptureEvent{
+            .type = from_client ? ReplayCaptureEvent::Type::SEND : ReplayCaptureEvent::Type::RECEIVE,
+            .client_id = client_id,
+            .source_line = line_num};
+        is_parsing_command = true;
+        continue;
+      }
+    }
+  }
+  if (is_parsing_command) {
+    finish_parsing_command();
+  }
+
+  w.set_flags(flags);
+  return w.take_capture();
+}
+
+void ReplayCapture::print_text_log(FILE* stream) const {
+  if (this->flags() & Flag::USE_PSOV2_RAND_CRYPT) {
+    fputs("### use psov2 crypt\n", stream);
+  }
+  if (this->flags() & Flag::USE_LEGACY_ITEM_RANDOM_BEHAVIOR) {
+    fputs("### use legacy item random behavior\n", stream);
+  }
+
+  std::unordered_map<uint64_t, Version> client_versions;
+  auto cursor = this->begin();
+  ReplayCaptureEvent ev;
+  while (cursor.next(ev)) {
+    // The line prefix must have the same number of tokens as a real log line, since from_text_log uses token indexes
+    std::string prefix = std::format("I 0 {:%Y-%m-%d %H:%M:%S} -",
+        std::chrono::sys_seconds(std::chrono::seconds(ev.timestamp / 1000000)));
+    switch (ev.type) {
+      case ReplayCaptureEvent::Type::CONNECT:
+        client_versions[ev.client_id] = ev.version;
+        phosg::fwrite_fmt(stream, "{} [GameServer] Client connected: C-{:X} via TRC-{}-{}-capture\n",
+            prefix, ev.client_id, ev.port, phosg::name_for_enum(ev.version));
+        break;
+      case ReplayCaptureEvent::Type::DISCONNECT:
+        phosg::fwrite_fmt(stream, "{} [GameServer] Running cleanup tasks for C-{:X}\n", prefix, ev.client_id);
+        break;
+      case ReplayCaptureEvent::Type::SHELL:
+        phosg::fwrite_fmt(stream, "### shell {}\n", ev.data);
+        break;
+      case ReplayCaptureEvent::Type::SEND:
+      case ReplayCaptureEvent::Type::RECEIVE: {
+        Version version = client_versions.at(ev.client_id);
+        if (ev.data.size() < ((version == Version::BB_V4) ? 8 : 4)) {
+          throw std::runtime_error("replay capture contains command too small for header");
+        }
+        const auto* header = reinterpret_cast<const PSOCommandHeader*>(ev.data.data());
+        const char* direction = (ev.type == ReplayCaptureEvent::Type::SEND) ? "Received from" : "Sending to";
+        if (version == Version::BB_V4) {
+          phosg::fwrite_fmt(stream, "{} [Commands] {} C-{:X} (version=BB command={:04X} flag={:08X})\n",
+              prefix, direction, ev.client_id, header->command(version), header->flag(version));
+        } else {
+          phosg::fwrite_fmt(stream, "{} [Commands] {} C-{:X} (version={} command={:02X} flag={:02X})\n",
+              prefix, direction, ev.client_id, phosg::name_for_enum(version), header->command(version),
+              header->flag(version));
+        }
+
+        // This is the same format as phosg::print_data with PRINT_ASCII and OFFSET_16_BITS, except masked bytes are
+        // written as ??, which phosg::parse_data_string understands
+        for (size_t line_offset = 0; line_offset < ev.data.size(); line_offset += 0x10) {
+          std::string line = std::format("{:04X} |", line_offset);
+          std::string ascii;
+          for (size_t z = line_offset; z < line_offset + 0x10; z++) {
+            if (z >= ev.data.size()) {
+              line += "   ";
+              continue;
+            }
+            uint8_t ch = ev.data[z];
+            if (!ev.mask.empty() && (ev.mask[z] == 0)) {
+              line += " ??";
+            } else {
+              line += std::format(" {:02X}", ch);
+            }
+            ascii.push_back(((ch >= 0x20) && (ch < 0x7F)) ? ch : ' ');
+          }
+          phosg::fwrite_fmt(stream, "{} | {}\n", line, ascii);
+        }
+        break;
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ReplayCaptureWriter
+
+ReplayCaptureWriter::ReplayCaptureWriter(const std::string& filename, uint32_t flags) : filename(filename) {
+  // The header replaces any existing file; everything after it is appended
+  this->write_header(flags);
+  file_write_queue.write(this->filename, std::move(this->buffer));
+  this->bytes_written += sizeof(ReplayCaptureFileHeader);
+  this->buffer.clear();
+}
+
+ReplayCaptureWriter::ReplayCaptureWriter(uint32_t flags) {
+  this->write_header(flags);
+}
+
+ReplayCaptureWriter::~ReplayCaptureWriter() {
+  try {
+    this->flush();
+  } catch (const std::exception&) {
+  }
+}
+
+void ReplayCaptureWriter::write_header(uint32_t flags) {
+  ReplayCaptureFileHeader header;
+  header.flags = flags;
+  this->buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void ReplayCaptureWriter::write_record_header(const ReplayCaptureEvent& ev, size_t data_size, bool has_mask) {
+  ReplayCaptureRecordHeader header;
+  header.type = static_cast<uint8_t>(ev.type);
+  header.flags = has_mask ? ReplayCaptureRecordHeader::HAS_MASK : 0;
+  header.port = ev.port;
+  header.data_size = data_size;
+  header.client_id = ev.client_id;
+  header.timestamp = ev.timestamp;
+  header.source_line = ev.source_line;
+  this->buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void ReplayCaptureWriter::add_event(const ReplayCaptureEvent& ev) {
+  if (ev.type == ReplayCaptureEvent::Type::CONNECT) {
+    const char* version_name = phosg::name_for_enum(ev.version);
+    size_t version_name_size = strlen(version_name);
+    this->write_record_header(ev, version_name_size, false);
+    this->buffer.append(version_name, version_name_size);
+  } else {
+    bool has_mask = !ev.mask.empty();
+    if (has_mask && (ev.mask.size() != ev.data.size())) {
+      throw std::logic_error("replay capture event mask size does not match data size");
+    }
+    this->write_record_header(ev, ev.data.size(), has_mask);
+    this->buffer.append(ev.data);
+    this->buffer.append(ev.mask);
+  }
+  this->flush_if_needed();
+}
+
+void ReplayCaptureWriter::add_command(
+    uint64_t client_id,
+    ReplayCaptureEvent::Type type,
+    const void* header,
+    size_t header_size,
+    const void* data,
+    size_t size,
+    const void* censor_data,
+    size_t censor_size) {
+  const uint8_t* censor_bytes = reinterpret_cast<const uint8_t*>(censor_data);
+  size_t censor_end = censor_bytes ? std::min<size_t>(size, censor_size) : 0;
+  bool has_mask = (type == ReplayCaptureEvent::Type::RECEIVE) &&
+      std::any_of(censor_bytes, censor_bytes + censor_end, [](uint8_t b) -> bool { return b != 0; });
+
+  ReplayCaptureEvent ev{.type = type, .client_id = client_id, .timestamp = phosg::now()};
+  this->write_record_header(ev, header_size + size, has_mask);
+  this->buffer.append(reinterpret_cast<const char*>(header), header_size);
+  size_t data_offset = this->buffer.size();
+  this->buffer.append(reinterpret_cast<const char*>(data), size);
+  for (size_t z = 0; z < censor_end; z++) {
+    if (censor_bytes[z]) {
+      this->buffer[data_offset + z] = 0;
+    }
+  }
+  if (has_mask) {
+    size_t mask_data_offset = this->buffer.size() + header_size;
+    this->buffer.append(header_size + size, '\xFF');
+    for (size_t z = 0; z < censor_end; z++) {
+      if (censor_bytes[z]) {
+        this->buffer[mask_data_offset + z] = 0;
+      }
+    }
+  }
+  this->flush_if_needed();
+}
+
+void ReplayCaptureWriter::set_flags(uint32_t flags) {
+  if (!this->filename.empty() || (this->buffer.size() < sizeof(ReplayCaptureFileHeader))) {
+    throw std::logic_error("flags can only be changed on in-memory replay captures");
+  }
+  reinterpret_cast<ReplayCaptureFileHeader*>(this->buffer.data())->flags = flags;
+}
+
+std::shared_ptr<ReplayCapture> ReplayCaptureWriter::take_capture() {
+  if (!this->filename.empty()) {
+    throw std::logic_error("cannot take capture from file-backed writer");
+  }
+  auto ret = std::make_shared<ReplayCapture>(std::move(this->buffer));
+  this->buffer.clear();
+  return ret;
+}
+
+void ReplayCaptureWriter::flush_if_needed() {
+  if (!this->filename.empty() && (this->buffer.size() >= FLUSH_THRESHOLD)) {
+    this->flush();
+  }
+}
+
+void ReplayCaptureWriter::flush() {
+  if (this->filename.empty() || this->buffer.empty()) {
+    return;
+  }
+  this->bytes_written += this->buffer.size();
+  file_write_queue.append(this->filename, std::move(this->buffer));
+  this->buffer.clear();
+}
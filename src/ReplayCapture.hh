@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Version.hh"
+
+// Replay captures are a binary equivalent of the text logs in tests/*.test.txt. They contain the same events (client
+// connections and disconnections, and the unencrypted commands sent and received by each client), but they're much
+// smaller than the text format and can be read without any parsing, so they're suitable for recording long periods of
+// real traffic. Captures are written by channels when ServerState::replay_capture is set, and can be converted to and
+// from the text format.
+
+struct ReplayCaptureEvent {
+  // As in ReplaySession, event types are named from the client's perspective: SEND events are commands sent by the
+  // client to the server, and RECEIVE events are commands sent by the server to the client.
+  enum class Type : uint8_t {
+    CONNECT = 0,
+    DISCONNECT = 1,
+    SEND = 2,
+    RECEIVE = 3,
+    // Runs a server shell command (e.g. to reload data partway through a replay). Channels never write these; they
+    // come from `### shell` lines in text logs.
+    SHELL = 4,
+  };
+  Type type = Type::CONNECT;
+  uint64_t client_id = 0;
+  uint64_t timestamp = 0; // 0 if converted from a text log
+  size_t source_line = 0; // Nonzero only if converted from a text log
+  uint16_t port = 0; // CONNECT only
+  Version version = Version::UNKNOWN; // CONNECT only
+  std::string_view data; // SEND and RECEIVE: includes the command header; SHELL: the shell command
+  std::string_view mask; // RECEIVE only; empty if all bytes must match
+};
+
+// A read-only capture. When loaded from a file, the file is memory-mapped (on platforms that support it), and events
+// are decoded directly from the mapped data as they're read, so the capture is never fully loaded into memory.
+class ReplayCapture {
+public:
+  enum Flag : uint32_t {
+    USE_PSOV2_RAND_CRYPT = 0x00000001,
+    USE_LEGACY_ITEM_RANDOM_BEHAVIOR = 0x00000002,
+  };
+
+  class Cursor {
+  public:
+    // Returns false at the end of the capture. Throws if the capture is truncated or corrupt. The event's data and mask
+    // point into the capture, so they remain valid as long as the capture does.
+    bool next(ReplayCaptureEvent& ev);
+
+  private:
+    friend class ReplayCapture;
+    explicit Cursor(const ReplayCapture* capture);
+    const ReplayCapture* capture;
+    size_t offset;
+  };
+
+  explicit ReplayCapture(std::string&& data);
+  ReplayCapture(const ReplayCapture&) = delete;
+  ReplayCapture(ReplayCapture&&) = delete;
+  ReplayCapture& operator=(const ReplayCapture&) = delete;
+  ReplayCapture& operator=(ReplayCapture&&) = delete;
+  ~ReplayCapture();
+
+  static std::shared_ptr<ReplayCapture> from_file(const std::string& filename);
+  // Parses a text log (as in tests/*.test.txt). Throws if the log is malformed.
+  static std::shared_ptr<ReplayCapture> from_text_log(FILE* f);
+  // Returns true if the given file begins with a capture header
+  static bool is_capture_file(const std::string& filename);
+
+  uint32_t flags() const;
+  Cursor begin() const;
+
+  // Writes the capture in the text log format, which from_text_log can read
+  void print_text_log(FILE* stream) const;
+
+private:
+  std::string owned_data;
+  const char* data = nullptr;
+  size_t size = 0;
+  void* mapped_data = nullptr;
+  size_t mapped_size = 0;
+
+  ReplayCapture() = default;
+  void check_header() const;
+};
+
+// Appends events to a capture file or to a buffer in memory. This class is not thread-safe; all events for a capture
+// must be added from the same thread (in the server, this is the io_context thread).
+class ReplayCaptureWriter {
+public:
+  // Writes to the given file. Data is buffered in memory and appended to the file in large blocks by file_write_queue
+  // (so the io_context thread never waits for the disk); call flush() to hand the buffered data to the queue
+  // immediately. The file is overwritten if it already exists.
+  ReplayCaptureWriter(const std::string& filename, uint32_t flags);
+  // Writes to memory; use take_capture to get the result
+  explicit ReplayCaptureWriter(uint32_t flags);
+  ReplayCaptureWriter(const ReplayCaptureWriter&) = delete;
+  ReplayCaptureWriter(ReplayCaptureWriter&&) = delete;
+  ReplayCaptureWriter& operator=(const ReplayCaptureWriter&) = delete;
+  ReplayCaptureWriter& operator=(ReplayCaptureWriter&&) = delete;
+  ~ReplayCaptureWriter();
+
+  void add_event(const ReplayCaptureEvent& ev);
+  // Adds a SEND or RECEIVE event. If censor_data is given, it's interpreted as in CommandCensorData: each nonzero byte
+  // in it causes the corresponding byte of the command (after the header) to be written as zero. This is used to
+  // avoid recording credentials. In RECEIVE events, censored bytes are also masked, so replays accept any value there.
+  void add_command(
+      uint64_t client_id,
+      ReplayCaptureEvent::Type type,
+      const void* header,
+      size_t header_size,
+      const void* data,
+      size_t size,
+      const void* censor_data = nullptr,
+      size_t censor_size = 0);
+
+  // Only valid for writers that write to memory
+  void set_flags(uint32_t flags);
+  std::shared_ptr<ReplayCapture> take_capture();
+
+  void flush();
+
+  inline uint64_t get_bytes_written() const {
+    return this->bytes_written;
+  }
+
+private:
+  static constexpr size_t FLUSH_THRESHOLD = 0x100000; // 1MB
+
+  std::string filename; // Empty for in-memory writers
+  std::string buffer;
+  uint64_t bytes_written = 0;
+
+  void write_header(uint32_t flags);
+  void write_record_header(const ReplayCaptureEvent& ev, size_t data_size, bool has_mask);
+  void flush_if_needed();
+};
@@ -7,22 +7,19 @@
 #include "GameServer.hh"
 #include "Loggers.hh"
 #include "Server.hh"
+#include "ShellCommands.hh"
 
-static std::string encode_chat_message(Version version, const std::string& message) {
-  std::string encoded_message;
-  encoded_message.resize(8, 0);
-  encoded_message += uses_utf16(version) ? tt_utf8_to_utf16("\tE" + message) : tt_utf8_to_ascii("\tE" + message);
-  encoded_message.resize((encoded_message.size() + 3) & (~3));
-  return prepend_command_header(version, true, 0x06, 0x00, encoded_message);
-}
-
-ReplaySession::Event::Event(Type type, size_t event_number, uint64_t client_id, size_t line_num)
-    : type(type),
+ReplaySession::Event::Event(const ReplayCaptureEvent& ev, size_t event_number)
+    : type(ev.type),
       event_number(event_number),
-      client_id(client_id),
+      client_id(ev.client_id),
+      data(ev.data),
       allow_size_disparity(false),
-      complete(false),
-      line_num(line_num) {}
+      line_num(ev.source_line) {
+  if (this->type == Type::RECEIVE) {
+    this->mask = ev.mask.empty() ? std::string(this->data.size(), '\xFF') : std::string(ev.mask);
+  }
+}
 
 std::string ReplaySession::Event::str() const {
   std::string ret;
@@ -34,14 +31,17 @@ std::string ReplaySession::Event::str() const {
     ret = std::format("Event[{}, SEND {:04X}", this->client_id, this->data.size());
   } else if (this->type == Type::RECEIVE) {
     ret = std::format("Event[{}, RECEIVE {:04X}", this->client_id, this->data.size());
+  } else if (this->type == Type::SHELL) {
+    ret = std::format("Event[SHELL {}", this->data);
   }
   if (this->allow_size_disparity) {
     ret += ", size disparity allowed";
   }
-  if (this->complete) {
-    ret += ", done";
+  if (this->line_num) {
+    ret += std::format(", ev-line {}]", this->line_num);
+  } else {
+    ret += std::format(", event {}]", this->event_number);
   }
-  ret += std::format(", ev-line {}]", this->line_num);
   return ret;
 }
 
@@ -63,15 +63,6 @@ std::string ReplaySession::Client::str() const {
   return std::format("Client[{}, T-{}, {}]", this->id, this->port, phosg::name_for_enum(this->version));
 }
 
-ReplaySession::Event& ReplaySession::create_event(Event::Type type, std::shared_ptr<Client> c, size_t line_num) {
-  size_t event_number = this->events.size() + 1;
-  auto& event = this->events.emplace(event_number, Event{type, event_number, c->id, line_num}).first->second;
-  if (type == Event::Type::RECEIVE) {
-    c->pending_receive_event_numbers.emplace_back(event_number);
-  }
-  return event;
-}
-
 void ReplaySession::apply_default_mask(Event& ev) const {
   auto version = this->clients.at(ev.client_id)->version;
 
@@ -324,191 +315,56 @@ void ReplaySession::apply_default_mask(Event& ev) const {
 }
 
 ReplaySession::ReplaySession(std::shared_ptr<ServerState> state, FILE* input_log)
+    : ReplaySession(state, ReplayCapture::from_text_log(input_log)) {}
+
+ReplaySession::ReplaySession(std::shared_ptr<ServerState> state, std::shared_ptr<const ReplayCapture> capture)
     : state(state),
+      capture(capture),
       commands_sent(0),
       bytes_sent(0),
       commands_received(0),
       bytes_received(0),
-      idle_timeout_timer(*this->state->io_context) {
-  Event* parsing_command = nullptr;
-
-  size_t line_num = 0;
-  while (!feof(input_log)) {
-    line_num++;
-    std::string line = phosg::fgets(input_log);
-    if (line.ends_with("\n")) {
-      line.resize(line.size() - 1);
-    }
-    if (line.empty()) {
-      continue;
-    }
-
-    if (parsing_command) {
-      std::string expected_start = std::format("{:04X} |", parsing_command->data.size());
-      if (line.starts_with(expected_start)) {
-        // Parse out the hex part of the hex/ASCII dump
-        std::string mask_bytes;
-        std::string data_bytes = phosg::parse_data_string(line.substr(expected_start.size(), 16 * 3 + 1), &mask_bytes);
-        parsing_command->data += data_bytes;
-        parsing_command->mask += mask_bytes;
-        continue;
-      } else {
-        if (parsing_command->type == Event::Type::RECEIVE) {
-          this->apply_default_mask(*parsing_command);
-        }
-        parsing_command = nullptr;
-      }
-    }
+      idle_timeout_timer(*this->state->io_context) {}
 
-    if (line == "### use psov2 crypt") {
-      this->use_psov2_rand_crypt = true;
-    }
-    if (line == "### use legacy item random behavior") {
-      this->use_legacy_item_random_behavior = true;
-    }
-    if (line.starts_with("### cc ")) {
-      // ### cc $<chat command>
-      if (this->clients.size() != 1) {
-        throw std::runtime_error(std::format(
-            "(ev-line {}) Bare `cc` shortcut cannot be used with multiple clients connected; use `on C-X cc` instead",
-            line_num));
-      }
-      try {
-        auto c = this->clients.begin()->second;
-        auto& event = this->create_event(Event::Type::SEND, c, line_num);
-        event.data = encode_chat_message(c->version, line.substr(7));
-      } catch (const std::exception& e) {
-        throw std::runtime_error(std::format("(ev-line {}) Failed to generate chat message ({})", line_num, e.what()));
-      }
-      continue;
-
-    } else if (line.starts_with("### on C-")) {
-      // ### on C-{} cc <chat command>
-      try {
-        size_t end_offset;
-        auto c = this->clients.at(stoull(line.substr(9), &end_offset, 16));
-        if (line.compare(end_offset + 9, 4, " cc ") != 0) {
-          throw std::runtime_error("malformed `on C-X cc $...` shortcut command");
-        }
-        auto& event = this->create_event(Event::Type::SEND, c, line_num);
-        event.data = encode_chat_message(c->version, line.substr(end_offset + 13));
-      } catch (const std::exception& e) {
-        throw std::runtime_error(std::format("(ev-line {}) Failed to generate chat message ({})", line_num, e.what()));
-      }
-      continue;
-
-    } else if (line.starts_with("I ")) {
-      // I <pid/ts> - [GameServer] Client connected: C-1 via TG-9000-GC_V3-gc-jp10-game_server
-      // I <pid/ts> - [GameServer] Client connected: C-3 via TSI-9000-GC_V3-game_server
-      size_t offset = line.find(" - [GameServer] Client connected: C-");
-      if (offset != std::string::npos) {
-        auto tokens = phosg::split(line, ' ');
-
-        if (!tokens[8].starts_with("C-")) {
-          throw std::runtime_error(std::format("(ev-line {}) Client connection message missing client ID token", line_num));
-        }
-        uint64_t client_id = stoull(tokens[8].substr(2), nullptr, 16);
-
-        auto listen_tokens = phosg::split(tokens[10], '-');
-        if (listen_tokens.size() < 4) {
-          throw std::runtime_error(std::format(
-              "(ev-line {}) Client connection message listening socket token format is incorrect", line_num));
-        }
-        uint16_t port = stoul(listen_tokens[1], nullptr, 10);
-        Version version = phosg::enum_for_name<Version>(listen_tokens[2]);
+asio::awaitable<void> ReplaySession::run() {
+  bool prev_use_psov2_rand_crypt = this->state->use_psov2_rand_crypt;
+  bool prev_use_legacy_item_random_behavior = this->state->use_legacy_item_random_behavior;
+  this->state->use_psov2_rand_crypt = !!(this->capture->flags() & ReplayCapture::Flag::USE_PSOV2_RAND_CRYPT);
+  this->state->use_legacy_item_random_behavior =
+      !!(this->capture->flags() & ReplayCapture::Flag::USE_LEGACY_ITEM_RANDOM_BEHAVIOR);
 
-        auto c = std::make_shared<Client>(state->io_context, client_id, port, version);
+  auto cursor = this->capture->begin();
+  std::unique_ptr<Event> current_ev;
+  try {
+    ReplayCaptureEvent capture_ev;
+    for (size_t event_number = 1; cursor.next(capture_ev); event_number++) {
+      current_ev = std::make_unique<Event>(capture_ev, event_number);
+      auto& ev = *current_ev;
+
+      std::shared_ptr<Client> c;
+      if (ev.type == Event::Type::CONNECT) {
+        c = std::make_shared<Client>(this->state->io_context, ev.client_id, capture_ev.port, capture_ev.version);
         if (!this->clients.emplace(c->id, c).second) {
-          throw std::runtime_error(std::format("(ev-line {}) Duplicate client ID in input log", line_num));
-        }
-        this->create_event(Event::Type::CONNECT, c, line_num);
-        continue;
-      }
-
-      // I <pid/ts> - [GameServer] Running cleanup tasks for C-{}
-      offset = line.find(" - [GameServer] Running cleanup tasks for C-");
-      if (offset != std::string::npos) {
-        auto tokens = phosg::split(line, ' ');
-        if (tokens.size() < 11) {
-          throw std::runtime_error(std::format("(ev-line {}) Client disconnection message has incorrect token count", line_num));
+          throw std::runtime_error(std::format("(ev-line {}) Duplicate client ID in input log", ev.line_num));
         }
-        if (!tokens[10].starts_with("C-")) {
-          throw std::runtime_error(std::format("(ev-line {}) Client disconnection message missing client ID token", line_num));
-        }
-        uint64_t client_id = stoul(tokens[10].substr(2), nullptr, 16);
+      } else if (ev.type != Event::Type::SHELL) { // Shell commands aren't associated with any client
         try {
-          auto& c = this->clients.at(client_id);
-          if (c->disconnect_event_number > 0) {
-            throw std::runtime_error(std::format("(ev-line {}) Client has multiple disconnect events", line_num));
-          }
-          c->disconnect_event_number = this->create_event(Event::Type::DISCONNECT, c, line_num).event_number;
+          c = this->clients.at(ev.client_id);
         } catch (const std::out_of_range&) {
-          throw std::runtime_error(std::format("(ev-line {}) Unknown disconnecting client ID in input log", line_num));
-        }
-        continue;
-      }
-
-      // I <pid/ts> - [Commands] Sending to C-{:X} (...)
-      // I <pid/ts> - [Commands] Received from C-{:X} (...)
-      offset = line.find(" - [Commands] Sending to C-");
-      if (offset == std::string::npos) {
-        offset = line.find(" - [Commands] Received from C-");
-      }
-      if (offset != std::string::npos) {
-        auto tokens = phosg::split(line, ' ');
-        if (tokens.size() < 10) {
-          throw std::runtime_error(std::format("(ev-line {}) Command header line too short", line_num));
+          throw std::runtime_error(std::format(
+              "(ev-line {}) Input log contains event for missing client", ev.line_num));
         }
-        bool from_client = (tokens[6] == "Received");
-        uint64_t client_id = stoull(tokens[8].substr(2), nullptr, 16);
-        try {
-          parsing_command = &this->create_event(
-              from_client ? Event::Type::SEND : Event::Type::RECEIVE, this->clients.at(client_id), line_num);
-        } catch (const std::out_of_range&) {
-          throw std::runtime_error(std::format("(ev-line {}) Input log contains command for missing client", line_num));
+        if (ev.type == Event::Type::RECEIVE) {
+          this->apply_default_mask(ev);
         }
-        continue;
-      }
-    }
-  }
-
-  if (replay_log.should_log(phosg::LogLevel::L_DEBUG)) {
-    replay_log.debug_f("{} clients in log", this->clients.size());
-    for (const auto& it : this->clients) {
-      replay_log.debug_f("  {} => {}", it.first, it.second->str());
-    }
-    replay_log.debug_f("{} events in replay log", this->events.size());
-    for (const auto& [_, ev] : this->events) {
-      replay_log.debug_f("  {}", ev.str());
-    }
-  }
-}
-
-asio::awaitable<void> ReplaySession::run() {
-  bool prev_use_psov2_rand_crypt = this->state->use_psov2_rand_crypt;
-  bool prev_use_legacy_item_random_behavior = this->state->use_legacy_item_random_behavior;
-  this->state->use_psov2_rand_crypt = this->use_psov2_rand_crypt;
-  this->state->use_legacy_item_random_behavior = this->use_legacy_item_random_behavior;
-
-  auto event_it = this->events.begin();
-  try {
-    for (; event_it != this->events.end(); event_it++) {
-      auto& ev = event_it->second;
-      if (ev.complete) {
-        continue;
       }
 
       if (replay_log.should_log(phosg::LogLevel::L_DEBUG)) {
-        replay_log.debug_f("Event: {}", ev.str());
+        replay_log.debug_f("Event: {} for {}", ev.str(), c ? c->str() : "server");
       }
 
-      auto& c = this->clients.at(ev.client_id);
       switch (ev.type) {
         case Event::Type::CONNECT: {
-          if (c->channel->connected()) {
-            throw std::runtime_error(std::format(
-                "(ev-line {}) Connect event on already-connected client", ev.line_num));
-          }
 
           const DataIndex::PortConfiguration* port_config;
           try {
@@ -543,6 +399,18 @@ asio::awaitable<void> ReplaySession::run() {
           this->bytes_sent += ev.data.size();
           break;
 
+        case Event::Type::SHELL: {
+          // The shell command runs to completion (including any off-thread work, such as a data reload) before the
+          // next event is replayed. This can take longer than the idle timeout, so the timeout is only rescheduled
+          // when the next RECEIVE event is replayed.
+          this->idle_timeout_timer.cancel();
+          auto output = co_await ShellCommand::dispatch_str(this->state, ev.data);
+          for (const auto& line : output) {
+            replay_log.info_f("(ev-line {}) {}", ev.line_num, line);
+          }
+          break;
+        }
+
         case Event::Type::RECEIVE: {
           if (!c->channel->connected()) {
             throw std::runtime_error(std::format("(ev-line {}) Receive event on non-connected client", ev.line_num));
@@ -559,15 +427,6 @@ asio::awaitable<void> ReplaySession::run() {
 
           constexpr uint64_t flags = phosg::FormatDataFlags::PRINT_ASCII | phosg::FormatDataFlags::OFFSET_16_BITS;
 
-          if (c->pending_receive_event_numbers.empty()) {
-            std::string data_str = phosg::format_data(full_command, 0, flags);
-            throw std::runtime_error(std::format("Received unexpected command for client:\n{}", data_str));
-          }
-          if (c->pending_receive_event_numbers.front() != ev.event_number) {
-            throw std::logic_error("Client receive events are out of order");
-          }
-          c->pending_receive_event_numbers.pop_front();
-
           if ((full_command.size() != ev.data.size()) && !ev.allow_size_disparity) {
             std::string expected_data = phosg::format_data(ev.data, 0, flags);
             std::string received_data = phosg::format_data(full_command, 0, flags);
@@ -637,13 +496,13 @@ asio::awaitable<void> ReplaySession::run() {
         default:
           throw std::logic_error("Unhandled event type");
       }
-      ev.complete = true;
+      current_ev.reset();
     }
 
   } catch (const std::exception& e) {
     this->failure = std::format("Replay failed: {}", e.what());
-    if (event_it != this->events.end()) {
-      this->failure += std::format("\nNext pending event: {}", event_it->second.str());
+    if (current_ev) {
+      this->failure += std::format("\nNext pending event: {}", current_ev->str());
     } else {
       this->failure += std::format("\nNo events are pending at failure time");
     }
@@ -1,6 +1,8 @@
 #include "SaveFileFormats.hh"
 
+#include <phosg/Filesystem.hh>
 #include <phosg/Hash.hh>
+#include <phosg/Strings.hh>
 #include <stdexcept>
 #include <string>
 
@@ -1125,8 +1127,12 @@ PSOBBCharacterFile::operator PSOXBCharacterFile::Character() const {
 }
 
 PSOCHARFile::LoadSharedResult PSOCHARFile::load_shared(const std::string& filename, bool load_system) {
-  auto f = phosg::fopen_unique(filename, "rb");
-  auto header = phosg::freadx<PSOCommandHeaderBB>(f.get());
+  return PSOCHARFile::parse_shared(phosg::load_file(filename), load_system);
+}
+
+PSOCHARFile::LoadSharedResult PSOCHARFile::parse_shared(const std::string& data, bool load_system) {
+  phosg::StringReader r(data);
+  const auto& header = r.get<PSOCommandHeaderBB>();
   if (header.size != 0x399C) {
     throw std::runtime_error("incorrect size in character file header");
   }
@@ -1139,22 +1145,20 @@ PSOCHARFile::LoadSharedResult PSOCHARFile::load_shared(const std::string& filena
   static_assert(sizeof(PSOBBCharacterFile) + sizeof(PSOBBBaseSystemFile) + sizeof(PSOBBFullTeamMembership) == 0x3994, ".psochar size is incorrect");
 
   LoadSharedResult ret;
-  ret.character_file = std::make_shared<PSOBBCharacterFile>(phosg::freadx<PSOBBCharacterFile>(f.get()));
+  ret.character_file = std::make_shared<PSOBBCharacterFile>(r.get<PSOBBCharacterFile>());
   if (load_system) {
-    ret.system_file = std::make_shared<PSOBBBaseSystemFile>(phosg::freadx<PSOBBBaseSystemFile>(f.get()));
+    ret.system_file = std::make_shared<PSOBBBaseSystemFile>(r.get<PSOBBBaseSystemFile>());
   }
   return ret;
 }
 
-void PSOCHARFile::save(
-    const std::string& filename,
-    std::shared_ptr<const PSOBBBaseSystemFile> system,
-    std::shared_ptr<const PSOBBCharacterFile> character) {
-  auto f = phosg::fopen_unique(filename, "wb");
+std::string PSOCHARFile::serialize(
+    std::shared_ptr<const PSOBBBaseSystemFile> system, std::shared_ptr<const PSOBBCharacterFile> character) {
+  phosg::StringWriter w;
   PSOCommandHeaderBB header = {sizeof(PSOCommandHeaderBB) + sizeof(PSOBBCharacterFile) + sizeof(PSOBBBaseSystemFile) + sizeof(PSOBBFullTeamMembership), 0x00E7, 0x00000000};
-  phosg::fwritex(f.get(), header);
-  phosg::fwritex(f.get(), *character);
-  phosg::fwritex(f.get(), *system);
+  w.put(header);
+  w.put(*character);
+  w.put(*system);
   // TODO: Technically, we should write the actual team membership struct to the file here, but that would cause Client
   // to depend on Account, which it currently does not. This data doesn't matter at all for correctness within newserv,
   // since it ignores this data entirely and instead generates the membership struct from the team ID in the Account
@@ -1163,7 +1167,15 @@ void PSOCHARFile::save(
   // have a different set of teams with a different set of team IDs anyway, so the membership struct here would be
   // useless either way.
   static const PSOBBFullTeamMembership empty_membership;
-  phosg::fwritex(f.get(), empty_membership);
+  w.put(empty_membership);
+  return std::move(w.str());
+}
+
+void PSOCHARFile::save(
+    const std::string& filename,
+    std::shared_ptr<const PSOBBBaseSystemFile> system,
+    std::shared_ptr<const PSOBBCharacterFile> character) {
+  phosg::save_file(filename, PSOCHARFile::serialize(system, character));
 }
 
 // TODO: Eliminate duplication between this function and the parallel function in PlayerBankT
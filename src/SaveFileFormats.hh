@@ -899,6 +899,9 @@ struct PSOCHARFile {
     // Team membership is present in the file, but newserv ignores it
   };
   static LoadSharedResult load_shared(const std::string& filename, bool load_system);
+  static LoadSharedResult parse_shared(const std::string& data, bool load_system);
+  static std::string serialize(
+      std::shared_ptr<const PSOBBBaseSystemFile> system, std::shared_ptr<const PSOBBCharacterFile> character);
   static void save(
       const std::string& filename,
       std::shared_ptr<const PSOBBBaseSystemFile> system,
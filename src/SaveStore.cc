@@ -0,0 +1,492 @@
+#include "SaveStore.hh"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <phosg/Encoding.hh>
+#include <phosg/Hash.hh>
+#include <phosg/Platform.hh>
+#include <phosg/Strings.hh>
+#include <set>
+
+#include "FileWriteQueue.hh"
+#include "Loggers.hh"
+
+#ifdef PHOSG_WINDOWS
+#include <io.h>
+#define fseeko _fseeki64
+#define fsync(fd) _commit(fd)
+#endif
+
+std::shared_ptr<SaveStore> save_store = std::make_shared<FilesystemSaveStore>();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FilesystemSaveStore
+
+bool FilesystemSaveStore::exists(const std::string& key) {
+  file_write_queue.wait_for(key);
+  return std::filesystem::is_regular_file(key);
+}
+
+std::string FilesystemSaveStore::get(const std::string& key) {
+  file_write_queue.wait_for(key);
+  return phosg::load_file(key);
+}
+
+void FilesystemSaveStore::put(const std::string& key, std::string&& data) {
+  file_write_queue.write(key, std::move(data));
+}
+
+void FilesystemSaveStore::remove(const std::string& key) {
+  file_write_queue.remove(key);
+}
+
+std::vector<std::string> FilesystemSaveStore::list(const std::string& directory) {
+  file_write_queue.flush();
+  std::vector<std::string> ret;
+  if (!std::filesystem::is_directory(directory)) {
+    // Create the directory so that later puts in it will succeed
+    std::filesystem::create_directories(directory);
+    return ret;
+  }
+  for (const auto& item : std::filesystem::directory_iterator(directory)) {
+    if (item.is_regular_file()) {
+      std::string name = item.path().filename().string();
+      if (!name.ends_with(".tmp")) { // Skip partially-written files from FileWriteQueue
+        ret.emplace_back(std::move(name));
+      }
+    }
+  }
+  return ret;
+}
+
+void FilesystemSaveStore::flush() {
+  file_write_queue.flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LogSaveStore
+
+struct LogSaveStoreFileHeader {
+  // All records before this offset have been synced to disk at least once, so their data checksums aren't checked
+  // when the file is opened; records after this offset are fully verified.
+  static constexpr uint64_t MAGIC = 0x4244455641535353; // 'SSSAVEDB'
+  le_uint64_t magic = MAGIC;
+  le_uint64_t verified_size = sizeof(LogSaveStoreFileHeader);
+} __packed_ws__(LogSaveStoreFileHeader, 0x10);
+
+struct LogSaveStoreRecordHeader {
+  // key_size = 0 and data_size = 0 denotes a commit record, which ends a batch
+  static constexpr uint32_t REMOVED = 0xFFFFFFFF;
+  static constexpr uint32_t MAX_KEY_SIZE = 0x1000;
+  le_uint32_t key_size = 0;
+  le_uint32_t data_size = 0;
+  le_uint32_t checksum = 0; // CRC32 of key_size, data_size, key, and data
+
+  inline bool is_commit() const {
+    return (this->key_size == 0) && (this->data_size == 0);
+  }
+  inline bool is_remove() const {
+    return (this->data_size == REMOVED);
+  }
+  inline uint64_t record_size() const {
+    return sizeof(LogSaveStoreRecordHeader) + this->key_size + (this->is_remove() ? 0 : this->data_size);
+  }
+  uint32_t compute_checksum(const std::string& key, const void* data) const {
+    uint32_t ret = phosg::crc32(this, offsetof(LogSaveStoreRecordHeader, checksum));
+    ret = phosg::crc32(key.data(), key.size(), ret);
+    if (data) {
+      ret = phosg::crc32(data, this->data_size, ret);
+    }
+    return ret;
+  }
+} __packed_ws__(LogSaveStoreRecordHeader, 0x0C);
+
+static void write_record(phosg::StringWriter& w, const std::string& key, const std::optional<std::string>& data) {
+  LogSaveStoreRecordHeader header;
+  header.key_size = key.size();
+  header.data_size = data ? data->size() : LogSaveStoreRecordHeader::REMOVED;
+  header.checksum = header.compute_checksum(key, data ? data->data() : nullptr);
+  w.put(header);
+  w.write(key);
+  if (data) {
+    w.write(*data);
+  }
+}
+
+static void write_commit_record(phosg::StringWriter& w) {
+  LogSaveStoreRecordHeader header;
+  header.checksum = header.compute_checksum("", nullptr);
+  w.put(header);
+}
+
+static void sync_file(FILE* f) {
+  if (fflush(f) != 0) {
+    throw std::runtime_error("cannot flush save database");
+  }
+  if (fsync(fileno(f)) != 0) {
+    throw std::runtime_error("cannot sync save database");
+  }
+}
+
+LogSaveStore::LogSaveStore(const std::string& filename)
+    : filename(filename), f(nullptr, +[](FILE*) {}), read_f(nullptr, +[](FILE*) {}) {
+  this->load_index();
+  if ((this->file_size > 0x1000000) && (this->live_bytes * 2 < this->file_size)) {
+    this->compact();
+  }
+  this->writer_thread = std::thread(&LogSaveStore::writer_thread_fn, this);
+}
+
+LogSaveStore::~LogSaveStore() {
+  {
+    std::lock_guard g(this->lock);
+    this->should_exit = true;
+  }
+  this->work_available.notify_all();
+  this->writer_thread.join();
+}
+
+void LogSaveStore::load_index() {
+  if (!std::filesystem::is_regular_file(this->filename)) {
+    phosg::save_object_file(this->filename, LogSaveStoreFileHeader());
+  }
+  this->f = phosg::fopen_unique(this->filename, "r+b");
+  uint64_t actual_size = std::filesystem::file_size(this->filename);
+
+  LogSaveStoreFileHeader file_header;
+  if (fread(&file_header, sizeof(file_header), 1, this->f.get()) != 1 || (file_header.magic != LogSaveStoreFileHeader::MAGIC)) {
+    throw std::runtime_error(this->filename + " is not a save database");
+  }
+
+  this->index.clear();
+  this->live_bytes = 0;
+  std::vector<std::pair<std::string, std::optional<Location>>> batch;
+  uint64_t offset = sizeof(LogSaveStoreFileHeader);
+  uint64_t committed_size = offset;
+  std::string key;
+  std::string data;
+  for (;;) {
+    LogSaveStoreRecordHeader header;
+    if (fread(&header, sizeof(header), 1, this->f.get()) != 1) {
+      break;
+    }
+    if (header.is_commit()) {
+      if (header.checksum != header.compute_checksum("", nullptr)) {
+        break;
+      }
+      offset += sizeof(header);
+      for (auto& [batch_key, loc] : batch) {
+        auto it = this->index.find(batch_key);
+        if (it != this->index.end()) {
+          this->live_bytes -= sizeof(LogSaveStoreRecordHeader) + it->first.size() + it->second.size;
+          if (!loc) {
+            this->index.erase(it);
+          }
+        }
+        if (loc) {
+          this->index[batch_key] = *loc;
+          this->live_bytes += sizeof(LogSaveStoreRecordHeader) + batch_key.size() + loc->size;
+        }
+      }
+      batch.clear();
+      committed_size = offset;
+      continue;
+    }
+
+    if ((header.key_size == 0) || (header.key_size > LogSaveStoreRecordHeader::MAX_KEY_SIZE) ||
+        (offset + header.record_size() > actual_size)) {
+      break;
+    }
+    key.resize(header.key_size);
+    if (fread(key.data(), key.size(), 1, this->f.get()) != 1) {
+      break;
+    }
+    uint64_t data_offset = offset + sizeof(header) + header.key_size;
+    if (header.is_remove()) {
+      if (header.checksum != header.compute_checksum(key, nullptr)) {
+        break;
+      }
+      batch.emplace_back(key, std::nullopt);
+    } else {
+      if (offset + header.record_size() > file_header.verified_size) {
+        data.resize(header.data_size);
+        if ((header.data_size > 0) && (fread(data.data(), data.size(), 1, this->f.get()) != 1)) {
+          break;
+        }
+        if (header.checksum != header.compute_checksum(key, data.data())) {
+          break;
+        }
+      } else if (fseeko(this->f.get(), header.data_size, SEEK_CUR) != 0) {
+        break;
+      }
+      batch.emplace_back(key, Location{data_offset, header.data_size});
+    }
+    offset += header.record_size();
+  }
+
+  if (committed_size < actual_size) {
+    player_data_log.warning_f("Discarding {} bytes of uncommitted or corrupt data at end of {}",
+        actual_size - committed_size, this->filename);
+    this->f.reset();
+    std::filesystem::resize_file(this->filename, committed_size);
+    this->f = phosg::fopen_unique(this->filename, "r+b");
+  }
+  this->file_size = committed_size;
+  this->read_f = phosg::fopen_unique(this->filename, "rb");
+  setvbuf(this->read_f.get(), nullptr, _IONBF, 0);
+  player_data_log.info_f("Indexed {} entries ({} bytes live, {} bytes total) in {}",
+      this->index.size(), this->live_bytes, this->file_size, this->filename);
+}
+
+void LogSaveStore::compact() {
+  player_data_log.info_f("Compacting {}", this->filename);
+  std::string temp_filename = this->filename + ".compact";
+  {
+    auto out_f = phosg::fopen_unique(temp_filename, "wb");
+    LogSaveStoreFileHeader file_header;
+    phosg::fwritex(out_f.get(), &file_header, sizeof(file_header));
+    phosg::StringWriter w;
+    for (const auto& [key, loc] : this->index) {
+      write_record(w, key, this->read_value_locked(loc));
+      if (w.size() >= 0x100000) {
+        phosg::fwritex(out_f.get(), w.str());
+        w.str().clear();
+      }
+    }
+    write_commit_record(w);
+    phosg::fwritex(out_f.get(), w.str());
+    sync_file(out_f.get());
+  }
+  this->f.reset();
+  this->read_f.reset();
+  std::filesystem::rename(temp_filename, this->filename);
+  this->load_index();
+}
+
+std::optional<LogSaveStore::PendingValue> LogSaveStore::find_unwritten_locked(const std::string& key) const {
+  auto it = this->pending.find(key);
+  if (it != this->pending.end()) {
+    return it->second;
+  }
+  it = this->committing.find(key);
+  if (it != this->committing.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+std::string LogSaveStore::read_value_locked(const Location& loc) {
+  std::string ret(loc.size, '\0');
+  if (fseeko(this->read_f.get(), loc.offset, SEEK_SET) != 0) {
+    throw std::runtime_error("cannot seek in save database");
+  }
+  if ((loc.size > 0) && (fread(ret.data(), ret.size(), 1, this->read_f.get()) != 1)) {
+    throw std::runtime_error("cannot read from save database");
+  }
+  return ret;
+}
+
+bool LogSaveStore::exists(const std::string& key) {
+  std::lock_guard g(this->lock);
+  auto unwritten = this->find_unwritten_locked(key);
+  if (unwritten) {
+    return unwritten->has_value();
+  }
+  return this->index.count(key);
+}
+
+std::string LogSaveStore::get(const std::string& key) {
+  std::lock_guard g(this->lock);
+  auto unwritten = this->find_unwritten_locked(key);
+  if (unwritten) {
+    if (!unwritten->has_value()) {
+      throw phosg::cannot_open_file(key);
+    }
+    return **unwritten;
+  }
+  auto it = this->index.find(key);
+  if (it == this->index.end()) {
+    throw phosg::cannot_open_file(key);
+  }
+  return this->read_value_locked(it->second);
+}
+
+void LogSaveStore::put(const std::string& key, std::string&& data) {
+  this->enqueue(key, std::move(data));
+}
+
+void LogSaveStore::remove(const std::string& key) {
+  this->enqueue(key, std::nullopt);
+}
+
+void LogSaveStore::enqueue(const std::string& key, PendingValue&& value) {
+  if (key.empty() || (key.size() > LogSaveStoreRecordHeader::MAX_KEY_SIZE)) {
+    throw std::invalid_argument("invalid key size");
+  }
+  if (value && (value->size() >= LogSaveStoreRecordHeader::REMOVED)) {
+    throw std::invalid_argument("value is too large");
+  }
+  {
+    std::lock_guard g(this->lock);
+    auto it = this->pending.find(key);
+    if (it != this->pending.end()) {
+      it->second = std::move(value);
+    } else {
+      this->pending.emplace(key, std::move(value));
+      this->pending_order.emplace_back(key);
+    }
+  }
+  this->work_available.notify_one();
+}
+
+std::vector<std::string> LogSaveStore::list(const std::string& directory) {
+  std::string prefix = directory + "/";
+  auto name_for_key = [&](const std::string& key) -> std::optional<std::string> {
+    if (!key.starts_with(prefix) || (key.find('/', prefix.size()) != std::string::npos)) {
+      return std::nullopt;
+    }
+    return key.substr(prefix.size());
+  };
+
+  std::lock_guard g(this->lock);
+  std::set<std::string> names;
+  for (auto it = this->index.lower_bound(prefix); (it != this->index.end()) && it->first.starts_with(prefix); it++) {
+    auto name = name_for_key(it->first);
+    if (name) {
+      names.emplace(std::move(*name));
+    }
+  }
+  // Apply unwritten changes; committing is older than pending, so apply it first
+  for (const auto* changes : {&this->committing, &this->pending}) {
+    for (const auto& [key, value] : *changes) {
+      auto name = name_for_key(key);
+      if (name && value) {
+        names.emplace(std::move(*name));
+      } else if (name) {
+        names.erase(*name);
+      }
+    }
+  }
+  return std::vector<std::string>(names.begin(), names.end());
+}
+
+void LogSaveStore::flush() {
+  std::unique_lock g(this->lock);
+  this->work_done.wait(g, [&]() -> bool {
+    return this->pending_order.empty() && this->committing.empty();
+  });
+}
+
+void LogSaveStore::writer_thread_fn() {
+  std::unique_lock g(this->lock);
+  for (;;) {
+    this->work_available.wait(g, [&]() -> bool {
+      return this->should_exit || !this->pending_order.empty();
+    });
+    if (this->pending_order.empty()) {
+      break; // should_exit must be true
+    }
+
+    // Take everything that's pending as one batch. Readers still see these values (via committing) until they're
+    // durable and in the index.
+    std::deque<std::string> keys = std::move(this->pending_order);
+    this->pending_order.clear();
+    this->committing = std::move(this->pending);
+    this->pending.clear();
+    g.unlock();
+
+    phosg::StringWriter w;
+    std::vector<std::pair<const std::string*, std::optional<Location>>> new_locations;
+    new_locations.reserve(keys.size());
+    for (const auto& key : keys) {
+      const auto& value = this->committing.at(key);
+      uint64_t data_offset = this->file_size + w.size() + sizeof(LogSaveStoreRecordHeader) + key.size();
+      write_record(w, key, value);
+      if (value) {
+        new_locations.emplace_back(&key, Location{data_offset, static_cast<uint32_t>(value->size())});
+      } else {
+        new_locations.emplace_back(&key, std::nullopt);
+      }
+    }
+    write_commit_record(w);
+
+    bool success = false;
+    try {
+      if (fseeko(this->f.get(), this->file_size, SEEK_SET) != 0) {
+        throw std::runtime_error("cannot seek in save database");
+      }
+      phosg::fwritex(this->f.get(), w.str());
+      sync_file(this->f.get());
+      // Update the verified size so the next open doesn't have to read all the data in this batch. This doesn't need
+      // to be synced; if it's lost, the next open just verifies more records.
+      LogSaveStoreFileHeader file_header;
+      file_header.verified_size = this->file_size + w.size();
+      fseeko(this->f.get(), 0, SEEK_SET);
+      phosg::fwritex(this->f.get(), &file_header, sizeof(file_header));
+      fflush(this->f.get());
+      success = true;
+    } catch (const std::exception& e) {
+      player_data_log.error_f("Failed to write {} entries to {}: {}", keys.size(), this->filename, e.what());
+      // Remove any partially-written data, since it would prevent later batches from being read when the file is
+      // next opened
+      try {
+        fflush(this->f.get());
+        std::filesystem::resize_file(this->filename, this->file_size);
+      } catch (const std::exception& e) {
+        player_data_log.error_f("Failed to truncate {}: {}", this->filename, e.what());
+      }
+    }
+
+    g.lock();
+    if (success) {
+      for (const auto& [key, loc] : new_locations) {
+        auto it = this->index.find(*key);
+        if (it != this->index.end()) {
+          this->live_bytes -= sizeof(LogSaveStoreRecordHeader) + it->first.size() + it->second.size;
+          if (!loc) {
+            this->index.erase(it);
+          }
+        }
+        if (loc) {
+          this->index[*key] = *loc;
+          this->live_bytes += sizeof(LogSaveStoreRecordHeader) + key->size() + loc->size;
+        }
+      }
+      this->file_size += w.size();
+      this->committing.clear();
+    } else {
+      // Put the failed batch back in the queue (unless newer values have been written since) and try again later
+      for (auto& key : keys) {
+        if (!this->pending.count(key)) {
+          this->pending.emplace(key, std::move(this->committing.at(key)));
+          this->pending_order.emplace_back(key);
+        }
+      }
+      this->committing.clear();
+      this->work_available.wait_for(g, std::chrono::seconds(1), [&]() -> bool { return this->should_exit; });
+      if (this->should_exit) {
+        player_data_log.error_f("Discarding {} unwritten entries for {}", this->pending.size(), this->filename);
+        this->pending.clear();
+        this->pending_order.clear();
+      }
+    }
+    this->work_done.notify_all();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Import/export
+
+size_t copy_save_store_directories(SaveStore& from, SaveStore& to, const std::vector<std::string>& directories) {
+  size_t count = 0;
+  for (const auto& directory : directories) {
+    for (const auto& name : from.list(directory)) {
+      std::string key = directory + "/" + name;
+      to.put(key, from.get(key));
+      count++;
+    }
+  }
+  to.flush();
+  return count;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <phosg/Filesystem.hh>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Persistent storage for accounts, teams, and BB player data. Keys are paths in the traditional directory layout
+// (e.g. "system/licenses/0000000001.json"), so that layout can be used as an import/export format for any backend.
+class SaveStore {
+public:
+  virtual ~SaveStore() = default;
+
+  virtual bool exists(const std::string& key) = 0;
+  // Throws phosg::cannot_open_file if the key doesn't exist
+  virtual std::string get(const std::string& key) = 0;
+  virtual void put(const std::string& key, std::string&& data) = 0;
+  virtual void remove(const std::string& key) = 0;
+  // Returns the names of all entries directly within the given directory (not including the directory itself)
+  virtual std::vector<std::string> list(const std::string& directory) = 0;
+  // Blocks until all previous puts and removes are durable
+  virtual void flush() = 0;
+
+  template <typename T>
+  T get_object(const std::string& key, bool allow_oversize = false) {
+    std::string data = this->get(key);
+    if ((data.size() < sizeof(T)) || (!allow_oversize && (data.size() != sizeof(T)))) {
+      throw std::runtime_error(std::format("{} has incorrect size (expected {} bytes, received {} bytes)",
+          key, sizeof(T), data.size()));
+    }
+    return *reinterpret_cast<const T*>(data.data());
+  }
+  template <typename T>
+  void put_object(const std::string& key, const T& obj) {
+    this->put(key, std::string(reinterpret_cast<const char*>(&obj), sizeof(T)));
+  }
+};
+
+// Stores each key as a separate file. Writes go through file_write_queue.
+class FilesystemSaveStore : public SaveStore {
+public:
+  FilesystemSaveStore() = default;
+  virtual ~FilesystemSaveStore() = default;
+
+  virtual bool exists(const std::string& key);
+  virtual std::string get(const std::string& key);
+  virtual void put(const std::string& key, std::string&& data);
+  virtual void remove(const std::string& key);
+  virtual std::vector<std::string> list(const std::string& directory);
+  virtual void flush();
+};
+
+// Stores all keys in a single append-only file. Each put or remove appends a record; records are written and synced
+// in batches on a background thread, and each batch ends with a commit record. When the file is opened, records
+// after the last commit record (or with an incorrect checksum) are discarded, so a crash at any point loses at most
+// the uncommitted batch and never leaves a partially-applied one. Only the location of each value is kept in memory.
+// Space used by overwritten values is reclaimed by compacting the file when it's opened.
+class LogSaveStore : public SaveStore {
+public:
+  explicit LogSaveStore(const std::string& filename);
+  LogSaveStore(const LogSaveStore&) = delete;
+  LogSaveStore(LogSaveStore&&) = delete;
+  LogSaveStore& operator=(const LogSaveStore&) = delete;
+  LogSaveStore& operator=(LogSaveStore&&) = delete;
+  virtual ~LogSaveStore();
+
+  virtual bool exists(const std::string& key);
+  virtual std::string get(const std::string& key);
+  virtual void put(const std::string& key, std::string&& data);
+  virtual void remove(const std::string& key);
+  virtual std::vector<std::string> list(const std::string& directory);
+  virtual void flush();
+
+  inline size_t size() const {
+    std::lock_guard g(this->lock);
+    return this->index.size();
+  }
+
+private:
+  struct Location {
+    uint64_t offset;
+    uint32_t size;
+  };
+  using PendingValue = std::optional<std::string>; // Missing = remove
+
+  std::string filename;
+  std::unique_ptr<FILE, void (*)(FILE*)> f; // Only used by the writer thread after construction
+  std::unique_ptr<FILE, void (*)(FILE*)> read_f; // Unbuffered; only used while holding lock
+  uint64_t file_size = 0;
+  uint64_t live_bytes = 0;
+
+  mutable std::mutex lock;
+  std::condition_variable work_available;
+  std::condition_variable work_done;
+  std::map<std::string, Location> index; // Ordered, so list() can scan by prefix
+  std::unordered_map<std::string, PendingValue> pending; // Not yet written
+  std::deque<std::string> pending_order;
+  std::unordered_map<std::string, PendingValue> committing; // Being written by the writer thread
+  bool should_exit = false;
+  std::thread writer_thread;
+
+  void load_index();
+  void compact();
+  std::optional<PendingValue> find_unwritten_locked(const std::string& key) const;
+  std::string read_value_locked(const Location& loc);
+  void enqueue(const std::string& key, PendingValue&& value);
+  void writer_thread_fn();
+};
+
+// Backend used for all saves; this is a FilesystemSaveStore unless configured otherwise
+extern std::shared_ptr<SaveStore> save_store;
+
+// Copies all entries in the given directories from one store to another (e.g. for importing or exporting a single-
+// file store from/to the traditional directory layout). Returns the number of entries copied.
+size_t copy_save_store_directories(SaveStore& from, SaveStore& to, const std::vector<std::string>& directories);
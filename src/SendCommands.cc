@@ -78,23 +78,41 @@ void send_command(std::shared_ptr<Client> c, uint16_t command, uint32_t flag, co
   c->channel->send(command, flag, data, size);
 }
 
+CommandBroadcast::CommandBroadcast(uint16_t command, uint32_t flag, const void* data, size_t size)
+    : command(command), flag(flag), block(data, size) {}
+
+void CommandBroadcast::send(std::shared_ptr<Client> c) {
+  auto& ch = c->channel;
+  if (!ch->connected()) {
+    ch->send(this->command, this->flag, this->block.first, this->block.second); // Logs the dropped command
+    return;
+  }
+  auto& framed = this->framed.at(ch->framing_type());
+  if (framed.empty()) {
+    ch->frame_command(framed, this->command, this->flag, &this->block, 1);
+  }
+  ch->send_framed(framed);
+}
+
 void send_command_excluding_client(
     std::shared_ptr<Lobby> l, std::shared_ptr<Client> c, uint16_t command, uint32_t flag, const void* data, size_t size) {
+  CommandBroadcast bc(command, flag, data, size);
   for (auto& client : l->clients) {
     if (!client || (client == c)) {
       continue;
     }
-    send_command(client, command, flag, data, size);
+    bc.send(client);
   }
 }
 
 void send_command_if_not_loading(
     std::shared_ptr<Lobby> l, uint16_t command, uint32_t flag, const void* data, size_t size) {
+  CommandBroadcast bc(command, flag, data, size);
   for (auto& client : l->clients) {
     if (!client || client->check_flag(Client::Flag::LOADING)) {
       continue;
     }
-    send_command(client, command, flag, data, size);
+    bc.send(client);
   }
 }
 
@@ -1621,8 +1639,8 @@ void send_quest_categories_menu_t(std::shared_ptr<Client> c, QuestMenuType menu_
   }
 
   std::vector<EntryT> entries;
-  auto s = c->require_server_state();
-  for (const auto& cat : s->data->quest_index->categories(menu_type, episode, version_flags, include_condition)) {
+  auto data = l ? l->require_data() : c->require_server_state()->data;
+  for (const auto& cat : data->quest_index->categories(menu_type, episode, version_flags, include_condition)) {
     auto& e = entries.emplace_back();
     e.menu_id = cat->use_ep2_icon() ? MenuID::QUEST_CATEGORIES_EP2 : MenuID::QUEST_CATEGORIES_EP1_EP3_EP4;
     e.item_id = cat->category_id;
@@ -1847,7 +1865,6 @@ static void send_join_spectator_team(std::shared_ptr<Client> c, std::shared_ptr<
     throw std::runtime_error("lobby is not a spectator team");
   }
 
-  auto s = c->require_server_state();
 
   S_JoinSpectatorTeam_Ep3_E8 cmd;
 
@@ -1872,7 +1889,7 @@ static void send_join_spectator_team(std::shared_ptr<Client> c, std::shared_ptr<
       auto& p = cmd.players[z];
       populate_lobby_data_for_client(p.lobby_data, wc, c);
       p.inventory = wc_p->inventory;
-      p.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+      p.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
       p.disp = wc_p->disp.to_v123<false>(c->language(), p.inventory.language);
       p.disp.enforce_lobby_join_limits_for_version(c->version());
 
@@ -1886,7 +1903,7 @@ static void send_join_spectator_team(std::shared_ptr<Client> c, std::shared_ptr<
           : wc_p->disp.stats.level.load();
       e.name_color = wc_p->disp.visual.sh.name_color;
 
-      uint32_t name_color = s->data->name_color_for_client(wc);
+      uint32_t name_color = l->require_data()->name_color_for_client(wc);
       if (name_color) {
         p.disp.visual.sh.name_color = name_color;
         e.name_color = name_color;
@@ -1916,7 +1933,7 @@ static void send_join_spectator_team(std::shared_ptr<Client> c, std::shared_ptr<
       auto& p = cmd.players[client_id];
       p.lobby_data = entry.lobby_data;
       p.inventory = entry.inventory;
-      p.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+      p.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
       p.disp = entry.disp;
       p.disp.enforce_lobby_join_limits_for_version(c->version());
 
@@ -1955,7 +1972,7 @@ static void send_join_spectator_team(std::shared_ptr<Client> c, std::shared_ptr<
           : other_p->disp.stats.level.load();
       cmd_e.name_color = other_p->disp.visual.sh.name_color;
 
-      uint32_t name_color = s->data->name_color_for_client(other_c);
+      uint32_t name_color = l->require_data()->name_color_for_client(other_c);
       if (name_color) {
         cmd_p.disp.visual.sh.name_color = name_color;
         cmd_e.name_color = name_color;
@@ -2058,18 +2075,17 @@ void send_join_game(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l) {
     case Version::GC_EP3: {
       S_JoinGame_Ep3_64 cmd;
       size_t player_count = populate_v3_cmd(cmd);
-      auto s = c->require_server_state();
       for (size_t x = 0; x < 4; x++) {
         auto lc = l->clients[x];
         if (lc) {
           auto other_p = lc->character_file();
           auto& cmd_p = cmd.players_ep3[x];
           cmd_p.inventory = other_p->inventory;
-          cmd_p.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+          cmd_p.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
           cmd_p.disp = convert_player_disp_data<PlayerDispDataV123>(
               other_p->disp, c->language(), other_p->inventory.language);
           cmd_p.disp.enforce_lobby_join_limits_for_version(c->version());
-          uint32_t name_color = s->data->name_color_for_client(lc);
+          uint32_t name_color = l->require_data()->name_color_for_client(lc);
           if (name_color) {
             cmd_p.disp.visual.sh.name_color = name_color;
           }
@@ -2103,7 +2119,6 @@ void send_join_game(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l) {
 
 template <typename LobbyDataT, typename DispDataT, typename RecordsT>
 void send_join_lobby_t(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l, std::shared_ptr<Client> joining_client = nullptr) {
-  auto s = c->require_server_state();
 
   uint8_t command;
   if (l->is_game()) {
@@ -2179,13 +2194,13 @@ void send_join_lobby_t(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l, std:
     auto& e = cmd.entries[used_entries++];
     populate_lobby_data_for_client(e.lobby_data, lc, c);
     e.inventory = lp->inventory;
-    e.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+    e.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
     if ((lc == c) && is_v1_or_v2(c->version()) && lc->v1_v2_last_reported_disp) {
       e.disp = convert_player_disp_data<DispDataT>(*lc->v1_v2_last_reported_disp, c->language(), lp->inventory.language);
     } else {
       e.disp = convert_player_disp_data<DispDataT>(lp->disp, c->language(), lp->inventory.language);
       e.disp.enforce_lobby_join_limits_for_version(c->version());
-      uint32_t name_color = s->data->name_color_for_client(lc);
+      uint32_t name_color = l->require_data()->name_color_for_client(lc);
       if (name_color) {
         e.disp.visual.sh.name_color = name_color;
         if (is_v1_or_v2(c->version())) {
@@ -2199,7 +2214,6 @@ void send_join_lobby_t(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l, std:
 }
 
 void send_join_lobby_xb(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l, std::shared_ptr<Client> joining_client = nullptr) {
-  auto s = c->require_server_state();
 
   uint8_t command;
   if (l->is_game()) {
@@ -2252,10 +2266,10 @@ void send_join_lobby_xb(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l, std
     auto& e = cmd.entries[used_entries++];
     populate_lobby_data_for_client(e.lobby_data, lc, c);
     e.inventory = lp->inventory;
-    e.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+    e.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
     e.disp = convert_player_disp_data<PlayerDispDataV123>(lp->disp, c->language(), lp->inventory.language);
     e.disp.enforce_lobby_join_limits_for_version(c->version());
-    uint32_t name_color = s->data->name_color_for_client(lc);
+    uint32_t name_color = l->require_data()->name_color_for_client(lc);
     if (name_color) {
       e.disp.visual.sh.name_color = name_color;
     }
@@ -2292,7 +2306,6 @@ void send_join_lobby_dc_nte(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l,
     }
   }
 
-  auto s = c->require_server_state();
 
   size_t used_entries = 0;
   for (const auto& lc : lobby_clients) {
@@ -2300,13 +2313,13 @@ void send_join_lobby_dc_nte(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l,
     auto& e = cmd.entries[used_entries++];
     populate_lobby_data_for_client(e.lobby_data, lc, c);
     e.inventory = lp->inventory;
-    e.inventory.encode_for_client(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+    e.inventory.encode_for_client(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
     if ((lc == c) && is_v1_or_v2(c->version()) && lc->v1_v2_last_reported_disp) {
       e.disp = convert_player_disp_data<PlayerDispDataV123>(*lc->v1_v2_last_reported_disp, c->language(), lp->inventory.language);
     } else {
       e.disp = convert_player_disp_data<PlayerDispDataV123>(lp->disp, c->language(), lp->inventory.language);
       e.disp.enforce_lobby_join_limits_for_version(c->version());
-      uint32_t name_color = s->data->name_color_for_client(lc);
+      uint32_t name_color = l->require_data()->name_color_for_client(lc);
       if (name_color) {
         e.disp.visual.sh.name_color = name_color;
         e.disp.visual.sh.compute_name_color_checksum();
@@ -2671,13 +2684,36 @@ void send_ep3_change_music(std::shared_ptr<Channel> ch, uint32_t song) {
 
 void send_game_join_sync_command(
     std::shared_ptr<Client> c, const void* data, size_t size, uint8_t dc_nte_sc, uint8_t dc_11_2000_sc, uint8_t sc) {
-  std::string compressed_data = bc0_compress(data, size);
+  // Building the decompressed state is cheap compared to compressing it, so the cache is keyed on the version and
+  // validated by comparing the decompressed data. This can never send stale state, even though the map and item state
+  // are modified in many places without going through any common function.
+  auto l = c->lobby.lock();
+  Lobby::JoinSyncCacheEntry* cache_entry = nullptr;
+  if (l) {
+    cache_entry = &l->join_sync_cache[(static_cast<uint16_t>(c->version()) << 8) | sc];
+    if ((cache_entry->decompressed_data.size() == size) && !memcmp(cache_entry->decompressed_data.data(), data, size)) {
+      c->log.debug_f("Using cached sync data for subcommand {:02X} ({:X} -> {:X} bytes)",
+          sc, size, cache_entry->compressed_data.size());
+      send_game_join_sync_command_compressed(c, cache_entry->compressed_data.data(),
+          cache_entry->compressed_data.size(), size, dc_nte_sc, dc_11_2000_sc, sc);
+      return;
+    }
+  }
+
+  auto s = c->require_server_state();
+  std::string compressed_data = s->data->fast_join_sync_compression
+      ? bc0_compress_fast(data, size)
+      : bc0_compress(data, size);
   if (c->check_flag(Client::Flag::DEBUG_ENABLED)) {
     c->log.info_f("Compressed sync data from ({:X} -> {:X} bytes):", size, compressed_data.size());
     phosg::print_data(stderr, data, size);
   }
   send_game_join_sync_command_compressed(
       c, compressed_data.data(), compressed_data.size(), size, dc_nte_sc, dc_11_2000_sc, sc);
+  if (cache_entry) {
+    cache_entry->decompressed_data.assign(reinterpret_cast<const char*>(data), size);
+    cache_entry->compressed_data = std::move(compressed_data);
+  }
 }
 
 void send_game_join_sync_command(
@@ -2766,7 +2802,7 @@ void send_game_item_state(std::shared_ptr<Client> c) {
       fi.room_id = 0;
       fi.drop_number = (floor == 0) ? 0xFFFF : (decompressed_header.next_drop_number_per_floor.at(floor - 1)++);
       fi.item = item->data;
-      fi.item.encode_for_version(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+      fi.item.encode_for_version(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
       floor_items_w.put(fi);
 
       decompressed_header.floor_item_count_per_floor.at(floor)++;
@@ -2791,7 +2827,7 @@ void send_game_item_state(std::shared_ptr<Client> c) {
       }
       uint8_t subcommand = get_pre_v1_subcommand(c->version(), 0x4F, 0x56, 0x5D);
       G_DropStackedItem_PC_V3_BB_6x5D cmd = {{{subcommand, 0x0A, 0x0000}, floor, 0, item->pos, item->data}, 0};
-      cmd.item_data.encode_for_version(c->version(), s->data->item_parameter_table_for_encode(c->version()));
+      cmd.item_data.encode_for_version(c->version(), l->require_data()->item_parameter_table_for_encode(c->version()));
       w.put(cmd);
     }
   }
@@ -3002,7 +3038,6 @@ void send_game_player_state(std::shared_ptr<Client> to_c, std::shared_ptr<Client
     throw std::logic_error("source client is not logged in");
   }
 
-  auto s = to_c->require_server_state();
   Parsed6x70Data to_send = *from_c->last_reported_6x70;
 
   to_send.base.client_id = from_c->lobby_client_id;
@@ -3035,30 +3070,31 @@ void send_game_player_state(std::shared_ptr<Client> to_c, std::shared_ptr<Client
     to_send.floor = from_c->floor;
   }
 
+  auto data = to_l ? to_l->require_data() : to_c->require_server_state()->data;
   switch (to_c->version()) {
     case Version::DC_NTE:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_nte(s));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_nte(data));
       break;
     case Version::DC_11_2000:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_112000(s));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_112000(data));
       break;
     case Version::DC_V1:
     case Version::DC_V2:
     case Version::PC_NTE:
     case Version::PC_V2:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_pc(s, to_c->version()));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_dc_pc(data, to_c->version()));
       break;
     case Version::GC_NTE:
     case Version::GC_V3:
     case Version::GC_EP3_NTE:
     case Version::GC_EP3:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_gc_gcnte(s, to_c->version()));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_gc_gcnte(data, to_c->version()));
       break;
     case Version::XB_V3:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_xb(s));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_xb(data));
       break;
     case Version::BB_V4:
-      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_bb(s, to_c->language()));
+      send_or_enqueue_command(to_c, 0x6D, to_c->lobby_client_id, to_send.as_bb(data, to_c->language()));
       break;
     default:
       throw std::logic_error("attempting to send 6x70 command to unknown game version");
@@ -3643,7 +3679,6 @@ void send_ep3_game_details(std::shared_ptr<Client> c, std::shared_ptr<Lobby> l)
 
 template <typename CmdT>
 void send_ep3_set_tournament_player_decks_t(std::shared_ptr<Client> c) {
-  auto s = c->require_server_state();
   auto l = c->require_lobby();
 
   auto& match = l->tournament_match;
@@ -3689,7 +3724,7 @@ void send_ep3_set_tournament_player_decks_t(std::shared_ptr<Client> c) {
   add_entries_for_team(match->preceding_b->winner_team, 2);
 
   if ((c->version() != Version::GC_EP3_NTE) &&
-      !(s->data->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
+      !(l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
     uint8_t mask_key = (phosg::random_object<uint32_t>() % 0xFF) + 1;
     set_mask_for_ep3_game_command(&cmd, sizeof(cmd), mask_key);
   }
@@ -3750,14 +3785,14 @@ void send_ep3_tournament_match_result(std::shared_ptr<Lobby> l, uint32_t meseta_
     cmd.winner_team_id = (match->preceding_b->winner_team == match->winner_team);
     cmd.meseta_amount = meseta_reward;
     cmd.meseta_reward_text.encode("You got %s meseta!", Language::ENGLISH);
-    if ((lc->version() != Version::GC_EP3_NTE) && !(s->data->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
+    if ((lc->version() != Version::GC_EP3_NTE) && !(l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
       uint8_t mask_key = (phosg::random_object<uint32_t>() % 0xFF) + 1;
       set_mask_for_ep3_game_command(&cmd, sizeof(cmd), mask_key);
     }
     send_command_t(lc, 0xC9, 0x00, cmd);
   }
 
-  if (s->data->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_STATUS_MESSAGES) {
+  if (l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::ENABLE_STATUS_MESSAGES) {
     send_text_message_fmt(l, "$C5TOURN/{:X}/{} WIN {}",
         tourn->get_menu_item_id(), match->round_num,
         match->winner_team == match->preceding_a->winner_team ? 'A' : 'B');
@@ -3780,14 +3815,13 @@ void send_ep3_update_game_metadata(std::shared_ptr<Lobby> l) {
     }
   }
 
-  auto s = l->require_server_state();
 
   {
     G_SetGameMetadata_Ep3_6xB4x52 cmd;
     cmd.total_spectators = total_spectators;
     for (auto c : l->clients) {
       if (c) {
-        if ((c->version() == Version::GC_EP3) && !(s->data->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
+        if ((c->version() == Version::GC_EP3) && !(l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
           G_SetGameMetadata_Ep3_6xB4x52 masked_cmd = cmd;
           uint8_t mask_key = (phosg::random_object<uint32_t>() % 0xFF) + 1;
           set_mask_for_ep3_game_command(&masked_cmd, sizeof(masked_cmd), mask_key);
@@ -3822,7 +3856,7 @@ void send_ep3_update_game_metadata(std::shared_ptr<Lobby> l) {
       cmd.text.encode(text, Language::ENGLISH);
       for (auto c : watcher_l->clients) {
         if (c) {
-          if ((c->version() == Version::GC_EP3) && !(s->data->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
+          if ((c->version() == Version::GC_EP3) && !(l->require_data()->ep3_behavior_flags & Episode3::BehaviorFlag::DISABLE_MASKING)) {
             G_SetGameMetadata_Ep3_6xB4x52 masked_cmd = cmd;
             uint8_t mask_key = (phosg::random_object<uint32_t>() % 0xFF) + 1;
             set_mask_for_ep3_game_command(&masked_cmd, sizeof(masked_cmd), mask_key);
@@ -4078,34 +4112,34 @@ bool send_ep3_start_tournament_deck_select_if_all_clients_ready(std::shared_ptr<
 }
 
 void send_ep3_card_auction(std::shared_ptr<Lobby> l) {
-  auto s = l->require_server_state();
-  if ((s->data->ep3_card_auction_points == 0) ||
-      (s->data->ep3_card_auction_min_size == 0) ||
-      (s->data->ep3_card_auction_max_size == 0)) {
+  auto data = l->require_data();
+  if ((data->ep3_card_auction_points == 0) ||
+      (data->ep3_card_auction_min_size == 0) ||
+      (data->ep3_card_auction_max_size == 0)) {
     throw std::runtime_error("card auctions are not configured on this server");
   }
 
   uint16_t num_cards;
-  if (s->data->ep3_card_auction_min_size == s->data->ep3_card_auction_max_size) {
-    num_cards = s->data->ep3_card_auction_min_size;
+  if (data->ep3_card_auction_min_size == data->ep3_card_auction_max_size) {
+    num_cards = data->ep3_card_auction_min_size;
   } else {
-    num_cards = s->data->ep3_card_auction_min_size +
-        (phosg::random_object<uint16_t>() % (s->data->ep3_card_auction_max_size - s->data->ep3_card_auction_min_size + 1));
+    num_cards = data->ep3_card_auction_min_size +
+        (phosg::random_object<uint16_t>() % (data->ep3_card_auction_max_size - data->ep3_card_auction_min_size + 1));
   }
   num_cards = std::min<uint16_t>(num_cards, 0x14);
 
-  auto card_index = l->is_ep3_nte() ? s->data->ep3_card_index_trial : s->data->ep3_card_index;
+  auto card_index = l->is_ep3_nte() ? data->ep3_card_index_trial : data->ep3_card_index;
 
   uint64_t distribution_size = 0;
-  for (const auto& e : s->data->ep3_card_auction_pool) {
+  for (const auto& e : data->ep3_card_auction_pool) {
     distribution_size += e.probability;
   }
 
   S_StartCardAuction_Ep3_EF cmd;
-  cmd.points_available = s->data->ep3_card_auction_points;
+  cmd.points_available = data->ep3_card_auction_points;
   for (size_t z = 0; z < num_cards; z++) {
     uint64_t v = phosg::random_object<uint64_t>() % distribution_size;
-    for (const auto& e : s->data->ep3_card_auction_pool) {
+    for (const auto& e : data->ep3_card_auction_pool) {
       if (v >= e.probability) {
         v -= e.probability;
       } else {
@@ -4306,14 +4340,8 @@ void send_intra_team_ranking(std::shared_ptr<Client> c) {
 void send_cross_team_ranking(std::shared_ptr<Client> c) {
   auto s = c->require_server_state();
 
-  // TODO: At some point we should maintain a sorted index instead of sorting these on-demand.
-  auto teams = s->team_index->all();
-  auto rank_fn = +[](const std::shared_ptr<const TeamIndex::Team>& a, const std::shared_ptr<const TeamIndex::Team>& b) {
-    return a->points > b->points;
-  };
-  sort(teams.begin(), teams.end(), rank_fn);
-
-  size_t num_to_send = std::min<size_t>(teams.size(), 0x300);
+  auto teams = s->team_index->ranking(0x300);
+  size_t num_to_send = teams.size();
 
   S_CrossTeamRanking_BB_1CEA cmd;
   cmd.num_entries = num_to_send;
@@ -4381,22 +4409,22 @@ void send_team_metadata_change_notifications(
     uint8_t what) {
   using TMC = TeamMetadataChange;
   for (const auto& it : team->members) {
-    try {
-      auto member_c = s->find_client(nullptr, it.second.account_id);
-      bool is_changed_client = (member_c->login && (member_c->login->account->account_id == changed_member_account_id));
-      if (is_changed_client || (what & TMC::TEAM_MASTER)) {
-        send_update_lobby_data_bb(member_c);
-      }
-      if (is_changed_client || (what & (TMC::TEAM_MASTER | TMC::TEAM_NAME | TMC::TEAM_MEMBER_COUNT))) {
-        send_update_team_membership(member_c);
-      }
-      if (is_changed_client || (what & (TMC::TEAM_MASTER | TMC::FLAG_DATA | TMC::TEAM_NAME | TMC::TEAM_MEMBER_COUNT))) {
-        send_update_team_metadata_for_client(member_c);
-      }
-      if (is_changed_client || (what & TMC::REWARD_FLAGS)) {
-        send_update_team_reward_flags(member_c);
-      }
-    } catch (const std::out_of_range&) {
+    auto member_c = s->find_client(nullptr, it.second.account_id);
+    if (!member_c) {
+      continue;
+    }
+    bool is_changed_client = (member_c->login && (member_c->login->account->account_id == changed_member_account_id));
+    if (is_changed_client || (what & TMC::TEAM_MASTER)) {
+      send_update_lobby_data_bb(member_c);
+    }
+    if (is_changed_client || (what & (TMC::TEAM_MASTER | TMC::TEAM_NAME | TMC::TEAM_MEMBER_COUNT))) {
+      send_update_team_membership(member_c);
+    }
+    if (is_changed_client || (what & (TMC::TEAM_MASTER | TMC::FLAG_DATA | TMC::TEAM_NAME | TMC::TEAM_MEMBER_COUNT))) {
+      send_update_team_metadata_for_client(member_c);
+    }
+    if (is_changed_client || (what & TMC::REWARD_FLAGS)) {
+      send_update_team_reward_flags(member_c);
     }
   }
 }
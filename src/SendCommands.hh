@@ -64,6 +64,26 @@ inline void send_command(std::shared_ptr<Client> c, uint16_t command, uint32_t f
   send_command(c, command, flag, nullptr, 0);
 }
 
+// Sends the same command to multiple clients. The unencrypted command is only built once for each distinct framing
+// type among the recipients (see Channel::framing_type); only encryption is done separately for each client. The data
+// pointer must remain valid for the lifetime of this object.
+class CommandBroadcast {
+public:
+  CommandBroadcast(uint16_t command, uint32_t flag, const void* data, size_t size);
+  CommandBroadcast(const CommandBroadcast&) = delete;
+  CommandBroadcast(CommandBroadcast&&) = delete;
+  CommandBroadcast& operator=(const CommandBroadcast&) = delete;
+  CommandBroadcast& operator=(CommandBroadcast&&) = delete;
+
+  void send(std::shared_ptr<Client> c);
+
+private:
+  uint16_t command;
+  uint32_t flag;
+  std::pair<const void*, size_t> block;
+  std::array<std::string, Channel::NUM_FRAMING_TYPES> framed;
+};
+
 void send_command_excluding_client(
     std::shared_ptr<Lobby> l, std::shared_ptr<Client> c, uint16_t command, uint32_t flag, const void* data, size_t size);
 
@@ -264,24 +264,76 @@ std::shared_ptr<Client> ServerState::find_client(
     }
   }
 
-  if (l) {
-    try {
-      return l->find_client(identifier, account_id);
-    } catch (const std::out_of_range&) {
+  // Return the first match in l if there is one; otherwise, return the first match in any lobby
+  std::shared_ptr<Client> fallback;
+  auto check_range = [&](auto range) -> std::shared_ptr<Client> {
+    for (auto it = range.first; it != range.second; it++) {
+      auto c = it->second.lock();
+      auto c_l = c ? c->lobby.lock() : nullptr;
+      if (!c_l) {
+        continue;
+      }
+      if (!l || (c_l == l)) {
+        return c;
+      }
+      if (!fallback) {
+        fallback = c;
+      }
     }
-  }
+    return nullptr;
+  };
 
-  for (auto& other_l : this->all_lobbies()) {
-    if (l == other_l) {
-      continue; // Don't bother looking again
+  if (account_id && (account_id <= 0xFFFFFFFF)) {
+    auto ret = check_range(this->lobby_clients_for_account.equal_range(account_id));
+    if (ret) {
+      return ret;
     }
-    try {
-      return other_l->find_client(identifier, account_id);
-    } catch (const std::out_of_range&) {
+  }
+  if (identifier) {
+    auto ret = check_range(this->lobby_clients_for_name.equal_range(phosg::tolower(*identifier)));
+    if (ret) {
+      return ret;
     }
   }
+  return fallback;
+}
+
+void ServerState::update_lobby_client_index(std::shared_ptr<Client> c) {
+  auto erase_from = [&c](auto& index, const auto& key) {
+    auto range = index.equal_range(key);
+    for (auto it = range.first; it != range.second;) {
+      auto other_c = it->second.lock();
+      if (!other_c || (other_c == c)) {
+        it = index.erase(it);
+      } else {
+        it++;
+      }
+    }
+  };
+
+  if (c->lobby_index_valid) {
+    erase_from(this->lobby_clients_for_account, c->lobby_index_account_id);
+    erase_from(this->lobby_clients_for_name, c->lobby_index_name);
+    c->lobby_index_valid = false;
+    c->lobby_index_account_id = 0;
+    c->lobby_index_name.clear();
+  }
+
+  if (!c->lobby.lock() || !c->login) {
+    return;
+  }
 
-  throw std::out_of_range("client not found");
+  c->lobby_index_account_id = c->login->account->account_id;
+  auto p = c->character_file(false, false);
+  if (p) {
+    // Names are matched case-insensitively, so the index key is lowercased here and in find_client
+    c->lobby_index_name = phosg::tolower(p->disp.visual.name.decode(c->language()));
+  }
+  this->lobby_clients_for_account.emplace(c->lobby_index_account_id, c);
+  if (!c->lobby_index_name.empty()) {
+    this->lobby_clients_for_name.emplace(c->lobby_index_name, c);
+  }
+  c->lobby_index_valid = true;
 }
 
 void ServerState::load_accounts() {
@@ -290,6 +342,9 @@ void ServerState::load_accounts() {
 }
 
 void ServerState::load_teams() {
+  if (this->team_index) {
+    this->team_index->flush();
+  }
   config_log.info_f("Indexing teams");
   this->team_index = std::make_shared<TeamIndex>("system/teams", this->data->team_reward_defs_json);
 }
@@ -383,6 +438,57 @@ void ServerState::reset_between_replays() {
   }
 }
 
+asio::awaitable<void> ServerState::team_save_task() {
+  asio::steady_timer timer(*this->io_context);
+  for (;;) {
+    timer.expires_after(std::chrono::microseconds(this->data->team_save_interval_usecs));
+    co_await timer.async_wait(asio::use_awaitable);
+
+    // The index may be replaced while the write is in progress, so hold a reference to the one being written
+    auto team_index = this->team_index;
+    if (!team_index) {
+      continue;
+    }
+    size_t count = team_index->prepare_pending_saves();
+    if (count == 0) {
+      continue;
+    }
+    try {
+      uint64_t start_time = phosg::now();
+      co_await call_on_thread_pool(*this->thread_pool, [team_index]() -> void { team_index->write_pending_saves(); });
+      config_log.debug_f("Saved {} teams in {}", count, phosg::format_duration(phosg::now() - start_time));
+    } catch (const std::exception& e) {
+      config_log.warning_f("Failed to save teams: {}", e.what());
+    }
+  }
+}
+
+asio::awaitable<void> ServerState::reload_data(std::function<void(DataIndex&)> fn) {
+  if (this->data_reload_in_progress) {
+    throw std::runtime_error("another reload is already in progress");
+  }
+  this->data_reload_in_progress = true;
+
+  std::shared_ptr<DataIndex> new_data;
+  try {
+    // The copy must be made on this thread, since some of the DataIndex's caches are modified during gameplay
+    new_data = std::make_shared<DataIndex>(*this->data);
+    uint64_t start_time = phosg::now();
+    new_data = co_await call_on_thread_pool(*this->thread_pool, [fn, new_data]() -> std::shared_ptr<DataIndex> {
+      fn(*new_data);
+      return new_data;
+    });
+    config_log.info_f("Data reload completed in {}", phosg::format_duration(phosg::now() - start_time));
+  } catch (const std::exception&) {
+    this->data_reload_in_progress = false;
+    throw;
+  }
+
+  this->data = std::move(new_data);
+  this->data->apply_log_levels();
+  this->data_reload_in_progress = false;
+}
+
 void ServerState::disconnect_all_banned_clients() {
   uint64_t now_usecs = phosg::now();
 
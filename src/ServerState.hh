@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <phosg/JSON.hh>
@@ -28,6 +29,7 @@
 #include "MagMetadataTable.hh"
 #include "Menu.hh"
 #include "Quest.hh"
+#include "ReplayCapture.hh"
 #include "ShopRandomSets.hh"
 #include "TeamIndex.hh"
 #include "TekkerAdjustmentSet.hh"
@@ -40,7 +42,9 @@ class HTTPServer;
 
 class ServerState : public std::enable_shared_from_this<ServerState> {
 public:
+  // This is replaced (never modified in place) when any part of it is reloaded; see reload_data
   std::shared_ptr<DataIndex> data;
+  bool data_reload_in_progress = false;
 
   std::shared_ptr<asio::io_context> io_context;
   std::shared_ptr<asio::thread_pool> thread_pool;
@@ -49,6 +53,8 @@ public:
   bool is_replay = false;
   bool use_psov2_rand_crypt = false; // Used in some tests
   bool use_legacy_item_random_behavior = false; // Used in some tests
+  // If set, all game server traffic is recorded in this capture (see ReplayCapture.hh)
+  std::shared_ptr<ReplayCaptureWriter> replay_capture;
 
   std::shared_ptr<Episode3::TournamentIndex> ep3_tournament_index;
 
@@ -60,6 +66,12 @@ public:
 
   std::unordered_map<uint64_t, std::shared_ptr<Client>> client_for_id;
   std::unordered_map<uint32_t, std::shared_ptr<Client>> client_for_account;
+  // Indexes of clients that are in any lobby or game, used by find_client. These are maintained by
+  // update_lobby_client_index, which Lobby::add_client and Lobby::remove_client call; it must also be called when an
+  // indexed client's name changes. There can be multiple clients with the same name (or account, if concurrent logins
+  // are allowed), hence the multimaps. Names are lowercased, since they are matched case-insensitively.
+  std::unordered_multimap<uint32_t, std::weak_ptr<Client>> lobby_clients_for_account;
+  std::unordered_multimap<std::string, std::weak_ptr<Client>> lobby_clients_for_name;
 
   std::shared_ptr<IPStackSimulator> ip_stack_simulator;
   std::shared_ptr<DNSServer> dns_server;
@@ -88,14 +100,24 @@ public:
   void remove_lobby(std::shared_ptr<Lobby> l);
   void on_player_left_lobby(std::shared_ptr<Lobby> l, uint8_t leaving_client_id);
 
+  // Returns nullptr if no client in any lobby matches. If multiple clients match, one in l is preferred.
   std::shared_ptr<Client> find_client(
       const std::string* identifier = nullptr, uint64_t account_id = 0, std::shared_ptr<Lobby> l = nullptr);
+  void update_lobby_client_index(std::shared_ptr<Client> c);
 
   void create_default_lobbies();
   void load_accounts();
   void load_teams();
+  // Periodically writes modified teams to disk on the thread pool; see TeamIndex::prepare_pending_saves
+  asio::awaitable<void> team_save_task();
   void load_ep3_tournament_state();
 
+  // Makes a copy of the current DataIndex, calls fn on the copy on the thread pool, then replaces this->data with the
+  // copy, so other clients aren't blocked while the reload runs. Games keep the DataIndex they were created with (see
+  // Lobby::data); everything else sees the new one as soon as this returns. If fn throws, this->data is not changed.
+  // fn must not set the log levels (pass update_log_levels = false when loading the config); this function applies the
+  // new DataIndex's log levels on the io thread after replacing this->data.
+  asio::awaitable<void> reload_data(std::function<void(DataIndex&)> fn);
   void update_default_lobby_events_from_config();
   void reset_between_replays();
 
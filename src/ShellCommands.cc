@@ -7,6 +7,7 @@
 #include <phosg/Strings.hh>
 
 #include "ChatCommands.hh"
+#include "CommandMetrics.hh"
 #include "GameServer.hh"
 #include "ReceiveCommands.hh"
 #include "ReplaySession.hh"
@@ -175,73 +176,138 @@ ShellCommand c_reload(
       text-index - reload in-game text\n\
       word-select - regenerate the Word Select translation table\n\
       all - do all of the above\n\
-    Reloading will not affect items that are in use; for example, if an Episode\n\
-    3 battle is in progress, it will continue to use the previous map and card\n\
-    definitions until the battle ends. Similarly, BB clients are not forced to\n\
-    disconnect or reload the battle parameters, so if these are changed without\n\
-    restarting, clients may see (for example) EXP messages inconsistent with\n\
-    the amounts of EXP actually received.",
+    Reloading happens in the background and will not affect games that already\n\
+    exist; for example, if an Episode 3 battle is in progress, it will continue\n\
+    to use the previous map and card definitions until the battle ends, and\n\
+    games will continue to use the previous drop tables and quests. Similarly,\n\
+    BB clients are not forced to disconnect or reload the battle parameters, so\n\
+    if these are changed without restarting, clients may see (for example) EXP\n\
+    messages inconsistent with the amounts of EXP actually received.",
     +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
+      static const std::unordered_map<std::string, std::function<void(DataIndex&)>> data_index_reload_fns = {
+          {"all", +[](DataIndex& data) -> void { data.load_all(false); }},
+          {"bb-keys", +[](DataIndex& data) -> void { data.load_bb_private_keys(); }},
+          {"maps", +[](DataIndex& data) -> void { data.load_maps(); }},
+          {"patch-files", +[](DataIndex& data) -> void { data.load_patch_indexes(); }},
+          {"ep3-cards", +[](DataIndex& data) -> void { data.load_ep3_cards(); }},
+          {"ep3-maps", +[](DataIndex& data) -> void { data.load_ep3_maps(); }},
+          {"functions", +[](DataIndex& data) -> void { data.compile_functions(); }},
+          {"dol-files", +[](DataIndex& data) -> void { data.load_dol_files(); }},
+          {"set-tables", +[](DataIndex& data) -> void { data.load_set_data_tables(); }},
+          {"battle-params", +[](DataIndex& data) -> void {
+             data.load_battle_params();
+             data.generate_bb_stream_file();
+           }},
+          {"level-tables", +[](DataIndex& data) -> void {
+             data.load_level_tables();
+             data.generate_bb_stream_file();
+           }},
+          {"text-index", +[](DataIndex& data) -> void { data.load_text_index(); }},
+          {"word-select", +[](DataIndex& data) -> void { data.load_word_select_table(); }},
+          {"item-definitions", +[](DataIndex& data) -> void {
+             data.load_item_definitions();
+             data.generate_bb_stream_file();
+           }},
+          {"item-name-index", +[](DataIndex& data) -> void { data.load_item_name_indexes(); }},
+          {"drop-tables", +[](DataIndex& data) -> void { data.load_drop_tables(); }},
+          {"config", +[](DataIndex& data) -> void {
+             data.load_config_early(false);
+             data.load_config_late();
+           }},
+          {"quests", +[](DataIndex& data) -> void { data.load_quest_index(); }},
+      };
+
+      // Everything in the DataIndex is reloaded at once into a new copy of it, off the main thread; see
+      // ServerState::reload_data. The remaining types are reloaded afterward, since some of them depend on the
+      // DataIndex.
       auto types = phosg::split(args.args, ' ');
+      std::vector<std::function<void(DataIndex&)>> data_index_fns;
+      bool config_reloaded = false;
       for (const auto& type : types) {
-        if (type == "all") {
-          args.s->data->load_all();
-          args.s->disconnect_all_banned_clients();
-          args.s->update_default_lobby_events_from_config();
-        } else if (type == "bb-keys") {
-          args.s->data->load_bb_private_keys();
-        } else if (type == "accounts") {
+        if ((type == "accounts") || (type == "ep3-tournaments") || (type == "teams")) {
+          continue;
+        }
+        try {
+          data_index_fns.emplace_back(data_index_reload_fns.at(type));
+        } catch (const std::out_of_range&) {
+          throw std::runtime_error("invalid data type: " + type);
+        }
+        config_reloaded |= ((type == "all") || (type == "config"));
+      }
+
+      if (!data_index_fns.empty()) {
+        co_await args.s->reload_data([data_index_fns](DataIndex& data) -> void {
+          for (const auto& fn : data_index_fns) {
+            fn(data);
+          }
+        });
+      }
+      for (const auto& type : types) {
+        if (type == "accounts") {
           args.s->load_accounts();
-        } else if (type == "maps") {
-          args.s->data->load_maps();
-        } else if (type == "patch-files") {
-          args.s->data->load_patch_indexes();
-        } else if (type == "ep3-cards") {
-          args.s->data->load_ep3_cards();
-        } else if (type == "ep3-maps") {
-          args.s->data->load_ep3_maps();
         } else if (type == "ep3-tournaments") {
           args.s->load_ep3_tournament_state();
-        } else if (type == "functions") {
-          args.s->data->compile_functions();
-        } else if (type == "dol-files") {
-          args.s->data->load_dol_files();
-        } else if (type == "set-tables") {
-          args.s->data->load_set_data_tables();
-        } else if (type == "battle-params") {
-          args.s->data->load_battle_params();
-          args.s->data->generate_bb_stream_file();
-        } else if (type == "level-tables") {
-          args.s->data->load_level_tables();
-          args.s->data->generate_bb_stream_file();
-        } else if (type == "text-index") {
-          args.s->data->load_text_index();
-        } else if (type == "word-select") {
-          args.s->data->load_word_select_table();
-        } else if (type == "item-definitions") {
-          args.s->data->load_item_definitions();
-          args.s->data->generate_bb_stream_file();
-        } else if (type == "item-name-index") {
-          args.s->data->load_item_name_indexes();
-        } else if (type == "drop-tables") {
-          args.s->data->load_drop_tables();
-        } else if (type == "config") {
-          args.s->data->load_config_early();
-          args.s->data->load_config_late();
-          args.s->disconnect_all_banned_clients();
-          args.s->update_default_lobby_events_from_config();
         } else if (type == "teams") {
           args.s->load_teams();
-        } else if (type == "quests") {
-          args.s->data->load_quest_index();
-        } else {
-          throw std::runtime_error("invalid data type: " + type);
         }
       }
+      if (config_reloaded) {
+        args.s->disconnect_all_banned_clients();
+        args.s->update_default_lobby_events_from_config();
+      }
 
       co_return std::deque<std::string>{};
     });
 
+ShellCommand c_quest_compile_cache(
+    "quest-compile-cache", "quest-compile-cache stats\n\
+  quest-compile-cache clear\n\
+    Show statistics for the quest compile cache from when the quest index was\n\
+    last loaded, or delete all entries in the cache. Clearing the cache does\n\
+    not affect the loaded quests; it takes effect on the next reload.",
+    +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
+      auto quest_index = args.s->data->quest_index;
+      if (!quest_index) {
+        throw std::runtime_error("quest index is not loaded");
+      }
+      std::deque<std::string> ret;
+      if (args.args == "stats") {
+        ret.emplace_back(quest_index->compile_cache_stats.str());
+      } else if (args.args == "clear") {
+        size_t count = co_await call_on_thread_pool(*args.s->thread_pool, [&]() -> size_t {
+          return QuestCompileCache::clear(quest_index->compile_cache_directory);
+        });
+        ret.emplace_back(std::format("Deleted {} entries", count));
+      } else {
+        throw std::invalid_argument("invalid subcommand");
+      }
+      co_return ret;
+    });
+
+ShellCommand c_quest_map_cache(
+    "quest-map-cache", "quest-map-cache\n\
+    Show statistics for the cache of generated maps for quests with random\n\
+    enemy sections.",
+    +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
+      auto quest_index = args.s->data->quest_index;
+      if (!quest_index) {
+        throw std::runtime_error("quest index is not loaded");
+      }
+      co_return std::deque<std::string>{quest_index->random_supermap_cache_stats_snapshot().str()};
+    });
+
+ShellCommand c_metrics(
+    "metrics", "metrics [COUNT]\n\
+    Show the command and subcommand handlers that have used the most total\n\
+    time, with their latency percentiles and traffic. COUNT defaults to 20.\n\
+    The same data is available in Prometheus format at /y/metrics on the\n\
+    HTTP server.",
+    +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
+      size_t count = args.args.empty() ? 20 : std::stoull(args.args, nullptr, 0);
+      auto lines = command_metrics.summary_lines(count);
+      co_return std::deque<std::string>(std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+    });
+
 ShellCommand c_list_accounts(
     "list-accounts", "list-accounts\n\
     List all accounts registered on the server.",
@@ -636,6 +702,9 @@ ShellCommand c_lookup(
     Find the account for a logged-in user.",
     +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
       auto target = args.s->find_client(&args.args);
+      if (!target) {
+        throw std::runtime_error("no such client");
+      }
       if (target->login) {
         co_return std::deque<std::string>{format("Found client {} with account ID {:08X}",
             target->channel->name, target->login->account->account_id)};
@@ -651,6 +720,9 @@ ShellCommand c_kick(
     free to reconnect after doing this.",
     +[](ShellCommand::Args& args) -> asio::awaitable<std::deque<std::string>> {
       auto target = args.s->find_client(&args.args);
+      if (!target) {
+        throw std::runtime_error("no such client");
+      }
       send_message_box(target, "$C6You have been kicked off the server.");
       target->channel->disconnect();
       co_return std::deque<std::string>{std::format("Client C-{:X} disconnected from server", target->id)};
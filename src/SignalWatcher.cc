@@ -27,26 +27,28 @@ asio::awaitable<void> SignalWatcher::signal_handler_task() {
       case SIGUSR1:
         this->log.info_f("Received SIGUSR1; reloading config.json");
         try {
-          this->state->data->load_config_early();
-          this->state->data->load_config_late();
+          co_await this->state->reload_data([](DataIndex& data) -> void {
+            data.load_config_early(false);
+            data.load_config_late();
+          });
           this->state->disconnect_all_banned_clients();
           this->state->update_default_lobby_events_from_config();
           phosg::fwrite_fmt(stderr, "Configuration update complete\n");
         } catch (const std::exception& e) {
           phosg::fwrite_fmt(stderr, "FAILED: {}\n", e.what());
-          phosg::fwrite_fmt(stderr, "Some configuration may have been reloaded. Fix the underlying issue and try again.\n");
+          phosg::fwrite_fmt(stderr, "No configuration was changed. Fix the underlying issue and try again.\n");
         }
         break;
       case SIGUSR2:
         this->log.info_f("Received SIGUSR2; reloading config.json and all dependencies");
         try {
-          this->state->data->load_all();
+          co_await this->state->reload_data([](DataIndex& data) -> void { data.load_all(false); });
           this->state->disconnect_all_banned_clients();
           this->state->update_default_lobby_events_from_config();
           phosg::fwrite_fmt(stderr, "Configuration update complete\n");
         } catch (const std::exception& e) {
           phosg::fwrite_fmt(stderr, "FAILED: {}\n", e.what());
-          phosg::fwrite_fmt(stderr, "Some configuration may have been reloaded. Fix the underlying issue and try again.\n");
+          phosg::fwrite_fmt(stderr, "No configuration was changed. Fix the underlying issue and try again.\n");
         }
         break;
       default:
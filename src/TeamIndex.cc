@@ -9,6 +9,7 @@
 #include "ImageEncoder.hh"
 #include "ItemData.hh"
 #include "Loggers.hh"
+#include "SaveStore.hh"
 #include "StaticGameData.hh"
 
 TeamIndex::Team::Member::Member(const phosg::JSON& json)
@@ -49,7 +50,7 @@ std::string TeamIndex::Team::flag_filename() const {
 }
 
 void TeamIndex::Team::load_config() {
-  auto json = phosg::JSON::parse(phosg::load_file(this->json_filename()));
+  auto json = phosg::JSON::parse(save_store->get(this->json_filename()));
   this->name = json.get_string("Name");
   this->spent_points = json.get_int("SpentPoints");
   this->points = 0;
@@ -90,11 +91,11 @@ phosg::JSON TeamIndex::Team::json() const {
 }
 
 void TeamIndex::Team::save_config() const {
-  phosg::save_file(this->json_filename(), this->json().serialize(phosg::JSON::SerializeOption::FORMAT | phosg::JSON::SerializeOption::HEX_INTEGERS | phosg::JSON::SerializeOption::ESCAPE_CONTROLS_ONLY));
+  save_store->put(this->json_filename(), this->json().serialize(phosg::JSON::SerializeOption::FORMAT | phosg::JSON::SerializeOption::HEX_INTEGERS | phosg::JSON::SerializeOption::ESCAPE_CONTROLS_ONLY));
 }
 
 void TeamIndex::Team::load_flag() {
-  auto img = phosg::ImageRGBA8888N::from_file_data(phosg::load_file(this->flag_filename()));
+  auto img = phosg::ImageRGBA8888N::from_file_data(save_store->get(this->flag_filename()));
   if (img.get_width() != 32 || img.get_height() != 32) {
     throw std::runtime_error("incorrect flag image dimensions");
   }
@@ -121,12 +122,12 @@ void TeamIndex::Team::save_flag() const {
     return;
   }
   auto img = this->decode_flag_data();
-  phosg::save_file(this->flag_filename(), img.serialize(phosg::ImageFormat::WINDOWS_BITMAP));
+  save_store->put(this->flag_filename(), img.serialize(phosg::ImageFormat::WINDOWS_BITMAP));
 }
 
 void TeamIndex::Team::delete_files() const {
-  std::filesystem::remove(this->json_filename());
-  std::filesystem::remove(this->flag_filename());
+  save_store->remove(this->json_filename());
+  save_store->remove(this->flag_filename());
 }
 
 PSOBBBaseTeamMembership TeamIndex::Team::base_membership_for_member(uint32_t account_id) const {
@@ -241,15 +242,10 @@ TeamIndex::TeamIndex(const std::string& directory, const phosg::JSON& reward_def
     this->reward_defs.emplace_back(reward_menu_item_id++, *it);
   }
 
-  if (!std::filesystem::is_directory(this->directory)) {
-    std::filesystem::create_directories(this->directory.c_str());
-    return;
-  }
-  for (const auto& item : std::filesystem::directory_iterator(this->directory)) {
-    std::string filename = item.path().filename().string();
+  for (const auto& filename : save_store->list(this->directory)) {
     std::string file_path = this->directory + "/" + filename;
     if (filename == "base.json") {
-      auto json = phosg::JSON::parse(phosg::load_file(file_path));
+      auto json = phosg::JSON::parse(save_store->get(file_path));
       this->next_team_id = json.get_int("NextTeamID");
     } else if (filename.ends_with(".json")) {
       try {
@@ -306,10 +302,21 @@ std::vector<std::shared_ptr<const TeamIndex::Team>> TeamIndex::all() const {
   return ret;
 }
 
+std::vector<std::shared_ptr<const TeamIndex::Team>> TeamIndex::ranking(size_t max_count) const {
+  std::vector<std::shared_ptr<const Team>> ret;
+  for (const auto& [points, team_id] : this->points_ranking) {
+    if (max_count && (ret.size() >= max_count)) {
+      break;
+    }
+    ret.emplace_back(this->id_to_team.at(team_id));
+  }
+  return ret;
+}
+
 std::shared_ptr<const TeamIndex::Team> TeamIndex::create(
     const std::string& name, uint32_t master_account_id, const std::string& master_name) {
   auto team = std::make_shared<Team>(this->next_team_id++);
-  phosg::save_file(this->directory + "/base.json", phosg::JSON::dict({{"NextTeamID", this->next_team_id}}).serialize());
+  save_store->put(this->directory + "/base.json", phosg::JSON::dict({{"NextTeamID", this->next_team_id}}).serialize());
 
   Team::Member m;
   m.account_id = master_account_id;
@@ -320,15 +327,24 @@ std::shared_ptr<const TeamIndex::Team> TeamIndex::create(
   team->members.emplace(master_account_id, std::move(m));
   team->name = name;
 
-  team->save_config();
   this->add_to_indexes(team);
+  this->mark_modified(team, true, false);
   return team;
 }
 
 void TeamIndex::disband(uint32_t team_id) {
   auto team = this->id_to_team.at(team_id);
   this->remove_from_indexes(team);
-  team->delete_files();
+
+  // The files are deleted by the writer, after any saves for this team that were already taken from pending_saves,
+  // so a save that's in progress can't recreate them
+  this->modified_teams.erase(team_id);
+  std::lock_guard g(this->pending_saves_lock);
+  auto& pending = this->pending_saves[team_id];
+  pending.team = team;
+  pending.save_config = false;
+  pending.save_flag = false;
+  pending.delete_files = true;
 }
 
 void TeamIndex::rename(uint32_t team_id, const std::string& new_team_name) {
@@ -338,7 +354,7 @@ void TeamIndex::rename(uint32_t team_id, const std::string& new_team_name) {
   }
   this->name_to_team.erase(team->name);
   team->name = new_team_name;
-  team->save_config();
+  this->mark_modified(team, true, false);
 }
 
 void TeamIndex::add_member(uint32_t team_id, uint32_t account_id, const std::string& name) {
@@ -353,8 +369,7 @@ void TeamIndex::add_member(uint32_t team_id, uint32_t account_id, const std::str
   m.points = 0;
   m.name = name;
   team->members.emplace(account_id, std::move(m));
-
-  team->save_config();
+  this->mark_modified(team, true, false);
 }
 
 void TeamIndex::remove_member(uint32_t account_id) {
@@ -368,7 +383,7 @@ void TeamIndex::remove_member(uint32_t account_id) {
   if (team->members.empty()) {
     this->disband(team->team_id);
   } else {
-    team->save_config();
+    this->mark_modified(team, true, false);
   }
 }
 
@@ -376,21 +391,24 @@ void TeamIndex::update_member_name(uint32_t account_id, const std::string& name)
   auto team = this->account_id_to_team.at(account_id);
   auto& m = team->members.at(account_id);
   m.name = name;
-  team->save_config();
+  this->mark_modified(team, true, false);
 }
 
 void TeamIndex::add_member_points(uint32_t account_id, uint32_t points) {
   auto team = this->account_id_to_team.at(account_id);
   auto& m = team->members.at(account_id);
+  this->points_ranking.erase(std::make_pair(team->points, team->team_id));
   m.points += points;
   team->points += points;
-  team->save_config();
+  this->points_ranking.emplace(team->points, team->team_id);
+  this->mark_modified(team, true, false);
 }
 
 void TeamIndex::set_flag_data(uint32_t team_id, const parray<le_uint16_t, 0x20 * 0x20>& flag_data) {
   auto team = this->id_to_team.at(team_id);
+  // The flag data is replaced rather than modified in place, since pending saves may share the existing flag data
   team->flag_data.reset(new parray<le_uint16_t, 0x20 * 0x20>(flag_data));
-  team->save_flag();
+  this->mark_modified(team, false, true);
 }
 
 bool TeamIndex::promote_leader(uint32_t master_account_id, uint32_t leader_account_id) {
@@ -405,7 +423,7 @@ bool TeamIndex::promote_leader(uint32_t master_account_id, uint32_t leader_accou
     return false;
   }
   other_m.set_flag(TeamIndex::Team::Member::Flag::IS_LEADER);
-  team->save_config();
+  this->mark_modified(team, true, false);
   return true;
 }
 
@@ -421,7 +439,7 @@ bool TeamIndex::demote_leader(uint32_t master_account_id, uint32_t leader_accoun
     return false;
   }
   other_m.clear_flag(TeamIndex::Team::Member::Flag::IS_LEADER);
-  team->save_config();
+  this->mark_modified(team, true, false);
   return true;
 }
 
@@ -438,7 +456,7 @@ void TeamIndex::change_master(uint32_t master_account_id, uint32_t new_master_ac
   new_master_m.clear_flag(TeamIndex::Team::Member::Flag::IS_LEADER);
   new_master_m.set_flag(TeamIndex::Team::Member::Flag::IS_MASTER);
   team->master_account_id = new_master_account_id;
-  team->save_config();
+  this->mark_modified(team, true, false);
 }
 
 void TeamIndex::buy_reward(uint32_t team_id, const std::string& key, uint32_t points, Team::RewardFlag reward_flag) {
@@ -451,7 +469,73 @@ void TeamIndex::buy_reward(uint32_t team_id, const std::string& key, uint32_t po
   if (reward_flag != Team::RewardFlag::NONE) {
     team->set_reward_flag(reward_flag);
   }
-  team->save_config();
+  this->mark_modified(team, true, false);
+}
+
+void TeamIndex::mark_modified(std::shared_ptr<const Team> team, bool config, bool flag) {
+  auto& pending = this->modified_teams[team->team_id];
+  pending.save_config |= config;
+  pending.save_flag |= flag;
+}
+
+size_t TeamIndex::prepare_pending_saves() {
+  if (this->modified_teams.empty()) {
+    return 0;
+  }
+
+  // Copying a team is much cheaper than serializing it (and the flag data isn't copied at all), so this is done here
+  // and the serialization is done in write_pending_saves
+  size_t count = this->modified_teams.size();
+  std::lock_guard g(this->pending_saves_lock);
+  for (auto& [team_id, modified] : this->modified_teams) {
+    auto& pending = this->pending_saves[team_id];
+    pending.team = std::make_shared<Team>(*this->id_to_team.at(team_id));
+    pending.save_config |= modified.save_config;
+    pending.save_flag |= modified.save_flag;
+  }
+  this->modified_teams.clear();
+  return count;
+}
+
+void TeamIndex::write_pending_saves() {
+  std::lock_guard write_g(this->write_lock);
+  std::map<uint32_t, PendingSave> to_write;
+  {
+    std::lock_guard g(this->pending_saves_lock);
+    to_write.swap(this->pending_saves);
+  }
+
+  for (const auto& [team_id, pending] : to_write) {
+    try {
+      if (pending.delete_files) {
+        pending.team->delete_files();
+      }
+      // If the team was disbanded after this batch was taken, its files will be deleted by the next batch anyway, so
+      // don't bother writing them
+      bool disbanded = false;
+      {
+        std::lock_guard g(this->pending_saves_lock);
+        auto it = this->pending_saves.find(team_id);
+        disbanded = (it != this->pending_saves.end()) && it->second.delete_files;
+      }
+      if (disbanded) {
+        continue;
+      }
+      if (pending.save_config) {
+        pending.team->save_config();
+      }
+      if (pending.save_flag) {
+        pending.team->save_flag();
+      }
+    } catch (const std::exception& e) {
+      static_game_data_log.warning_f("Failed to save team {:08X}: {}", team_id, e.what());
+    }
+  }
+}
+
+void TeamIndex::flush() {
+  this->prepare_pending_saves();
+  this->write_pending_saves();
 }
 
 void TeamIndex::add_to_indexes(std::shared_ptr<Team> team) {
@@ -462,6 +546,7 @@ void TeamIndex::add_to_indexes(std::shared_ptr<Team> team) {
     this->id_to_team.erase(team->team_id);
     throw std::runtime_error("team name is already in use");
   }
+  this->points_ranking.emplace(team->points, team->team_id);
   for (const auto& [_, member] : team->members) {
     if (!this->account_id_to_team.emplace(member.account_id, team).second) {
       static_game_data_log.warning_f("Serial number {:08X} ({:010}) exists in multiple teams",
@@ -473,6 +558,7 @@ void TeamIndex::add_to_indexes(std::shared_ptr<Team> team) {
 void TeamIndex::remove_from_indexes(std::shared_ptr<Team> team) {
   this->id_to_team.erase(team->team_id);
   this->name_to_team.erase(team->name);
+  this->points_ranking.erase(std::make_pair(team->points, team->team_id));
   for (const auto& it : team->members) {
     this->account_id_to_team.erase(it.second.account_id);
   }
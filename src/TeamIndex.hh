@@ -3,10 +3,15 @@
 #include <stdint.h>
 
 #include <array>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <phosg/JSON.hh>
 #include <random>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "ItemNameIndex.hh"
 #include "SaveFileFormats.hh"
@@ -117,6 +122,10 @@ public:
   };
 
   TeamIndex(const std::string& directory, const phosg::JSON& reward_defs_json);
+  TeamIndex(const TeamIndex&) = delete;
+  TeamIndex(TeamIndex&&) = delete;
+  TeamIndex& operator=(const TeamIndex&) = delete;
+  TeamIndex& operator=(TeamIndex&&) = delete;
   ~TeamIndex() = default;
 
   inline const std::vector<Reward>& reward_definitions() const {
@@ -128,6 +137,8 @@ public:
   std::shared_ptr<const Team> get_by_name(const std::string& name) const;
   std::shared_ptr<const Team> get_by_account_id(uint32_t account_id) const;
   std::vector<std::shared_ptr<const Team>> all() const;
+  // Returns teams in descending order of points (ties are in order of team ID). If max_count is 0, returns all teams.
+  std::vector<std::shared_ptr<const Team>> ranking(size_t max_count = 0) const;
 
   std::shared_ptr<const Team> create(
       const std::string& name, uint32_t master_account_id, const std::string& master_name);
@@ -144,14 +155,50 @@ public:
   void change_master(uint32_t master_account_id, uint32_t new_master_account_id);
   void buy_reward(uint32_t team_id, const std::string& key, uint32_t points, Team::RewardFlag reward_flag);
 
+  // The mutators above don't save teams immediately; they only mark them as modified. Teams are saved in two steps so
+  // that the game thread doesn't have to serialize them: prepare_pending_saves copies all modified teams (this must be
+  // called on the same thread as the mutators), then write_pending_saves serializes the copies and writes them to the
+  // save store (this may be called on any thread). Each team is written at most once per call, no matter how many
+  // times it was modified. Disbanding a team doesn't delete its files immediately either; the deletion is queued with
+  // the pending saves and done by the next write_pending_saves call. flush does both steps on the calling thread; it's
+  // used at shutdown and before reloading.
+  size_t prepare_pending_saves();
+  void write_pending_saves();
+  void flush();
+
 protected:
+  struct PendingSave {
+    std::shared_ptr<const Team> team; // Copy of the team at the time the save was prepared
+    bool save_config = false;
+    bool save_flag = false;
+    // Set when the team is disbanded. The team's files are deleted before anything else in this entry is written,
+    // and writers skip in-progress saves for teams with this flag set.
+    bool delete_files = false;
+  };
+  struct RankingOrder {
+    inline bool operator()(const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) const {
+      return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+    }
+  };
+
   std::string directory;
   uint32_t next_team_id;
   std::unordered_map<uint32_t, std::shared_ptr<Team>> id_to_team;
   std::unordered_map<std::string, std::shared_ptr<Team>> name_to_team;
   std::unordered_map<uint32_t, std::shared_ptr<Team>> account_id_to_team;
+  std::set<std::pair<uint32_t, uint32_t>, RankingOrder> points_ranking; // (points, team_id)
   std::vector<Reward> reward_defs;
 
+  // Teams modified since the last prepare_pending_saves call; only used on the game thread
+  std::unordered_map<uint32_t, PendingSave> modified_teams;
+  // Saves prepared but not yet written. pending_saves_lock is only held briefly (never during I/O), so the game thread
+  // doesn't wait for writes. write_lock is held by write_pending_saves for the entire write, so batches are written
+  // in the order they were taken from pending_saves, even if flush is called while another thread is writing.
+  std::mutex pending_saves_lock;
+  std::map<uint32_t, PendingSave> pending_saves;
+  std::mutex write_lock;
+
   void add_to_indexes(std::shared_ptr<Team> team);
   void remove_from_indexes(std::shared_ptr<Team> team);
+  void mark_modified(std::shared_ptr<const Team> team, bool config, bool flag);
 };
@@ -163,7 +163,7 @@ std::string UnicodeTextSet::serialize() const {
   }
 
   header_w.write(data_w.str());
-  return prs_compress_optimal(header_w.str());
+  return prs_compress_parallel(header_w.str());
 }
 
 BinaryTextSet::BinaryTextSet(const std::string& pr2_data, size_t collection_count, bool has_rel_footer, bool is_sjis) {
@@ -436,8 +436,8 @@ std::pair<std::string, std::string> BinaryTextAndKeyboardsSet::serialize_t(bool
 
   const std::string& pr2_data = w.str();
   const std::string& pr3_data = reloc_w.str();
-  std::string pr2_compressed = prs_compress_optimal(pr2_data.data(), pr2_data.size());
-  std::string pr3_compressed = prs_compress_optimal(pr3_data.data(), pr3_data.size());
+  std::string pr2_compressed = prs_compress_parallel(pr2_data.data(), pr2_data.size());
+  std::string pr3_compressed = prs_compress_parallel(pr3_data.data(), pr3_data.size());
   std::string pr2_ret = encrypt_pr2_data<BE>(pr2_compressed, pr2_data.size(), phosg::random_object<uint32_t>());
   std::string pr3_ret = encrypt_pr2_data<BE>(pr3_compressed, pr3_data.size(), phosg::random_object<uint32_t>());
   return std::make_pair(std::move(pr2_ret), std::move(pr3_ret));
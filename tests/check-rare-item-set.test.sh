@@ -0,0 +1,19 @@
+#!/bin/sh
+
+set -e
+
+EXECUTABLE="$1"
+if [ -z "$EXECUTABLE" ]; then
+  EXECUTABLE="./newserv"
+fi
+
+echo "... check JSON rare item set"
+$EXECUTABLE --config=tests/config.json check-rare-item-set system/tables/rare-table-v4.json
+
+echo "... convert v2 rare item set to AFS"
+$EXECUTABLE --config=tests/config.json convert-rare-item-set system/tables/rare-table-v2.json tests/rare-table-v2-test.afs
+echo "... check AFS rare item set"
+$EXECUTABLE --config=tests/config.json check-rare-item-set tests/rare-table-v2-test.afs
+
+echo "... clean up"
+rm tests/rare-table-v2-test.afs
@@ -47,6 +47,53 @@ diff $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.lo.dec
 echo "... check result from pessimal"
 diff $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.lp.dec
 
+if [ "$SCHEME" = "prs" ]; then
+  echo "... compress in parallel with level=1"
+  $EXECUTABLE compress-prs --parallel --compression-level=1 $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.pl1
+  echo "... compress in parallel with level=9 (single thread)"
+  $EXECUTABLE compress-prs --parallel --threads=1 $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.pl9s
+  echo "... compress in parallel with level=9"
+  $EXECUTABLE compress-prs --parallel $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.pl9
+  echo "... check that parallel output does not depend on thread count"
+  cmp $BASENAME.mnrd.$SCHEME.pl9s $BASENAME.mnrd.$SCHEME.pl9
+  echo "... decompress from parallel level=1"
+  $EXECUTABLE decompress-prs $BASENAME.mnrd.$SCHEME.pl1 $BASENAME.mnrd.$SCHEME.pl1.dec
+  echo "... decompress from parallel level=9"
+  $EXECUTABLE decompress-prs $BASENAME.mnrd.$SCHEME.pl9 $BASENAME.mnrd.$SCHEME.pl9.dec
+  echo "... check result from parallel level=1"
+  diff $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.pl1.dec
+  echo "... check result from parallel level=9"
+  diff $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.pl9.dec
+
+  echo "... benchmark"
+  $EXECUTABLE compress-prs --iterations=3 $BASENAME.mnrd /dev/null
+  $EXECUTABLE compress-prs --parallel --compression-level=1 --iterations=3 $BASENAME.mnrd /dev/null
+  $EXECUTABLE compress-prs --parallel --iterations=3 $BASENAME.mnrd /dev/null
+  $EXECUTABLE decompress-prs --iterations=20 $BASENAME.mnrd.$SCHEME.pl9 /dev/null
+  $EXECUTABLE decompress-prs --iterations=20 $BASENAME.mnrd.$SCHEME.l0 /dev/null
+
+  rm $BASENAME.mnrd.$SCHEME.pl1 \
+      $BASENAME.mnrd.$SCHEME.pl9s \
+      $BASENAME.mnrd.$SCHEME.pl9 \
+      $BASENAME.mnrd.$SCHEME.pl1.dec \
+      $BASENAME.mnrd.$SCHEME.pl9.dec
+fi
+
+if [ "$SCHEME" = "bc0" ]; then
+  echo "... compress with fast compressor"
+  $EXECUTABLE compress-bc0 --fast $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.lf
+  echo "... decompress from fast compressor"
+  $EXECUTABLE decompress-bc0 $BASENAME.mnrd.$SCHEME.lf $BASENAME.mnrd.$SCHEME.lf.dec
+  echo "... check result from fast compressor"
+  diff $BASENAME.mnrd $BASENAME.mnrd.$SCHEME.lf.dec
+
+  echo "... benchmark"
+  $EXECUTABLE compress-bc0 --iterations=3 $BASENAME.mnrd /dev/null
+  $EXECUTABLE compress-bc0 --fast --iterations=3 $BASENAME.mnrd /dev/null
+
+  rm $BASENAME.mnrd.$SCHEME.lf $BASENAME.mnrd.$SCHEME.lf.dec
+fi
+
 echo "... clean up"
 rm $BASENAME.mnrd \
     $BASENAME.mnrd.$SCHEME.lN \
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+set -e
+
+EXECUTABLE="$1"
+if [ -z "$EXECUTABLE" ]; then
+  EXECUTABLE="./newserv"
+fi
+
+echo "... load test"
+$EXECUTABLE load-test --config=tests/config.json --clients=8 --versions=DC_V2,PC_V2,GC_V3,XB_V3 --duration=2 --step-interval=10 --kills-per-game=3
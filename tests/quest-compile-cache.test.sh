@@ -0,0 +1,35 @@
+#!/bin/sh
+
+set -e
+
+EXECUTABLE="$1"
+if [ -z "$EXECUTABLE" ]; then
+  EXECUTABLE="./newserv"
+fi
+
+DIR=tests/quest-compile-cache-test
+
+echo "... prepare quest with an included file"
+rm -rf $DIR
+mkdir -p $DIR
+echo "// Version 1" > $DIR/test.inc.txt
+(echo ".include test.inc.txt"; cat system/quests/retrieval/q058-gc-e.bin.txt) > $DIR/q058-gc-e.bin.txt
+
+echo "... assemble with empty cache"
+$EXECUTABLE assemble-quest-script --optimal --compile-cache=$DIR/cache $DIR/q058-gc-e.bin.txt $DIR/result.bin 2> $DIR/log.txt
+grep -q "Quest compile cache: 0 hits (0 bytes), 1 misses (0 stale" $DIR/log.txt
+diff $DIR/result.bin tests/q058-gc-e.bin
+
+echo "... assemble again (should use cache)"
+$EXECUTABLE assemble-quest-script --optimal --compile-cache=$DIR/cache $DIR/q058-gc-e.bin.txt $DIR/result.bin 2> $DIR/log.txt
+grep -q "Quest compile cache: 1 hits" $DIR/log.txt
+diff $DIR/result.bin tests/q058-gc-e.bin
+
+echo "... change included file and assemble again (should recompile)"
+echo "// Version 2" > $DIR/test.inc.txt
+$EXECUTABLE assemble-quest-script --optimal --compile-cache=$DIR/cache $DIR/q058-gc-e.bin.txt $DIR/result.bin 2> $DIR/log.txt
+grep -q "Quest compile cache: 0 hits (0 bytes), 1 misses (1 stale" $DIR/log.txt
+diff $DIR/result.bin tests/q058-gc-e.bin
+
+echo "... clean up"
+rm -rf $DIR
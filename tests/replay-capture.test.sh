@@ -0,0 +1,34 @@
+#!/bin/sh
+
+set -e
+
+EXECUTABLE="$1"
+if [ -z "$EXECUTABLE" ]; then
+  EXECUTABLE="./newserv"
+fi
+
+LOG=tests/DCv1-DCv2-PCv2-CrossplayPrivateDrops.test.txt
+BASENAME="replay-capture-test"
+
+echo "... convert $LOG to capture"
+$EXECUTABLE convert-replay-log $LOG $BASENAME.bin
+echo "... replay capture"
+$EXECUTABLE --config=tests/config.json --replay-log=$BASENAME.bin
+echo "... convert capture back to text"
+$EXECUTABLE convert-replay-log $BASENAME.bin $BASENAME.txt
+echo "... replay converted text log"
+$EXECUTABLE --config=tests/config.json --replay-log=$BASENAME.txt
+
+# This log doesn't use any replay flags, so the server's default flags in the capture header are correct
+LIVE_LOG=tests/GC-TradeWindow.test.txt
+echo "... record capture from server while replaying $LIVE_LOG"
+$EXECUTABLE --config=tests/config.json --replay-log=$LIVE_LOG --replay-capture=$BASENAME-live.bin
+echo "... replay recorded capture"
+$EXECUTABLE --config=tests/config.json --replay-log=$BASENAME-live.bin
+echo "... convert recorded capture to text"
+$EXECUTABLE convert-replay-log $BASENAME-live.bin $BASENAME-live.txt
+echo "... replay converted recorded capture"
+$EXECUTABLE --config=tests/config.json --replay-log=$BASENAME-live.txt
+
+echo "... clean up"
+rm -f $BASENAME.bin $BASENAME.txt $BASENAME-live.bin $BASENAME-live.txt